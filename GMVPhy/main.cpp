@@ -27,6 +27,18 @@ int lPhysStats(lua_State *state) {
 
 		Msg("Environment %d active\n", i);
 		Msg("\t%d active objects\n", pEnv->GetActiveObjectCount());
+
+		physics_stats_t stats;
+		memset(&stats, 0, sizeof(stats));
+		pEnv->ReadStats(&stats);
+		Msg("\t%d collision pairs, %d touching, %d collision events\n", stats.collisionPairsTotal, stats.impactCollisionChecks, stats.impactCounter);
+
+		// Per stage timings of the last 256 simulation steps
+		physprofile_t profile[PHYSPROFILE_COUNT];
+		int numStages = ((IPhysicsEnvironment32 *)pEnv)->GetStepProfile(profile, PHYSPROFILE_COUNT);
+		for (int j = 0; j < numStages; j++) {
+			Msg("\t%-12s last %.3f min %.3f avg %.3f max %.3f ms\n", profile[j].pName, profile[j].lastMs, profile[j].minMs, profile[j].avgMs, profile[j].maxMs);
+		}
 	}
 
 	return 0;
@@ -0,0 +1,215 @@
+// Micro-benchmark for CPhysicsCollision::ConvexFromPlanes (plane sets -> convex hull).
+// Runs the same path as vphysics (plane conversion + btGeometryUtil::getHullFromPlaneEquations) on generated brush data,
+// next to the brute force plane triplet + HullLibrary path for reference.
+// Prints one line per brush set and method: name, planes per brush, hulls built per second and average hull size.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#include "LinearMath/btGeometryUtil.h"
+#include "LinearMath/btConvexHull.h"
+#include "LinearMath/btMatrix3x3.h"
+#include "LinearMath/btQuaternion.h"
+
+#define METERS_PER_INCH		(0.0254f)
+#define MERGE_DISTANCE		0.25f // What the game passes in (inches)
+
+#ifndef M_PI
+	#define M_PI 3.14159265358979323846
+#endif
+
+struct brushplane_t {
+	float normal[3];
+	float dist;
+};
+
+struct brushset_t {
+	const char *name;
+	int planesPerBrush;
+	btAlignedObjectArray<brushplane_t> planes; // planesPerBrush * numBrushes
+};
+
+static float RandFloat(float min, float max) {
+	return min + (max - min) * (rand() / (float)RAND_MAX);
+}
+
+static btMatrix3x3 RandRotation() {
+	btQuaternion q(btVector3(RandFloat(-1, 1), RandFloat(-1, 1), RandFloat(-1, 1)).normalized(), RandFloat(0, 2 * M_PI));
+	return btMatrix3x3(q);
+}
+
+static void AddPlane(brushset_t &set, const btMatrix3x3 &rot, const btVector3 &origin, const btVector3 &localNormal, float localDist) {
+	btVector3 normal = rot * localNormal.normalized();
+	brushplane_t plane;
+	plane.normal[0] = normal.x();
+	plane.normal[1] = normal.y();
+	plane.normal[2] = normal.z();
+	plane.dist = localDist / localNormal.length() + normal.dot(origin);
+	set.planes.push_back(plane);
+}
+
+// Hammer's block tool, optionally rotated
+static void AddBox(brushset_t &set, const btMatrix3x3 &rot, const btVector3 &origin, const btVector3 &extents) {
+	for (int axis = 0; axis < 3; axis++) {
+		btVector3 normal(0, 0, 0);
+		normal[axis] = 1;
+		AddPlane(set, rot, origin, normal, extents[axis]);
+		AddPlane(set, rot, origin, -normal, extents[axis]);
+	}
+}
+
+// A box with the top cut off at an angle (ramps, stairs)
+static void AddWedge(brushset_t &set, const btMatrix3x3 &rot, const btVector3 &origin, const btVector3 &extents) {
+	AddBox(set, rot, origin, extents);
+	AddPlane(set, rot, origin, btVector3(0, extents.z(), extents.y()), 0);
+}
+
+// Hammer's cylinder tool (n-gon prism)
+static void AddCylinder(brushset_t &set, const btMatrix3x3 &rot, const btVector3 &origin, float radius, float height, int sides) {
+	for (int i = 0; i < sides; i++) {
+		float angle = 2 * M_PI * i / sides;
+		AddPlane(set, rot, origin, btVector3(cosf(angle), sinf(angle), 0), radius);
+	}
+
+	AddPlane(set, rot, origin, btVector3(0, 0, 1), height);
+	AddPlane(set, rot, origin, btVector3(0, 0, -1), height);
+}
+
+// Compiled brushes also carry vbsp's bevel planes on every edge, plus duplicates of the same planes
+static void AddBeveledBox(brushset_t &set, const btMatrix3x3 &rot, const btVector3 &origin, const btVector3 &extents) {
+	AddBox(set, rot, origin, extents);
+
+	for (int i = 0; i < 3; i++) {
+		int a = (i + 1) % 3, b = (i + 2) % 3;
+		for (int sa = -1; sa <= 1; sa += 2) {
+			for (int sb = -1; sb <= 1; sb += 2) {
+				btVector3 normal(0, 0, 0);
+				normal[a] = (float)sa;
+				normal[b] = (float)sb;
+				AddPlane(set, rot, origin, normal, extents[a] + extents[b]);
+			}
+		}
+	}
+
+	AddPlane(set, rot, origin, btVector3(0, 0, 1), extents.z());
+}
+
+static void GenerateSets(brushset_t *pSets, int numBrushes) {
+	pSets[0].name = "box";
+	pSets[0].planesPerBrush = 6;
+	pSets[1].name = "rotated_box";
+	pSets[1].planesPerBrush = 6;
+	pSets[2].name = "wedge";
+	pSets[2].planesPerBrush = 7;
+	pSets[3].name = "cylinder_8";
+	pSets[3].planesPerBrush = 10;
+	pSets[4].name = "cylinder_24";
+	pSets[4].planesPerBrush = 26;
+	pSets[5].name = "beveled_box";
+	pSets[5].planesPerBrush = 19;
+
+	btMatrix3x3 identity = btMatrix3x3::getIdentity();
+
+	for (int i = 0; i < numBrushes; i++) {
+		btVector3 origin(RandFloat(-8192, 8192), RandFloat(-8192, 8192), RandFloat(-2048, 2048));
+		btVector3 extents(RandFloat(8, 512), RandFloat(8, 512), RandFloat(8, 256));
+
+		AddBox(pSets[0], identity, origin, extents);
+		AddBox(pSets[1], RandRotation(), origin, extents);
+		AddWedge(pSets[2], RandRotation(), origin, extents);
+		AddCylinder(pSets[3], RandRotation(), origin, extents.x(), extents.z(), 8);
+		AddCylinder(pSets[4], RandRotation(), origin, extents.x(), extents.z(), 24);
+		AddBeveledBox(pSets[5], RandRotation(), origin, extents);
+	}
+}
+
+// Same conversion as ConvexFromPlanes (axes swapped, inches to meters)
+static void ConvertPlanes(const brushplane_t *pPlanes, int numPlanes, btAlignedObjectArray<btVector3> &out) {
+	out.resize(numPlanes);
+	for (int i = 0; i < numPlanes; i++) {
+		out[i].setValue(pPlanes[i].normal[0], pPlanes[i].normal[2], -pPlanes[i].normal[1]);
+		out[i][3] = -pPlanes[i].dist * METERS_PER_INCH;
+	}
+}
+
+// Returns the amount of hull vertices
+static int BuildHull(const btAlignedObjectArray<btVector3> &planes, bool bruteForce) {
+	if (!bruteForce) {
+		// What ConvexFromPlanes does
+		btAlignedObjectArray<btVector3> verts;
+		btAlignedObjectArray<unsigned int> indices;
+		btGeometryUtil::getHullFromPlaneEquations(planes, verts, indices, MERGE_DISTANCE * METERS_PER_INCH);
+
+		return verts.size() >= 4 ? verts.size() : 0;
+	}
+
+	// Reference: every plane triplet intersection, then the hull library
+	btAlignedObjectArray<btVector3> verts;
+	btGeometryUtil::getVerticesFromPlaneEquations(planes, verts);
+	if (verts.size() < 4)
+		return 0;
+
+	HullLibrary lib;
+	HullResult res;
+	HullDesc desc(QF_TRIANGLES, verts.size(), &verts[0]);
+	if (lib.CreateConvexHull(desc, res) != QE_OK)
+		return 0;
+
+	int numVerts = res.mNumOutputVertices;
+	lib.ReleaseResult(res);
+
+	return numVerts;
+}
+
+static double Now() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void RunSet(const brushset_t &set, bool bruteForce, double minTime) {
+	int numBrushes = set.planes.size() / set.planesPerBrush;
+	btAlignedObjectArray<btVector3> planes;
+
+	int numHulls = 0, numFailed = 0;
+	long long totalVerts = 0;
+
+	double start = Now(), elapsed = 0;
+	while (elapsed < minTime) {
+		for (int i = 0; i < numBrushes; i++) {
+			ConvertPlanes(&set.planes[i * set.planesPerBrush], set.planesPerBrush, planes);
+
+			int numVerts = BuildHull(planes, bruteForce);
+			if (numVerts == 0)
+				numFailed++;
+
+			totalVerts += numVerts;
+			numHulls++;
+		}
+
+		elapsed = Now() - start;
+	}
+
+	printf("%-12s %-8s planes=%-3d hulls_per_sec=%-10.0f avg_verts=%-6.2f failed=%d\n", set.name, bruteForce ? "brute" : "clip",
+		set.planesPerBrush, numHulls / elapsed, (double)totalVerts / numHulls, numFailed);
+}
+
+int main(int argc, char **argv) {
+	int numBrushes = argc > 1 ? atoi(argv[1]) : 1000;
+	double minTime = argc > 2 ? atof(argv[2]) : 1.0;
+
+	srand(1337);
+
+	brushset_t sets[6];
+	GenerateSets(sets, numBrushes);
+
+	for (int i = 0; i < 6; i++) {
+		RunSet(sets[i], true, minTime);
+		RunSet(sets[i], false, minTime);
+	}
+
+	return 0;
+}
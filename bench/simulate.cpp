@@ -0,0 +1,647 @@
+// Headless simulation benchmark. vphysics is linked in directly with stand-ins for tier0/vstdlib (stubs.cpp),
+// so no game or dedicated server install is needed.
+// Runs scripted scenarios (prop piles, ragdoll rain, welded contraptions, vehicle fleets, soft body ropes, save/restore),
+// each in its own process so the peak memory is the scenario's own.
+// Prints one line of key=value pairs per scenario on stdout: ms per Simulate (avg/min/p50/p95/max),
+// the average ms of every profiler stage, anything the scenario reports itself and the peak resident memory.
+// Console output from vphysics goes to stderr.
+//
+// Usage: bench_simulate [scenario|all] [steps] [count]
+//	count overrides the scenario's default size (props, ragdolls, contraptions, vehicles, ropes or saved props)
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include <tier0/platform.h>
+#include <tier1/interface.h>
+#include <tier1/strtools.h>
+#include <tier1/utlvector.h>
+#include <vstdlib/random.h>
+#include <mathlib/mathlib.h>
+#include <vphysics_interface.h>
+#include <vphysics/constraints.h>
+#include <vphysics/vehicles.h>
+
+#include "vphysics_interfaceV32.h"
+#include "vphysics/softbodyV32.h"
+
+// The save/restore scenario writes and reads the environment's save records directly
+#include "StdAfx.h"
+#include "Physics_Environment.h"
+
+#define TICK_INTERVAL	(1.0f / 66.0f)	// Default server tickrate
+#define WARMUP_STEPS	30
+
+static const char *s_pSurfaceProps =
+	"default { density 2000 elasticity 0.25 friction 0.8 dampening 0.0 }\n"
+	"metal { density 2700 elasticity 0.1 friction 0.8 }\n"
+	"rubbertire { density 800 elasticity 0.5 friction 1.0 }\n";
+
+struct benchenv_t {
+	IPhysics32 *				pPhysics;
+	IPhysicsEnvironment32 *		pEnv;
+	IPhysicsCollision32 *		pCollision;
+	IPhysicsSurfaceProps *		pSurfaceProps;
+
+	int							count;
+	int							step;
+
+	CUtlVector<IPhysicsVehicleController *>	vehicles;
+	CUtlVector<IPhysicsConstraint *>		constraints;
+};
+
+struct scenario_t {
+	const char *	pName;
+	int				defaultCount;
+	void			(*pSetup)(benchenv_t &bench);
+	void			(*pTick)(benchenv_t &bench); // Before every Simulate, can be NULL
+	void			(*pReport)(benchenv_t &bench); // After the steps, prints extra key=value pairs, can be NULL
+};
+
+/***********************************
+* Helpers
+***********************************/
+
+static objectparams_t ObjectParams(float mass, const char *pName) {
+	objectparams_t params = g_PhysDefaultObjectParams;
+	params.mass = mass;
+	params.pName = pName;
+	return params;
+}
+
+static IPhysicsObject *CreateBox(benchenv_t &bench, const Vector &mins, const Vector &maxs, const Vector &origin, const QAngle &angles, float mass) {
+	CPhysCollide *pCollide = bench.pCollision->BBoxToCollide(mins, maxs);
+	objectparams_t params = ObjectParams(mass, "box");
+	int material = bench.pSurfaceProps->GetSurfaceIndex("metal");
+
+	if (mass <= 0)
+		return bench.pEnv->CreatePolyObjectStatic(pCollide, material, origin, angles, &params);
+
+	IPhysicsObject *pObject = bench.pEnv->CreatePolyObject(pCollide, material, origin, angles, &params);
+	pObject->Wake();
+	return pObject;
+}
+
+static IPhysicsObject *CreateCylinder(benchenv_t &bench, const Vector &mins, const Vector &maxs, const Vector &origin, const QAngle &angles, float mass) {
+	CPhysConvex *pConvex = bench.pCollision->CylinderToConvex(mins, maxs);
+	CPhysCollide *pCollide = bench.pCollision->ConvertConvexToCollide(&pConvex, 1);
+	objectparams_t params = ObjectParams(mass, "cylinder");
+
+	IPhysicsObject *pObject = bench.pEnv->CreatePolyObject(pCollide, bench.pSurfaceProps->GetSurfaceIndex("default"), origin, angles, &params);
+	pObject->Wake();
+	return pObject;
+}
+
+static void CreateGround(benchenv_t &bench, float size) {
+	CreateBox(bench, Vector(-size, -size, -64), Vector(size, size, 0), vec3_origin, vec3_angle, 0);
+}
+
+static QAngle RandomAngles() {
+	return QAngle(RandomFloat(-180, 180), RandomFloat(-180, 180), RandomFloat(-180, 180));
+}
+
+/***********************************
+* Scenario: prop pile
+***********************************/
+
+// Boxes, spheres and cylinders dropped into one heap
+static void SetupPropPile(benchenv_t &bench) {
+	CreateGround(bench, 4096);
+
+	for (int i = 0; i < bench.count; i++) {
+		Vector origin(RandomFloat(-256, 256), RandomFloat(-256, 256), 64 + i * 4.0f);
+		Vector extents(RandomFloat(6, 24), RandomFloat(6, 24), RandomFloat(6, 24));
+
+		switch (i % 3) {
+			case 0:
+				CreateBox(bench, -extents, extents, origin, RandomAngles(), RandomFloat(10, 100));
+				break;
+			case 1: {
+				objectparams_t params = ObjectParams(RandomFloat(10, 100), "sphere");
+				bench.pEnv->CreateSphereObject(extents.x, bench.pSurfaceProps->GetSurfaceIndex("default"), origin, RandomAngles(), &params, false)->Wake();
+				break;
+			}
+			case 2:
+				CreateCylinder(bench, -extents, extents, origin, RandomAngles(), RandomFloat(10, 100));
+				break;
+		}
+	}
+}
+
+/***********************************
+* Scenario: ragdoll rain
+***********************************/
+
+struct ragdollbone_t {
+	int		parent;
+	Vector	joint;		// Relative to the parent's joint (the pelvis' joint is the ragdoll's origin)
+	Vector	mins, maxs;	// Box around the bone's joint
+	float	mass;
+};
+
+static const ragdollbone_t s_ragdollBones[] = {
+	{-1, Vector(0, 0, 0),		Vector(-8, -6, -4),		Vector(8, 6, 4),	12},	// Pelvis
+	{0,  Vector(0, 0, 4),		Vector(-8, -5, 0),		Vector(8, 5, 20),	20},	// Spine
+	{1,  Vector(0, 0, 20),		Vector(-5, -5, 0),		Vector(5, 5, 10),	5},		// Head
+	{1,  Vector(0, -10, 18),	Vector(-3, -12, -3),	Vector(3, 0, 3),	4},		// Left upper arm
+	{3,  Vector(0, -12, 0),		Vector(-2, -12, -2),	Vector(2, 0, 2),	3},		// Left forearm
+	{1,  Vector(0, 10, 18),		Vector(-3, 0, -3),		Vector(3, 12, 3),	4},		// Right upper arm
+	{5,  Vector(0, 12, 0),		Vector(-2, 0, -2),		Vector(2, 12, 2),	3},		// Right forearm
+	{0,  Vector(0, -5, -4),		Vector(-4, -4, -18),	Vector(4, 4, 0),	9},		// Left thigh
+	{7,  Vector(0, 0, -18),		Vector(-3, -3, -18),	Vector(3, 3, 0),	5},		// Left calf
+	{0,  Vector(0, 5, -4),		Vector(-4, -4, -18),	Vector(4, 4, 0),	9},		// Right thigh
+	{9,  Vector(0, 0, -18),		Vector(-3, -3, -18),	Vector(3, 3, 0),	5},		// Right calf
+};
+
+#define RAGDOLL_BONES		ARRAYSIZE(s_ragdollBones)
+#define RAGDOLL_INTERVAL	3	// Ticks between spawns
+
+static void CreateRagdoll(benchenv_t &bench, const Vector &origin) {
+	constraint_groupparams_t group;
+	group.Defaults();
+	IPhysicsConstraintGroup *pGroup = bench.pEnv->CreateConstraintGroup(group);
+
+	IPhysicsObject *pBones[RAGDOLL_BONES];
+	Vector joints[RAGDOLL_BONES];
+
+	for (int i = 0; i < RAGDOLL_BONES; i++) {
+		const ragdollbone_t &bone = s_ragdollBones[i];
+		joints[i] = (bone.parent >= 0 ? joints[bone.parent] : origin) + bone.joint;
+		pBones[i] = CreateBox(bench, bone.mins, bone.maxs, joints[i], vec3_angle, bone.mass);
+
+		if (bone.parent < 0)
+			continue;
+
+		// Pivot at our joint
+		constraint_ragdollparams_t ragdoll;
+		ragdoll.Defaults();
+		SetIdentityMatrix(ragdoll.constraintToReference);
+		MatrixSetColumn(joints[i] - joints[bone.parent], 3, ragdoll.constraintToReference);
+		SetIdentityMatrix(ragdoll.constraintToAttached);
+		ragdoll.parentIndex = bone.parent;
+		ragdoll.childIndex = i;
+
+		for (int axis = 0; axis < 3; axis++) {
+			ragdoll.axes[axis].SetAxisFriction(-40, 40, 0.5f);
+		}
+
+		bench.pEnv->CreateRagdollConstraint(pBones[bone.parent], pBones[i], pGroup, ragdoll);
+	}
+
+	pGroup->Activate();
+}
+
+static void SetupRagdollRain(benchenv_t &bench) {
+	CreateGround(bench, 4096);
+}
+
+static void TickRagdollRain(benchenv_t &bench) {
+	int spawned = bench.step / RAGDOLL_INTERVAL;
+	if (bench.step % RAGDOLL_INTERVAL != 0 || spawned >= bench.count)
+		return;
+
+	CreateRagdoll(bench, Vector(RandomFloat(-384, 384), RandomFloat(-384, 384), 512));
+}
+
+/***********************************
+* Scenario: welded contraptions
+***********************************/
+
+#define CONTRAPTION_SIZE_X	4
+#define CONTRAPTION_SIZE_Y	3
+#define CONTRAPTION_SIZE_Z	2
+#define CONTRAPTION_SPACING	24
+
+// Grids of plates welded to their neighbours, like tools build them
+static void CreateContraption(benchenv_t &bench, const Vector &origin, const QAngle &angles) {
+	IPhysicsObject *pParts[CONTRAPTION_SIZE_X][CONTRAPTION_SIZE_Y][CONTRAPTION_SIZE_Z];
+	matrix3x4_t xform;
+	AngleMatrix(angles, origin, xform);
+
+	Vector extents(CONTRAPTION_SPACING / 2, CONTRAPTION_SPACING / 2, 2);
+	for (int x = 0; x < CONTRAPTION_SIZE_X; x++) {
+		for (int y = 0; y < CONTRAPTION_SIZE_Y; y++) {
+			for (int z = 0; z < CONTRAPTION_SIZE_Z; z++) {
+				Vector pos;
+				VectorTransform(Vector(x, y, z * 0.5f) * CONTRAPTION_SPACING, xform, pos);
+				pParts[x][y][z] = CreateBox(bench, -extents, extents, pos, angles, 30);
+			}
+		}
+	}
+
+	for (int x = 0; x < CONTRAPTION_SIZE_X; x++) {
+		for (int y = 0; y < CONTRAPTION_SIZE_Y; y++) {
+			for (int z = 0; z < CONTRAPTION_SIZE_Z; z++) {
+				IPhysicsObject *pNeighbours[3] = {
+					x + 1 < CONTRAPTION_SIZE_X ? pParts[x + 1][y][z] : NULL,
+					y + 1 < CONTRAPTION_SIZE_Y ? pParts[x][y + 1][z] : NULL,
+					z + 1 < CONTRAPTION_SIZE_Z ? pParts[x][y][z + 1] : NULL,
+				};
+
+				for (int i = 0; i < 3; i++) {
+					if (!pNeighbours[i])
+						continue;
+
+					constraint_fixedparams_t fixed;
+					fixed.Defaults();
+					fixed.InitWithCurrentObjectState(pParts[x][y][z], pNeighbours[i]);
+					bench.pEnv->CreateFixedConstraint(pParts[x][y][z], pNeighbours[i], NULL, fixed);
+				}
+			}
+		}
+	}
+}
+
+static void SetupContraptions(benchenv_t &bench) {
+	CreateGround(bench, 4096);
+
+	int perRow = (int)ceilf(sqrtf((float)bench.count));
+	for (int i = 0; i < bench.count; i++) {
+		Vector origin((i % perRow) * 160.0f - perRow * 80.0f, (i / perRow) * 160.0f - perRow * 80.0f, RandomFloat(64, 256));
+		CreateContraption(bench, origin, QAngle(RandomFloat(-30, 30), RandomFloat(-180, 180), RandomFloat(-30, 30)));
+	}
+}
+
+/***********************************
+* Scenario: vehicle fleet
+***********************************/
+
+static void InitVehicleParams(benchenv_t &bench, vehicleparams_t &params) {
+	memset(&params, 0, sizeof(params));
+
+	params.axleCount = 2;
+	params.wheelsPerAxle = 2;
+
+	for (int i = 0; i < params.axleCount; i++) {
+		vehicle_axleparams_t &axle = params.axles[i];
+		axle.offset = Vector(i == 0 ? 48 : -48, 0, -8);
+		axle.wheelOffset = Vector(0, 32, 0);
+		axle.torqueFactor = 0.5f;
+		axle.brakeFactor = 0.5f;
+
+		axle.wheels.radius = 14;
+		axle.wheels.mass = 20;
+		axle.wheels.inertia = 0.5f;
+		axle.wheels.damping = 0;
+		axle.wheels.rotdamping = 0;
+		axle.wheels.frictionScale = 1;
+		axle.wheels.materialIndex = bench.pSurfaceProps->GetSurfaceIndex("rubbertire");
+		axle.wheels.springAdditionalLength = 8;
+
+		axle.suspension.springConstant = 80;
+		axle.suspension.springDamping = 1;
+		axle.suspension.stabilizerConstant = 50;
+		axle.suspension.springDampingCompression = 1;
+		axle.suspension.maxBodyForce = 20;
+	}
+
+	params.body.massOverride = 1500;
+	params.body.addGravity = 0.5f;
+	params.body.tiltForce = 5;
+	params.body.keepUprightTorque = 0;
+
+	params.engine.horsepower = 300;
+	params.engine.maxSpeed = 60;
+	params.engine.maxRevSpeed = 20;
+	params.engine.maxRPM = 6000;
+	params.engine.axleRatio = 3.5f;
+	params.engine.throttleTime = 1;
+	params.engine.isAutoTransmission = true;
+	params.engine.gearCount = 4;
+	params.engine.gearRatio[0] = 2.5f;
+	params.engine.gearRatio[1] = 1.6f;
+	params.engine.gearRatio[2] = 1.2f;
+	params.engine.gearRatio[3] = 0.9f;
+	params.engine.shiftUpRPM = 4500;
+	params.engine.shiftDownRPM = 2000;
+
+	params.steering.degreesSlow = 40;
+	params.steering.degreesFast = 15;
+	params.steering.speedSlow = 10;
+	params.steering.speedFast = 40;
+}
+
+static void SetupVehicleFleet(benchenv_t &bench) {
+	CreateGround(bench, 8192);
+
+	vehicleparams_t params;
+	InitVehicleParams(bench, params);
+
+	int perRow = (int)ceilf(sqrtf((float)bench.count));
+	for (int i = 0; i < bench.count; i++) {
+		Vector origin((i % perRow) * 192.0f - perRow * 96.0f, (i / perRow) * 160.0f - perRow * 80.0f, 48);
+		IPhysicsObject *pBody = CreateBox(bench, Vector(-64, -36, -12), Vector(64, 36, 20), origin, QAngle(0, RandomFloat(-180, 180), 0), 1500);
+
+		bench.vehicles.AddToTail(bench.pEnv->CreateVehicleController(pBody, params, VEHICLE_TYPE_CAR_WHEELS, NULL));
+	}
+}
+
+// Everyone drives around in circles, changing direction every couple seconds
+static void TickVehicleFleet(benchenv_t &bench) {
+	for (int i = 0; i < bench.vehicles.Count(); i++) {
+		vehicle_controlparams_t controls;
+		memset(&controls, 0, sizeof(controls));
+
+		controls.throttle = 1;
+		controls.steering = sinf((bench.step + i * 17) * TICK_INTERVAL * 0.5f);
+		controls.brake = (bench.step / 132 + i) % 4 == 0 ? 1.0f : 0.0f;
+
+		bench.vehicles[i]->Update(TICK_INTERVAL, controls);
+	}
+}
+
+/***********************************
+* Scenario: soft body ropes
+***********************************/
+
+#define ROPE_RESOLUTION	32
+#define ROPE_LENGTH		256
+
+// Ropes hanging from the ceiling with a weight at the end, swinging into each other
+static void SetupRopes(benchenv_t &bench) {
+	CreateGround(bench, 4096);
+	IPhysicsObject *pCeiling = CreateBox(bench, Vector(-1024, -1024, 0), Vector(1024, 1024, 16), Vector(0, 0, 512), vec3_angle, 0);
+
+	softbodyparams_t params;
+	params.totalMass = 5;
+
+	int perRow = (int)ceilf(sqrtf((float)bench.count));
+	for (int i = 0; i < bench.count; i++) {
+		Vector start((i % perRow) * 24.0f - perRow * 12.0f, (i / perRow) * 24.0f - perRow * 12.0f, 512);
+		Vector end = start + Vector(RandomFloat(-ROPE_LENGTH, ROPE_LENGTH), 0, -ROPE_LENGTH) * 0.7f;
+
+		IPhysicsSoftBody *pRope = bench.pEnv->CreateSoftBodyRope(start, end, ROPE_RESOLUTION, &params);
+		if (!pRope)
+			continue;
+
+		IPhysicsObject *pWeight = CreateBox(bench, Vector(-4, -4, -4), Vector(4, 4, 4), end, vec3_angle, 10);
+		pRope->Anchor(0, pCeiling);
+		pRope->Anchor(pRope->GetNodeCount() - 1, pWeight);
+	}
+}
+
+/***********************************
+* Scenario: save/restore
+***********************************/
+
+// A field of props, every other one welded to its neighbour, left to settle before it's saved
+static void SetupSaveRestore(benchenv_t &bench) {
+	CreateGround(bench, 16384);
+
+	int perRow = (int)ceilf(sqrtf((float)bench.count));
+	IPhysicsObject *pLast = NULL;
+	for (int i = 0; i < bench.count; i++) {
+		Vector origin((i % perRow) * 48.0f - perRow * 24.0f, (i / perRow) * 48.0f - perRow * 24.0f, RandomFloat(16, 64));
+		Vector extents(RandomFloat(6, 16), RandomFloat(6, 16), RandomFloat(6, 16));
+
+		IPhysicsObject *pObject;
+		if (i % 3 == 1) {
+			objectparams_t params = ObjectParams(RandomFloat(10, 100), "sphere");
+			pObject = bench.pEnv->CreateSphereObject(extents.x, bench.pSurfaceProps->GetSurfaceIndex("default"), origin, RandomAngles(), &params, false);
+			pObject->Wake();
+		} else {
+			pObject = CreateBox(bench, -extents, extents, origin, RandomAngles(), RandomFloat(10, 100));
+		}
+
+		if (i % 2 == 1) {
+			constraint_fixedparams_t fixed;
+			fixed.Defaults();
+			fixed.InitWithCurrentObjectState(pLast, pObject);
+			bench.constraints.AddToTail(bench.pEnv->CreateFixedConstraint(pLast, pObject, NULL, fixed));
+		}
+
+		pLast = pObject;
+	}
+}
+
+// Saves every object and constraint with the records Save writes, then loads them into a new environment
+// like a save game restore does (PreRestore, a Restore per record, then PostRestore's bulk broadphase rebuild).
+// The game's ISave/IRestore just store the records as blocks of data, so they're left out.
+static void ReportSaveRestore(benchenv_t &bench) {
+	CPhysicsEnvironment *pEnv = (CPhysicsEnvironment *)bench.pEnv;
+
+	int numObjects = 0;
+	IPhysicsObject **pObjects = (IPhysicsObject **)bench.pEnv->GetObjectList(&numObjects);
+
+	CUtlVector<CPhysCollide *> collides;
+	collides.SetCount(numObjects);
+	for (int i = 0; i < numObjects; i++)
+		collides[i] = ((IPhysicsObject32 *)pObjects[i])->GetCollide();
+
+	CUtlBuffer buf;
+	double saveStart = Plat_FloatTime();
+
+	for (int i = 0; i < numObjects; i++)
+		pEnv->WriteSaveRecord(buf, PIID_IPHYSICSOBJECT, pObjects[i]);
+
+	for (int i = 0; i < bench.constraints.Count(); i++)
+		pEnv->WriteSaveRecord(buf, PIID_IPHYSICSCONSTRAINT, bench.constraints[i]);
+
+	double saveTime = Plat_FloatTime() - saveStart;
+
+	IPhysicsEnvironment32 *pRestoreEnv = (IPhysicsEnvironment32 *)bench.pPhysics->CreateEnvironment();
+	CPhysicsEnvironment *pRestore = (CPhysicsEnvironment *)pRestoreEnv;
+	pRestoreEnv->SetGravity(Vector(0, 0, -600));
+	pRestoreEnv->SetAirDensity(2);
+
+	physprerestoreparams_t preParams;
+	memset(&preParams, 0, sizeof(preParams));
+
+	physrestoreparams_t params;
+	memset(&params, 0, sizeof(params));
+
+	int restored = 0;
+	double restoreStart = Plat_FloatTime();
+	pRestoreEnv->PreRestore(preParams);
+
+	params.type = PIID_IPHYSICSOBJECT;
+	for (int i = 0; i < numObjects; i++) {
+		params.pCollisionModel = collides[i];
+		params.pName = "restored";
+		restored += pRestore->ReadSaveRecord(buf, params) != NULL;
+	}
+
+	params.type = PIID_IPHYSICSCONSTRAINT;
+	params.pCollisionModel = NULL;
+	for (int i = 0; i < bench.constraints.Count(); i++)
+		restored += pRestore->ReadSaveRecord(buf, params) != NULL;
+
+	double rebuildStart = Plat_FloatTime();
+	pRestoreEnv->PostRestore();
+	double restoreEnd = Plat_FloatTime();
+
+	// First step after the load, this is where the game would notice a slow rebuild
+	pRestoreEnv->Simulate(TICK_INTERVAL);
+	double stepTime = Plat_FloatTime() - restoreEnd;
+
+	int numRecords = numObjects + bench.constraints.Count();
+	double restoreTime = restoreEnd - restoreStart;
+	printf(" records=%d restored=%d snapshot_kb=%d save_ms=%.4f save_records_per_s=%.0f restore_ms=%.4f rebuild_ms=%.4f restore_records_per_s=%.0f restored_step_ms=%.4f",
+		numRecords, restored, buf.TellPut() / 1024, saveTime * 1000.0, numRecords / MAX(saveTime, 1e-9),
+		restoreTime * 1000.0, (restoreEnd - rebuildStart) * 1000.0, numRecords / MAX(restoreTime, 1e-9), stepTime * 1000.0);
+
+	bench.pPhysics->DestroyEnvironment(pRestoreEnv);
+}
+
+static const scenario_t s_scenarios[] = {
+	{"prop_pile",			500,	SetupPropPile,		NULL,				NULL},
+	{"ragdoll_rain",		100,	SetupRagdollRain,	TickRagdollRain,	NULL},
+	{"welded_contraption",	40,		SetupContraptions,	NULL,				NULL},
+	{"vehicle_fleet",		32,		SetupVehicleFleet,	TickVehicleFleet,	NULL},
+	{"softbody_ropes",		64,		SetupRopes,			NULL,				NULL},
+	{"save_restore",		10000,	SetupSaveRestore,	NULL,				ReportSaveRestore},
+};
+
+/***********************************
+* Runner
+***********************************/
+
+// Peak resident memory of this process in kB (0 if unknown)
+static int GetPeakMemory() {
+	FILE *pFile = fopen("/proc/self/status", "r");
+	if (!pFile)
+		return 0;
+
+	int peak = 0;
+	char line[256];
+	while (fgets(line, sizeof(line), pFile)) {
+		if (sscanf(line, "VmHWM: %d kB", &peak) == 1)
+			break;
+	}
+
+	fclose(pFile);
+	return peak;
+}
+
+static int CompareFloats(const float *a, const float *b) {
+	return *a < *b ? -1 : *a > *b;
+}
+
+static void RunScenario(IPhysics32 *pPhysics, IPhysicsCollision32 *pCollision, IPhysicsSurfaceProps *pSurfaceProps, const scenario_t &scenario, int steps, int count) {
+	RandomSeed(1337);
+
+	benchenv_t bench;
+	bench.pPhysics = pPhysics;
+	bench.pEnv = (IPhysicsEnvironment32 *)pPhysics->CreateEnvironment();
+	bench.pCollision = pCollision;
+	bench.pSurfaceProps = pSurfaceProps;
+	bench.count = count > 0 ? count : scenario.defaultCount;
+	bench.step = 0;
+
+	bench.pEnv->SetGravity(Vector(0, 0, -600));
+	bench.pEnv->SetAirDensity(2);
+	scenario.pSetup(bench);
+
+	CUtlVector<float> stepTimes;
+	double stageTotals[PHYSPROFILE_COUNT] = {0};
+
+	for (int i = 0; i < WARMUP_STEPS + steps; i++, bench.step++) {
+		if (scenario.pTick)
+			scenario.pTick(bench);
+
+		double start = Plat_FloatTime();
+		bench.pEnv->Simulate(TICK_INTERVAL);
+		double elapsed = Plat_FloatTime() - start;
+
+		if (i < WARMUP_STEPS)
+			continue;
+
+		stepTimes.AddToTail((float)(elapsed * 1000.0));
+
+		physprofile_t profile[PHYSPROFILE_COUNT];
+		int numStages = bench.pEnv->GetStepProfile(profile, PHYSPROFILE_COUNT);
+		for (int j = 0; j < numStages; j++) {
+			stageTotals[j] += profile[j].lastMs;
+		}
+	}
+
+	float total = 0;
+	for (int i = 0; i < stepTimes.Count(); i++)
+		total += stepTimes[i];
+
+	stepTimes.Sort(CompareFloats);
+	int numSteps = MAX(stepTimes.Count(), 1);
+
+	printf("scenario=%s count=%d objects=%d active=%d steps=%d ms_avg=%.4f ms_min=%.4f ms_p50=%.4f ms_p95=%.4f ms_max=%.4f",
+		scenario.pName, bench.count, bench.pEnv->GetObjectCount(), bench.pEnv->GetActiveObjectCount(), steps, total / numSteps,
+		stepTimes.Count() ? stepTimes.Head() : 0, stepTimes.Count() ? stepTimes[stepTimes.Count() / 2] : 0,
+		stepTimes.Count() ? stepTimes[stepTimes.Count() * 95 / 100] : 0, stepTimes.Count() ? stepTimes.Tail() : 0);
+
+	physprofile_t profile[PHYSPROFILE_COUNT];
+	int numStages = bench.pEnv->GetStepProfile(profile, PHYSPROFILE_COUNT);
+	for (int i = 0; i < numStages; i++) {
+		printf(" %s_ms=%.4f", profile[i].pName, stageTotals[i] / numSteps);
+	}
+
+	if (scenario.pReport)
+		scenario.pReport(bench);
+
+	printf(" peak_kb=%d\n", GetPeakMemory());
+	fflush(stdout);
+
+	for (int i = 0; i < bench.vehicles.Count(); i++)
+		bench.pEnv->DestroyVehicleController(bench.vehicles[i]);
+
+	pPhysics->DestroyEnvironment(bench.pEnv);
+}
+
+int main(int argc, char **argv) {
+	const char *pScenario = argc > 1 ? argv[1] : "all";
+	int steps = argc > 2 ? atoi(argv[2]) : 600;
+	int count = argc > 3 ? atoi(argv[3]) : 0;
+
+	MathLib_Init(2.2f, 2.2f, 0.0f, 2);
+
+	CreateInterfaceFn factory = Sys_GetFactoryThis();
+	IPhysics32 *pPhysics = (IPhysics32 *)factory("VPhysics032", NULL);
+	IPhysicsCollision32 *pCollision = (IPhysicsCollision32 *)factory(VPHYSICS_COLLISION_INTERFACE_VERSION, NULL);
+	IPhysicsSurfaceProps *pSurfaceProps = (IPhysicsSurfaceProps *)factory(VPHYSICS_SURFACEPROPS_INTERFACE_VERSION, NULL);
+	if (!pPhysics || !pCollision || !pSurfaceProps) {
+		fprintf(stderr, "Failed to get the vphysics interfaces\n");
+		return 1;
+	}
+
+	if (!pPhysics->Connect(factory) || pPhysics->Init() != INIT_OK) {
+		fprintf(stderr, "Failed to init vphysics\n");
+		return 1;
+	}
+
+	pSurfaceProps->ParseSurfaceData("bench_surfaceproperties.txt", s_pSurfaceProps);
+
+	bool bFound = false;
+	for (int i = 0; i < ARRAYSIZE(s_scenarios); i++) {
+		if (Q_stricmp(pScenario, "all") && Q_stricmp(pScenario, s_scenarios[i].pName))
+			continue;
+
+		bFound = true;
+
+		// Run every scenario in its own process so the peak memory and allocator state don't carry over
+		fflush(stdout);
+		pid_t pid = fork();
+		if (pid == 0) {
+			RunScenario(pPhysics, pCollision, pSurfaceProps, s_scenarios[i], steps, count);
+			_exit(0);
+		} else if (pid > 0) {
+			int status;
+			waitpid(pid, &status, 0);
+			if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+				printf("scenario=%s failed=1\n", s_scenarios[i].pName);
+		} else {
+			RunScenario(pPhysics, pCollision, pSurfaceProps, s_scenarios[i], steps, count);
+		}
+	}
+
+	if (!bFound) {
+		fprintf(stderr, "Unknown scenario \"%s\"\n", pScenario);
+		return 1;
+	}
+
+	pPhysics->Shutdown();
+	pPhysics->Disconnect();
+
+	return 0;
+}
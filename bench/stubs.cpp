@@ -0,0 +1,262 @@
+// Stand-ins for the tier0 and vstdlib exports vphysics (and the SDK's tier1/mathlib) use, so the simulation benchmark
+// can link without libtier0_srv.so and libvstdlib_srv.so from a dedicated server install.
+// All console output goes to stderr, stdout is left for the benchmark results.
+// Written against the 2013 SDK headers, if a different SDK branch leaves symbols unresolved add them here.
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include <tier0/platform.h>
+#include <tier0/dbg.h>
+#include <tier0/threadtools.h>
+#include <tier1/utlsymbol.h>
+#include <tier1/strtools.h>
+#include <vstdlib/IKeyValuesSystem.h>
+#include <vstdlib/random.h>
+#include <Color.h>
+
+/***********************************
+* tier0: Spew
+***********************************/
+
+static void SpewV(const char *pPrefix, const char *pMsg, va_list args) {
+	if (pPrefix)
+		fputs(pPrefix, stderr);
+
+	vfprintf(stderr, pMsg, args);
+}
+
+#define SPEW_VARARGS(prefix, msg) { va_list args; va_start(args, msg); SpewV(prefix, msg, args); va_end(args); }
+
+void Msg(const tchar *pMsg, ...)								SPEW_VARARGS(NULL, pMsg)
+void Warning(const tchar *pMsg, ...)							SPEW_VARARGS("Warning: ", pMsg)
+void DevMsg(const tchar *pMsg, ...)								SPEW_VARARGS(NULL, pMsg)
+void DevMsg(int level, const tchar *pMsg, ...)					SPEW_VARARGS(NULL, pMsg)
+void DevWarning(const tchar *pMsg, ...)							SPEW_VARARGS("Warning: ", pMsg)
+void DevWarning(int level, const tchar *pMsg, ...)				SPEW_VARARGS("Warning: ", pMsg)
+void ConMsg(const tchar *pMsg, ...)								SPEW_VARARGS(NULL, pMsg)
+void ConDMsg(const tchar *pMsg, ...)							SPEW_VARARGS(NULL, pMsg)
+void ConColorMsg(const Color &clr, const tchar *pMsg, ...)		SPEW_VARARGS(NULL, pMsg)
+
+void Error(const tchar *pMsg, ...) {
+	SPEW_VARARGS("Error: ", pMsg)
+	_exit(1);
+}
+
+void _SpewInfo(SpewType_t type, const tchar *pFile, int line) {
+	if (type == SPEW_ASSERT)
+		fprintf(stderr, "%s (%d): ", pFile, line);
+}
+
+SpewRetval_t _SpewMessage(const tchar *pMsg, ...) {
+	SPEW_VARARGS(NULL, pMsg)
+	return SPEW_CONTINUE;
+}
+
+SpewRetval_t _DSpewMessage(const tchar *pGroupName, int level, const tchar *pMsg, ...) {
+	SPEW_VARARGS(NULL, pMsg)
+	return SPEW_CONTINUE;
+}
+
+bool IsSpewActive(const tchar *pGroupName, int level) {
+	return true;
+}
+
+void _ExitOnFatalAssert(const tchar *pFile, int line) {
+	fprintf(stderr, "Fatal assert failed: %s (%d)\n", pFile, line);
+	_exit(1);
+}
+
+bool ShouldUseNewAssertDialog() {
+	return false;
+}
+
+bool DoNewAssertDialog(const tchar *pFile, int line, const tchar *pExpression) {
+	return false;
+}
+
+/***********************************
+* tier0: Platform
+***********************************/
+
+double Plat_FloatTime() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+unsigned long Plat_MSTime() {
+	return (unsigned long)(Plat_FloatTime() * 1000.0);
+}
+
+/***********************************
+* tier0: Threads
+***********************************/
+
+static pthread_t s_mainThread = pthread_self();
+
+ThreadId_t ThreadGetCurrentId() {
+	return (ThreadId_t)pthread_self();
+}
+
+bool ThreadInMainThread() {
+	return pthread_equal(pthread_self(), s_mainThread) != 0;
+}
+
+void ThreadSleep(unsigned duration) {
+	usleep(duration * 1000);
+}
+
+CThreadLocalBase::CThreadLocalBase() {
+	pthread_key_create(&m_index, NULL);
+}
+
+CThreadLocalBase::~CThreadLocalBase() {
+	pthread_key_delete(m_index);
+}
+
+void *CThreadLocalBase::Get() const {
+	return pthread_getspecific(m_index);
+}
+
+void CThreadLocalBase::Set(void *value) {
+	pthread_setspecific(m_index, value);
+}
+
+CThreadMutex::CThreadMutex() {
+	pthread_mutexattr_init(&m_Attr);
+	pthread_mutexattr_settype(&m_Attr, PTHREAD_MUTEX_RECURSIVE);
+	pthread_mutex_init(&m_Mutex, &m_Attr);
+}
+
+CThreadMutex::~CThreadMutex() {
+	pthread_mutex_destroy(&m_Mutex);
+	pthread_mutexattr_destroy(&m_Attr);
+}
+
+void CThreadMutex::Lock() {
+	pthread_mutex_lock(&m_Mutex);
+}
+
+void CThreadMutex::Unlock() {
+	pthread_mutex_unlock(&m_Mutex);
+}
+
+bool CThreadMutex::TryLock() {
+	return pthread_mutex_trylock(&m_Mutex) == 0;
+}
+
+long ThreadInterlockedIncrement(long volatile *p)								{ return __sync_add_and_fetch(p, 1); }
+long ThreadInterlockedDecrement(long volatile *p)								{ return __sync_sub_and_fetch(p, 1); }
+long ThreadInterlockedExchange(long volatile *p, long value)					{ return __sync_lock_test_and_set(p, value); }
+long ThreadInterlockedExchangeAdd(long volatile *p, long value)					{ return __sync_fetch_and_add(p, value); }
+long ThreadInterlockedCompareExchange(long volatile *p, long value, long comp)	{ return __sync_val_compare_and_swap(p, comp, value); }
+bool ThreadInterlockedAssignIf(long volatile *p, long value, long comp)			{ return __sync_bool_compare_and_swap(p, comp, value); }
+
+void *ThreadInterlockedExchangePointer(void * volatile *p, void *value)					{ return __sync_lock_test_and_set(p, value); }
+void *ThreadInterlockedCompareExchangePointer(void * volatile *p, void *value, void *comp)	{ return __sync_val_compare_and_swap(p, comp, value); }
+bool ThreadInterlockedAssignPointerIf(void * volatile *p, void *value, void *comp)		{ return __sync_bool_compare_and_swap(p, comp, value); }
+
+int64 ThreadInterlockedIncrement64(int64 volatile *p)								{ return __sync_add_and_fetch(p, 1); }
+int64 ThreadInterlockedDecrement64(int64 volatile *p)								{ return __sync_sub_and_fetch(p, 1); }
+int64 ThreadInterlockedExchange64(int64 volatile *p, int64 value)					{ return __sync_lock_test_and_set(p, value); }
+int64 ThreadInterlockedExchangeAdd64(int64 volatile *p, int64 value)				{ return __sync_fetch_and_add(p, value); }
+int64 ThreadInterlockedCompareExchange64(int64 volatile *p, int64 value, int64 comp)	{ return __sync_val_compare_and_swap(p, comp, value); }
+bool ThreadInterlockedAssignIf64(volatile int64 *p, int64 value, int64 comp)		{ return __sync_bool_compare_and_swap(p, comp, value); }
+
+/***********************************
+* vstdlib: KeyValues system
+***********************************/
+
+// What KeyValues (surface properties, key parser) needs to run: a symbol table and plain allocation.
+// Both kinds of symbols live in one table since GetStringForSymbol gets either kind.
+// Case insensitive symbols are the lowercase string.
+class CBenchKeyValuesSystem : public IKeyValuesSystem {
+	public:
+		CBenchKeyValuesSystem() : m_symbols(0, 128, false) {}
+
+		void RegisterSizeofKeyValues(int size) {}
+
+		void *AllocKeyValuesMemory(int size) {
+			return malloc(size);
+		}
+
+		void FreeKeyValuesMemory(void *pMem) {
+			free(pMem);
+		}
+
+		HKeySymbol GetSymbolForString(const char *name, bool bCreate) {
+			char lower[1024];
+			V_strncpy(lower, name, sizeof(lower));
+			V_strlower(lower);
+
+			return GetSymbol(lower, bCreate);
+		}
+
+		const char *GetStringForSymbol(HKeySymbol symbol) {
+			return symbol != INVALID_KEY_SYMBOL ? m_symbols.String((UtlSymId_t)symbol) : "";
+		}
+
+		void AddKeyValuesToMemoryLeakList(void *pMem, HKeySymbol name) {}
+		void RemoveKeyValuesFromMemoryLeakList(void *pMem) {}
+
+		void SetKeyValuesExpressionSymbol(const char *name, bool bValue) {}
+
+		bool GetKeyValuesExpressionSymbol(const char *name) {
+			return false;
+		}
+
+		HKeySymbol GetSymbolForStringCaseSensitive(HKeySymbol &hCaseInsensitiveSymbol, const char *name, bool bCreate) {
+			hCaseInsensitiveSymbol = GetSymbolForString(name, bCreate);
+			return GetSymbol(name, bCreate);
+		}
+
+	private:
+		HKeySymbol GetSymbol(const char *name, bool bCreate) {
+			CUtlSymbol sym = bCreate ? m_symbols.AddString(name) : m_symbols.Find(name);
+			return sym.IsValid() ? (HKeySymbol)(UtlSymId_t)sym : INVALID_KEY_SYMBOL;
+		}
+
+		CUtlSymbolTable m_symbols;
+};
+
+IKeyValuesSystem *KeyValuesSystem() {
+	static CBenchKeyValuesSystem s_keyValuesSystem;
+	return &s_keyValuesSystem;
+}
+
+/***********************************
+* vstdlib: Random
+***********************************/
+
+// Fixed seed, every run of a scenario should do the same work
+static unsigned int s_randomState = 1337;
+
+static float RandomFraction() {
+	s_randomState = s_randomState * 1103515245 + 12345;
+	return (s_randomState >> 8) / (float)(1 << 24);
+}
+
+void RandomSeed(int iSeed) {
+	s_randomState = (unsigned int)iSeed;
+}
+
+float RandomFloat(float flMinVal, float flMaxVal) {
+	return flMinVal + (flMaxVal - flMinVal) * RandomFraction();
+}
+
+float RandomFloatExp(float flMinVal, float flMaxVal, float flExponent) {
+	return flMinVal + (flMaxVal - flMinVal) * powf(RandomFraction(), flExponent);
+}
+
+int RandomInt(int iMinVal, int iMaxVal) {
+	if (iMaxVal <= iMinVal)
+		return iMinVal;
+
+	return iMinVal + (int)(RandomFraction() * (iMaxVal - iMinVal + 1)) % (iMaxVal - iMinVal + 1);
+}
@@ -205,6 +205,7 @@ struct	btDbvt
 	{
 		const btDbvtNode*	node;
 		int			mask;
+		sStkNP() {}
 		sStkNP(const btDbvtNode* n, unsigned m) : node(n), mask(m) {}
 	};
 	struct	sStkNPS
@@ -221,6 +222,14 @@ struct	btDbvt
 		btDbvtNode*		parent;
 		sStkCLN(const btDbvtNode* n, btDbvtNode* p) : node(n), parent(p) {}
 	};
+	/* Ray packet entry	*/
+	struct	sRayPacketEntry
+	{
+		btVector3		rayFrom;
+		btVector3		rayDirectionInverse;
+		unsigned int	signs[3];
+		btScalar		lambda_max;	// policies may shrink this as hits are found
+	};
 	// Policies/Interfaces
 
 	/* ICollide	*/ 
@@ -230,6 +239,7 @@ struct	btDbvt
 			DBVT_VIRTUAL void	Process(const btDbvtNode*, const btDbvtNode*)		{}
 		DBVT_VIRTUAL void	Process(const btDbvtNode*)					{}
 		DBVT_VIRTUAL void	Process(const btDbvtNode* n, btScalar)			{ Process(n); }
+		DBVT_VIRTUAL void	ProcessRay(const btDbvtNode*, int)			{}
 		DBVT_VIRTUAL bool	Descent(const btDbvtNode*)					{ return(true); }
 		DBVT_VIRTUAL bool	AllLeaves(const btDbvtNode*)					{ return(true); }
 	};
@@ -326,7 +336,7 @@ struct	btDbvt
 		const btDbvtVolume& volume,
 		DBVT_IPOLICY) const;
 	///rayTest is a re-entrant ray test, and can be called in parallel as long as the btAlignedAlloc is thread-safe (uses locking etc)
-	///rayTest is slower than rayTestInternal, because it builds a local stack, using memory allocations, and it recomputes signs/rayDirectionInverses each time
+	///rayTest is slower than rayTestInternal, because it builds a local stack (only heap allocated for very deep trees) and it recomputes signs/rayDirectionInverses each time
 	DBVT_PREFIX
 		static void		rayTest(	const btDbvtNode* root,
 		const btVector3& rayFrom,
@@ -344,6 +354,17 @@ struct	btDbvt
 								const btVector3& aabbMin,
 								const btVector3& aabbMax,
 								DBVT_IPOLICY) const;
+	///rayTestPacket traces up to 32 rays through the tree at once, every stack entry carries a mask of the rays still inside the node
+	///leaves are reported per ray with ProcessRay(leaf, rayIndex), the policy can shrink rays[rayIndex].lambda_max to cull the rest of the tree
+	///it is re-entrant as long as every thread passes in its own stack
+	DBVT_PREFIX
+		static void		rayTestPacket(	const btDbvtNode* root,
+								sRayPacketEntry* rays,
+								int numRays,
+								const btVector3& aabbMin,
+								const btVector3& aabbMax,
+								btAlignedObjectArray<sStkNP>& stack,
+								DBVT_IPOLICY);
 
 	DBVT_PREFIX
 		static void		collideKDOP(const btDbvtNode* root,
@@ -1002,6 +1023,58 @@ inline void		btDbvt::rayTestInternal(	const btDbvtNode* root,
 	}
 }
 
+//
+DBVT_PREFIX
+inline void		btDbvt::rayTestPacket(	const btDbvtNode* root,
+								sRayPacketEntry* rays,
+								int numRays,
+								const btVector3& aabbMin,
+								const btVector3& aabbMax,
+								btAlignedObjectArray<sStkNP>& stack,
+								DBVT_IPOLICY)
+{
+	DBVT_CHECKTYPE
+	btAssert(numRays<=32);
+	if(root&&(numRays>0))
+	{
+		stack.resize(0);
+		stack.push_back(sStkNP(root,numRays<32?(1u<<numRays)-1:~0u));
+		btVector3 bounds[2];
+		do
+		{
+			const sStkNP	se=stack[stack.size()-1];
+			stack.pop_back();
+			bounds[0] = se.node->volume.Mins()-aabbMax;
+			bounds[1] = se.node->volume.Maxs()-aabbMin;
+			unsigned int	mask=0;
+			for(int i=0;i<numRays;++i)
+			{
+				if(((unsigned)se.mask)&(1u<<i))
+				{
+					btScalar tmin=1.f;
+					if(btRayAabb2(rays[i].rayFrom, rays[i].rayDirectionInverse, rays[i].signs, bounds, tmin, 0.f, rays[i].lambda_max))
+						mask|=1u<<i;
+				}
+			}
+			if(mask)
+			{
+				if(se.node->isinternal())
+				{
+					stack.push_back(sStkNP(se.node->childs[0],mask));
+					stack.push_back(sStkNP(se.node->childs[1],mask));
+				}
+				else
+				{
+					for(int i=0;i<numRays;++i)
+					{
+						if(mask&(1u<<i)) policy.ProcessRay(se.node,i);
+					}
+				}
+			}
+		} while(stack.size());
+	}
+}
+
 //
 DBVT_PREFIX
 inline void		btDbvt::rayTest(	const btDbvtNode* root,
@@ -1027,12 +1100,14 @@ inline void		btDbvt::rayTest(	const btDbvtNode* root,
 
 			btVector3 resultNormal;
 
-			btAlignedObjectArray<const btDbvtNode*>	stack;
+			///start out on the call stack so shallow trees (compound shapes) don't touch the heap, spill to heapStack when it runs out
+			const btDbvtNode*						localStack[DOUBLE_STACKSIZE];
+			btAlignedObjectArray<const btDbvtNode*>	heapStack;
+			const btDbvtNode**						stack=localStack;
 
 			int								depth=1;
 			int								treshold=DOUBLE_STACKSIZE-2;
 
-			stack.resize(DOUBLE_STACKSIZE);
 			stack[0]=root;
 			btVector3 bounds[2];
 			do	{
@@ -1056,8 +1131,17 @@ inline void		btDbvt::rayTest(	const btDbvtNode* root,
 					{
 						if(depth>treshold)
 						{
-							stack.resize(stack.size()*2);
-							treshold=stack.size()-2;
+							if(stack==localStack)
+							{
+								heapStack.resize(DOUBLE_STACKSIZE*2);
+								for(int i=0;i<depth;++i) heapStack[i]=localStack[i];
+							}
+							else
+							{
+								heapStack.resize(heapStack.size()*2);
+							}
+							stack=&heapStack[0];
+							treshold=heapStack.size()-2;
 						}
 						stack[depth++]=node->childs[0];
 						stack[depth++]=node->childs[1];
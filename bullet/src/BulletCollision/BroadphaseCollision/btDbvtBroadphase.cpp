@@ -599,6 +599,19 @@ void							btDbvtBroadphase::optimize()
 	m_sets[1].optimizeTopDown();
 }
 
+//
+void							btDbvtBroadphase::rebuild(btDispatcher* /*dispatcher*/)
+{
+	m_sets[0].optimizeTopDown();
+	m_sets[1].optimizeTopDown();
+	m_fixedleft=0;
+	/* new proxies are all in the dynamic set	*/ 
+	btDbvtTreeCollider	collider(this);
+	m_sets[0].collideTTpersistentStack(m_sets[0].m_root, m_sets[1].m_root, collider);
+	m_sets[0].collideTTpersistentStack(m_sets[0].m_root, m_sets[0].m_root, collider);
+	m_needcleanup=true;
+}
+
 //
 btOverlappingPairCache*			btDbvtBroadphase::getOverlappingPairCache()
 {
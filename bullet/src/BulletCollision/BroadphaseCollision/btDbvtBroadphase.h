@@ -102,6 +102,9 @@ struct	btDbvtBroadphase : btBroadphaseInterface
 	~btDbvtBroadphase();
 	void							collide(btDispatcher* dispatcher);
 	void							optimize();
+	///rebuilds both trees and finds every overlapping pair in one pass
+	///use after inserting many proxies with m_deferedcollide set (e.g. when restoring a saved world)
+	void							rebuild(btDispatcher* dispatcher);
 	
 	/* btBroadphaseInterface Implementation	*/
 	btBroadphaseProxy*				createProxy(const btVector3& aabbMin, const btVector3& aabbMax, int shapeType, void* userPtr, short int collisionFilterGroup, short int collisionFilterMask, btDispatcher* dispatcher, void* multiSapProxy);
@@ -66,6 +66,52 @@ btCollisionDispatcher::~btCollisionDispatcher()
 {
 }
 
+// Per-body manifold lists. Every manifold is linked into both of its bodies' lists,
+// so contact queries on one body don't need to look at every manifold in the world.
+static void linkManifoldToBody(btPersistentManifold* manifold, int slot, const btCollisionObject* body)
+{
+	btPersistentManifold::btManifoldBodyLink& link = manifold->m_bodyLinks[slot];
+	link.m_body = body;
+	link.m_prev = 0;
+	link.m_next = body->getFirstManifold();
+
+	if (link.m_next)
+	{
+		btPersistentManifold* next = link.m_next;
+		next->m_bodyLinks[next->m_bodyLinks[0].m_body == body ? 0 : 1].m_prev = manifold;
+	}
+
+	body->internalSetFirstManifold(manifold);
+}
+
+static void unlinkManifoldFromBody(btPersistentManifold* manifold, int slot)
+{
+	btPersistentManifold::btManifoldBodyLink& link = manifold->m_bodyLinks[slot];
+	const btCollisionObject* body = link.m_body;
+	if (!body)
+		return;
+
+	if (link.m_prev)
+	{
+		btPersistentManifold* prev = link.m_prev;
+		prev->m_bodyLinks[prev->m_bodyLinks[0].m_body == body ? 0 : 1].m_next = link.m_next;
+	} else
+	{
+		btAssert(body->getFirstManifold() == manifold);
+		body->internalSetFirstManifold(link.m_next);
+	}
+
+	if (link.m_next)
+	{
+		btPersistentManifold* next = link.m_next;
+		next->m_bodyLinks[next->m_bodyLinks[0].m_body == body ? 0 : 1].m_prev = link.m_prev;
+	}
+
+	link.m_body = 0;
+	link.m_prev = 0;
+	link.m_next = 0;
+}
+
 btPersistentManifold*	btCollisionDispatcher::getNewManifold(const btCollisionObject* body0, const btCollisionObject* body1) 
 { 
 	gNumManifold++;
@@ -103,6 +149,9 @@ btPersistentManifold*	btCollisionDispatcher::getNewManifold(const btCollisionObj
 	manifold->m_index1a = m_manifoldsPtr.size();
 	m_manifoldsPtr.push_back(manifold);
 
+	linkManifoldToBody(manifold, 0, body0);
+	linkManifoldToBody(manifold, 1, body1);
+
 	return manifold;
 }
 
@@ -124,6 +173,9 @@ void btCollisionDispatcher::releaseManifold(btPersistentManifold* manifold)
 	m_manifoldsPtr[findIndex]->m_index1a = findIndex;
 	m_manifoldsPtr.pop_back();
 
+	unlinkManifoldFromBody(manifold, 0);
+	unlinkManifoldFromBody(manifold, 1);
+
 	manifold->~btPersistentManifold();
 	if (m_persistentManifoldPoolAllocator->validPtr(manifold))
 	{
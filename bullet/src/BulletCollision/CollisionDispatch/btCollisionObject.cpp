@@ -39,7 +39,9 @@ btCollisionObject::btCollisionObject()
 		m_ccdSweptSphereRadius(btScalar(0.)),
 		m_ccdMotionThreshold(btScalar(0.)),
 		m_checkCollideWith(false),
-		m_pDebugName(NULL)
+		m_pDebugName(NULL),
+		m_activationStateCallback(NULL),
+		m_manifoldListHead(NULL)
 {
 	m_worldTransform.setIdentity();
 }
@@ -51,12 +53,16 @@ btCollisionObject::~btCollisionObject()
 void btCollisionObject::setActivationState(int newState, bool force) const
 { 
 	if (force || ((m_activationState1 != DISABLE_DEACTIVATION) && (m_activationState1 != DISABLE_SIMULATION)))
-		m_activationState1 = newState;
+		forceActivationState(newState);
 }
 
 void btCollisionObject::forceActivationState(int newState) const
 {
+	int oldState = m_activationState1;
 	m_activationState1 = newState;
+
+	if (m_activationStateCallback && oldState != newState)
+		m_activationStateCallback->activationStateChanged(this, oldState, newState);
 }
 
 void btCollisionObject::activate(bool forceActivation) const
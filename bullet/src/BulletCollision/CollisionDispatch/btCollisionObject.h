@@ -27,6 +27,7 @@ subject to the following restrictions:
 
 struct	btBroadphaseProxy;
 class	btCollisionShape;
+class	btPersistentManifold;
 struct btCollisionShapeData;
 #include "LinearMath/btMotionState.h"
 #include "LinearMath/btAlignedAllocator.h"
@@ -34,6 +35,17 @@ struct btCollisionShapeData;
 
 typedef btAlignedObjectArray<class btCollisionObject*> btCollisionObjectArray;
 
+///btActivationStateCallback is notified whenever an object's activation state actually changes.
+///This lets users track sleeping/waking objects without scanning the whole world every step.
+///Called from whichever thread changed the state (the island manager runs on the stepping thread).
+class btActivationStateCallback
+{
+public:
+	virtual ~btActivationStateCallback() {}
+
+	virtual void activationStateChanged(const btCollisionObject *pObject, int oldState, int newState) = 0;
+};
+
 #ifdef BT_USE_DOUBLE_PRECISION
 #define btCollisionObjectData btCollisionObjectDoubleData
 #define btCollisionObjectDataName "btCollisionObjectDoubleData"
@@ -116,6 +128,12 @@ protected:
 	// Name to print for debug messages pertaining to this object
 	const char *m_pDebugName;
 
+	// Notified on activation state changes (NULL if nobody cares)
+	btActivationStateCallback *m_activationStateCallback;
+
+	// Head of the list of contact manifolds touching this object, maintained by the dispatcher
+	mutable btPersistentManifold *m_manifoldListHead;
+
 	virtual bool	checkCollideWithOverride(const btCollisionObject* /* co */) const
 	{
 		return true;
@@ -260,6 +278,28 @@ public:
 
 	void forceActivationState(int newState) const;
 
+	void	setActivationStateCallback(btActivationStateCallback *pCallback)
+	{
+		m_activationStateCallback = pCallback;
+	}
+
+	btActivationStateCallback *getActivationStateCallback() const
+	{
+		return m_activationStateCallback;
+	}
+
+	///first contact manifold touching this object, use btPersistentManifold::getNextManifoldOnBody to walk the rest
+	btPersistentManifold *getFirstManifold() const
+	{
+		return m_manifoldListHead;
+	}
+
+	///only the dispatcher should call this
+	void	internalSetFirstManifold(btPersistentManifold *pManifold) const
+	{
+		m_manifoldListHead = pManifold;
+	}
+
 	void	activate(bool forceActivation = false) const;
 
 	SIMD_FORCE_INLINE bool isActive() const
@@ -31,8 +31,15 @@ btPersistentManifold::btPersistentManifold()
 m_body0(0),
 m_body1(0),
 m_cachedPoints (0),
-m_index1a(0)
+m_index1a(0),
+m_userTimestamp(btScalar(-1.))
 {
+	for (int i = 0; i < 2; i++)
+	{
+		m_bodyLinks[i].m_body = 0;
+		m_bodyLinks[i].m_prev = 0;
+		m_bodyLinks[i].m_next = 0;
+	}
 }
 
 
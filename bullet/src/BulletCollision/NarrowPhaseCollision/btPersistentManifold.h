@@ -81,14 +81,35 @@ public:
 
 	int m_index1a;
 
+	///links into the per-body manifold lists maintained by btCollisionDispatcher (see btCollisionObject::getFirstManifold)
+	///m_bodyLinks[i].m_body remembers which list the link belongs to, so setBodies can't corrupt the lists
+	struct btManifoldBodyLink
+	{
+		const btCollisionObject*	m_body;
+		btPersistentManifold*		m_prev;
+		btPersistentManifold*		m_next;
+	};
+
+	btManifoldBodyLink	m_bodyLinks[2];
+
+	///free for the user to timestamp events on this pair of bodies, -1 for new manifolds
+	btScalar	m_userTimestamp;
+
 	btPersistentManifold();
 
 	btPersistentManifold(const btCollisionObject* body0, const btCollisionObject* body1, int, btScalar contactBreakingThreshold, btScalar contactProcessingThreshold)
 		: btTypedObject(BT_PERSISTENT_MANIFOLD_TYPE),
 	m_body0(body0), m_body1(body1), m_cachedPoints(0),
 		m_contactBreakingThreshold(contactBreakingThreshold),
-		m_contactProcessingThreshold(contactProcessingThreshold)
+		m_contactProcessingThreshold(contactProcessingThreshold),
+		m_userTimestamp(btScalar(-1.))
 	{
+		for (int i = 0; i < 2; i++)
+		{
+			m_bodyLinks[i].m_body = 0;
+			m_bodyLinks[i].m_prev = 0;
+			m_bodyLinks[i].m_next = 0;
+		}
 	}
 
 	SIMD_FORCE_INLINE const btCollisionObject* getBody0() const { return m_body0;}
@@ -100,6 +121,12 @@ public:
 		m_body1 = body1;
 	}
 
+	///next manifold in the list of manifolds touching body
+	SIMD_FORCE_INLINE btPersistentManifold* getNextManifoldOnBody(const btCollisionObject* body) const
+	{
+		return m_bodyLinks[0].m_body == body ? m_bodyLinks[0].m_next : m_bodyLinks[1].m_next;
+	}
+
 	void clearUserCache(btManifoldPoint& pt);
 
 #ifdef DEBUG_PERSISTENCY
@@ -44,6 +44,10 @@ class btSolveCallback
 		virtual void postSolveContact(btSolverBody *obj0, btSolverBody *obj1, btManifoldPoint *cp) {};
 
 		virtual void friction(btSolverBody *obj0, btSolverBody *obj1, btSolverConstraint *fric) {};
+
+		// Return true if the callbacks above may be called from several threads at once.
+		// Solvers that work in parallel will fall back to solving serially otherwise.
+		virtual bool isThreadSafe() const { return false; };
 };
 
 class btConstraintSolver
@@ -33,6 +33,22 @@ public:
 
 	virtual void getInfo2 (btConstraintInfo2* info);
 
+	const btTransform & getFrameOffsetA() const
+	{
+		return m_frameInA;
+	}
+
+	const btTransform & getFrameOffsetB() const
+	{
+		return m_frameInB;
+	}
+
+	void setFrames(const btTransform& frameA, const btTransform& frameB)
+	{
+		m_frameInA = frameA;
+		m_frameInB = frameB;
+	}
+
 	virtual	void	setParam(int num, btScalar value, int axis = -1)
 	{
 		btAssert(0);
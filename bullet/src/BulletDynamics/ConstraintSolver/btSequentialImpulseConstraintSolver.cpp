@@ -50,7 +50,8 @@ subject to the following restrictions:
 #endif
 
 btSequentialImpulseConstraintSolver::btSequentialImpulseConstraintSolver()
-:m_btSeed2(0)
+:m_pSolveCallback(NULL),
+m_btSeed2(0)
 {}
 
 btSequentialImpulseConstraintSolver::~btSequentialImpulseConstraintSolver()
@@ -107,6 +107,11 @@ public:
 	// fixedSubSteps is how many substeps to do within the fixed timestep
 	virtual int	stepSimulation( btScalar timeStep, int maxSubSteps=1, btScalar fixedTimeStep=btScalar(1.)/btScalar(60.), int fixedSubSteps=1);
 
+	///time accumulated towards the next fixed step (what stepSimulation interpolates motion states by)
+	btScalar	getLocalTime() const
+	{
+		return m_localTime;
+	}
 
 	virtual void	synchronizeMotionStates();
 
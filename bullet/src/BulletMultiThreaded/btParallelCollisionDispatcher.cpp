@@ -3,6 +3,12 @@
 #include "BulletCollision/BroadphaseCollision/btOverlappingPairCache.h"
 #include "BulletCollision/BroadphaseCollision/btCollisionAlgorithm.h"
 #include "BulletCollision/CollisionDispatch/btCollisionObject.h"
+#include "BulletCollision/CollisionShapes/btCompoundShape.h"
+#include "BulletCollision/CollisionShapes/btConvexHullShape.h"
+
+// Chunks handed out per queue (thread pool threads + main thread). More than one
+// so there's something left to steal when a chunk's cost was misjudged.
+#define CHUNKS_PER_QUEUE 4
 
 class btProcessOverlapTask : public btIThreadTask {
 	public:
@@ -12,30 +18,7 @@ class btProcessOverlapTask : public btIThreadTask {
 		}
 
 		void run() {
-			btCollisionObject *obj0 = (btCollisionObject *)m_pair.m_pProxy0->m_clientObject;
-			btCollisionObject *obj1 = (btCollisionObject *)m_pair.m_pProxy1->m_clientObject;
-
-			// Check for invalid numbers being passed through
-			btAssert(obj0->getWorldTransform() == obj0->getWorldTransform());
-			btAssert(obj1->getWorldTransform() == obj1->getWorldTransform());
-
-			btCollisionObjectWrapper obj0Wrap(0, obj0->getCollisionShape(), obj0, obj0->getWorldTransform(), -1, -1);
-			btCollisionObjectWrapper obj1Wrap(0, obj1->getCollisionShape(), obj1, obj1->getWorldTransform(), -1, -1);
-
-			if (!m_pair.m_algorithm) {
-				m_pair.m_algorithm = m_pDispatcher->findAlgorithm(&obj0Wrap, &obj1Wrap);
-			}
-
-			if (m_pair.m_algorithm) {
-				btManifoldResult contactPointResult(&obj0Wrap, &obj1Wrap);
-				
-				if (m_pInfo->m_dispatchFunc == btDispatcherInfo::DISPATCH_DISCRETE) {
-					m_pair.m_algorithm->processCollision(&obj0Wrap, &obj1Wrap, *m_pInfo, &contactPointResult);
-				} else {
-					// Continuous dispatch
-					m_pair.m_algorithm->calculateTimeOfImpact(obj0, obj1, *m_pInfo, &contactPointResult);
-				}
-			}
+			m_pDispatcher->processPair(m_pair, *m_pInfo);
 		}
 
 		// Called after run() to destroy this task.
@@ -55,6 +38,9 @@ btParallelCollisionDispatcher::btParallelCollisionDispatcher(btCollisionConfigur
 	void *taskPoolMem = btAlloc(sizeof(btPoolAllocator));
 	m_pTaskPool = new(taskPoolMem) btPoolAllocator(sizeof(btProcessOverlapTask), 4096);
 
+	m_bChunkedDispatch = true;
+	m_totalChunkCost = 0;
+
 	m_pPoolCritSect = btCreateCriticalSection();
 	m_pAlgoPoolSect = btCreateCriticalSection();
 }
@@ -67,6 +53,103 @@ btParallelCollisionDispatcher::~btParallelCollisionDispatcher() {
 	btDeleteCriticalSection(m_pAlgoPoolSect);
 }
 
+void btParallelCollisionDispatcher::processPair(btBroadphasePair &pair, const btDispatcherInfo &info) {
+	btCollisionObject *obj0 = (btCollisionObject *)pair.m_pProxy0->m_clientObject;
+	btCollisionObject *obj1 = (btCollisionObject *)pair.m_pProxy1->m_clientObject;
+
+	// Check for invalid numbers being passed through
+	btAssert(obj0->getWorldTransform() == obj0->getWorldTransform());
+	btAssert(obj1->getWorldTransform() == obj1->getWorldTransform());
+
+	btCollisionObjectWrapper obj0Wrap(0, obj0->getCollisionShape(), obj0, obj0->getWorldTransform(), -1, -1);
+	btCollisionObjectWrapper obj1Wrap(0, obj1->getCollisionShape(), obj1, obj1->getWorldTransform(), -1, -1);
+
+	if (!pair.m_algorithm) {
+		pair.m_algorithm = findAlgorithm(&obj0Wrap, &obj1Wrap);
+	}
+
+	if (pair.m_algorithm) {
+		btManifoldResult contactPointResult(&obj0Wrap, &obj1Wrap);
+
+		if (info.m_dispatchFunc == btDispatcherInfo::DISPATCH_DISCRETE) {
+			pair.m_algorithm->processCollision(&obj0Wrap, &obj1Wrap, info, &contactPointResult);
+		} else {
+			// Continuous dispatch
+			pair.m_algorithm->calculateTimeOfImpact(obj0, obj1, info, &contactPointResult);
+		}
+	}
+}
+
+void btProcessOverlapChunkTask::run() {
+	for (int i = m_start; i < m_end; i++) {
+		m_pDispatcher->processPair(*m_pDispatcher->getChunkedPair(i), *m_pInfo);
+	}
+}
+
+// Rough relative cost of running the narrowphase against this shape. Doesn't have to be accurate,
+// it just needs to keep the expensive pairs from piling up in the same chunk.
+static int estimateShapeCost(const btCollisionShape *pShape) {
+	if (pShape->isCompound()) {
+		return btMax(((btCompoundShape *)pShape)->getNumChildShapes(), 1);
+	} else if (pShape->isConcave()) {
+		return 16;
+	} else if (pShape->getShapeType() == CONVEX_HULL_SHAPE_PROXYTYPE) {
+		return 1 + ((btConvexHullShape *)pShape)->getNumPoints() / 32;
+	}
+
+	return 1;
+}
+
+void btParallelCollisionDispatcher::addPairToChunk(btBroadphasePair &pair) {
+	btCollisionObject *obj0 = (btCollisionObject *)pair.m_pProxy0->m_clientObject;
+	btCollisionObject *obj1 = (btCollisionObject *)pair.m_pProxy1->m_clientObject;
+
+	// Compound vs. compound tests scale with both child counts. Cap it so one pair can't overflow the total.
+	int cost = btMin(estimateShapeCost(obj0->getCollisionShape()) * estimateShapeCost(obj1->getCollisionShape()), 4096);
+
+	m_chunkPairs.push_back(&pair);
+	m_chunkPairCosts.push_back(cost);
+	m_totalChunkCost += cost;
+}
+
+void btParallelCollisionDispatcher::dispatchChunks(const btDispatcherInfo &dispatchInfo) {
+	int numPairs = m_chunkPairs.size();
+	if (numPairs == 0) return;
+
+	int numChunks = (m_pThreadPool->getNumThreads() + 1) * CHUNKS_PER_QUEUE;
+	int targetCost = btMax(m_totalChunkCost / numChunks, 1);
+
+	// Cut the pair array into runs of roughly equal cost
+	m_chunkTasks.resize(0);
+
+	int start = 0;
+	int cost = 0;
+	for (int i = 0; i < numPairs; i++) {
+		cost += m_chunkPairCosts[i];
+
+		if (cost >= targetCost || i == numPairs - 1) {
+			btProcessOverlapChunkTask task;
+			task.m_pDispatcher = this;
+			task.m_pInfo = &dispatchInfo;
+			task.m_start = start;
+			task.m_end = i + 1;
+			m_chunkTasks.push_back(task);
+
+			start = i + 1;
+			cost = 0;
+		}
+	}
+
+	// Queue these up after the array is done growing (push_back may move the tasks)
+	for (int i = 0; i < m_chunkTasks.size(); i++) {
+		m_pThreadPool->addTask(&m_chunkTasks[i]);
+	}
+
+	m_pThreadPool->runTasks();
+	m_pThreadPool->clearTasks();
+}
+
+// The lock also covers the per-body manifold lists, two pairs being processed on different threads can share a body.
 btPersistentManifold *btParallelCollisionDispatcher::getNewManifold(const btCollisionObject *ob0, const btCollisionObject *ob1) {
 	m_pPoolCritSect->lock();
 	btPersistentManifold *ret = btCollisionDispatcher::getNewManifold(ob0, ob1);
@@ -128,9 +211,13 @@ class btCollisionPairCallback : public btOverlapCallback {
 			btAssert(m_pDispatcher->needsCollision(obj0, obj1) == m_pDispatcher->needsCollision(obj1, obj0));
 
 			if (m_pDispatcher->needsCollision(obj0, obj1)) {
-				void *mem = m_pDispatcher->allocateTask(sizeof(btProcessOverlapTask));
-				btProcessOverlapTask *task = new(mem) btProcessOverlapTask(pair, m_pInfo, m_pDispatcher);
-				m_pDispatcher->getThreadPool()->addTask(task);
+				if (m_pDispatcher->getChunkedDispatch()) {
+					m_pDispatcher->addPairToChunk(pair);
+				} else {
+					void *mem = m_pDispatcher->allocateTask(sizeof(btProcessOverlapTask));
+					btProcessOverlapTask *task = new(mem) btProcessOverlapTask(pair, m_pInfo, m_pDispatcher);
+					m_pDispatcher->getThreadPool()->addTask(task);
+				}
 			}
 
 			// Always return false (for whatever reason)
@@ -143,11 +230,20 @@ class btCollisionPairCallback : public btOverlapCallback {
 };
 
 void btParallelCollisionDispatcher::dispatchAllCollisionPairs(btOverlappingPairCache *pairCache, const btDispatcherInfo &dispatchInfo, btDispatcher *dispatcher) {
+	// These keep their capacity between frames, so we don't allocate once they've grown big enough
+	m_chunkPairs.resize(0);
+	m_chunkPairCosts.resize(0);
+	m_totalChunkCost = 0;
+
 	btCollisionPairCallback cb(dispatchInfo, this);
 	pairCache->processAllOverlappingPairs(&cb, dispatcher);
 
-	m_pThreadPool->runTasks();
-	m_pThreadPool->clearTasks();
+	if (m_bChunkedDispatch) {
+		dispatchChunks(dispatchInfo);
+	} else {
+		m_pThreadPool->runTasks();
+		m_pThreadPool->clearTasks();
+	}
 }
 
 btThreadPool *btParallelCollisionDispatcher::getThreadPool() {
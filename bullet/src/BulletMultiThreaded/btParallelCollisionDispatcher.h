@@ -8,6 +8,19 @@
 #include "btThreadPool.h"
 #include "btThreading.h"
 
+class btParallelCollisionDispatcher;
+
+// Processes a range of the dispatcher's pair array (chunked dispatch mode)
+class btProcessOverlapChunkTask : public btIThreadTask {
+	public:
+		void run();
+
+		btParallelCollisionDispatcher *m_pDispatcher;
+		const btDispatcherInfo *m_pInfo;
+		int m_start;
+		int m_end;
+};
+
 class btParallelCollisionDispatcher : public btCollisionDispatcher {
 	public:
 		btParallelCollisionDispatcher(btCollisionConfiguration *pConfiguration, btThreadPool *pThreadPool);
@@ -26,9 +39,27 @@ class btParallelCollisionDispatcher : public btCollisionDispatcher {
 
 		btThreadPool *getThreadPool();
 
+		// Chunked mode collects the pairs into a flat array and hands the threads cost-balanced ranges
+		// of it instead of allocating a task per pair. Enabled by default.
+		void setChunkedDispatch(bool enable) { m_bChunkedDispatch = enable; }
+		bool getChunkedDispatch() const { return m_bChunkedDispatch; }
+
+		// Internal functions (do not call these)
+		void addPairToChunk(btBroadphasePair &pair);
+		void processPair(btBroadphasePair &pair, const btDispatcherInfo &info);
+		btBroadphasePair *getChunkedPair(int i) { return m_chunkPairs[i]; }
+
 	private:
+		void dispatchChunks(const btDispatcherInfo &dispatchInfo);
+
 		btPoolAllocator *	m_pTaskPool;
 
+		bool				m_bChunkedDispatch;
+		int					m_totalChunkCost;
+		btAlignedObjectArray<btBroadphasePair *>		m_chunkPairs;
+		btAlignedObjectArray<int>						m_chunkPairCosts;
+		btAlignedObjectArray<btProcessOverlapChunkTask>	m_chunkTasks;
+
 		btICriticalSection *m_pPoolCritSect; // Manifold pool crit section
 		btICriticalSection *m_pAlgoPoolSect; // Algorithm pool crit section
 		btThreadPool *		m_pThreadPool;
@@ -4,8 +4,8 @@
 
 This software is provided 'as-is', without any express or implied warranty.
 In no event will the authors be held liable for any damages arising from the use of this software.
-Permission is granted to anyone to use this software for any purpose, 
-including commercial applications, and to alter it and redistribute it freely, 
+Permission is granted to anyone to use this software for any purpose,
+including commercial applications, and to alter it and redistribute it freely,
 subject to the following restrictions:
 
 1. The origin of this software must not be misrepresented; you must not claim that you wrote the original software. If you use this software in a product, an acknowledgment in the product documentation would be appreciated but is not required.
@@ -17,341 +17,569 @@ subject to the following restrictions:
 
 #include "btParallelConstraintSolver.h"
 #include "BulletDynamics/ConstraintSolver/btContactSolverInfo.h"
+#include "BulletDynamics/ConstraintSolver/btTypedConstraint.h"
+#include "BulletDynamics/Dynamics/btRigidBody.h"
 #include "BulletCollision/BroadphaseCollision/btDispatcher.h"
-#include "LinearMath/btPoolAllocator.h"
 #include "BulletCollision/NarrowPhaseCollision/btPersistentManifold.h"
 
 #include "btThreadPool.h"
 #include "btThreading.h"
 
 #include "LinearMath/btDefines.h"
+#include "LinearMath/btMinMax.h"
 #include "LinearMath/btScalar.h"
 
-#ifdef USE_SIMD
-#include <emmintrin.h>
-#define btVecSplat(x, e) _mm_shuffle_ps(x, x, _MM_SHUFFLE(e,e,e,e))
-static inline __m128 btSimdDot3(__m128 vec0, __m128 vec1)
-{
-	__m128 result = _mm_mul_ps(vec0, vec1);
-	return _mm_add_ps(btVecSplat(result, 0), _mm_add_ps(btVecSplat(result, 1), btVecSplat(result, 2)));
-}
-#endif//USE_SIMD
+// Number of colors we can track per body (bits in m_bodyColors)
+#define MAX_BATCH_COLORS 32
+
+// Minimum number of rows a thread gets from a color batch. Less than this isn't worth the task overhead.
+#define MIN_BATCH_TASK_ROWS 64
 
-// Small class that is duplicated many times
-ATTRIBUTE_ALIGNED16(class) btMiniSolverBody {
+class btSolveIslandTask : public btIThreadTask {
 	public:
-	BT_DECLARE_ALIGNED_ALLOCATOR();
+		void run() {
+			m_pSolver->solveIsland(m_island);
+		}
 
-	btMiniSolverBody() {
+		btParallelConstraintSolver *m_pSolver;
+		int m_island;
+};
 
-	}
+class btSolveBatchTask : public btIThreadTask {
+	public:
+		void run() {
+			m_pSolver->solveBatchRows(m_phase, m_start, m_end, m_iteration);
+		}
 
-	btMiniSolverBody(const btSolverBody &body) {
-		m_deltaLinearVelocity = body.getDeltaLinearVelocity();
-		m_deltaAngularVelocity = body.getDeltaAngularVelocity();
-		m_invMass = body.internalGetInvMass()[0]; // The 3 values should be the same (right?)
-	}
+		btParallelConstraintSolver *m_pSolver;
+		int m_phase;
+		int m_start;
+		int m_end;
+		int m_iteration;
+};
 
-	void writeBack(btSolverBody &body) {
-		if (body.m_originalBody) {
-			body.internalGetDeltaAngularVelocity() += m_deltaAngularVelocity * body.m_angularFactor;
-			body.internalGetDeltaLinearVelocity() += m_deltaLinearVelocity * body.m_linearFactor;
-		}
-	}
+btParallelConstraintSolver::btParallelConstraintSolver(btThreadPool *pThreadPool) {
+	m_pThreadPool = pThreadPool;
+	m_minColoringGroupSize = 512;
 
-	btVector3 &getDeltaLinearVelocity() {
-		return m_deltaLinearVelocity;
-	}
+	m_bDeferring = false;
+	m_pInfo = NULL;
+	m_pDebugDrawer = NULL;
+	m_pDispatcher = NULL;
 
-	btSimdScalar getInvMassSIMD() {
-		return btSimdScalar(m_invMass);
-	}
+	m_pSolverCritSect = btCreateCriticalSection();
+}
 
-	btScalar getInvMass() {
-		return m_invMass;
+btParallelConstraintSolver::~btParallelConstraintSolver() {
+	for (int i = 0; i < m_solvers.size(); i++) {
+		delete m_solvers[i];
 	}
 
-	SIMD_FORCE_INLINE void internalApplyImpulse(const btVector3& linearComponent, const btVector3& angularComponent, const btScalar impulseMagnitude)
-	{
-		m_deltaLinearVelocity += linearComponent*impulseMagnitude;
-		m_deltaAngularVelocity += angularComponent*(impulseMagnitude);
+	btDeleteCriticalSection(m_pSolverCritSect);
+}
+
+void btParallelConstraintSolver::setSolveCallback(btSolveCallback *callback) {
+	m_pSolveCallback = callback;
+
+	for (int i = 0; i < m_solvers.size(); i++) {
+		m_solvers[i]->setSolveCallback(callback);
 	}
+}
 
-	public:
-	btVector3		m_deltaLinearVelocity;
-	btVector3		m_deltaAngularVelocity;
-	btScalar		m_invMass;
-};
+bool btParallelConstraintSolver::canSolveInParallel() const {
+	if (!m_pThreadPool || m_pThreadPool->getNumThreads() <= 0)
+		return false;
 
-static void resolveSingleConstraintRowGeneric(btMiniSolverBody& body1, btMiniSolverBody& body2, const btSolverConstraint& c);
-static void resolveSingleConstraintRowLowerLimit(btMiniSolverBody& body1, btMiniSolverBody& body2, const btSolverConstraint& c);
-
-// Project Gauss Seidel or the equivalent Sequential Impulse
-static void resolveSingleConstraintRowGenericSIMD(btMiniSolverBody& body1, btMiniSolverBody& body2, const btSolverConstraint& c)
-{
-#ifdef USE_SIMD
-	__m128 cpAppliedImp = _mm_set1_ps(c.m_appliedImpulse);
-	__m128	lowerLimit1 = _mm_set1_ps(c.m_lowerLimit);
-	__m128	upperLimit1 = _mm_set1_ps(c.m_upperLimit);
-
-	btSimdScalar deltaImpulse = _mm_sub_ps(_mm_set1_ps(c.m_rhs), _mm_mul_ps(cpAppliedImp, _mm_set1_ps(c.m_cfm)));
-	__m128 deltaVel1Dotn = _mm_add_ps(btSimdDot3(c.m_contactNormal1.mVec128, body1.m_deltaLinearVelocity.mVec128), btSimdDot3(c.m_relpos1CrossNormal.mVec128, body1.m_deltaAngularVelocity.mVec128));
-	__m128 deltaVel2Dotn = _mm_add_ps(btSimdDot3(c.m_contactNormal2.mVec128, body2.m_deltaLinearVelocity.mVec128), btSimdDot3(c.m_relpos2CrossNormal.mVec128, body2.m_deltaAngularVelocity.mVec128));
-
-	deltaImpulse = _mm_sub_ps(deltaImpulse, _mm_mul_ps(deltaVel1Dotn, _mm_set1_ps(c.m_jacDiagABInv)));
-	deltaImpulse = _mm_sub_ps(deltaImpulse, _mm_mul_ps(deltaVel2Dotn, _mm_set1_ps(c.m_jacDiagABInv)));
-
-	btSimdScalar sum = _mm_add_ps(cpAppliedImp, deltaImpulse);
-	btSimdScalar resultLowerLess, resultUpperLess;
-	resultLowerLess = _mm_cmplt_ps(sum, lowerLimit1);
-	resultUpperLess = _mm_cmplt_ps(sum, upperLimit1);
-	__m128 lowMinApplied = _mm_sub_ps(lowerLimit1, cpAppliedImp);
-	deltaImpulse = _mm_or_ps(_mm_and_ps(resultLowerLess, lowMinApplied), _mm_andnot_ps(resultLowerLess, deltaImpulse));
-	c.m_appliedImpulse = _mm_or_ps(_mm_and_ps(resultLowerLess, lowerLimit1), _mm_andnot_ps(resultLowerLess, sum));
-	__m128 upperMinApplied = _mm_sub_ps(upperLimit1, cpAppliedImp);
-	deltaImpulse = _mm_or_ps(_mm_and_ps(resultUpperLess, deltaImpulse), _mm_andnot_ps(resultUpperLess, upperMinApplied));
-	c.m_appliedImpulse = _mm_or_ps(_mm_and_ps(resultUpperLess, c.m_appliedImpulse), _mm_andnot_ps(resultUpperLess, upperLimit1));
-	__m128	linearComponentA = _mm_mul_ps(c.m_contactNormal1.mVec128, body1.getInvMassSIMD());
-	__m128	linearComponentB = _mm_mul_ps((c.m_contactNormal2).mVec128, body2.getInvMassSIMD());
-	__m128 impulseMagnitude = deltaImpulse;
-
-	body1.m_deltaLinearVelocity.mVec128 = _mm_add_ps(body1.m_deltaLinearVelocity.mVec128, _mm_mul_ps(linearComponentA, impulseMagnitude));
-	body1.m_deltaAngularVelocity.mVec128 = _mm_add_ps(body1.m_deltaLinearVelocity.mVec128, _mm_mul_ps(c.m_angularComponentA.mVec128, impulseMagnitude));
-	body2.m_deltaLinearVelocity.mVec128 = _mm_add_ps(body2.m_deltaLinearVelocity.mVec128, _mm_mul_ps(linearComponentB, impulseMagnitude));
-	body2.m_deltaAngularVelocity.mVec128 = _mm_add_ps(body2.m_deltaLinearVelocity.mVec128, _mm_mul_ps(c.m_angularComponentB.mVec128, impulseMagnitude));
-#else
-	return resolveSingleConstraintRowGeneric(body1, body2, c);
-#endif
+	// The callback gets called from whatever thread is solving the rows
+	return !m_pSolveCallback || m_pSolveCallback->isThreadSafe();
 }
 
-// Project Gauss Seidel or the equivalent Sequential Impulse
-static void resolveSingleConstraintRowGeneric(btMiniSolverBody& body1, btMiniSolverBody& body2, const btSolverConstraint& c)
-{
-	btScalar deltaImpulse = c.m_rhs - btScalar(c.m_appliedImpulse)*c.m_cfm;
-	const btScalar deltaVel1Dotn = c.m_contactNormal1.dot(body1.m_deltaLinearVelocity) + c.m_relpos1CrossNormal.dot(body1.m_deltaAngularVelocity);
-	const btScalar deltaVel2Dotn = c.m_contactNormal2.dot(body2.m_deltaLinearVelocity) + c.m_relpos2CrossNormal.dot(body2.m_deltaAngularVelocity);
-
-	//	const btScalar delta_rel_vel	=	deltaVel1Dotn-deltaVel2Dotn;
-	deltaImpulse -= deltaVel1Dotn*c.m_jacDiagABInv;
-	deltaImpulse -= deltaVel2Dotn*c.m_jacDiagABInv;
-
-	const btScalar sum = btScalar(c.m_appliedImpulse) + deltaImpulse;
-	if (sum < c.m_lowerLimit) {
-		deltaImpulse = c.m_lowerLimit - c.m_appliedImpulse;
-		c.m_appliedImpulse = c.m_lowerLimit;
-	} else if (sum > c.m_upperLimit) {
-		deltaImpulse = c.m_upperLimit - c.m_appliedImpulse;
-		c.m_appliedImpulse = c.m_upperLimit;
-	} else {
-		c.m_appliedImpulse = sum;
+btSequentialImpulseConstraintSolver *btParallelConstraintSolver::acquireSolver() {
+	m_pSolverCritSect->lock();
+
+	if (m_freeSolvers.size() == 0) {
+		// Only happens for the first few steps (we end up with at most one solver per thread)
+		btSequentialImpulseConstraintSolver *pSolver = new btSequentialImpulseConstraintSolver;
+		pSolver->setSolveCallback(m_pSolveCallback);
+
+		m_solvers.push_back(pSolver);
+		m_freeSolvers.push_back(pSolver);
 	}
 
-	body1.internalApplyImpulse(c.m_contactNormal1*body1.getInvMass(), c.m_angularComponentA, deltaImpulse);
-	body2.internalApplyImpulse(c.m_contactNormal2*body2.getInvMass(), c.m_angularComponentB, deltaImpulse);
+	btSequentialImpulseConstraintSolver *pSolver = m_freeSolvers[m_freeSolvers.size() - 1];
+	m_freeSolvers.pop_back();
+
+	m_pSolverCritSect->unlock();
+	return pSolver;
+}
+
+void btParallelConstraintSolver::releaseSolver(btSequentialImpulseConstraintSolver *pSolver) {
+	m_pSolverCritSect->lock();
+	m_freeSolvers.push_back(pSolver);
+	m_pSolverCritSect->unlock();
 }
 
-static void resolveSingleConstraintRowLowerLimitSIMD(btMiniSolverBody& body1, btMiniSolverBody& body2, const btSolverConstraint& c)
-{
-#ifdef USE_SIMD
-	__m128 cpAppliedImp = _mm_set1_ps(c.m_appliedImpulse);
-	__m128	lowerLimit1 = _mm_set1_ps(c.m_lowerLimit);
-	__m128	upperLimit1 = _mm_set1_ps(c.m_upperLimit);
-	btSimdScalar deltaImpulse = _mm_sub_ps(_mm_set1_ps(c.m_rhs), _mm_mul_ps(_mm_set1_ps(c.m_appliedImpulse), _mm_set1_ps(c.m_cfm)));
-	__m128 deltaVel1Dotn = _mm_add_ps(btSimdDot3(c.m_contactNormal1.mVec128, body1.m_deltaLinearVelocity.mVec128), btSimdDot3(c.m_relpos1CrossNormal.mVec128, body1.m_deltaAngularVelocity.mVec128));
-	__m128 deltaVel2Dotn = _mm_add_ps(btSimdDot3(c.m_contactNormal2.mVec128, body2.m_deltaLinearVelocity.mVec128), btSimdDot3(c.m_relpos2CrossNormal.mVec128, body2.m_deltaAngularVelocity.mVec128));
-	deltaImpulse = _mm_sub_ps(deltaImpulse, _mm_mul_ps(deltaVel1Dotn, _mm_set1_ps(c.m_jacDiagABInv)));
-	deltaImpulse = _mm_sub_ps(deltaImpulse, _mm_mul_ps(deltaVel2Dotn, _mm_set1_ps(c.m_jacDiagABInv)));
-	btSimdScalar sum = _mm_add_ps(cpAppliedImp, deltaImpulse);
-	btSimdScalar resultLowerLess, resultUpperLess;
-	resultLowerLess = _mm_cmplt_ps(sum, lowerLimit1);
-	resultUpperLess = _mm_cmplt_ps(sum, upperLimit1);
-	__m128 lowMinApplied = _mm_sub_ps(lowerLimit1, cpAppliedImp);
-	deltaImpulse = _mm_or_ps(_mm_and_ps(resultLowerLess, lowMinApplied), _mm_andnot_ps(resultLowerLess, deltaImpulse));
-	c.m_appliedImpulse = _mm_or_ps(_mm_and_ps(resultLowerLess, lowerLimit1), _mm_andnot_ps(resultLowerLess, sum));
-	__m128	linearComponentA = _mm_mul_ps(c.m_contactNormal1.mVec128, body1.getInvMassSIMD());
-	__m128	linearComponentB = _mm_mul_ps(c.m_contactNormal2.mVec128, body2.getInvMassSIMD());
-	__m128 impulseMagnitude = deltaImpulse;
-	body1.m_deltaLinearVelocity.mVec128 = _mm_add_ps(body1.m_deltaLinearVelocity.mVec128, _mm_mul_ps(linearComponentA, impulseMagnitude));
-	body1.m_deltaAngularVelocity.mVec128 = _mm_add_ps(body1.m_deltaAngularVelocity.mVec128, _mm_mul_ps(c.m_angularComponentA.mVec128, impulseMagnitude));
-	body2.m_deltaLinearVelocity.mVec128 = _mm_add_ps(body2.m_deltaLinearVelocity.mVec128, _mm_mul_ps(linearComponentB, impulseMagnitude));
-	body2.m_deltaAngularVelocity.mVec128 = _mm_add_ps(body2.m_deltaAngularVelocity.mVec128, _mm_mul_ps(c.m_angularComponentB.mVec128, impulseMagnitude));
-#else
-	return resolveSingleConstraintRowLowerLimit(body1, body2, c);
-#endif
+void btParallelConstraintSolver::prepareSolve(int numBodies, int numManifolds) {
+	m_islands.resize(0);
+	m_islandBodies.resize(0);
+	m_islandManifolds.resize(0);
+	m_islandConstraints.resize(0);
+
+	m_islandBodies.reserve(numBodies);
+	m_islandManifolds.reserve(numManifolds);
+
+	m_bDeferring = canSolveInParallel();
 }
 
-static void resolveSingleConstraintRowLowerLimit(btMiniSolverBody& body1, btMiniSolverBody& body2, const btSolverConstraint& c)
-{
-	btScalar deltaImpulse = c.m_rhs - btScalar(c.m_appliedImpulse)*c.m_cfm;
-	const btScalar deltaVel1Dotn = c.m_contactNormal1.dot(body1.m_deltaLinearVelocity) + c.m_relpos1CrossNormal.dot(body1.m_deltaAngularVelocity);
-	const btScalar deltaVel2Dotn = c.m_contactNormal2.dot(body2.m_deltaLinearVelocity) + c.m_relpos2CrossNormal.dot(body2.m_deltaAngularVelocity);
-
-	deltaImpulse -= deltaVel1Dotn*c.m_jacDiagABInv;
-	deltaImpulse -= deltaVel2Dotn*c.m_jacDiagABInv;
-	const btScalar sum = btScalar(c.m_appliedImpulse) + deltaImpulse;
-	if (sum < c.m_lowerLimit) {
-		deltaImpulse = c.m_lowerLimit - c.m_appliedImpulse;
-		c.m_appliedImpulse = c.m_lowerLimit;
-	} else {
-		c.m_appliedImpulse = sum;
+btScalar btParallelConstraintSolver::solveGroup(btCollisionObject **bodies, int numBodies, btPersistentManifold **manifolds, int numManifolds, btTypedConstraint **constraints,
+												int numConstraints, const btContactSolverInfo &infoGlobal, btIDebugDraw *debugDrawer, btDispatcher *dispatcher) {
+	if (!m_bDeferring) {
+		// Called outside of prepareSolve/allSolved, or someone can't handle us solving in parallel
+		if (canSolveInParallel() && numManifolds + numConstraints > m_minColoringGroupSize)
+			return solveGroupColored(bodies, numBodies, manifolds, numManifolds, constraints, numConstraints, infoGlobal, debugDrawer);
+
+		return btSequentialImpulseConstraintSolver::solveGroup(bodies, numBodies, manifolds, numManifolds, constraints, numConstraints, infoGlobal, debugDrawer, dispatcher);
 	}
-	body1.internalApplyImpulse(c.m_contactNormal1*body1.getInvMass(), c.m_angularComponentA, deltaImpulse);
-	body2.internalApplyImpulse(c.m_contactNormal2*body2.getInvMass(), c.m_angularComponentB, deltaImpulse);
+
+	// The island manager reuses its arrays between calls, so copy everything out.
+	btParallelSolverIsland island;
+	island.bodyStart = m_islandBodies.size();
+	island.numBodies = numBodies;
+	island.manifoldStart = m_islandManifolds.size();
+	island.numManifolds = numManifolds;
+	island.constraintStart = m_islandConstraints.size();
+	island.numConstraints = numConstraints;
+	island.cost = numManifolds + numConstraints;
+	m_islands.push_back(island);
+
+	for (int i = 0; i < numBodies; i++)
+		m_islandBodies.push_back(bodies[i]);
+
+	for (int i = 0; i < numManifolds; i++)
+		m_islandManifolds.push_back(manifolds[i]);
+
+	for (int i = 0; i < numConstraints; i++)
+		m_islandConstraints.push_back(constraints[i]);
+
+	m_pInfo = &infoGlobal;
+	m_pDebugDrawer = debugDrawer;
+	m_pDispatcher = dispatcher;
+
+	// Unused return value
+	return btScalar(0);
 }
 
-class btSolveConstraintTask : public btIThreadTask {
-	public:
-		// Guaranteed that the constraint will only be available to us (threadsafe)
-		btSolveConstraintTask(btParallelConstraintSolver *pSolver, int constraintType, btSolverBody &bodyA, btSolverBody &bodyB, btSolverConstraint *pConstraint, bool useSimd) {
-			m_pSolver = pSolver;
-			m_constraintType = constraintType;
-			m_bodyA = bodyA;
-			m_bodyB = bodyB;
-			m_pConstraint = pConstraint;
-			btAssert(pConstraint != NULL);
-
-			m_useSimd = useSimd;
-		}
+void btParallelConstraintSolver::allSolved(const btContactSolverInfo &info, btIDebugDraw *debugDrawer) {
+	m_bDeferring = false;
+	if (m_islands.size() == 0) return;
 
-		void run() {
-			switch (m_constraintType) {
-				// generic
-				case 0: {
-					if (m_useSimd) {
-						resolveSingleConstraintRowGenericSIMD(m_bodyA, m_bodyB, *m_pConstraint);
-					} else {
-						resolveSingleConstraintRowGeneric(m_bodyA, m_bodyB, *m_pConstraint);
-					}
-					break;
-				}
+	// Kinematic bodies aren't split into islands, so islands that touch the same kinematic body
+	// would fight over its solver body. Those get solved after the parallel ones, on this thread.
+	m_islandTasks.resize(m_islands.size());
+	int numSerial = 0;
 
-				// lower limit
-				case 1: {
-					if (m_useSimd) {
-						resolveSingleConstraintRowLowerLimitSIMD(m_bodyA, m_bodyB, *m_pConstraint);
-					} else {
-						resolveSingleConstraintRowLowerLimit(m_bodyA, m_bodyB, *m_pConstraint);
-					}
-					break;
-				}
-			}
+	for (int i = 0; i < m_islands.size(); i++) {
+		const btParallelSolverIsland &island = m_islands[i];
+		if (island.cost > m_minColoringGroupSize || touchesKinematicBody(island)) {
+			numSerial++;
+			continue;
 		}
 
-		void destroy() {
-			m_pSolver->freeTask(this);
-		}
+		btSolveIslandTask *pTask = &m_islandTasks[i];
+		pTask->m_pSolver = this;
+		pTask->m_island = i;
+		m_pThreadPool->addTask(pTask);
+	}
 
-	public:
-		btParallelConstraintSolver *m_pSolver;
+	m_pThreadPool->runTasks();
+	m_pThreadPool->clearTasks();
 
-		btMiniSolverBody m_bodyA;
-		btMiniSolverBody m_bodyB;
-		btSolverConstraint *m_pConstraint;
+	if (numSerial > 0) {
+		for (int i = 0; i < m_islands.size(); i++) {
+			const btParallelSolverIsland &island = m_islands[i];
+			btCollisionObject **bodies = island.numBodies ? &m_islandBodies[island.bodyStart] : NULL;
+			btPersistentManifold **manifolds = island.numManifolds ? &m_islandManifolds[island.manifoldStart] : NULL;
+			btTypedConstraint **constraints = island.numConstraints ? &m_islandConstraints[island.constraintStart] : NULL;
+
+			// Big islands get split up into batches and solved in parallel
+			if (island.cost > m_minColoringGroupSize)
+				solveGroupColored(bodies, island.numBodies, manifolds, island.numManifolds, constraints, island.numConstraints, *m_pInfo, m_pDebugDrawer);
+			else if (touchesKinematicBody(island))
+				btSequentialImpulseConstraintSolver::solveGroup(bodies, island.numBodies, manifolds, island.numManifolds, constraints, island.numConstraints, *m_pInfo, m_pDebugDrawer, m_pDispatcher);
+		}
+	}
 
-		bool m_useSimd;
+	m_islands.resize(0);
+}
 
-		// 0=user, 
-		int m_constraintType;
-};
+bool btParallelConstraintSolver::touchesKinematicBody(const btParallelSolverIsland &island) const {
+	for (int i = 0; i < island.numManifolds; i++) {
+		const btPersistentManifold *pManifold = m_islandManifolds[island.manifoldStart + i];
+		if (pManifold->getBody0()->isKinematicObject() || pManifold->getBody1()->isKinematicObject())
+			return true;
+	}
 
-btParallelConstraintSolver::btParallelConstraintSolver(btThreadPool *pThreadPool) {
-	m_pThreadPool = pThreadPool;
+	for (int i = 0; i < island.numConstraints; i++) {
+		const btTypedConstraint *pConstraint = m_islandConstraints[island.constraintStart + i];
+		if (pConstraint->getRigidBodyA().isKinematicObject() || pConstraint->getRigidBodyB().isKinematicObject())
+			return true;
+	}
 
-	void *taskPoolMem = btAlloc(sizeof(btPoolAllocator));
-	m_pTaskPool = new(taskPoolMem)btPoolAllocator(sizeof(btSolveConstraintTask), 4096);
+	return false;
 }
 
-btParallelConstraintSolver::~btParallelConstraintSolver() {
-	m_pTaskPool->~btPoolAllocator();
-	btFree(m_pTaskPool);
+void btParallelConstraintSolver::solveIsland(int islandId) {
+	const btParallelSolverIsland &island = m_islands[islandId];
+	btCollisionObject **bodies = island.numBodies ? &m_islandBodies[island.bodyStart] : NULL;
+	btPersistentManifold **manifolds = island.numManifolds ? &m_islandManifolds[island.manifoldStart] : NULL;
+	btTypedConstraint **constraints = island.numConstraints ? &m_islandConstraints[island.constraintStart] : NULL;
+
+	btSequentialImpulseConstraintSolver *pSolver = acquireSolver();
+
+	// Don't let the results depend on which solver picked up the island
+	pSolver->setRandSeed(0);
+	pSolver->solveGroup(bodies, island.numBodies, manifolds, island.numManifolds, constraints, island.numConstraints, *m_pInfo, m_pDebugDrawer, m_pDispatcher);
+
+	releaseSolver(pSolver);
 }
 
-void *btParallelConstraintSolver::allocateTask(int size) {
-	void *ret = NULL;
-	
-	if (m_pTaskPool->getFreeCount() > 0) {
-		ret = m_pTaskPool->allocate();
-	} else {
-		ret = btAlloc(size);
+// Greedy graph coloring. Each run of rows gets the lowest color neither of its bodies has been used with,
+// then the rows are sorted by color. Fixed bodies never get written to so they don't conflict.
+btConstraintArray &btParallelConstraintSolver::getPhaseRows(int phase) {
+	switch (phase) {
+		case BT_SOLVER_PHASE_NONCONTACT:
+			return m_tmpSolverNonContactConstraintPool;
+		case BT_SOLVER_PHASE_FRICTION:
+			return m_tmpSolverContactFrictionConstraintPool;
+		case BT_SOLVER_PHASE_ROLLING_FRICTION:
+			return m_tmpSolverContactRollingFrictionConstraintPool;
+		default:
+			return m_tmpSolverContactConstraintPool;
 	}
+}
 
-	return ret;
+// Rows are generated per manifold/constraint, so neighboring rows usually act on the same pair of bodies.
+// Runs like that are kept together in one color and one task.
+static inline bool sameBodies(const btSolverConstraint &a, const btSolverConstraint &b) {
+	return a.m_solverBodyIdA == b.m_solverBodyIdA && a.m_solverBodyIdB == b.m_solverBodyIdB;
 }
 
-void btParallelConstraintSolver::freeTask(void *ptr) {
-	if (m_pTaskPool->validPtr(ptr)) {
-		m_pTaskPool->freeMemory(ptr);
-	} else {
-		btFree(ptr);
+void btParallelConstraintSolver::buildBatches(int phase) {
+	const btConstraintArray *pPool = &getPhaseRows(phase);
+
+	btAlignedObjectArray<int> &rows = m_batchRows[phase];
+	btAlignedObjectArray<btParallelSolverBatch> &batches = m_batches[phase];
+	int numRows = pPool->size();
+
+	rows.resize(numRows);
+	batches.resize(0);
+	if (numRows == 0) return;
+
+	m_bodyColors.resize(m_tmpSolverBodyPool.size());
+	for (int i = 0; i < m_bodyColors.size(); i++)
+		m_bodyColors[i] = 0;
+
+	m_rowColors.resize(numRows);
+	m_colorCounts.resize(MAX_BATCH_COLORS + 1);
+	for (int i = 0; i < m_colorCounts.size(); i++)
+		m_colorCounts[i] = 0;
+
+	for (int i = 0; i < numRows; i++) {
+		const btSolverConstraint &row = (*pPool)[i];
+		if (i > 0 && sameBodies(row, (*pPool)[i - 1])) {
+			m_rowColors[i] = m_rowColors[i - 1];
+			m_colorCounts[m_rowColors[i]]++;
+			continue;
+		}
+
+		unsigned int usedA = m_tmpSolverBodyPool[row.m_solverBodyIdA].m_originalBody ? m_bodyColors[row.m_solverBodyIdA] : 0;
+		unsigned int usedB = m_tmpSolverBodyPool[row.m_solverBodyIdB].m_originalBody ? m_bodyColors[row.m_solverBodyIdB] : 0;
+		unsigned int used = usedA | usedB;
+
+		// Anything that doesn't fit goes into the overflow color
+		int color = MAX_BATCH_COLORS;
+		for (int c = 0; c < MAX_BATCH_COLORS; c++) {
+			if (!(used & (1u << c))) {
+				color = c;
+				break;
+			}
+		}
+
+		if (color < MAX_BATCH_COLORS) {
+			if (m_tmpSolverBodyPool[row.m_solverBodyIdA].m_originalBody)
+				m_bodyColors[row.m_solverBodyIdA] |= 1u << color;
+
+			if (m_tmpSolverBodyPool[row.m_solverBodyIdB].m_originalBody)
+				m_bodyColors[row.m_solverBodyIdB] |= 1u << color;
+		}
+
+		m_rowColors[i] = color;
+		m_colorCounts[color]++;
 	}
-}
 
-void btParallelConstraintSolver::solveSingleIterationParallel(int iteration, const btContactSolverInfo &infoGlobal) {
-	int numNonContactPool = m_tmpSolverNonContactConstraintPool.size();
-	int numConstraintPool = m_tmpSolverContactConstraintPool.size();
-	int numFrictionPool = m_tmpSolverContactFrictionConstraintPool.size();
-
-	// Resolve all joint constraints (user constraints)
-	for (int i = 0; i < numNonContactPool; i++) {
-		btSolverConstraint &constraint = m_tmpSolverNonContactConstraintPool[m_orderNonContactConstraintPool[i]];
-		if (iteration < constraint.m_overrideNumSolverIterations) {
-			btSolveConstraintTask *pTask = (btSolveConstraintTask *)allocateTask(sizeof(btSolveConstraintTask));
-			pTask = new(pTask) btSolveConstraintTask(this, 0, m_tmpSolverBodyPool[constraint.m_solverBodyIdA], m_tmpSolverBodyPool[constraint.m_solverBodyIdB], &constraint, infoGlobal.m_solverMode & SOLVER_SIMD);
-			m_pThreadPool->addTask(pTask);
+	// Counting sort by color (keeps the original order within a color)
+	int start = 0;
+	for (int c = 0; c <= MAX_BATCH_COLORS; c++) {
+		int count = m_colorCounts[c];
+		if (count > 0) {
+			btParallelSolverBatch batch;
+			batch.start = start;
+			batch.end = start + count;
+			batch.serial = c == MAX_BATCH_COLORS;
+			batches.push_back(batch);
 		}
+
+		m_colorCounts[c] = start;
+		start += count;
 	}
 
-	if (iteration < infoGlobal.m_numIterations) {
-		//-------------------------
-		// CONTACT CONSTRAINTS
-		//-------------------------
-		for (int i = 0; i < numConstraintPool; i++) {
-			btSolverConstraint &solveManifold = m_tmpSolverContactConstraintPool[m_orderTmpConstraintPool[i]];
+	for (int i = 0; i < numRows; i++) {
+		rows[m_colorCounts[m_rowColors[i]]++] = i;
+	}
+}
 
-			btSolveConstraintTask *pTask = (btSolveConstraintTask *)allocateTask(sizeof(btSolveConstraintTask));
-			pTask = new(pTask)btSolveConstraintTask(this, 1, m_tmpSolverBodyPool[solveManifold.m_solverBodyIdA], m_tmpSolverBodyPool[solveManifold.m_solverBodyIdB], &solveManifold, infoGlobal.m_solverMode & SOLVER_SIMD);
-			m_pThreadPool->addTask(pTask);
+// Moves the contact and friction rows into color order so every batch is one contiguous block of memory.
+// Joint rows stay put, solveGroupCacheFriendlyFinish depends on their order.
+void btParallelConstraintSolver::sortRowsByColor() {
+	const btAlignedObjectArray<int> &contactRows = m_batchRows[BT_SOLVER_PHASE_CONTACT];
+	const btAlignedObjectArray<int> &frictionRows = m_batchRows[BT_SOLVER_PHASE_FRICTION];
+
+	// Old index -> new index
+	m_contactRemap.resize(contactRows.size());
+	for (int i = 0; i < contactRows.size(); i++)
+		m_contactRemap[contactRows[i]] = i;
+
+	m_frictionRemap.resize(frictionRows.size());
+	for (int i = 0; i < frictionRows.size(); i++)
+		m_frictionRemap[frictionRows[i]] = i;
+
+	for (int phase = BT_SOLVER_PHASE_CONTACT; phase <= BT_SOLVER_PHASE_ROLLING_FRICTION; phase++) {
+		btConstraintArray &pool = getPhaseRows(phase);
+		btAlignedObjectArray<int> &rows = m_batchRows[phase];
+
+		m_sortScratch.resize(pool.size());
+		for (int i = 0; i < pool.size(); i++) {
+			m_sortScratch[i] = pool[rows[i]];
+			rows[i] = i;
 		}
+
+		// The old pool becomes the scratch array for the next phase
+		pool.swapArray(m_sortScratch);
 	}
 
-	m_pThreadPool->runTasks();
+	// Fix up the links between contacts and their friction rows. Both friction rows of a contact point
+	// act on the same bodies, so they're still next to each other.
+	for (int i = 0; i < m_tmpSolverContactConstraintPool.size(); i++) {
+		btSolverConstraint &row = m_tmpSolverContactConstraintPool[i];
+		if (row.m_frictionIndex < m_frictionRemap.size())
+			row.m_frictionIndex = m_frictionRemap[row.m_frictionIndex];
+	}
 
-	// Pull the data back
-	for (int i = 0; i < m_pThreadPool->getNumTasks(); i++) {
-		btSolveConstraintTask *pTask = (btSolveConstraintTask *)m_pThreadPool->getTask(i);
-		pTask->m_bodyA.writeBack(m_tmpSolverBodyPool[pTask->m_pConstraint->m_solverBodyIdA]);
-		pTask->m_bodyB.writeBack(m_tmpSolverBodyPool[pTask->m_pConstraint->m_solverBodyIdB]);
+	for (int i = 0; i < m_tmpSolverContactFrictionConstraintPool.size(); i++) {
+		btSolverConstraint &row = m_tmpSolverContactFrictionConstraintPool[i];
+		row.m_frictionIndex = m_contactRemap[row.m_frictionIndex];
 	}
 
-	m_pThreadPool->clearTasks();
+	for (int i = 0; i < m_tmpSolverContactRollingFrictionConstraintPool.size(); i++) {
+		btSolverConstraint &row = m_tmpSolverContactRollingFrictionConstraintPool[i];
+		row.m_frictionIndex = m_contactRemap[row.m_frictionIndex];
+	}
 }
 
-btScalar btParallelConstraintSolver::solveGroupCacheFriendlyIterations(btCollisionObject **bodies, int numBodies, btPersistentManifold **manifolds, int numManifolds, btTypedConstraint **constraints, int numConstraints, const btContactSolverInfo &infoGlobal, btIDebugDraw *debugDrawer) {
-	// Resolve penetrations for contacts
-	solveGroupCacheFriendlySplitImpulseIterations(bodies, numBodies, manifolds, numManifolds, constraints, numConstraints, infoGlobal, debugDrawer);
+void btParallelConstraintSolver::runBatches(int phase, int iteration) {
+	int rowPhase = phase == BT_SOLVER_PHASE_SPLIT_IMPULSE ? BT_SOLVER_PHASE_CONTACT : phase;
+	const btAlignedObjectArray<btParallelSolverBatch> &batches = m_batches[rowPhase];
+	const btAlignedObjectArray<int> &rows = m_batchRows[rowPhase];
+	const btConstraintArray &pool = getPhaseRows(rowPhase);
 
-	// If the override is greater than the global num iterations, use it instead
-	int maxIterations = m_maxOverrideNumSolverIterations > infoGlobal.m_numIterations ? m_maxOverrideNumSolverIterations : infoGlobal.m_numIterations;
+	int numQueues = m_pThreadPool->getNumThreads() + 1;
+
+	// Colors have to be solved one after another, the rows within a color can go in any order.
+	for (int i = 0; i < batches.size(); i++) {
+		const btParallelSolverBatch &batch = batches[i];
+		int numRows = batch.end - batch.start;
 
-	for (int iteration = 0; iteration < maxIterations; iteration++){
-		solveSingleIterationParallel(iteration, infoGlobal);
+		if (batch.serial || numRows < MIN_BATCH_TASK_ROWS * 2) {
+			solveBatchRows(phase, batch.start, batch.end, iteration);
+			continue;
+		}
+
+		int numTasks = btMin(numQueues, numRows / MIN_BATCH_TASK_ROWS);
+		m_batchTasks.resize(numTasks);
+
+		int start = batch.start;
+		for (int j = 0; j < numTasks && start < batch.end; j++) {
+			int end = batch.start + (numRows * (j + 1)) / numTasks;
+
+			// Don't split a run of rows on the same bodies between two tasks
+			while (end < batch.end && sameBodies(pool[rows[end - 1]], pool[rows[end]]))
+				end++;
+
+			btSolveBatchTask *pTask = &m_batchTasks[j];
+			pTask->m_pSolver = this;
+			pTask->m_phase = phase;
+			pTask->m_start = start;
+			pTask->m_end = end;
+			pTask->m_iteration = iteration;
+
+			m_pThreadPool->addTask(pTask);
+			start = end;
+		}
+
+		m_pThreadPool->runTasks();
+		m_pThreadPool->clearTasks();
 	}
+}
 
-	return 0.f;
+// Same as the loops in solveSingleIteration/solveGroupCacheFriendlySplitImpulseIterations, but only over
+// a range of a color batch.
+void btParallelConstraintSolver::solveBatchRows(int phase, int start, int end, int iteration) {
+	const btContactSolverInfo &infoGlobal = *m_pInfo;
+	bool useSimd = (infoGlobal.m_solverMode & SOLVER_SIMD) != 0;
+
+	switch (phase) {
+		case BT_SOLVER_PHASE_SPLIT_IMPULSE: {
+			const btAlignedObjectArray<int> &rows = m_batchRows[BT_SOLVER_PHASE_CONTACT];
+			for (int i = start; i < end; i++) {
+				const btSolverConstraint &solveManifold = m_tmpSolverContactConstraintPool[rows[i]];
+				if (solveManifold.m_rhsPenetration <= 0)
+					continue;
+
+				if (useSimd)
+					resolveSplitPenetrationSIMD(m_tmpSolverBodyPool[solveManifold.m_solverBodyIdA], m_tmpSolverBodyPool[solveManifold.m_solverBodyIdB], solveManifold);
+				else
+					resolveSplitPenetrationImpulseCacheFriendly(m_tmpSolverBodyPool[solveManifold.m_solverBodyIdA], m_tmpSolverBodyPool[solveManifold.m_solverBodyIdB], solveManifold);
+			}
+
+			break;
+		}
+		case BT_SOLVER_PHASE_NONCONTACT: {
+			const btAlignedObjectArray<int> &rows = m_batchRows[BT_SOLVER_PHASE_NONCONTACT];
+			for (int i = start; i < end; i++) {
+				btSolverConstraint &constraint = m_tmpSolverNonContactConstraintPool[rows[i]];
+				if (iteration >= constraint.m_overrideNumSolverIterations)
+					continue;
+
+				if (useSimd)
+					resolveSingleConstraintRowGenericSIMD(m_tmpSolverBodyPool[constraint.m_solverBodyIdA], m_tmpSolverBodyPool[constraint.m_solverBodyIdB], constraint);
+				else
+					resolveSingleConstraintRowGeneric(m_tmpSolverBodyPool[constraint.m_solverBodyIdA], m_tmpSolverBodyPool[constraint.m_solverBodyIdB], constraint);
+			}
+
+			break;
+		}
+		case BT_SOLVER_PHASE_CONTACT: {
+			const btAlignedObjectArray<int> &rows = m_batchRows[BT_SOLVER_PHASE_CONTACT];
+			for (int i = start; i < end; i++) {
+				btSolverConstraint &solveManifold = m_tmpSolverContactConstraintPool[rows[i]];
+				btSolverBody &bodyA = m_tmpSolverBodyPool[solveManifold.m_solverBodyIdA];
+				btSolverBody &bodyB = m_tmpSolverBodyPool[solveManifold.m_solverBodyIdB];
+
+				if (m_pSolveCallback)
+					m_pSolveCallback->preSolveContact(&bodyA, &bodyB, (btManifoldPoint *)solveManifold.m_originalContactPoint);
+
+				if (useSimd)
+					resolveSingleConstraintRowLowerLimitSIMD(bodyA, bodyB, solveManifold);
+				else
+					resolveSingleConstraintRowLowerLimit(bodyA, bodyB, solveManifold);
+
+				if (m_pSolveCallback)
+					m_pSolveCallback->postSolveContact(&bodyA, &bodyB, (btManifoldPoint *)solveManifold.m_originalContactPoint);
+			}
+
+			break;
+		}
+		case BT_SOLVER_PHASE_FRICTION: {
+			const btAlignedObjectArray<int> &rows = m_batchRows[BT_SOLVER_PHASE_FRICTION];
+			for (int i = start; i < end; i++) {
+				btSolverConstraint &solveManifold = m_tmpSolverContactFrictionConstraintPool[rows[i]];
+				btScalar totalImpulse = m_tmpSolverContactConstraintPool[solveManifold.m_frictionIndex].m_appliedImpulse;
+				if (totalImpulse <= btScalar(0))
+					continue;
+
+				solveManifold.m_lowerLimit = -(solveManifold.m_friction*totalImpulse);
+				solveManifold.m_upperLimit = solveManifold.m_friction*totalImpulse;
+
+				if (useSimd)
+					resolveSingleConstraintRowGenericSIMD(m_tmpSolverBodyPool[solveManifold.m_solverBodyIdA], m_tmpSolverBodyPool[solveManifold.m_solverBodyIdB], solveManifold);
+				else
+					resolveSingleConstraintRowGeneric(m_tmpSolverBodyPool[solveManifold.m_solverBodyIdA], m_tmpSolverBodyPool[solveManifold.m_solverBodyIdB], solveManifold);
+			}
+
+			break;
+		}
+		case BT_SOLVER_PHASE_ROLLING_FRICTION: {
+			const btAlignedObjectArray<int> &rows = m_batchRows[BT_SOLVER_PHASE_ROLLING_FRICTION];
+			for (int i = start; i < end; i++) {
+				btSolverConstraint &rollingFrictionConstraint = m_tmpSolverContactRollingFrictionConstraintPool[rows[i]];
+				btScalar totalImpulse = m_tmpSolverContactConstraintPool[rollingFrictionConstraint.m_frictionIndex].m_appliedImpulse;
+				if (totalImpulse <= btScalar(0))
+					continue;
+
+				btScalar rollingFrictionMagnitude = rollingFrictionConstraint.m_friction*totalImpulse;
+				if (rollingFrictionMagnitude > rollingFrictionConstraint.m_friction)
+					rollingFrictionMagnitude = rollingFrictionConstraint.m_friction;
+
+				rollingFrictionConstraint.m_lowerLimit = -rollingFrictionMagnitude;
+				rollingFrictionConstraint.m_upperLimit = rollingFrictionMagnitude;
+
+				if (useSimd)
+					resolveSingleConstraintRowGenericSIMD(m_tmpSolverBodyPool[rollingFrictionConstraint.m_solverBodyIdA], m_tmpSolverBodyPool[rollingFrictionConstraint.m_solverBodyIdB], rollingFrictionConstraint);
+				else
+					resolveSingleConstraintRowGeneric(m_tmpSolverBodyPool[rollingFrictionConstraint.m_solverBodyIdA], m_tmpSolverBodyPool[rollingFrictionConstraint.m_solverBodyIdB], rollingFrictionConstraint);
+			}
+
+			break;
+		}
+	}
 }
 
-btScalar btParallelConstraintSolver::solveGroup(btCollisionObject **bodies, int numBodies, btPersistentManifold **manifolds, int numManifolds, btTypedConstraint **constraints, 
-											int numConstraints, const btContactSolverInfo &infoGlobal, btIDebugDraw *debugDrawer, btDispatcher *dispatcher) {
+// Solves a single large group on this solver, spreading each color batch over the thread pool.
+// SOLVER_RANDMIZE_ORDER is ignored here, the batches fix the row order.
+btScalar btParallelConstraintSolver::solveGroupColored(btCollisionObject **bodies, int numBodies, btPersistentManifold **manifolds, int numManifolds, btTypedConstraint **constraints,
+													   int numConstraints, const btContactSolverInfo &infoGlobal, btIDebugDraw *debugDrawer) {
+	m_pInfo = &infoGlobal;
+
 	solveGroupCacheFriendlySetup(bodies, numBodies, manifolds, numManifolds, constraints, numConstraints, infoGlobal, debugDrawer);
 
-	solveGroupCacheFriendlyIterations(bodies, numBodies, manifolds, numManifolds, constraints, numConstraints, infoGlobal, debugDrawer);
+	for (int i = 0; i < BT_SOLVER_NUM_PHASES; i++)
+		buildBatches(i);
+
+	sortRowsByColor();
+
+	// Resolve penetrations for contacts
+	if (infoGlobal.m_splitImpulse) {
+		for (int iteration = 0; iteration < infoGlobal.m_numIterations; iteration++)
+			runBatches(BT_SOLVER_PHASE_SPLIT_IMPULSE, iteration);
+	}
+
+	// If the override is greater than the global num iterations, use it instead
+	int maxIterations = m_maxOverrideNumSolverIterations > infoGlobal.m_numIterations ? m_maxOverrideNumSolverIterations : infoGlobal.m_numIterations;
+
+	for (int iteration = 0; iteration < maxIterations; iteration++) {
+		runBatches(BT_SOLVER_PHASE_NONCONTACT, iteration);
+
+		// Don't solve contacts/friction more than numIterations times!
+		if (iteration < infoGlobal.m_numIterations) {
+			// Obsolete constraint solving (can create solver bodies, so not threaded)
+			for (int i = 0; i < numConstraints; i++) {
+				if (constraints[i]->isEnabled()) {
+					int bodyAid = getOrInitSolverBody(constraints[i]->getRigidBodyA(), infoGlobal.m_timeStep);
+					int bodyBid = getOrInitSolverBody(constraints[i]->getRigidBodyB(), infoGlobal.m_timeStep);
+					btSolverBody &bodyA = m_tmpSolverBodyPool[bodyAid];
+					btSolverBody &bodyB = m_tmpSolverBodyPool[bodyBid];
+					constraints[i]->solveConstraintObsolete(bodyA, bodyB, infoGlobal.m_timeStep);
+				}
+			}
+
+			runBatches(BT_SOLVER_PHASE_CONTACT, iteration);
+			runBatches(BT_SOLVER_PHASE_FRICTION, iteration);
+			runBatches(BT_SOLVER_PHASE_ROLLING_FRICTION, iteration);
+		}
+	}
 
 	solveGroupCacheFriendlyFinish(bodies, numBodies, infoGlobal);
 
 	// Unused return value
 	return btScalar(0);
 }
-
-void btParallelConstraintSolver::waitUntilFinished() {
-
-}
\ No newline at end of file
@@ -22,30 +22,105 @@ subject to the following restrictions:
 #include "PlatformDefinitions.h"
 
 class btThreadPool;
-class btPoolAllocator;
 class btICriticalSection;
+class btSolveIslandTask;
+class btSolveBatchTask;
 
-/// The btParallelConstraintSolver performs computations on different constraint rows in parallel
+enum btParallelSolverPhase {
+	BT_SOLVER_PHASE_NONCONTACT = 0,
+	BT_SOLVER_PHASE_CONTACT,
+	BT_SOLVER_PHASE_FRICTION,
+	BT_SOLVER_PHASE_ROLLING_FRICTION,
+	BT_SOLVER_NUM_PHASES,
+
+	BT_SOLVER_PHASE_SPLIT_IMPULSE = BT_SOLVER_NUM_PHASES, // Uses the contact batches
+};
+
+// A group of bodies/manifolds/constraints handed to us by the island manager.
+// Stored as ranges into the solver's flat arrays until allSolved().
+struct btParallelSolverIsland {
+	int bodyStart;
+	int numBodies;
+	int manifoldStart;
+	int numManifolds;
+	int constraintStart;
+	int numConstraints;
+	int cost;
+};
+
+// Range of rows in a color batch (all of the rows in a batch touch different bodies)
+struct btParallelSolverBatch {
+	int start;
+	int end;
+	bool serial; // Overflow batch for rows that didn't fit in any color. Solved on one thread.
+};
+
+/// The btParallelConstraintSolver solves independent islands at the same time on the thread pool,
+/// each on its own sequential impulse solver. Islands too big to be worth solving on a single
+/// thread are split into graph-colored batches of rows that share no dynamic bodies, and each batch
+/// is solved in parallel. Neither method depends on the order tasks run in, so the results are deterministic.
 class btParallelConstraintSolver : public btSequentialImpulseConstraintSolver {
 	public:
 		btParallelConstraintSolver(btThreadPool *pThreadPool);
 		virtual ~btParallelConstraintSolver();
-	
-		virtual void *allocateTask(int size);
-		virtual void freeTask(void *ptr);
 
-		void solveSingleIterationParallel(int iteration, const btContactSolverInfo &infoGlobal);
+		virtual void prepareSolve(int numBodies, int numManifolds);
+		virtual btScalar solveGroup(btCollisionObject **bodies, int numBodies, btPersistentManifold **manifold, int numManifolds, btTypedConstraint **constraints, int numConstraints, const btContactSolverInfo &info, btIDebugDraw *debugDrawer, btDispatcher *dispatcher);
+		virtual void allSolved(const btContactSolverInfo &info, btIDebugDraw *debugDrawer);
 
-		virtual btScalar solveGroupCacheFriendlyIterations(btCollisionObject **bodies, int numBodies, btPersistentManifold **manifolds, int numManifolds, btTypedConstraint **constraints, int numConstraints, const btContactSolverInfo &infoGlobal, btIDebugDraw *debugDrawer);
+		virtual void setSolveCallback(btSolveCallback *callback);
 
-		virtual btScalar solveGroup(btCollisionObject **bodies, int numBodies, btPersistentManifold **manifold, int numManifolds, btTypedConstraint **constraints, int numConstraints, const btContactSolverInfo &info, btIDebugDraw *debugDrawer, btDispatcher *dispatcher);
-		virtual void waitUntilFinished();
+		// Groups with more rows (manifolds + constraints) than this get solved with colored batches
+		void setMinColoringGroupSize(int size) { m_minColoringGroupSize = size; }
+		int getMinColoringGroupSize() const { return m_minColoringGroupSize; }
+
+		// Internal functions (do not call these)
+		void solveIsland(int island);
+		void solveBatchRows(int phase, int start, int end, int iteration);
 
 	protected:
+		btSequentialImpulseConstraintSolver *acquireSolver();
+		void releaseSolver(btSequentialImpulseConstraintSolver *pSolver);
+
+		bool canSolveInParallel() const;
+		bool touchesKinematicBody(const btParallelSolverIsland &island) const;
+
+		btScalar solveGroupColored(btCollisionObject **bodies, int numBodies, btPersistentManifold **manifolds, int numManifolds, btTypedConstraint **constraints, int numConstraints, const btContactSolverInfo &infoGlobal, btIDebugDraw *debugDrawer);
+		btConstraintArray &getPhaseRows(int phase);
+		void buildBatches(int phase);
+		void sortRowsByColor();
+		void runBatches(int phase, int iteration);
+
 		btThreadPool *m_pThreadPool;
-		btPoolAllocator *m_pTaskPool;
-};
+		int m_minColoringGroupSize;
+
+		// Deferred islands (between prepareSolve and allSolved)
+		bool m_bDeferring;
+		const btContactSolverInfo *m_pInfo;
+		btIDebugDraw *m_pDebugDrawer;
+		btDispatcher *m_pDispatcher;
+		btAlignedObjectArray<btParallelSolverIsland> m_islands;
+		btAlignedObjectArray<btCollisionObject *> m_islandBodies;
+		btAlignedObjectArray<btPersistentManifold *> m_islandManifolds;
+		btAlignedObjectArray<btTypedConstraint *> m_islandConstraints;
 
+		// Solvers for the threads to use (one per thread + main thread)
+		btAlignedObjectArray<btSequentialImpulseConstraintSolver *> m_solvers;
+		btAlignedObjectArray<btSequentialImpulseConstraintSolver *> m_freeSolvers;
+		btICriticalSection *m_pSolverCritSect;
 
+		// Color batches for the group currently being solved by solveGroupColored (indexed by phase)
+		btAlignedObjectArray<int> m_batchRows[BT_SOLVER_NUM_PHASES];
+		btAlignedObjectArray<btParallelSolverBatch> m_batches[BT_SOLVER_NUM_PHASES];
+		btAlignedObjectArray<unsigned int> m_bodyColors;
+		btAlignedObjectArray<int> m_rowColors;
+		btAlignedObjectArray<int> m_colorCounts;
+		btAlignedObjectArray<int> m_contactRemap;
+		btAlignedObjectArray<int> m_frictionRemap;
+		btConstraintArray m_sortScratch;
+
+		btAlignedObjectArray<btSolveIslandTask> m_islandTasks;
+		btAlignedObjectArray<btSolveBatchTask> m_batchTasks;
+};
 
 #endif //__BT_PARALLEL_CONSTRAINT_SOLVER_H
\ No newline at end of file
@@ -1,6 +1,7 @@
 #include "btThreadPool.h"
 
 #include "LinearMath/btDefines.h"
+#include "LinearMath/btMinMax.h"
 
 #include <stdio.h>
 
@@ -13,27 +14,38 @@ static void ThreadFunc(void *pArg) {
 }
 
 btThreadPool::btThreadPool() {
+	m_numThreads = 0;
 	m_bThreadsStarted = false;
 	m_bThreadsShouldExit = false;
 	m_bRunningTasks = false;
 
+	m_mainQueue.pLock = btCreateCriticalSection();
+	m_mainQueue.head = 0;
+	m_mainQueue.tail = 0;
+
 	m_taskArray.reserve(100); // Reserve some space just to reduce some allocations
 }
 
 btThreadPool::~btThreadPool() {
 	if (m_bThreadsStarted)
 		stopThreads();
+
+	btDeleteCriticalSection(m_mainQueue.pLock);
 }
 
 void btThreadPool::beginThread(btThreadPoolInfo *pInfo) {
 	btIThread *pThread = btCreateThread();
-	
+
 	pInfo->pThread = pThread;
 	pInfo->pIdleEvent = btCreateEvent(true);
 	pInfo->pStartEvent = btCreateEvent(false);
 	pInfo->pThreadPool = this;
-	pInfo->pTaskArr = NULL;
-	pInfo->numTasks = 0;
+
+	pInfo->pQueue = (btThreadTaskQueue *)btAlloc(sizeof(btThreadTaskQueue));
+	pInfo->pQueue->pLock = btCreateCriticalSection();
+	pInfo->pQueue->head = 0;
+	pInfo->pQueue->tail = 0;
+
 	pThread->setThreadFunc(ThreadFunc);
 
 	// Set the name for debugging purposes
@@ -54,9 +66,23 @@ void btThreadPool::endThread(btThreadPoolInfo *pInfo) {
 	btDeleteEvent(pInfo->pIdleEvent);
 	btDeleteEvent(pInfo->pStartEvent);
 
+	btDeleteCriticalSection(pInfo->pQueue->pLock);
+	btFree(pInfo->pQueue);
+
 	m_bThreadsShouldExit = false;
 }
 
+// Queue ids match thread ids, the main thread's queue is always the last one.
+void btThreadPool::rebuildQueueList() {
+	m_pQueues.resize(0);
+
+	for (int i = 0; i < m_pThreadInfo.size(); i++) {
+		m_pQueues.push_back(m_pThreadInfo[i]->pQueue);
+	}
+
+	m_pQueues.push_back(&m_mainQueue);
+}
+
 void btThreadPool::startThreads(int numThreads) {
 	btAssert(numThreads > 0);
 	btAssert(!m_bThreadsStarted);
@@ -73,6 +99,8 @@ void btThreadPool::startThreads(int numThreads) {
 
 		beginThread(pInfo);
 	}
+
+	rebuildQueueList();
 }
 
 void btThreadPool::stopThreads() {
@@ -85,6 +113,9 @@ void btThreadPool::stopThreads() {
 		endThread(m_pThreadInfo[i]);
 		btFree(m_pThreadInfo[i]);
 	}
+
+	m_pThreadInfo.resize(0);
+	rebuildQueueList();
 }
 
 void btThreadPool::resizeThreads(int numThreads) {
@@ -103,7 +134,7 @@ void btThreadPool::resizeThreads(int numThreads) {
 	} else {
 		// More threads!
 		m_pThreadInfo.resize(numThreads); // FYI: This doesn't actually change the thread info location since threads still need it!
-		
+
 		for (int i = m_numThreads; i < numThreads; i++) {
 			m_pThreadInfo[i] = (btThreadPoolInfo *)btAlloc(sizeof(btThreadPoolInfo));
 			btThreadPoolInfo *pInfo = m_pThreadInfo[i];
@@ -112,8 +143,9 @@ void btThreadPool::resizeThreads(int numThreads) {
 			beginThread(pInfo);
 		}
 	}
-	
+
 	m_numThreads = numThreads;
+	rebuildQueueList();
 }
 
 int btThreadPool::getNumThreads() {
@@ -143,44 +175,48 @@ void btThreadPool::runTasks() {
 	btAssert(!m_bRunningTasks); // This class cannot be used recursively!
 	m_bRunningTasks = true;
 
-	if (m_taskArray.size() >= m_numThreads) {
-		int tasksPerThread = m_taskArray.size() / m_numThreads;
-		int remainder = m_taskArray.size() % m_numThreads;
-		int curTask = 0;
+	int numTasks = m_taskArray.size();
 
-		for (int i = 0; i < m_numThreads; i++) {
-			m_pThreadInfo[i]->pTaskArr = &m_taskArray[curTask];
-			m_pThreadInfo[i]->numTasks = tasksPerThread + (remainder ? 1 : 0);
-			curTask += m_pThreadInfo[i]->numTasks;
+	if (numTasks == 1 || !m_bThreadsStarted) {
+		// Not worth waking anybody up for this.
+		for (int i = 0; i < numTasks; i++) {
+			m_taskArray[i]->run();
+		}
+	} else {
+		// Deal out contiguous slices to every queue (including ours). Threads that run out of work
+		// will steal from the others, so uneven task costs even themselves out.
+		int numQueues = m_pQueues.size();
+		int tasksPerQueue = numTasks / numQueues;
+		int remainder = numTasks % numQueues;
+		int curTask = 0;
 
+		for (int i = 0; i < numQueues; i++) {
+			btThreadTaskQueue *pQueue = m_pQueues[i];
+			int count = tasksPerQueue + (remainder > 0 ? 1 : 0);
 			if (remainder > 0) remainder--;
+
+			pQueue->pLock->lock();
+			pQueue->head = curTask;
+			pQueue->tail = curTask + count;
+			pQueue->pLock->unlock();
+
+			curTask += count;
 		}
 
-		// Start the threads!
-		for (int i = 0; i < m_numThreads; i++) {
+		// Start the threads! Don't bother waking threads that would only find an empty pool.
+		int numWake = btMin(m_numThreads, numTasks - 1);
+		for (int i = 0; i < numWake; i++) {
 			m_pThreadInfo[i]->pIdleEvent->reset(); // Reset the idle event
 			m_pThreadInfo[i]->pStartEvent->trigger(); // Start it
 		}
-	} else if (m_taskArray.size() >= m_numThreads / 2) {
-		// Rare case where tasks are less than num threads
-		// Probably better to just run the task on the main thread if it's only one task, but whatever.
-		for (int i = 0; i < m_taskArray.size(); i++) {
-			m_pThreadInfo[i]->pTaskArr = &m_taskArray[i];
-			m_pThreadInfo[i]->numTasks = 1;
 
-			m_pThreadInfo[i]->pIdleEvent->reset(); // Reset the idle event
-			m_pThreadInfo[i]->pStartEvent->trigger(); // Go!
-		}
-	} else {
-		// Not enough tasks. Run sequentially!
-		for (int i = 0; i < m_taskArray.size(); i++) {
-			m_taskArray[i]->run();
-		}
+		// Help out while they work
+		workLoop(numQueues - 1);
+
+		waitIdle();
 	}
 
 	m_bRunningTasks = false;
-
-	waitIdle();
 }
 
 void btThreadPool::waitIdle() {
@@ -191,6 +227,67 @@ void btThreadPool::waitIdle() {
 	}
 }
 
+btIThreadTask *btThreadPool::popTask(btThreadTaskQueue *pQueue) {
+	btIThreadTask *pTask = NULL;
+
+	pQueue->pLock->lock();
+	if (pQueue->head < pQueue->tail) {
+		pTask = m_taskArray[pQueue->head++];
+	}
+	pQueue->pLock->unlock();
+
+	return pTask;
+}
+
+btIThreadTask *btThreadPool::stealTask(int thiefId) {
+	int numQueues = m_pQueues.size();
+	btThreadTaskQueue *pOwnQueue = m_pQueues[thiefId];
+
+	// Start with our neighbor so the thieves spread out over the victims
+	for (int i = 1; i < numQueues; i++) {
+		btThreadTaskQueue *pVictim = m_pQueues[(thiefId + i) % numQueues];
+
+		pVictim->pLock->lock();
+		int available = pVictim->tail - pVictim->head;
+		if (available <= 0) {
+			pVictim->pLock->unlock();
+			continue;
+		}
+
+		// Take the back half, the victim is working its way up from the front
+		int take = (available + 1) / 2;
+		int end = pVictim->tail;
+		pVictim->tail -= take;
+		int start = pVictim->tail;
+		pVictim->pLock->unlock();
+
+		// Run the first stolen task ourselves and publish the rest so they can be stolen again
+		pOwnQueue->pLock->lock();
+		pOwnQueue->head = start + 1;
+		pOwnQueue->tail = end;
+		pOwnQueue->pLock->unlock();
+
+		return m_taskArray[start];
+	}
+
+	return NULL;
+}
+
+void btThreadPool::workLoop(int queueId) {
+	btThreadTaskQueue *pQueue = m_pQueues[queueId];
+
+	while (true) {
+		btIThreadTask *pTask = popTask(pQueue);
+		if (!pTask) {
+			pTask = stealTask(queueId);
+			if (!pTask)
+				break; // Everything's either done or being worked on
+		}
+
+		pTask->run();
+	}
+}
+
 void btThreadPool::threadFunction(btThreadPoolInfo *pInfo) {
 	while (true) {
 		pInfo->pIdleEvent->trigger(); // Trigger idle event (tell main thread we're done working)
@@ -200,14 +297,6 @@ void btThreadPool::threadFunction(btThreadPoolInfo *pInfo) {
 			break;
 
 		// We have some work to do!
-		if (pInfo->pTaskArr) {
-			for (int i = 0; i < pInfo->numTasks; i++) {
-				pInfo->pTaskArr[i]->run();
-			}
-			
-			// Nullify this stuff for next time
-			pInfo->pTaskArr = NULL;
-			pInfo->numTasks = 0;
-		}
+		workLoop(pInfo->threadId);
 	}
 }
\ No newline at end of file
@@ -12,6 +12,15 @@ class btIThreadTask {
 
 class btThreadPool;
 
+// Work queue owned by a single worker (or the main thread).
+// The queue is a window [head, tail) into the pool's task array. The owner pops from the head,
+// thieves steal the back half from the tail, so the owner and thieves rarely fight over the same tasks.
+struct btThreadTaskQueue {
+	btICriticalSection *pLock;
+	int head;
+	int tail;
+};
+
 struct btThreadPoolInfo {
 	btIThread *pThread;
 	btIEvent *pIdleEvent;
@@ -20,8 +29,7 @@ struct btThreadPoolInfo {
 	int threadId;
 
 	// Task information
-	btIThreadTask **pTaskArr;
-	int numTasks;
+	btThreadTaskQueue *pQueue;
 };
 
 class btThreadPool {
@@ -47,7 +55,7 @@ class btThreadPool {
 			return m_taskArray[i];
 		}
 
-		void runTasks(); // Runs the threads until task pool is empty
+		void runTasks(); // Runs the threads (and the calling thread) until task pool is empty
 		void waitIdle(); // Waits until thread pool is idle (no more tasks)
 
 		// Internal functions (do not call these)
@@ -58,6 +66,13 @@ class btThreadPool {
 		void beginThread(btThreadPoolInfo *pInfo);
 		void endThread(btThreadPoolInfo *pInfo);
 
+		void rebuildQueueList();
+
+		// Work loop shared by the threads and the main thread. Returns when there's nothing left to run or steal.
+		void workLoop(int queueId);
+		btIThreadTask *popTask(btThreadTaskQueue *pQueue);
+		btIThreadTask *stealTask(int thiefId);
+
 		btAlignedObjectArray<btThreadPoolInfo *> m_pThreadInfo;
 		//btThreadPoolInfo **	m_pThreadInfo;
 		int					m_numThreads;
@@ -65,6 +80,10 @@ class btThreadPool {
 		bool				m_bThreadsShouldExit;
 		bool				m_bRunningTasks;
 
+		// One queue per thread, plus one (the last) for the main thread
+		btAlignedObjectArray<btThreadTaskQueue *> m_pQueues;
+		btThreadTaskQueue	m_mainQueue;
+
 		btAlignedObjectArray<btIThreadTask *> m_taskArray; // FIXME: We don't need an aligned array.
 };
 
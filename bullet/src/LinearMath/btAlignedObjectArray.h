@@ -517,6 +517,15 @@ class btAlignedObjectArray
 				m_data[i] = otherArray[i];
 			}
 		}
+
+		// Swaps the contents of two arrays without copying any elements
+		void swapArray(btAlignedObjectArray& otherArray)
+		{
+			btSwap(m_size, otherArray.m_size);
+			btSwap(m_capacity, otherArray.m_capacity);
+			btSwap(m_data, otherArray.m_data);
+			btSwap(m_ownsMemory, otherArray.m_ownsMemory);
+		}
 };
 
 #endif // BT_ALIGNED_OBJECT_ARRAY_H
@@ -183,3 +183,213 @@ void	btGeometryUtil::getVerticesFromPlaneEquations(const btAlignedObjectArray<bt
 	}
 }
 
+//Clips a convex polygon, keeping the part behind the plane. Returns the new vertex count (at most numIn + 1).
+static int clipPolygonByPlane(const btVector3* in, int numIn, const btVector3& normal, btScalar dist, btVector3* out)
+{
+	int numOut = 0;
+
+	btScalar da = normal.dot(in[numIn-1]) + dist;
+	for (int i=0;i<numIn;i++)
+	{
+		const btVector3& a = in[(i+numIn-1)%numIn];
+		const btVector3& b = in[i];
+		btScalar db = normal.dot(b) + dist;
+
+		if ((da < btScalar(0.) && db > btScalar(0.)) || (da > btScalar(0.) && db < btScalar(0.)))
+		{
+			out[numOut++] = a.lerp(b, da / (da - db));
+		}
+
+		if (db <= btScalar(0.))
+		{
+			out[numOut++] = b;
+		}
+
+		da = db;
+	}
+
+	return numOut;
+}
+
+void	btGeometryUtil::getHullFromPlaneEquations(const btAlignedObjectArray<btVector3>& planeEquations, btAlignedObjectArray<btVector3>& verticesOut, btAlignedObjectArray<unsigned int>& indicesOut, btScalar mergeDistance )
+{
+	const int numbrushes = planeEquations.size();
+
+	btScalar weldDist = btMax(mergeDistance, btScalar(0.0001));
+	btScalar weldDist2 = weldDist * weldDist;
+
+	//normalize the planes and throw out duplicates (keep the distance out of the w component, SIMD math may trash it)
+	btAlignedObjectArray<btVector3> normals;
+	btAlignedObjectArray<btScalar> dists;
+	normals.reserve(numbrushes);
+	dists.reserve(numbrushes);
+
+	btScalar maxDist = btScalar(0.);
+	for (int i=0;i<numbrushes;i++)
+	{
+		btVector3 normal(planeEquations[i].getX(), planeEquations[i].getY(), planeEquations[i].getZ());
+		btScalar len = normal.length();
+		if (len < SIMD_EPSILON)
+			continue;
+
+		normal /= len;
+		btScalar dist = planeEquations[i][3] / len;
+
+		bool duplicate = false;
+		for (int j=0;j<normals.size();j++)
+		{
+			if (normals[j].dot(normal) > btScalar(0.9999) && btFabs(dists[j] - dist) < weldDist)
+			{
+				duplicate = true;
+				break;
+			}
+		}
+
+		if (duplicate)
+			continue;
+
+		normals.push_back(normal);
+		dists.push_back(dist);
+		maxDist = btMax(maxDist, btFabs(dist));
+	}
+
+	const int numPlanes = normals.size();
+	if (numPlanes < 4)
+		return; //can't enclose anything
+
+	//the starting polygon on every plane has to be bigger than the face it's going to be clipped down to
+	btScalar extent = btScalar(4.) * maxDist + btScalar(1.);
+
+	//a face can't have more than one vertex per plane cutting it (plus the starting 4)
+	btAlignedObjectArray<btVector3> polyA, polyB;
+	btAlignedObjectArray<unsigned int> face;
+	//btVector3 doesn't initialize itself, so give resize something to copy
+	polyA.resize(numPlanes + 4, btVector3(0, 0, 0));
+	polyB.resize(numPlanes + 4, btVector3(0, 0, 0));
+	face.resize(numPlanes + 4);
+
+	for (int i=0;i<numPlanes;i++)
+	{
+		//u cross v is the normal, so the polygon (and everything clipped out of it) winds counter clockwise around it
+		const btVector3& normal = normals[i];
+		btVector3 u, v;
+		btPlaneSpace1(normal, u, v);
+
+		btVector3 center = normal * -dists[i];
+		btVector3* in = &polyA[0];
+		btVector3* out = &polyB[0];
+
+		in[0] = center + (u + v) * extent;
+		in[1] = center + (v - u) * extent;
+		in[2] = center - (u + v) * extent;
+		in[3] = center + (u - v) * extent;
+		int numVerts = 4;
+
+		for (int j=0;j<numPlanes && numVerts > 0;j++)
+		{
+			if (j == i)
+				continue;
+
+			//nothing to do if the whole polygon is already behind this plane
+			bool clipped = false;
+			for (int k=0;k<numVerts;k++)
+			{
+				if (normals[j].dot(in[k]) + dists[j] > btScalar(0.))
+				{
+					clipped = true;
+					break;
+				}
+			}
+
+			if (!clipped)
+				continue;
+
+			numVerts = clipPolygonByPlane(in, numVerts, normals[j], dists[j], out);
+			btSwap(in, out);
+		}
+
+		//weld the polygon into the vertex list, dropping the edges that collapse
+		int numFaceVerts = 0;
+		for (int k=0;k<numVerts;k++)
+		{
+			int index = -1;
+			for (int l=0;l<verticesOut.size();l++)
+			{
+				if (verticesOut[l].distance2(in[k]) <= weldDist2)
+				{
+					index = l;
+					break;
+				}
+			}
+
+			if (index == -1)
+			{
+				index = verticesOut.size();
+				verticesOut.push_back(in[k]);
+			}
+
+			if (numFaceVerts == 0 || face[numFaceVerts-1] != (unsigned int)index)
+				face[numFaceVerts++] = index;
+		}
+
+		if (numFaceVerts > 1 && face[numFaceVerts-1] == face[0])
+			numFaceVerts--;
+
+		//drop vertices sitting in the middle of an edge (planes that touch the hull along an edge leave those behind)
+		int k = 0;
+		while (numFaceVerts >= 3 && k < numFaceVerts)
+		{
+			const btVector3& prev = verticesOut[face[(k+numFaceVerts-1)%numFaceVerts]];
+			const btVector3& cur = verticesOut[face[k]];
+			const btVector3& next = verticesOut[face[(k+1)%numFaceVerts]];
+
+			btVector3 edge = next - prev;
+			if ((cur - prev).cross(edge).length2() <= weldDist2 * edge.length2())
+			{
+				for (int l=k+1;l<numFaceVerts;l++)
+				{
+					face[l-1] = face[l];
+				}
+
+				numFaceVerts--;
+				k = btMax(k-1, 0);
+				continue;
+			}
+
+			k++;
+		}
+
+		//planes that only touch the hull at an edge or a corner end up here with less than 3 vertices
+		for (int k=2;k<numFaceVerts;k++)
+		{
+			indicesOut.push_back(face[0]);
+			indicesOut.push_back(face[k-1]);
+			indicesOut.push_back(face[k]);
+		}
+	}
+
+	//drop the vertices that only ended up on collapsed faces
+	btAlignedObjectArray<int> remap;
+	remap.resize(verticesOut.size(), -1);
+	for (int i=0;i<indicesOut.size();i++)
+	{
+		remap[indicesOut[i]] = 0;
+	}
+
+	int numUsed = 0;
+	for (int i=0;i<verticesOut.size();i++)
+	{
+		if (remap[i] == -1)
+			continue;
+
+		remap[i] = numUsed;
+		verticesOut[numUsed++] = verticesOut[i];
+	}
+
+	verticesOut.resize(numUsed, btVector3(0, 0, 0));
+	for (int i=0;i<indicesOut.size();i++)
+	{
+		indicesOut[i] = remap[indicesOut[i]];
+	}
+}
+
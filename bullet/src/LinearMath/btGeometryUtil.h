@@ -28,6 +28,11 @@ class btGeometryUtil
 		static void	getPlaneEquationsFromVertices(btAlignedObjectArray<btVector3>& vertices, btAlignedObjectArray<btVector3>& planeEquationsOut );
 
 		static void	getVerticesFromPlaneEquations(const btAlignedObjectArray<btVector3>& planeEquations, btAlignedObjectArray<btVector3>& verticesOut );
+
+		///Builds the hull (vertices and outward facing triangles) of the space behind all of the planes directly, without
+		///a convex hull pass. Every face is a polygon on its plane clipped against all of the other planes, which is
+		///O(n^2) instead of the O(n^4) above. Vertices closer together than mergeDistance are welded.
+		static void	getHullFromPlaneEquations(const btAlignedObjectArray<btVector3>& planeEquations, btAlignedObjectArray<btVector3>& verticesOut, btAlignedObjectArray<unsigned int>& indicesOut, btScalar mergeDistance );
 	
 		static bool	isInside(const btAlignedObjectArray<btVector3>& vertices, const btVector3& planeNormal, btScalar	margin);
 		
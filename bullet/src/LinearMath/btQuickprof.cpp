@@ -559,4 +559,17 @@ void CProfileManager::Dump_All()
 
 
 
+#else //BT_NO_PROFILE
+
+btEnterProfileZoneFunc*	gEnterProfileZoneFunc = 0;
+btLeaveProfileZoneFunc*	gLeaveProfileZoneFunc = 0;
+
+void	btSetCustomProfileZoneFuncs(btEnterProfileZoneFunc* enterFunc, btLeaveProfileZoneFunc* leaveFunc)
+{
+	// Clear the enter function first so nobody picks up a mismatched pair
+	gEnterProfileZoneFunc = 0;
+	gLeaveProfileZoneFunc = leaveFunc;
+	gEnterProfileZoneFunc = leaveFunc ? enterFunc : 0;
+}
+
 #endif //BT_NO_PROFILE
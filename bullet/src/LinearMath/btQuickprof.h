@@ -191,7 +191,40 @@ public:
 
 #else // BT_NO_PROFILE
 
-#define	BT_PROFILE( name )
+#include "btScalar.h"
+
+///With the hierarchical profiler compiled out, BT_PROFILE zones can still be timed by the user through these hooks.
+///They're called from whichever thread enters the zone, and zone names are string literals.
+typedef void (btEnterProfileZoneFunc)(const char* name);
+typedef void (btLeaveProfileZoneFunc)();
+
+///Set both to 0 to turn them off again. Zones that were entered before keep using the old leave function.
+void	btSetCustomProfileZoneFuncs(btEnterProfileZoneFunc* enterFunc, btLeaveProfileZoneFunc* leaveFunc);
+
+extern btEnterProfileZoneFunc*	gEnterProfileZoneFunc;
+extern btLeaveProfileZoneFunc*	gLeaveProfileZoneFunc;
+
+class btProfileZone
+{
+	btLeaveProfileZoneFunc*	m_leaveFunc;
+
+public:
+	SIMD_FORCE_INLINE btProfileZone(const char* name)
+	{
+		btEnterProfileZoneFunc* enterFunc = gEnterProfileZoneFunc;
+		m_leaveFunc = enterFunc ? gLeaveProfileZoneFunc : 0;
+		if (m_leaveFunc)
+			enterFunc(name);
+	}
+
+	SIMD_FORCE_INLINE ~btProfileZone()
+	{
+		if (m_leaveFunc)
+			m_leaveFunc();
+	}
+};
+
+#define	BT_PROFILE( name )			btProfileZone __profile( name )
 
 #define BT_PROFILE_SCOPE_ENTER( name )
 #define BT_PROFILE_SCOPE_EXIT()
@@ -24,6 +24,36 @@ class IPhysicsVehicleController;
 struct softbodyparams_t;
 struct constraint_gearparams_t;
 
+struct physraytrace_t {
+	const Ray_t *			pRay;
+	unsigned int			fMask;
+	IPhysicsTraceFilter *	pTraceFilter; // Can be NULL
+};
+
+// Stages of IPhysicsEnvironment::Simulate timed by the environment's profiler
+enum {
+	PHYSPROFILE_TOTAL = 0,		// The whole Simulate call
+	PHYSPROFILE_BROADPHASE,
+	PHYSPROFILE_NARROWPHASE,
+	PHYSPROFILE_ISLANDS,
+	PHYSPROFILE_SOLVER,
+	PHYSPROFILE_INTEGRATE,
+	PHYSPROFILE_CONTROLLERS,
+	PHYSPROFILE_CALLBACKS,		// Collision events and the rest of the game callbacks
+	PHYSPROFILE_OTHER,			// Everything that isn't in any of the stages above
+
+	PHYSPROFILE_COUNT,
+};
+
+// Times are in milliseconds per Simulate call. Min/avg/max are over the last few hundred calls.
+struct physprofile_t {
+	const char *			pName;
+	float					lastMs;
+	float					minMs;
+	float					avgMs;
+	float					maxMs;
+};
+
 abstract_class IPhysics32 : public IPhysics {
 	public:
 		virtual int		GetActiveEnvironmentCount() = 0;
@@ -45,6 +75,25 @@ abstract_class IPhysicsEnvironment32 : public IPhysicsEnvironment {
 		virtual void	SweepConvex(const CPhysConvex *pConvex, const Vector &vecAbsStart, const Vector &vecAbsEnd, const QAngle &vecAngles, unsigned int fMask, IPhysicsTraceFilter *pTraceFilter, trace_t *pTrace) = 0;
 
 		virtual int		GetObjectCount() const = 0;
+
+		// Traces a batch of rays, pTraces receives one trace per ray (box traces are skipped).
+		// Rays are split up over the simulation threads, so the trace filters MUST be thread safe!
+		// Keep rays that start close to each other and point the same way next to each other in the array.
+		virtual void	TraceRays(const physraytrace_t *pRays, int numRays, trace_t *pTraces) = 0;
+
+		// Fills pOutput with up to maxStages stages (indexed by PHYSPROFILE_*), returns the amount written.
+		virtual int		GetStepProfile(physprofile_t *pOutput, int maxStages) const = 0;
+
+		// Asynchronous mode: Simulate launches the step on a simulation thread and returns right away.
+		// Until the next Simulate, objects report their position, velocity and sleep state from before the step,
+		// and anything that changes the environment (or reads state that isn't in the snapshot) waits for the step first.
+		// The step's collision, fluid, wake/sleep and PostSimulationFrame callbacks happen at the start of the next Simulate,
+		// and motion controllers (and anything else that calls into the game while ticking) tick there too, once per substep of the step.
+		// Destroyed objects are always queued, like with EnableDeleteQueue.
+		virtual void	SetAsyncSimulation(bool enable) = 0;
+		virtual bool	IsAsyncSimulation() const = 0;
+		// Blocks until the running step is done (nothing to wait for in synchronous mode). Callbacks aren't delivered here.
+		virtual void	WaitForSimulation() = 0;
 };
 
 abstract_class IPhysicsObject32 : public IPhysicsObject {
@@ -73,6 +122,12 @@ abstract_class IPhysicsObject32 : public IPhysicsObject {
 		virtual IPhysicsEnvironment32 *GetEnvironment() const = 0;
 
 		virtual IPhysicsVehicleController *GetVehicleController() const = 0;
+
+		// Pairs of objects in the same collision set (any size) with the same game data are filtered by the set in the broadphase,
+		// and the game's IPhysicsCollisionSolver::ShouldCollide isn't called for them. Other instances sharing the set still ask the game.
+		// index is our entry in the set. Pass NULL to remove it, destroying the set removes it too.
+		virtual void		SetCollisionSet(IPhysicsCollisionSet *pSet, int index) = 0;
+		virtual IPhysicsCollisionSet *GetCollisionSet(int *pIndex = NULL) const = 0;
 };
 
 // Note: If you change anything about a collision shape that an IPhysicsObject is using, call UpdateCollide on that object.
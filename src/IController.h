@@ -5,8 +5,27 @@ class CPhysicsObject;
 
 class IController {
 	public:
+		IController() { m_iControllerIndex = -1; m_iTickGroup = -1; }
+
 		// Bullet tick, called post-simulation
 		virtual void Tick(float deltaTime) = 0;
+
+		// Objects Tick reads or writes. Controllers that share none of them can tick in parallel.
+		virtual void GetTickObjects(CUtlVector<CPhysicsObject *> &objects) = 0;
+		// False if Tick calls into the game, those have to tick on the game thread.
+		virtual bool IsTickThreadSafe() const = 0;
+
+		// Slot in the environment's controller list (-1 if we're not in it)
+		int GetControllerIndex() const { return m_iControllerIndex; }
+		void SetControllerIndex(int index) { m_iControllerIndex = index; }
+
+		// Scratch for the environment's tick scheduling (-1 = ticks on the game thread)
+		int GetTickGroup() const { return m_iTickGroup; }
+		void SetTickGroup(int group) { m_iTickGroup = group; }
+
+	private:
+		int m_iControllerIndex;
+		int m_iTickGroup;
 };
 
 #endif // ICONTROLLER_H
@@ -90,13 +90,10 @@ IPhysicsCollisionSet *CPhysics::FindOrCreateCollisionSet(unsigned int id, int ma
 	if (m_colSetTable.Find(id) != m_colSetTable.InvalidHandle())
 		return m_collisionSets[m_colSetTable.Element(m_colSetTable.Find(id))];
 
-	CPhysicsCollisionSet *set = NULL;
-	if (maxElementCount < sizeof(int) * 8) { // Limit of 32 because of the way this works internally
-		set = ::CreateCollisionSet(maxElementCount);
-		int vecId = m_collisionSets.AddToTail(set);
+	CPhysicsCollisionSet *set = ::CreateCollisionSet(maxElementCount);
+	int vecId = m_collisionSets.AddToTail(set);
 
-		m_colSetTable.Insert(id, vecId);
-	}
+	m_colSetTable.Insert(id, vecId);
 
 	return set;
 }
@@ -109,6 +106,9 @@ IPhysicsCollisionSet *CPhysics::FindCollisionSet(unsigned int id) {
 }
 
 void CPhysics::DestroyAllCollisionSets() {
+	// Objects in a running step may still be filtered through them
+	WaitForSimulations();
+
 	for (int i = 0; i < m_collisionSets.Count(); i++)
 		delete (CPhysicsCollisionSet *)m_collisionSets[i];
 
@@ -116,6 +116,13 @@ void CPhysics::DestroyAllCollisionSets() {
 	m_colSetTable.RemoveAll();
 }
 
+// UNEXPOSED
+// For changes to things every environment can be using, like collision sets and collides
+void CPhysics::WaitForSimulations() {
+	for (int i = 0; i < m_envList.Count(); i++)
+		((CPhysicsEnvironment *)m_envList[i])->WaitForSimulation();
+}
+
 CPhysics g_Physics;
 EXPOSE_SINGLE_INTERFACE_GLOBALVAR(CPhysics, IPhysics, VPHYSICS_INTERFACE_VERSION, g_Physics);
 EXPOSE_SINGLE_INTERFACE_GLOBALVAR(CPhysics, IPhysics32, "VPhysics032", g_Physics); // "Undocumented" way to determine if this is the newer vphysics or not.
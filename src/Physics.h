@@ -29,6 +29,8 @@ class CPhysics : public CTier1AppSystem<IPhysics32> {
 		IPhysicsCollisionSet *		FindOrCreateCollisionSet(unsigned int id, int maxElementCount);
 		IPhysicsCollisionSet *		FindCollisionSet(unsigned int id);
 		void						DestroyAllCollisionSets();
+
+		void						WaitForSimulations(); // UNEXPOSED
 	private:
 		CUtlVector<IPhysicsEnvironment *>	m_envList;
 		CUtlVector<IPhysicsCollisionSet *>	m_collisionSets;
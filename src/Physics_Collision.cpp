@@ -2,11 +2,18 @@
 
 #include <vphysics/virtualmesh.h>
 #include <cmodel.h>
+#include <tier1/byteswap.h>
 
 #include "BulletCollision/CollisionDispatch/btInternalEdgeUtility.h"
 #include "LinearMath/btConvexHull.h"
+#include "LinearMath/btConvexHullComputer.h"
+#include "LinearMath/btGeometryUtil.h"
+#include "BulletMultiThreaded/btThreadPool.h"
 
+#include "Physics.h"
 #include "Physics_Collision.h"
+#include "Physics_Environment.h"
+#include "Physics_ConvexDecomposition.h"
 #include "Physics_Object.h"
 #include "convert.h"
 #include "Physics_KeyParser.h"
@@ -174,15 +181,217 @@ BEGIN_BYTESWAP_DATADESC(ivpcompactledgenode_t)
 	DEFINE_FIELD(free_0, FIELD_CHARACTER),
 END_BYTESWAP_DATADESC()
 
+BEGIN_BYTESWAP_DATADESC(bulletcollide_t)
+	DEFINE_FIELD(endianTag, FIELD_INTEGER),
+	DEFINE_FIELD(version, FIELD_INTEGER),
+	DEFINE_FIELD(numConvexes, FIELD_INTEGER),
+	DEFINE_FIELD(convexOffset, FIELD_INTEGER),
+	DEFINE_ARRAY(massCenter, FIELD_FLOAT, 3),
+	DEFINE_FIELD(margin, FIELD_FLOAT),
+	DEFINE_ARRAY(rotInertia, FIELD_FLOAT, 3),
+	DEFINE_ARRAY(scale, FIELD_FLOAT, 3),
+	DEFINE_ARRAY(reserved, FIELD_INTEGER, 2),
+END_BYTESWAP_DATADESC()
+
+BEGIN_BYTESWAP_DATADESC(bulletconvex_t)
+	DEFINE_ARRAY(basis, FIELD_FLOAT, 9),
+	DEFINE_ARRAY(origin, FIELD_FLOAT, 3),
+	DEFINE_ARRAY(scale, FIELD_FLOAT, 3),
+	DEFINE_FIELD(margin, FIELD_FLOAT),
+	DEFINE_ARRAY(params, FIELD_FLOAT, 4),
+	DEFINE_FIELD(shapeType, FIELD_INTEGER),
+	DEFINE_FIELD(gameData, FIELD_INTEGER),
+	DEFINE_FIELD(numVertices, FIELD_INTEGER),
+	DEFINE_FIELD(vertexOffset, FIELD_INTEGER),
+	DEFINE_FIELD(numTriangles, FIELD_INTEGER),
+	DEFINE_FIELD(indexOffset, FIELD_INTEGER),
+	DEFINE_ARRAY(reserved, FIELD_INTEGER, 2),
+END_BYTESWAP_DATADESC()
+
 /****************************
 * CLASS CPhysCollide
 ****************************/
 
+// Every live collide by address, with its serial (see CPhysCollide::FindLive)
+static CUtlHashtable<uintp, unsigned int> s_liveCollides;
+static CThreadFastMutex s_liveCollidesMutex;
+static CInterlockedUInt s_collideSerial;
+
 CPhysCollide::CPhysCollide(btCollisionShape *pShape) {
 	m_pShape = pShape;
 	m_pShape->setUserPointer(this);
 
 	m_massCenter.setZero();
+	m_bCachedSolid = false;
+	m_solidCacheKey = 0;
+	m_pBuoyancyData = NULL;
+
+	m_serial = ++s_collideSerial;
+
+	AUTO_LOCK(s_liveCollidesMutex);
+	s_liveCollides.Insert((uintp)this, m_serial);
+}
+
+CPhysCollide::~CPhysCollide() {
+	{
+		AUTO_LOCK(s_liveCollidesMutex);
+		s_liveCollides.Remove((uintp)this);
+	}
+
+	delete m_pBuoyancyData;
+}
+
+CPhysCollide *CPhysCollide::FindLive(const CPhysCollide *pCollide, unsigned int serial) {
+	AUTO_LOCK(s_liveCollidesMutex);
+
+	UtlHashHandle_t h = s_liveCollides.Find((uintp)pCollide);
+	if (h == s_liveCollides.InvalidHandle() || s_liveCollides.Element(h) != serial)
+		return NULL;
+
+	return (CPhysCollide *)pCollide;
+}
+
+// Points of a convex child in the child's (scaled) space
+static void GetConvexPoints(const btCollisionShape *pShape, btAlignedObjectArray<btVector3> &points) {
+	if (pShape->getShapeType() == CONVEX_HULL_SHAPE_PROXYTYPE) {
+		const btConvexHullShape *pHull = (const btConvexHullShape *)pShape;
+		for (int i = 0; i < pHull->getNumPoints(); i++)
+			points.push_back(pHull->getScaledPoint(i));
+	} else if (pShape->getShapeType() == CONVEX_TRIANGLEMESH_SHAPE_PROXYTYPE) {
+		btStridingMeshInterface *pMeshInterface = ((btConvexTriangleMeshShape *)pShape)->getMeshInterface();
+		btIndexedMesh &mesh = ((btTriangleIndexVertexArray *)pMeshInterface)->getIndexedMeshArray()[0];
+
+		const btVector3 *pVerts = (const btVector3 *)mesh.m_vertexBase;
+		for (int i = 0; i < mesh.m_numVertices; i++)
+			points.push_back(pVerts[i] * pMeshInterface->getScaling());
+	} else if (pShape->isConvex()) {
+		// Primitives (box, sphere, cylinder, cone), sample them with support mapping
+		btShapeHull hull((const btConvexShape *)pShape);
+		hull.buildHull(0);
+		for (int i = 0; i < hull.numVertices(); i++)
+			points.push_back(hull.getVertexPointer()[i]);
+	}
+}
+
+// Builds the hull's triangles, volume and centroid. Returns false if it's degenerate.
+static bool BuildBuoyancyHull(const btAlignedObjectArray<btVector3> &points, buoyancyhull_t &hull) {
+	btConvexHullComputer computer;
+	computer.compute(&points[0].getX(), sizeof(btVector3), points.size(), 0, 0);
+	if (computer.faces.size() < 4)
+		return false;
+
+	hull.verts.copyFromArray(computer.vertices);
+
+	btVector3 inside(0, 0, 0);
+	for (int i = 0; i < hull.verts.size(); i++)
+		inside += hull.verts[i];
+
+	inside /= hull.verts.size();
+
+	// Fan triangulate the faces
+	for (int i = 0; i < computer.faces.size(); i++) {
+		const btConvexHullComputer::Edge *pFirst = &computer.edges[computer.faces[i]];
+		int v0 = pFirst->getSourceVertex();
+
+		for (const btConvexHullComputer::Edge *pEdge = pFirst->getNextEdgeOfFace(); pEdge->getTargetVertex() != v0; pEdge = pEdge->getNextEdgeOfFace()) {
+			int v1 = pEdge->getSourceVertex();
+			int v2 = pEdge->getTargetVertex();
+
+			// Wind it outwards, whatever the hull computer gave us
+			const btVector3 &a = hull.verts[v0];
+			if ((hull.verts[v1] - a).cross(hull.verts[v2] - a).dot(a - inside) < 0)
+				btSwap(v1, v2);
+
+			hull.tris.push_back(v0);
+			hull.tris.push_back(v1);
+			hull.tris.push_back(v2);
+		}
+	}
+
+	// Sum of the tetrahedrons between every triangle and a point inside
+	btScalar volume = 0;
+	btVector3 moment(0, 0, 0);
+	for (int i = 0; i < hull.tris.size(); i += 3) {
+		const btVector3 &a = hull.verts[hull.tris[i]];
+		const btVector3 &b = hull.verts[hull.tris[i+1]];
+		const btVector3 &c = hull.verts[hull.tris[i+2]];
+
+		btScalar tetVolume = (a - inside).dot((b - inside).cross(c - inside)) / 6;
+		volume += tetVolume;
+		moment += tetVolume * (inside + a + b + c) / 4;
+	}
+
+	if (volume <= SIMD_EPSILON)
+		return false;
+
+	hull.volume = volume;
+	hull.centroid = moment / volume;
+
+	hull.radius = 0;
+	for (int i = 0; i < hull.verts.size(); i++)
+		hull.radius = btMax(hull.radius, hull.verts[i].distance(hull.centroid));
+
+	return true;
+}
+
+const buoyancydata_t *CPhysCollide::GetBuoyancyData() {
+	if (m_pBuoyancyData)
+		return m_pBuoyancyData;
+
+	if (!IsCompound())
+		return NULL;
+
+	// Fluid controllers tick in parallel, and collides are shared between objects
+	AUTO_LOCK(m_buoyancyMutex);
+	if (m_pBuoyancyData)
+		return m_pBuoyancyData;
+
+	buoyancydata_t *pData = new buoyancydata_t;
+	pData->volume = 0;
+	pData->centroid.setZero();
+
+	btCompoundShape *pCompound = GetCompoundShape();
+	btAlignedObjectArray<btVector3> points;
+	for (int i = 0; i < pCompound->getNumChildShapes(); i++) {
+		points.resize(0);
+		GetConvexPoints(pCompound->getChildShape(i), points);
+		if (points.size() < 4)
+			continue;
+
+		// Into the compound's space
+		const btTransform &childTrans = pCompound->getChildTransform(i);
+		for (int j = 0; j < points.size(); j++)
+			points[j] = childTrans * points[j];
+
+		pData->hulls.expand();
+		if (!BuildBuoyancyHull(points, pData->hulls[pData->hulls.size() - 1])) {
+			pData->hulls.pop_back();
+			continue;
+		}
+
+		const buoyancyhull_t &hull = pData->hulls[pData->hulls.size() - 1];
+		pData->volume += hull.volume;
+		pData->centroid += hull.volume * hull.centroid;
+	}
+
+	if (pData->volume > 0)
+		pData->centroid /= pData->volume;
+
+	ThreadMemoryBarrier();
+	m_pBuoyancyData = pData;
+	return pData;
+}
+
+// Fluid controllers read the data without the lock while they tick, so the steps need to be done before this
+void CPhysCollide::InvalidateBuoyancyData() {
+	buoyancydata_t *pData;
+	{
+		AUTO_LOCK(m_buoyancyMutex);
+		pData = m_pBuoyancyData;
+		m_pBuoyancyData = NULL;
+	}
+
+	delete pData;
 }
 
 /****************************
@@ -191,12 +400,8 @@ CPhysCollide::CPhysCollide(btCollisionShape *pShape) {
 
 class CPhysPolysoup {
 	public:
-		CPhysPolysoup() {
-
-		}
-
-	private:
-		
+		// Bullet space, 3 per triangle
+		btAlignedObjectArray<btVector3> m_triVerts;
 };
 
 /****************************
@@ -208,16 +413,35 @@ class CPhysPolysoup {
 // CPhysConvex is usually a btConvexHullShape
 
 #define VPHYSICS_ID					MAKEID('V', 'P', 'H', 'Y')
+#define VPHYSICS_ID_SWAPPED			MAKEID('Y', 'H', 'P', 'V') // VPHYSICS_ID written with the other byte order
 #define IVP_COMPACT_SURFACE_ID		MAKEID('I', 'V', 'P', 'S')
 #define IVP_COMPACT_MOPP_ID			MAKEID('M', 'O', 'P', 'P')
 
 CPhysicsCollision::CPhysicsCollision() {
+	m_pMainContext = NULL;
+	m_pTraceObject = NULL;
+	m_pTraceBox = NULL;
+
 	// Default to old behavior
 	EnableBBoxCache(true);
 }
 
 CPhysicsCollision::~CPhysicsCollision() {
-	ClearBBoxCache();
+	// Thread contexts forward this to the main context, whose cache is still in use
+	if (!m_pMainContext)
+		ClearBBoxCache();
+
+	delete m_pTraceObject;
+	delete m_pTraceBox;
+
+	// Anything left over was never unloaded
+	for (UtlHashHandle_t h = m_solidCache.FirstHandle(); h != m_solidCache.InvalidHandle(); h = m_solidCache.NextHandle(h)) {
+		CPhysCollide *pCollide = m_solidCache.Element(h).pCollide;
+		pCollide->SetCachedSolid(false);
+		DestroyCollide(pCollide);
+	}
+
+	m_solidCache.RemoveAll();
 }
 
 // FIXME: Why is it important to have an array of pointers?
@@ -267,20 +491,11 @@ btConvexTriangleMeshShape *CreateTriMeshFromHull(HullResult &res) {
 	return pShape;
 }
 
-// Newer version of the above (just an array, not an array of pointers)
-CPhysConvex *CPhysicsCollision::ConvexFromVerts(const Vector *pVerts, int vertCount) {
-	if (!pVerts || vertCount == 0) return NULL;
-
-	btVector3 *pBullVerts = new btVector3[vertCount];
-
-	for (int i = 0; i < vertCount; i++) {
-		ConvertPosToBull(pVerts[i], pBullVerts[i]);
-	}
-
+static CPhysConvex *ConvexFromBullVerts(const btVector3 *pVerts, int vertCount) {
 	HullLibrary lib;
 
 	HullResult res;
-	HullDesc desc(QF_TRIANGLES, vertCount, pBullVerts);
+	HullDesc desc(QF_TRIANGLES, vertCount, pVerts);
 	HullError err = lib.CreateConvexHull(desc, res);
 	// A problem occurred in creating the hull :(
 	if (err != QE_OK)
@@ -293,9 +508,47 @@ CPhysConvex *CPhysicsCollision::ConvexFromVerts(const Vector *pVerts, int vertCo
 	return (CPhysConvex *)pMesh;
 }
 
+// Newer version of the above (just an array, not an array of pointers)
+CPhysConvex *CPhysicsCollision::ConvexFromVerts(const Vector *pVerts, int vertCount) {
+	if (!pVerts || vertCount == 0) return NULL;
+
+	btVector3 *pBullVerts = new btVector3[vertCount];
+
+	for (int i = 0; i < vertCount; i++) {
+		ConvertPosToBull(pVerts[i], pBullVerts[i]);
+	}
+
+	CPhysConvex *pConvex = ConvexFromBullVerts(pBullVerts, vertCount);
+	delete [] pBullVerts;
+
+	return pConvex;
+}
+
+// Planes are 4 floats each (normal, distance), the convex is everything behind all of them.
 CPhysConvex *CPhysicsCollision::ConvexFromPlanes(float *pPlanes, int planeCount, float mergeDistance) {
-	NOT_IMPLEMENTED
-	return NULL;
+	if (!pPlanes || planeCount < 4) return NULL;
+
+	// Bullet plane equations are normal.dot(p) + w = 0
+	btAlignedObjectArray<btVector3> planes;
+	planes.resize(planeCount);
+	for (int i = 0; i < planeCount; i++) {
+		const float *pPlane = &pPlanes[i * 4];
+		ConvertDirectionToBull(Vector(pPlane[0], pPlane[1], pPlane[2]), planes[i]);
+		planes[i][3] = -ConvertDistanceToBull(pPlane[3]);
+	}
+
+	// The faces come straight out of the planes, no need to run the hull library.
+	HullResult res;
+	btGeometryUtil::getHullFromPlaneEquations(planes, res.m_OutputVertices, res.m_Indices, ConvertDistanceToBull(mergeDistance));
+	if (res.m_OutputVertices.size() < 4)
+		return NULL;
+
+	res.mPolygons = false;
+	res.mNumOutputVertices = res.m_OutputVertices.size();
+	res.mNumIndices = res.m_Indices.size();
+	res.mNumFaces = res.mNumIndices / 3;
+
+	return (CPhysConvex *)CreateTriMeshFromHull(res);
 }
 
 float CPhysicsCollision::ConvexVolume(CPhysConvex *pConvex) {
@@ -388,7 +641,7 @@ float CPhysicsCollision::ConvexSurfaceArea(CPhysConvex *pConvex) {
 }
 
 void CPhysicsCollision::ConvexFree(CPhysConvex *pConvex) {
-	if (!pConvex) return;
+	if (!pConvex || ReleasePrimitive(pConvex)) return;
 
 	btCollisionShape *pShape = (btCollisionShape *)pConvex;
 
@@ -418,8 +671,17 @@ void CPhysicsCollision::ConvexFree(CPhysConvex *pConvex) {
 }
 
 // TODO: Need this to get contents of a convex in a compound shape
+// NOTE: The convex is the game's handle, so an interned one can only be made private if the caller is its only user.
+// Primitives that are shared with somebody else are left alone (disable the bbox cache if that matters).
 void CPhysicsCollision::SetConvexGameData(CPhysConvex *pConvex, unsigned int gameData) {
+	if (!pConvex) return;
+
 	btConvexShape *pShape = (btConvexShape *)pConvex;
+	if (!DetachPrimitive(pShape)) {
+		DevWarning("SetConvexGameData: Convex is a primitive shared with other users, ignoring game data!\n");
+		return;
+	}
+
 	pShape->setUserPointer((void *)gameData);
 }
 
@@ -438,8 +700,6 @@ void CPhysicsCollision::ConvexesFromConvexPolygon(const Vector &vPolyNormal, con
 	NOT_IMPLEMENTED
 }
 
-// TODO: Support this, gmod lua Entity:PhysicsInitMultiConvex uses this!
-// IVP internally used QHull to generate the convexes.
 CPhysPolysoup *CPhysicsCollision::PolysoupCreate() {
 	return new CPhysPolysoup();
 }
@@ -448,15 +708,65 @@ void CPhysicsCollision::PolysoupDestroy(CPhysPolysoup *pSoup) {
 	delete pSoup;
 }
 
+// TODO: Material indices are thrown away, compound children don't have materials.
 void CPhysicsCollision::PolysoupAddTriangle(CPhysPolysoup *pSoup, const Vector &a, const Vector &b, const Vector &c, int materialIndex7bits) {
-	NOT_IMPLEMENTED
+	if (!pSoup) return;
+
+	btVector3 verts[3];
+	ConvertPosToBull(a, verts[0]);
+	ConvertPosToBull(b, verts[1]);
+	ConvertPosToBull(c, verts[2]);
+
+	pSoup->m_triVerts.push_back(verts[0]);
+	pSoup->m_triVerts.push_back(verts[1]);
+	pSoup->m_triVerts.push_back(verts[2]);
 }
 
-// TODO: This will involve convex decomposition, which breaks a concave shape into multiple convex shapes.
-// Too complex to write myself, will need a library to do this. QHull does not support this.
+static ConVar vphysics_polysoup_maxhulls("vphysics_polysoup_maxhulls", "16", FCVAR_ARCHIVE, "Maximum amount of convex pieces a polysoup gets broken up into.", true, 1, true, 256);
+static ConVar vphysics_polysoup_maxverts("vphysics_polysoup_maxverts", "32", FCVAR_ARCHIVE, "Maximum amount of vertices in every convex piece of a polysoup.", true, 4, true, 256);
+static ConVar vphysics_polysoup_concavity("vphysics_polysoup_concavity", "0.01", FCVAR_ARCHIVE, "Concavity (fraction of the size of the model) a polysoup piece may have before it gets split.", true, 0, true, 1);
+
+// Breaks the soup up into convex pieces (it's usually concave)
 CPhysCollide *CPhysicsCollision::ConvertPolysoupToCollide(CPhysPolysoup *pSoup, bool useMOPP) {
-	NOT_IMPLEMENTED
-	return NULL;
+	if (m_pMainContext) return m_pMainContext->ConvertPolysoupToCollide(pSoup, useMOPP);
+	if (!pSoup || pSoup->m_triVerts.size() == 0) return NULL;
+
+	convexdecompparams_t params;
+	params.maxHulls = vphysics_polysoup_maxhulls.GetInt();
+	params.maxVerticesPerHull = vphysics_polysoup_maxverts.GetInt();
+	params.concavity = vphysics_polysoup_concavity.GetFloat();
+
+	btAlignedObjectArray<btVector3> hullVerts;
+	CUtlVector<int> hullVertCounts;
+
+	// Borrow the thread pool of an environment that isn't using it. Only the main thread can have one
+	// (the environment list isn't locked either), loader threads do the decomposition by themselves.
+	CPhysicsEnvironment *pPoolEnv = NULL;
+	btThreadPool *pPool = NULL;
+	for (int i = 0; ThreadInMainThread() && i < g_Physics.GetActiveEnvironmentCount() && !pPool; i++) {
+		pPoolEnv = (CPhysicsEnvironment *)g_Physics.GetActiveEnvironmentByIndex(i);
+		pPool = pPoolEnv->AcquireSharedThreadPool();
+	}
+
+	DecomposeConvex(&pSoup->m_triVerts[0], pSoup->m_triVerts.size() / 3, params, pPool, hullVerts, hullVertCounts);
+
+	if (pPool)
+		pPoolEnv->ReleaseSharedThreadPool();
+
+	CUtlVector<CPhysConvex *> convexes;
+	int curVert = 0;
+	for (int i = 0; i < hullVertCounts.Count(); i++) {
+		CPhysConvex *pConvex = ConvexFromBullVerts(&hullVerts[curVert], hullVertCounts[i]);
+		curVert += hullVertCounts[i];
+
+		if (pConvex)
+			convexes.AddToTail(pConvex);
+	}
+
+	if (convexes.Count() == 0)
+		return NULL;
+
+	return ConvertConvexToCollide(convexes.Base(), convexes.Count());
 }
 
 CPhysCollide *CPhysicsCollision::ConvertConvexToCollide(CPhysConvex **ppConvex, int convexCount) {
@@ -486,6 +796,14 @@ CPhysCollide *CPhysicsCollision::ConvertConvexToCollideParams(CPhysConvex **pCon
 void CPhysicsCollision::AddConvexToCollide(CPhysCollide *pCollide, const CPhysConvex *pConvex, const matrix3x4_t *xform) {
 	if (!pCollide || !pConvex) return;
 
+	// Objects in a running step may be using the collide
+	g_Physics.WaitForSimulations();
+
+	if (!DetachSolid(pCollide)) {
+		Warning("AddConvexToCollide: Collide is shared with other loads of the same model, ignoring!\n");
+		return;
+	}
+
 	if (pCollide->IsCompound()) {
 		btCompoundShape *pCompound = pCollide->GetCompoundShape();
 		btCollisionShape *pShape = (btCollisionShape *)pConvex;
@@ -496,18 +814,27 @@ void CPhysicsCollision::AddConvexToCollide(CPhysCollide *pCollide, const CPhysCo
 		}
 
 		pCompound->addChildShape(trans, pShape);
+		pCollide->InvalidateBuoyancyData();
 	}
 }
 
 void CPhysicsCollision::RemoveConvexFromCollide(CPhysCollide *pCollide, const CPhysConvex *pConvex) {
 	if (!pCollide || !pConvex) return;
 
+	g_Physics.WaitForSimulations();
+
+	if (!DetachSolid(pCollide)) {
+		Warning("RemoveConvexFromCollide: Collide is shared with other loads of the same model, ignoring!\n");
+		return;
+	}
+
 	if (pCollide->IsCompound()) {
 		btCompoundShape *pCompound = pCollide->GetCompoundShape();
 		btCollisionShape *pShape = (btCollisionShape *)pConvex;
 
 		// FIXME: Need to recalculate the aabb tree or something
 		pCompound->removeChildShape(pShape);
+		pCollide->InvalidateBuoyancyData();
 	}
 }
 
@@ -517,7 +844,7 @@ CPhysCollide *CPhysicsCollision::CreateCollide() {
 }
 
 void CPhysicsCollision::DestroyCollide(CPhysCollide *pCollide) {
-	if (!pCollide || IsCachedBBox(pCollide)) return;
+	if (!pCollide || pCollide->IsCachedSolid() || ReleasePrimitive(pCollide)) return;
 
 	btCollisionShape *pShape = pCollide->GetCollisionShape();
 
@@ -567,20 +894,426 @@ void CPhysicsCollision::DestroyCollide(CPhysCollide *pCollide) {
 	}
 }
 
+/****************************
+* Collide serialization
+****************************/
+
+static inline int AlignTo16(int size) {
+	return (size + 15) & ~15;
+}
+
+// Finds the mesh data of a convex we know how to write. Primitives don't have any.
+static bool GetConvexMeshData(const btCollisionShape *pShape, const btVector3 **ppVerts, int *pNumVerts, const unsigned short **ppIndices, int *pNumTris) {
+	*ppVerts = NULL;
+	*ppIndices = NULL;
+	*pNumVerts = 0;
+	*pNumTris = 0;
+
+	switch (pShape->getShapeType()) {
+		case CONVEX_TRIANGLEMESH_SHAPE_PROXYTYPE: {
+			btTriangleIndexVertexArray *pArr = (btTriangleIndexVertexArray *)((btConvexTriangleMeshShape *)pShape)->getMeshInterface();
+			if (pArr->getIndexedMeshArray().size() != 1) return false;
+
+			const btIndexedMesh &mesh = pArr->getIndexedMeshArray()[0];
+			if (mesh.m_vertexStride != sizeof(btVector3) || mesh.m_triangleIndexStride != 3 * sizeof(unsigned short))
+				return false;
+
+			*ppVerts = (const btVector3 *)mesh.m_vertexBase;
+			*ppIndices = (const unsigned short *)mesh.m_triangleIndexBase;
+			*pNumTris = mesh.m_numTriangles;
+
+			// Don't trust m_numVertices, the ledge converter leaves the last vertex out of it
+			int numVerts = mesh.m_numVertices;
+			for (int i = 0; i < mesh.m_numTriangles * 3; i++) {
+				if ((*ppIndices)[i] >= numVerts)
+					numVerts = (*ppIndices)[i] + 1;
+			}
+
+			*pNumVerts = numVerts;
+			return true;
+		}
+		case CONVEX_HULL_SHAPE_PROXYTYPE:
+			*ppVerts = ((btConvexHullShape *)pShape)->getUnscaledPoints();
+			*pNumVerts = ((btConvexHullShape *)pShape)->getNumPoints();
+			return true;
+		case BOX_SHAPE_PROXYTYPE:
+		case SPHERE_SHAPE_PROXYTYPE:
+		case CYLINDER_SHAPE_PROXYTYPE:
+		case CONE_SHAPE_PROXYTYPE:
+			return true;
+	}
+
+	return false;
+}
+
+// Size of everything after the collideheader_t, or 0 if we can't write this collide
+static int GetBulletCollideSize(const CPhysCollide *pCollide) {
+	if (!pCollide->IsCompound()) return 0;
+
+	const btCompoundShape *pCompound = pCollide->GetCompoundShape();
+	int size = sizeof(bulletcollide_t) + pCompound->getNumChildShapes() * sizeof(bulletconvex_t);
+
+	for (int i = 0; i < pCompound->getNumChildShapes(); i++) {
+		const btVector3 *pVerts;
+		const unsigned short *pIndices;
+		int numVerts, numTris;
+		if (!GetConvexMeshData(pCompound->getChildShape(i), &pVerts, &numVerts, &pIndices, &numTris))
+			return 0;
+
+		size += numVerts * 4 * sizeof(float);
+		size += AlignTo16(numTris * 3 * sizeof(unsigned short));
+	}
+
+	return size;
+}
+
+// True if count elements of elemSize starting at offset fit in dataSize. Doesn't overflow on garbage counts.
+static bool IsRangeInData(int offset, int count, int elemSize, int dataSize) {
+	if (offset < 0 || count < 0 || offset > dataSize) return false;
+	return count <= (dataSize - offset) / elemSize;
+}
+
+// Swaps a bulletcollide_t and everything it points to in place.
+// bNative tells us if the data is currently in our byte order, so we know whether to read the counts and offsets
+// before or after swapping them. Returns false (leaving the data half swapped) if anything points outside of dataSize.
+static bool SwapBulletCollide(bulletcollide_t *pHeader, bool bNative, int dataSize) {
+	CByteswap swap;
+	swap.ActivateByteSwapping(true);
+
+	bulletcollide_t header = *pHeader;
+	swap.SwapFieldsToTargetEndian(pHeader);
+	if (!bNative)
+		header = *pHeader;
+
+	if (!IsRangeInData(header.convexOffset, header.numConvexes, sizeof(bulletconvex_t), dataSize))
+		return false;
+
+	bulletconvex_t *pConvexes = (bulletconvex_t *)((char *)pHeader + header.convexOffset);
+	for (int i = 0; i < header.numConvexes; i++) {
+		bulletconvex_t *pConvex = &pConvexes[i];
+
+		bulletconvex_t convex = *pConvex;
+		swap.SwapFieldsToTargetEndian(pConvex);
+		if (!bNative)
+			convex = *pConvex;
+
+		if (convex.numVertices > 0) {
+			if (!IsRangeInData(convex.vertexOffset, convex.numVertices, 4 * sizeof(float), dataSize))
+				return false;
+
+			float *pVerts = (float *)((char *)pHeader + convex.vertexOffset);
+			swap.SwapBufferToTargetEndian(pVerts, pVerts, convex.numVertices * 4);
+		}
+
+		if (convex.numTriangles > 0) {
+			if (!IsRangeInData(convex.indexOffset, convex.numTriangles, 3 * sizeof(unsigned short), dataSize))
+				return false;
+
+			unsigned short *pIndices = (unsigned short *)((char *)pHeader + convex.indexOffset);
+			swap.SwapBufferToTargetEndian(pIndices, pIndices, convex.numTriangles * 3);
+		}
+	}
+
+	return true;
+}
+
+static void WriteBulletConvex(bulletconvex_t *pOut, const btCollisionShape *pShape, const btTransform &trans, const btVector3 &compoundScale) {
+	memset(pOut, 0, sizeof(*pOut));
+
+	// Store the child like it was before the compound got scaled, loading it will scale it back up.
+	for (int i = 0; i < 3; i++) {
+		for (int j = 0; j < 3; j++) {
+			pOut->basis[i * 3 + j] = trans.getBasis()[i][j];
+		}
+
+		pOut->origin[i] = trans.getOrigin()[i] / compoundScale[i];
+	}
+
+	btVector3 scale = pShape->getLocalScaling();
+	for (int i = 0; i < 3; i++) {
+		pOut->scale[i] = scale[i] / compoundScale[i];
+	}
+
+	pOut->margin = pShape->getMargin();
+	pOut->shapeType = pShape->getShapeType();
+	pOut->gameData = pShape->getUserData();
+
+	// Constructor arguments, these stay the same no matter how the shape gets scaled.
+	switch (pShape->getShapeType()) {
+		case BOX_SHAPE_PROXYTYPE:
+		case CYLINDER_SHAPE_PROXYTYPE: {
+			const btConvexInternalShape *pConvex = (const btConvexInternalShape *)pShape;
+			btVector3 margin(pConvex->getMargin(), pConvex->getMargin(), pConvex->getMargin());
+			btVector3 halfExtents = (pConvex->getImplicitShapeDimensions() + margin) / scale;
+			for (int i = 0; i < 3; i++) {
+				pOut->params[i] = halfExtents[i];
+			}
+
+			break;
+		}
+		case SPHERE_SHAPE_PROXYTYPE:
+			pOut->params[0] = ((const btSphereShape *)pShape)->getImplicitShapeDimensions().getX();
+			break;
+		case CONE_SHAPE_PROXYTYPE: {
+			const btConeShape *pCone = (const btConeShape *)pShape;
+			pOut->params[0] = pCone->getRadius() / ((scale[0] + scale[2]) / 2);
+			pOut->params[1] = pCone->getHeight() / scale[1];
+			break;
+		}
+	}
+}
+
+static btCollisionShape *ReadBulletConvex(const bulletcollide_t *pHeader, const bulletconvex_t *pIn) {
+	btCollisionShape *pShape = NULL;
+
+	switch (pIn->shapeType) {
+		case CONVEX_TRIANGLEMESH_SHAPE_PROXYTYPE: {
+			if (pIn->numVertices <= 0 || pIn->numTriangles <= 0) return NULL;
+
+			const unsigned short *pSrcIndices = (const unsigned short *)((const char *)pHeader + pIn->indexOffset);
+			for (int i = 0; i < pIn->numTriangles * 3; i++) {
+				if (pSrcIndices[i] >= pIn->numVertices) {
+					Warning("UnserializeCollide: Triangle index %d out of range (%d vertices)\n", pSrcIndices[i], pIn->numVertices);
+					return NULL;
+				}
+			}
+
+			const float *pSrcVerts = (const float *)((const char *)pHeader + pIn->vertexOffset);
+			btVector3 *pVerts = new btVector3[pIn->numVertices];
+			for (int i = 0; i < pIn->numVertices; i++) {
+				pVerts[i].setValue(pSrcVerts[i * 4], pSrcVerts[i * 4 + 1], pSrcVerts[i * 4 + 2]);
+			}
+
+			unsigned short *pIndices = new unsigned short[pIn->numTriangles * 3];
+			memcpy(pIndices, pSrcIndices, pIn->numTriangles * 3 * sizeof(unsigned short));
+
+			btIndexedMesh mesh;
+			mesh.m_numTriangles = pIn->numTriangles;
+			mesh.m_numVertices = pIn->numVertices;
+			mesh.m_vertexBase = (unsigned char *)pVerts;
+			mesh.m_vertexStride = sizeof(btVector3);
+			mesh.m_vertexType = PHY_FLOAT;
+			mesh.m_triangleIndexBase = (unsigned char *)pIndices;
+			mesh.m_triangleIndexStride = 3 * sizeof(unsigned short);
+
+			btTriangleIndexVertexArray *pMesh = new btTriangleIndexVertexArray;
+			pMesh->addIndexedMesh(mesh, PHY_SHORT);
+
+			pShape = new btConvexTriangleMeshShape(pMesh);
+			break;
+		}
+		case CONVEX_HULL_SHAPE_PROXYTYPE: {
+			if (pIn->numVertices <= 0) return NULL;
+
+			// Vertices are stored with btVector3's layout
+			btConvexHullShape *pHull = new btConvexHullShape(NULL, 0);
+			const float *pSrcVerts = (const float *)((const char *)pHeader + pIn->vertexOffset);
+			for (int i = 0; i < pIn->numVertices; i++) {
+				pHull->addPoint(btVector3(pSrcVerts[i * 4], pSrcVerts[i * 4 + 1], pSrcVerts[i * 4 + 2]), false);
+			}
+
+			pHull->recalcLocalAabb();
+			pShape = pHull;
+			break;
+		}
+		case BOX_SHAPE_PROXYTYPE:
+			pShape = new btBoxShape(btVector3(pIn->params[0], pIn->params[1], pIn->params[2]));
+			break;
+		case SPHERE_SHAPE_PROXYTYPE:
+			pShape = new btSphereShape(pIn->params[0]);
+			break;
+		case CYLINDER_SHAPE_PROXYTYPE:
+			pShape = new btCylinderShape(btVector3(pIn->params[0], pIn->params[1], pIn->params[2]));
+			break;
+		case CONE_SHAPE_PROXYTYPE:
+			pShape = new btConeShape(pIn->params[0], pIn->params[1]);
+			break;
+		default:
+			Warning("UnserializeCollide: Unknown shape type %d\n", pIn->shapeType);
+			return NULL;
+	}
+
+	if (pIn->shapeType != SPHERE_SHAPE_PROXYTYPE) // Spheres use their radius as the margin
+		pShape->setMargin(pIn->margin);
+
+	pShape->setLocalScaling(btVector3(pIn->scale[0], pIn->scale[1], pIn->scale[2]));
+	pShape->setUserData(pIn->gameData);
+
+	return pShape;
+}
+
+static CPhysCollide *LoadBulletCollide(void *pSolid, int size) {
+	int dataSize = size - sizeof(collideheader_t);
+	if (dataSize < (int)sizeof(bulletcollide_t)) return NULL;
+
+	bulletcollide_t *pHeader = (bulletcollide_t *)((char *)pSolid + sizeof(collideheader_t));
+	if (pHeader->endianTag == BULLET_COLLIDE_ENDIAN_SWAPPED) {
+		// Written on a machine with the other byte order, fix it up in place.
+		if (!SwapBulletCollide(pHeader, false, dataSize)) {
+			Warning("UnserializeCollide: Corrupted collide\n");
+			return NULL;
+		}
+	} else if (pHeader->endianTag != BULLET_COLLIDE_ENDIAN) {
+		Warning("UnserializeCollide: Bad endian tag %x\n", pHeader->endianTag);
+		return NULL;
+	}
+
+	if (pHeader->version != BULLET_COLLIDE_VERSION) {
+		Warning("UnserializeCollide: Unsupported version %d (expected %d)\n", pHeader->version, BULLET_COLLIDE_VERSION);
+		return NULL;
+	}
+
+	if (!IsRangeInData(pHeader->convexOffset, pHeader->numConvexes, sizeof(bulletconvex_t), dataSize)) {
+		Warning("UnserializeCollide: Corrupted collide\n");
+		return NULL;
+	}
+
+	const bulletconvex_t *pConvexes = (const bulletconvex_t *)((char *)pHeader + pHeader->convexOffset);
+	btCompoundShape *pCompound = new btCompoundShape(pHeader->numConvexes > 1); // Pointless for an AABB tree if it's just one convex
+	CPhysCollide *pCollide = new CPhysCollide(pCompound);
+
+	for (int i = 0; i < pHeader->numConvexes; i++) {
+		const bulletconvex_t &convex = pConvexes[i];
+		if (!IsRangeInData(convex.vertexOffset, convex.numVertices, 4 * sizeof(float), dataSize)
+		 || !IsRangeInData(convex.indexOffset, convex.numTriangles, 3 * sizeof(unsigned short), dataSize)) {
+			Warning("UnserializeCollide: Corrupted convex %d\n", i);
+			continue;
+		}
+
+		btCollisionShape *pShape = ReadBulletConvex(pHeader, &convex);
+		if (!pShape) continue;
+
+		btMatrix3x3 basis(convex.basis[0], convex.basis[1], convex.basis[2],
+						  convex.basis[3], convex.basis[4], convex.basis[5],
+						  convex.basis[6], convex.basis[7], convex.basis[8]);
+		pCompound->addChildShape(btTransform(basis, btVector3(convex.origin[0], convex.origin[1], convex.origin[2])), pShape);
+	}
+
+	pCompound->setMargin(pHeader->margin);
+
+	btVector3 scale(pHeader->scale[0], pHeader->scale[1], pHeader->scale[2]);
+	if (scale != btVector3(1, 1, 1))
+		pCompound->setLocalScaling(scale);
+
+	pCollide->SetMassCenter(btVector3(pHeader->massCenter[0], pHeader->massCenter[1], pHeader->massCenter[2]));
+	pCollide->SetRotationInertia(btVector3(pHeader->rotInertia[0], pHeader->rotInertia[1], pHeader->rotInertia[2]));
+
+	return pCollide;
+}
+
 int CPhysicsCollision::CollideSize(CPhysCollide *pCollide) {
-	NOT_IMPLEMENTED
-	return 0;
+	if (!pCollide) return 0;
+
+	int size = GetBulletCollideSize(pCollide);
+	if (size == 0) return 0;
+
+	return sizeof(collideheader_t) + size;
 }
 
-// TODO: Design a new file format
+// Writes a solid in the same layout VCollideLoad reads (the collideheader_t size excludes the size field itself)
 int CPhysicsCollision::CollideWrite(char *pDest, CPhysCollide *pCollide, bool swap) {
-	NOT_IMPLEMENTED
-	return 0;
+	if (!pDest || !pCollide) return 0;
+
+	int dataSize = GetBulletCollideSize(pCollide);
+	if (dataSize == 0) {
+		Warning("CollideWrite: Can't write this kind of collide!\n");
+		return 0;
+	}
+
+	int totalSize = sizeof(collideheader_t) + dataSize;
+	memset(pDest, 0, totalSize);
+
+	collideheader_t *pColHeader = (collideheader_t *)pDest;
+	pColHeader->size = totalSize - sizeof(int);
+	pColHeader->vphysicsID = VPHYSICS_ID;
+	pColHeader->version = 0x100;
+	pColHeader->modelType = COLLIDE_TYPE_BULLET;
+
+	const btCompoundShape *pCompound = pCollide->GetCompoundShape();
+	btVector3 compoundScale = pCompound->getLocalScaling();
+
+	bulletcollide_t *pHeader = (bulletcollide_t *)(pDest + sizeof(collideheader_t));
+	pHeader->endianTag = BULLET_COLLIDE_ENDIAN;
+	pHeader->version = BULLET_COLLIDE_VERSION;
+	pHeader->numConvexes = pCompound->getNumChildShapes();
+	pHeader->convexOffset = sizeof(bulletcollide_t);
+	pHeader->margin = pCompound->getMargin();
+
+	for (int i = 0; i < 3; i++) {
+		pHeader->massCenter[i] = pCollide->GetMassCenter()[i];
+		pHeader->rotInertia[i] = pCollide->GetRotationInertia()[i];
+		pHeader->scale[i] = compoundScale[i];
+	}
+
+	// Mesh data goes after the convex table
+	bulletconvex_t *pConvexes = (bulletconvex_t *)((char *)pHeader + pHeader->convexOffset);
+	int offset = pHeader->convexOffset + pHeader->numConvexes * sizeof(bulletconvex_t);
+
+	for (int i = 0; i < pHeader->numConvexes; i++) {
+		const btCollisionShape *pShape = pCompound->getChildShape(i);
+		bulletconvex_t *pConvex = &pConvexes[i];
+		WriteBulletConvex(pConvex, pShape, pCompound->getChildTransform(i), compoundScale);
+
+		const btVector3 *pVerts;
+		const unsigned short *pIndices;
+		int numVerts, numTris;
+		GetConvexMeshData(pShape, &pVerts, &numVerts, &pIndices, &numTris);
+
+		if (numVerts > 0) {
+			pConvex->numVertices = numVerts;
+			pConvex->vertexOffset = offset;
+
+			float *pOutVerts = (float *)((char *)pHeader + offset);
+			for (int j = 0; j < numVerts; j++) {
+				pOutVerts[j * 4 + 0] = pVerts[j].x();
+				pOutVerts[j * 4 + 1] = pVerts[j].y();
+				pOutVerts[j * 4 + 2] = pVerts[j].z();
+			}
+
+			offset += numVerts * 4 * sizeof(float);
+		}
+
+		if (numTris > 0) {
+			pConvex->numTriangles = numTris;
+			pConvex->indexOffset = offset;
+			memcpy((char *)pHeader + offset, pIndices, numTris * 3 * sizeof(unsigned short));
+
+			offset += AlignTo16(numTris * 3 * sizeof(unsigned short));
+		}
+	}
+
+	Assert(offset == dataSize);
+
+	if (swap) {
+		SwapBulletCollide(pHeader, true, dataSize);
+
+		CByteswap byteswap;
+		byteswap.ActivateByteSwapping(true);
+		byteswap.SwapFieldsToTargetEndian(pColHeader);
+	}
+
+	return totalSize;
 }
 
+// pBuffer is what CollideWrite wrote
 CPhysCollide *CPhysicsCollision::UnserializeCollide(char *pBuffer, int size, int index) {
-	NOT_IMPLEMENTED
-	return NULL;
+	if (!pBuffer || size < (int)sizeof(collideheader_t)) return NULL;
+
+	collideheader_t *pColHeader = (collideheader_t *)pBuffer;
+
+	// Written with swap (LoadBulletCollide fixes up the rest by the endian tag)
+	if (pColHeader->vphysicsID == VPHYSICS_ID_SWAPPED) {
+		CByteswap byteswap;
+		byteswap.ActivateByteSwapping(true);
+		byteswap.SwapFieldsToTargetEndian(pColHeader);
+	}
+
+	if (pColHeader->vphysicsID != VPHYSICS_ID || pColHeader->modelType != COLLIDE_TYPE_BULLET) {
+		Warning("UnserializeCollide: Not a collide we wrote (id: %.4s type: %d)\n", (char *)&pColHeader->vphysicsID, pColHeader->modelType);
+		return NULL;
+	}
+
+	return LoadBulletCollide(pBuffer, size);
 }
 
 float CPhysicsCollision::CollideVolume(CPhysCollide *pCollide) {
@@ -715,6 +1448,13 @@ void CPhysicsCollision::CollideGetMassCenter(CPhysCollide *pCollide, Vector *pOu
 void CPhysicsCollision::CollideSetMassCenter(CPhysCollide *pCollide, const Vector &massCenter) {
 	if (!pCollide) return;
 
+	g_Physics.WaitForSimulations();
+
+	if (!DetachSolid(pCollide)) {
+		Warning("CollideSetMassCenter: Collide is shared with other loads of the same model, ignoring!\n");
+		return;
+	}
+
 	btCollisionShape *pShape = pCollide->GetCollisionShape();
 
 	btVector3 bullMassCenter;
@@ -730,6 +1470,8 @@ void CPhysicsCollision::CollideSetMassCenter(CPhysCollide *pCollide, const Vecto
 			childTrans.setOrigin(childTrans.getOrigin() + offset);
 			pCompound->updateChildTransform(i, childTrans);
 		}
+
+		pCollide->InvalidateBuoyancyData();
 	}
 
 	pCollide->SetMassCenter(bullMassCenter);
@@ -748,6 +1490,13 @@ void CPhysicsCollision::CollideSetOrthographicAreas(CPhysCollide *pCollide, cons
 void CPhysicsCollision::CollideSetScale(CPhysCollide *pCollide, const Vector &scale) {
 	if (!pCollide) return;
 
+	g_Physics.WaitForSimulations();
+
+	if (!DetachSolid(pCollide)) {
+		Warning("CollideSetScale: Collide is shared with other loads of the same model, ignoring!\n");
+		return;
+	}
+
 	if (pCollide->IsCompound()) {
 		btCompoundShape *pCompound = pCollide->GetCompoundShape();
 
@@ -756,7 +1505,14 @@ void CPhysicsCollision::CollideSetScale(CPhysCollide *pCollide, const Vector &sc
 		bullScale.setY(scale.z);
 		bullScale.setZ(scale.y);
 
+		// Scaling changes the children, so they can't be shared with anybody else
+		btCompoundShapeChild *pChildren = pCompound->getChildList();
+		for (int i = 0; i < pCompound->getNumChildShapes(); i++) {
+			pChildren[i].m_childShape = UnsharePrimitive(pChildren[i].m_childShape);
+		}
+
 		pCompound->setLocalScaling(bullScale);
+		pCollide->InvalidateBuoyancyData();
 	}
 }
 
@@ -791,84 +1547,141 @@ int CPhysicsCollision::GetConvexesUsedInCollideable(const CPhysCollide *pCollide
 	return numSolids > iOutputArrayLimit ? iOutputArrayLimit : numSolids;
 }
 
-CPhysCollide *CPhysicsCollision::GetCachedBBox(const Vector &mins, const Vector &maxs) {
-	for (int i = 0; i < m_bboxCache.Count(); i++) {
-		bboxcache_t &cache = m_bboxCache[i];
-
-		if (cache.mins == mins && cache.maxs == maxs)
-			return cache.pCollide;
+static void InitPrimitiveKey(primitivekey_t &key, EPrimitiveType type, const float *pParams, int numParams) {
+	memset(&key, 0, sizeof(key));
+	key.type = type;
+	for (int i = 0; i < numParams; i++) {
+		key.params[i] = pParams[i];
 	}
+}
 
-	return NULL;
+static void InitPrimitiveKey(primitivekey_t &key, EPrimitiveType type, const Vector &mins, const Vector &maxs) {
+	float params[6] = {mins.x, mins.y, mins.z, maxs.x, maxs.y, maxs.z};
+	InitPrimitiveKey(key, type, params, 6);
+}
+
+CPhysCollide *CPhysicsCollision::GetCachedBBox(const Vector &mins, const Vector &maxs) {
+	primitivekey_t key;
+	InitPrimitiveKey(key, PRIMITIVE_BBOXCOLLIDE, mins, maxs);
+	return (CPhysCollide *)FindPrimitive(key, false);
 }
 
 void CPhysicsCollision::AddCachedBBox(CPhysCollide *pModel, const Vector &mins, const Vector &maxs) {
-	int idx = m_bboxCache.AddToTail();
-	bboxcache_t &cache = m_bboxCache[idx];
-	cache.pCollide = pModel;
-	cache.mins = mins;
-	cache.maxs = maxs;
+	if (!pModel) return;
+
+	primitivekey_t key;
+	InitPrimitiveKey(key, PRIMITIVE_BBOXCOLLIDE, mins, maxs);
+	InternPrimitive(key, pModel, 0);
 }
 
 bool CPhysicsCollision::IsCachedBBox(CPhysCollide *pModel) {
-	for (int i = 0; i < m_bboxCache.Count(); i++) {
-		bboxcache_t &cache = m_bboxCache[i];
+	if (m_pMainContext) return m_pMainContext->IsCachedBBox(pModel);
 
-		if (cache.pCollide == pModel)
-			return true;
-	}
+	AUTO_LOCK(m_primitiveCacheMutex);
 
-	return false;
+	UtlHashHandle_t h = m_primitiveShapes.Find((uintp)pModel);
+	if (h == m_primitiveShapes.InvalidHandle())
+		return false;
+
+	UtlHashHandle_t entry = m_primitiveCache.Find(m_primitiveShapes.Element(h));
+	return m_primitiveCache.Element(entry).key.type == PRIMITIVE_BBOXCOLLIDE;
 }
 
+// The cache owns bbox collides (old vphysics behavior), so all of them are destroyed.
+// Other primitives are destroyed by their last user, the box convexes of these collides included.
 void CPhysicsCollision::ClearBBoxCache() {
-	for (int i = m_bboxCache.Count() - 1; i >= 0; i--) {
-		bboxcache_t &cache = m_bboxCache[i];
+	if (m_pMainContext) return m_pMainContext->ClearBBoxCache();
+
+	AUTO_LOCK(m_primitiveCacheMutex);
+
+	// By key, destroying a collide releases its box convex (which may shuffle the table)
+	CUtlVector<unsigned int> removed;
+	for (UtlHashHandle_t h = m_primitiveCache.FirstHandle(); h != m_primitiveCache.InvalidHandle(); h = m_primitiveCache.NextHandle(h)) {
+		if (m_primitiveCache.Element(h).key.type == PRIMITIVE_BBOXCOLLIDE)
+			removed.AddToTail(m_primitiveCache.Key(h));
+	}
+
+	for (int i = 0; i < removed.Count(); i++) {
+		UtlHashHandle_t h = m_primitiveCache.Find(removed[i]);
+		primitivecache_t entry = m_primitiveCache.Element(h);
+		m_primitiveCache.RemoveByHandle(h);
+		m_primitiveShapes.Remove((uintp)entry.pShape);
 
 		// Remove the cache first so DestroyCollide doesn't stop.
-		CPhysCollide *pCollide = cache.pCollide;
-		m_bboxCache.Remove(i);
+		DestroyCollide((CPhysCollide *)entry.pShape);
+	}
+}
 
-		DestroyCollide(pCollide);
+static int GetPrimitiveSize(const primitivecache_t &entry) {
+	switch (entry.key.type) {
+		case PRIMITIVE_BBOXCOLLIDE:
+			// The box convex has its own entry
+			return sizeof(CPhysCollide) + sizeof(btCompoundShape) + sizeof(btCompoundShapeChild);
+		case PRIMITIVE_BOX:
+			return sizeof(btBoxShape);
+		case PRIMITIVE_CYLINDER:
+			return sizeof(btCylinderShape);
+		case PRIMITIVE_CONE:
+			return sizeof(btConeShape);
+		case PRIMITIVE_SPHERE:
+			return sizeof(btSphereShape);
 	}
+
+	return 0;
 }
 
+// pCachedSize is the memory used by the interned shapes in bytes, pCachedCount is the amount of interned shapes.
 bool CPhysicsCollision::GetBBoxCacheSize(int *pCachedSize, int *pCachedCount) {
-	// pCachedSize is size in bytes
+	if (m_pMainContext) return m_pMainContext->GetBBoxCacheSize(pCachedSize, pCachedCount);
+
+	AUTO_LOCK(m_primitiveCacheMutex);
+
+	int size = 0, inUse = 0;
+	for (UtlHashHandle_t h = m_primitiveCache.FirstHandle(); h != m_primitiveCache.InvalidHandle(); h = m_primitiveCache.NextHandle(h)) {
+		const primitivecache_t &entry = m_primitiveCache.Element(h);
+		size += GetPrimitiveSize(entry);
+		if (entry.refCount > 0)
+			inUse++;
+	}
+
 	if (pCachedSize)
-		*pCachedSize = m_bboxCache.Size();
+		*pCachedSize = size;
 
 	if (pCachedCount)
-		*pCachedCount = m_bboxCache.Count();
+		*pCachedCount = m_primitiveCache.Count();
 
-	// Bool return value is never used.
-	return false;
+	// Bool return value is never used (we return whether anything is still in use).
+	return inUse > 0;
 }
 
 void CPhysicsCollision::EnableBBoxCache(bool enable) {
+	if (m_pMainContext) return m_pMainContext->EnableBBoxCache(enable);
+
 	m_enableBBoxCache = enable;
 }
 
 bool CPhysicsCollision::IsBBoxCacheEnabled() {
+	if (m_pMainContext) return m_pMainContext->IsBBoxCacheEnabled();
+
 	return m_enableBBoxCache;
 }
 
 CPhysConvex *CPhysicsCollision::BBoxToConvex(const Vector &mins, const Vector &maxs) {
 	if (mins == maxs) return NULL;
 
-	btVector3 btmins, btmaxs;
-	ConvertAABBToBull(mins, maxs, btmins, btmaxs);
-	btVector3 halfExtents = (btmaxs - btmins) / 2;
-
-	btBoxShape *box = new btBoxShape(halfExtents);
-
-	return (CPhysConvex *)box;
+	primitivekey_t key;
+	InitPrimitiveKey(key, PRIMITIVE_BOX, mins, maxs);
+	return (CPhysConvex *)GetPrimitiveConvex(key);
 }
 
 CPhysCollide *CPhysicsCollision::BBoxToCollide(const Vector &mins, const Vector &maxs) {
 	// consult with the bbox cache first (this is old vphysics behavior)
-	if (m_enableBBoxCache) {
-		CPhysCollide *pCached = GetCachedBBox(mins, maxs);
+	primitivekey_t key;
+	InitPrimitiveKey(key, PRIMITIVE_BBOXCOLLIDE, mins, maxs);
+
+	bool useCache = IsBBoxCacheEnabled();
+	if (useCache) {
+		CPhysCollide *pCached = (CPhysCollide *)FindPrimitive(key, true);
 		if (pCached)
 			return pCached;
 	}
@@ -887,8 +1700,14 @@ CPhysCollide *CPhysicsCollision::BBoxToCollide(const Vector &mins, const Vector
 
 	CPhysCollide *pCollide = new CPhysCollide(pCompound);
 
-	if (m_enableBBoxCache)
-		AddCachedBBox(pCollide, mins, maxs);
+	if (useCache) {
+		// Another thread may have beaten us to it
+		CPhysCollide *pInterned = (CPhysCollide *)InternPrimitive(key, pCollide, 1);
+		if (pInterned != pCollide) {
+			DestroyCollide(pCollide);
+			return pInterned;
+		}
+	}
 
 	return pCollide;
 }
@@ -896,25 +1715,25 @@ CPhysCollide *CPhysicsCollision::BBoxToCollide(const Vector &mins, const Vector
 CPhysConvex *CPhysicsCollision::CylinderToConvex(const Vector &mins, const Vector &maxs) {
 	if (mins == maxs) return NULL;
 
-	btVector3 btmins, btmaxs;
-	ConvertAABBToBull(mins, maxs, btmins, btmaxs);
-	btVector3 halfSize = (btmaxs - btmins) / 2;
-
-	btCylinderShape *pShape = new btCylinderShape(halfSize);
-
-	return (CPhysConvex *)pShape;
+	primitivekey_t key;
+	InitPrimitiveKey(key, PRIMITIVE_CYLINDER, mins, maxs);
+	return (CPhysConvex *)GetPrimitiveConvex(key);
 }
 
 CPhysConvex *CPhysicsCollision::ConeToConvex(const float radius, const float height) {
-	btConeShape *pShape = new btConeShape(ConvertDistanceToBull(radius), ConvertDistanceToBull(height));
-	return (CPhysConvex *)pShape;
+	float params[2] = {radius, height};
+
+	primitivekey_t key;
+	InitPrimitiveKey(key, PRIMITIVE_CONE, params, 2);
+	return (CPhysConvex *)GetPrimitiveConvex(key);
 }
 
 CPhysConvex *CPhysicsCollision::SphereToConvex(const float radius) {
 	if (radius <= 0) return NULL;
 
-	btSphereShape *pShape = new btSphereShape(ConvertDistanceToBull(radius));
-	return (CPhysConvex *)pShape;
+	primitivekey_t key;
+	InitPrimitiveKey(key, PRIMITIVE_SPHERE, &radius, 1);
+	return (CPhysConvex *)GetPrimitiveConvex(key);
 }
 
 void CPhysicsCollision::TraceBox(const Vector &start, const Vector &end, const Vector &mins, const Vector &maxs, const CPhysCollide *pCollide, const Vector &collideOrigin, const QAngle &collideAngles, trace_t *ptr) {
@@ -991,11 +1810,44 @@ class CFilteredConvexResultCallback : public btCollisionWorld::ClosestConvexResu
 		btCollisionShape *m_pShape;
 };
 
+static void SetupTraceObject(btCollisionObject *pObject, const CPhysCollide *pCollide, const btTransform &transform) {
+	pObject->setCollisionShape((btCollisionShape *)pCollide->GetCollisionShape());
+	pObject->setWorldTransform(transform);
+}
+
+static void SetupTraceBox(btBoxShape *pBox, const btVector3 &halfExtents) {
+	// Same as the btBoxShape constructor (the margin can only shrink in setSafeMargin, so reset it first)
+	pBox->setMargin(CONVEX_DISTANCE_MARGIN);
+	pBox->setSafeMargin(halfExtents);
+
+	btScalar margin = pBox->getMargin();
+	pBox->setImplicitShapeDimensions(halfExtents - btVector3(margin, margin, margin));
+}
+
 static ConVar vphysics_visualizetraces("vphysics_visualizetraces", "0", FCVAR_CHEAT, "Visualize physics traces");
 
 void CPhysicsCollision::TraceBox(const Ray_t &ray, unsigned int contentsMask, IConvexInfo *pConvexInfo, const CPhysCollide *pCollide, const Vector &collideOrigin, const QAngle &collideAngles, trace_t *ptr) {
 	if (!pCollide || !ptr) return;
 
+	// Thread contexts reuse their scratch objects. The main interface is traced on from any thread, so it gets new ones every call.
+	if (m_pMainContext) {
+		if (!m_pTraceObject)
+			m_pTraceObject = new btCollisionObject;
+		if (!m_pTraceBox)
+			m_pTraceBox = new btBoxShape(btVector3(1, 1, 1));
+
+		TraceBox(ray, contentsMask, pConvexInfo, pCollide, collideOrigin, collideAngles, ptr, m_pTraceObject, m_pTraceBox);
+		return;
+	}
+
+	btCollisionObject object;
+	btBoxShape box(btVector3(1, 1, 1));
+	TraceBox(ray, contentsMask, pConvexInfo, pCollide, collideOrigin, collideAngles, ptr, &object, &box);
+}
+
+// UNEXPOSED
+void CPhysicsCollision::TraceBox(const Ray_t &ray, unsigned int contentsMask, IConvexInfo *pConvexInfo, const CPhysCollide *pCollide, const Vector &collideOrigin, const QAngle &collideAngles, trace_t *ptr, btCollisionObject *object, btBoxShape *box) {
+
 	// Clear the trace (appears engine does not do this every time)
 	memset(ptr, 0, sizeof(trace_t));
 	ptr->fraction = 1.f;
@@ -1007,9 +1859,7 @@ void CPhysicsCollision::TraceBox(const Ray_t &ray, unsigned int contentsMask, IC
 	btVector3 btvec;
 	btMatrix3x3 btmatrix;
 
-	btCollisionObject *object = new btCollisionObject;
 	btCollisionShape *shape = (btCollisionShape *)pCollide->GetCollisionShape();
-	object->setCollisionShape(shape);
 
 	// Set the object's transform
 	ConvertPosToBull(collideOrigin, btvec);
@@ -1018,7 +1868,7 @@ void CPhysicsCollision::TraceBox(const Ray_t &ray, unsigned int contentsMask, IC
 
 	// Offset it by the mass center (bullet obj centers are at the center of mass)
 	transform *= btTransform(btMatrix3x3::getIdentity(), pCollide->GetMassCenter());
-	object->setWorldTransform(transform);
+	SetupTraceObject(object, pCollide, transform);
 
 	// Setup the start and end positions
 	btVector3 startv, endv;
@@ -1080,7 +1930,7 @@ void CPhysicsCollision::TraceBox(const Ray_t &ray, unsigned int contentsMask, IC
 
 		// extents are half extents, compatible with bullet.
 		ConvertPosToBull(ray.m_Extents, btvec);
-		btBoxShape *box = new btBoxShape(btvec.absolute());
+		SetupTraceBox(box, btvec.absolute());
 
 		CFilteredConvexResultCallback cb(startv, endv, shape, contentsMask, pConvexInfo);
 		btCollisionWorld::objectQuerySingle(box, startt, endt, object, shape, transform, cb, 0.f);
@@ -1150,10 +2000,7 @@ void CPhysicsCollision::TraceBox(const Ray_t &ray, unsigned int contentsMask, IC
 			}
 		}
 
-		delete box;
 	}
-
-	delete object;
 }
 
 void CPhysicsCollision::TraceCollide(const Vector &start, const Vector &end, const CPhysCollide *pSweepCollide, const QAngle &sweepAngles, const CPhysCollide *pCollide, const Vector &collideOrigin, const QAngle &collideAngles, trace_t *pTrace) {
@@ -1291,8 +2138,21 @@ static btConvexShape *LedgeToConvex(const ivpcompactledge_t *ledge) {
 
 		// This code will find all unique indexes and add them to an array. This avoids
 		// adding duplicate points to the convex hull shape (triangle edges can share a vertex)
-		// If you find a better way you can replace this!
+		// Indices are 16 bit and a ledge's points are packed together, so a flag per point is cheap.
+		uint16 maxIndex = 0;
+		for (int j = 0; j < ledge->n_triangles; j++) {
+			for (int k = 0; k < 3; k++) {
+				if (tris[j].c_three_edges[k].start_point_index > maxIndex)
+					maxIndex = tris[j].c_three_edges[k].start_point_index;
+			}
+		}
+
+		CUtlVector<bool> seen;
+		seen.SetCount(maxIndex + 1);
+		memset(seen.Base(), 0, seen.Count() * sizeof(bool));
+
 		CUtlVector<uint16> indices;
+		indices.EnsureCapacity(maxIndex + 1);
 
 		for (int j = 0; j < ledge->n_triangles; j++) {
 			Assert((uint)j == tris[j].tri_index); // Sanity check
@@ -1300,7 +2160,8 @@ static btConvexShape *LedgeToConvex(const ivpcompactledge_t *ledge) {
 			for (int k = 0; k < 3; k++) {
 				uint16 index = tris[j].c_three_edges[k].start_point_index;
 
-				if (indices.Find(index) == -1) {
+				if (!seen[index]) {
+					seen[index] = true;
 					indices.AddToTail(index);
 				}
 			}
@@ -1472,37 +2333,381 @@ void CPhysicsCollision::VCollideLoad(vcollide_t *pOutput, int solidCount, const
 	// Now for the fun part:
 	// We must convert all of the ivp shapes into something we can use.
 	for (int i = 0; i < solidCount; i++) {
-		const collideheader_t &surfaceheader = *(collideheader_t *)pOutput->solids[i];
+		const char *pSolid = (const char *)pOutput->solids[i];
+		int solidSize = ((collideheader_t *)pSolid)->size + sizeof(int);
 
-		if (surfaceheader.vphysicsID	!= VPHYSICS_ID
-		 || surfaceheader.version		!= 0x100) {
-			pOutput->solids[i] = NULL;
-			Warning("VCollideLoad: Skipped solid %d due to invalid id/version (magic: %.4s version: %d)", i+1, surfaceheader.vphysicsID, surfaceheader.version);
-			continue;
+		pOutput->solids[i] = FindOrConvertSolid(pSolid, solidSize, swap, i);
+	}
+}
+
+// Converts a single solid from a VCollide buffer
+static CPhysCollide *ConvertSolid(void *pSolid, int size, bool swap, int solidIndex) {
+	const collideheader_t &surfaceheader = *(collideheader_t *)pSolid;
+
+	if (surfaceheader.vphysicsID	!= VPHYSICS_ID
+	 || surfaceheader.version		!= 0x100) {
+		Warning("VCollideLoad: Skipped solid %d due to invalid id/version (magic: %.4s version: %d)", solidIndex+1, (char *)&surfaceheader.vphysicsID, surfaceheader.version);
+		return NULL;
+	}
+
+	CPhysCollide *pShape = NULL;
+
+	// NOTE: modelType 0 is IVPS, 1 is (mostly unused) MOPP format
+	if (surfaceheader.modelType == 0x0) {
+		pShape = LoadIVPS(pSolid, swap);
+	} else if (surfaceheader.modelType == 0x1) {
+		// One big use of mopps is in old map displacement data
+		// The use is terribly unoptimized (each triangle is its own convex shape)
+		//pShape = LoadMOPP(pSolid, swap);
+
+		// If we leave this as NULL, the game will use CreateVirtualMesh instead.
+	} else if (surfaceheader.modelType == COLLIDE_TYPE_BULLET) {
+		// Already converted (see CollideWrite)
+		pShape = LoadBulletCollide(pSolid, size);
+	} else {
+		Warning("VCollideLoad: Unknown modelType %d (solid %d). Skipped!", surfaceheader.modelType, solidIndex+1);
+	}
+
+	return pShape;
+}
+
+/****************************
+* Solid cache
+****************************/
+
+// Directory for converted solids (in our own format, see CollideWrite). Empty to only cache in memory.
+static ConVar vphysics_solidcache_path("vphysics_solidcache_path", "", FCVAR_ARCHIVE, "Directory to cache converted collision models in (must exist). Empty disables the disk cache.");
+
+// 64 bit FNV-1a
+static uint64 HashBytes(const char *pData, int size) {
+	uint64 hash = 14695981039346656037ULL;
+	for (int i = 0; i < size; i++) {
+		hash ^= (unsigned char)pData[i];
+		hash *= 1099511628211ULL;
+	}
+
+	return hash;
+}
+
+static void GetSolidCacheFileName(uint64 hash, int size, char *pOut, int outSize) {
+	Q_snprintf(pOut, outSize, "%s/%08x%08x_%d.bphy", vphysics_solidcache_path.GetString(), (unsigned int)(hash >> 32), (unsigned int)hash, size);
+}
+
+static CPhysCollide *LoadSolidFromDisk(uint64 hash, int size) {
+	char fileName[MAX_PATH];
+	GetSolidCacheFileName(hash, size, fileName, sizeof(fileName));
+
+	FILE *pFile = fopen(fileName, "rb");
+	if (!pFile) return NULL;
+
+	fseek(pFile, 0, SEEK_END);
+	int fileSize = ftell(pFile);
+	fseek(pFile, 0, SEEK_SET);
+
+	CPhysCollide *pCollide = NULL;
+	if (fileSize > (int)sizeof(collideheader_t)) {
+		char *pBuffer = new char[fileSize];
+		if (fread(pBuffer, fileSize, 1, pFile) == 1)
+			pCollide = g_PhysicsCollision.UnserializeCollide(pBuffer, fileSize, 0);
+
+		delete [] pBuffer;
+	}
+
+	fclose(pFile);
+	return pCollide;
+}
+
+static void SaveSolidToDisk(uint64 hash, int size, CPhysCollide *pCollide) {
+	int bufferSize = g_PhysicsCollision.CollideSize(pCollide);
+	if (bufferSize == 0) return;
+
+	char fileName[MAX_PATH];
+	GetSolidCacheFileName(hash, size, fileName, sizeof(fileName));
+
+	FILE *pFile = fopen(fileName, "wb");
+	if (!pFile) {
+		DevWarning("VPhysics: Couldn't write solid cache file \"%s\"\n", fileName);
+		return;
+	}
+
+	char *pBuffer = new char[bufferSize];
+	g_PhysicsCollision.CollideWrite(pBuffer, pCollide);
+	fwrite(pBuffer, bufferSize, 1, pFile);
+	delete [] pBuffer;
+
+	fclose(pFile);
+}
+
+// Identical solids (the same model loaded by the server and the client, or loaded again after a map change)
+// are only converted once. The cache owns the converted solid until the last VCollideUnload that uses it.
+// The game can only change one in place while it is the only user, see DetachSolid.
+CPhysCollide *CPhysicsCollision::FindOrConvertSolid(const char *pSolid, int size, bool swap, int solidIndex) {
+	if (m_pMainContext) return m_pMainContext->FindOrConvertSolid(pSolid, size, swap, solidIndex);
+
+	uint64 hash = HashBytes(pSolid, size);
+	unsigned int key = (unsigned int)hash;
+
+	AUTO_LOCK(m_solidCacheMutex);
+
+	UtlHashHandle_t h = m_solidCache.Find(key);
+	if (h != m_solidCache.InvalidHandle()) {
+		solidcache_t &entry = m_solidCache.Element(h);
+		if (entry.hash == hash && entry.size == size) {
+			entry.refCount++;
+			return entry.pCollide;
 		}
+	}
+
+	CPhysCollide *pCollide = NULL;
+	bool bUseDisk = !swap && vphysics_solidcache_path.GetString()[0] != '\0';
+	if (bUseDisk)
+		pCollide = LoadSolidFromDisk(hash, size);
 
-		CPhysCollide *pShape = NULL;
+	if (!pCollide) {
+		pCollide = ConvertSolid((void *)pSolid, size, swap, solidIndex);
+		if (pCollide && bUseDisk)
+			SaveSolidToDisk(hash, size, pCollide);
+	}
 
-		// NOTE: modelType 0 is IVPS, 1 is (mostly unused) MOPP format
-		if (surfaceheader.modelType == 0x0) {
-			pShape = LoadIVPS(pOutput->solids[i], swap);
-		} else if (surfaceheader.modelType == 0x1) {
-			// One big use of mopps is in old map displacement data
-			// The use is terribly unoptimized (each triangle is its own convex shape)
-			//pShape = LoadMOPP(pOutput->solids[i], swap);
+	// Solids the game builds a virtual mesh for come back as NULL. Also leave it alone if another solid has our slot.
+	if (!pCollide || h != m_solidCache.InvalidHandle())
+		return pCollide;
 
-			// If we leave this as NULL, the game will use CreateVirtualMesh instead.
-		} else {
-			Warning("VCollideLoad: Unknown modelType %d (solid %d). Skipped!", surfaceheader.modelType, i+1);
+	solidcache_t entry;
+	entry.pCollide = pCollide;
+	entry.hash = hash;
+	entry.size = size;
+	entry.refCount = 1;
+	m_solidCache.Insert(key, entry);
+
+	pCollide->SetCachedSolid(true, key);
+	return pCollide;
+}
+
+// Solids that aren't cached (on a hash collision) are owned by the vcollide
+void CPhysicsCollision::ReleaseSolid(CPhysCollide *pCollide) {
+	if (m_pMainContext) return m_pMainContext->ReleaseSolid(pCollide);
+
+	if (!pCollide) return;
+
+	if (!pCollide->IsCachedSolid()) {
+		DestroyCollide(pCollide);
+		return;
+	}
+
+	AUTO_LOCK(m_solidCacheMutex);
+
+	UtlHashHandle_t h = m_solidCache.Find(pCollide->GetSolidCacheKey());
+	if (h == m_solidCache.InvalidHandle() || m_solidCache.Element(h).pCollide != pCollide) {
+		Assert(0); // Marked as cached but not in the cache?
+		return;
+	}
+
+	solidcache_t &entry = m_solidCache.Element(h);
+	if (--entry.refCount <= 0) {
+		m_solidCache.RemoveByHandle(h);
+
+		pCollide->SetCachedSolid(false);
+		DestroyCollide(pCollide);
+	}
+}
+
+// The game changes collides in place, and the pointer is its handle, so a cached solid can't be swapped for a copy.
+// Takes the solid out of the cache if only one vcollide uses it (later loads convert their own again).
+// Returns false if other vcollides are using it, the caller should leave it alone then.
+bool CPhysicsCollision::DetachSolid(CPhysCollide *pCollide) {
+	if (m_pMainContext) return m_pMainContext->DetachSolid(pCollide);
+
+	if (!pCollide->IsCachedSolid())
+		return true;
+
+	AUTO_LOCK(m_solidCacheMutex);
+
+	UtlHashHandle_t h = m_solidCache.Find(pCollide->GetSolidCacheKey());
+	if (h == m_solidCache.InvalidHandle() || m_solidCache.Element(h).pCollide != pCollide) {
+		Assert(0); // Marked as cached but not in the cache?
+		return true;
+	}
+
+	if (m_solidCache.Element(h).refCount > 1)
+		return false;
+
+	m_solidCache.RemoveByHandle(h);
+	pCollide->SetCachedSolid(false);
+	return true;
+}
+
+/****************************
+* Primitive shape cache
+****************************/
+
+static btCollisionShape *CreatePrimitiveConvex(const primitivekey_t &key) {
+	const float *p = key.params;
+
+	switch (key.type) {
+		case PRIMITIVE_BOX:
+		case PRIMITIVE_CYLINDER: {
+			btVector3 btmins, btmaxs;
+			ConvertAABBToBull(Vector(p[0], p[1], p[2]), Vector(p[3], p[4], p[5]), btmins, btmaxs);
+			btVector3 halfExtents = (btmaxs - btmins) / 2;
+
+			if (key.type == PRIMITIVE_BOX)
+				return new btBoxShape(halfExtents);
+
+			return new btCylinderShape(halfExtents);
 		}
+		case PRIMITIVE_CONE:
+			return new btConeShape(ConvertDistanceToBull(p[0]), ConvertDistanceToBull(p[1]));
+		case PRIMITIVE_SPHERE:
+			return new btSphereShape(ConvertDistanceToBull(p[0]));
+	}
+
+	return NULL;
+}
+
+// Returns the interned shape for the key (or NULL), addRef counts the caller as a user
+void *CPhysicsCollision::FindPrimitive(const primitivekey_t &key, bool addRef) {
+	if (m_pMainContext) return m_pMainContext->FindPrimitive(key, addRef);
+
+	unsigned int hash = (unsigned int)HashBytes((const char *)&key, sizeof(key));
+
+	AUTO_LOCK(m_primitiveCacheMutex);
+
+	UtlHashHandle_t h = m_primitiveCache.Find(hash);
+	if (h == m_primitiveCache.InvalidHandle())
+		return NULL;
+
+	primitivecache_t &entry = m_primitiveCache.Element(h);
+	if (memcmp(&entry.key, &key, sizeof(key)) != 0)
+		return NULL;
+
+	if (addRef)
+		entry.refCount++;
+
+	return entry.pShape;
+}
+
+// Returns the shape to use, which is the already interned one if somebody else got there first.
+// pShape is returned (and left alone) if another key has its slot.
+void *CPhysicsCollision::InternPrimitive(const primitivekey_t &key, void *pShape, int refCount) {
+	if (m_pMainContext) return m_pMainContext->InternPrimitive(key, pShape, refCount);
+
+	unsigned int hash = (unsigned int)HashBytes((const char *)&key, sizeof(key));
+
+	AUTO_LOCK(m_primitiveCacheMutex);
+
+	UtlHashHandle_t h = m_primitiveCache.Find(hash);
+	if (h != m_primitiveCache.InvalidHandle()) {
+		primitivecache_t &entry = m_primitiveCache.Element(h);
+		if (memcmp(&entry.key, &key, sizeof(key)) != 0)
+			return pShape;
+
+		entry.refCount += refCount;
+		return entry.pShape;
+	}
+
+	primitivecache_t entry;
+	entry.key = key;
+	entry.pShape = pShape;
+	entry.refCount = refCount;
+	m_primitiveCache.Insert(hash, entry);
+	m_primitiveShapes.Insert((uintp)pShape, hash);
+
+	return pShape;
+}
+
+// Returns true if the shape is still interned, in which case the caller must not free it.
+// The last user of a convex gets false back (it's out of the cache by then) and frees it.
+bool CPhysicsCollision::ReleasePrimitive(const void *pShape) {
+	if (m_pMainContext) return m_pMainContext->ReleasePrimitive(pShape);
+
+	AUTO_LOCK(m_primitiveCacheMutex);
+
+	UtlHashHandle_t h = m_primitiveShapes.Find((uintp)pShape);
+	if (h == m_primitiveShapes.InvalidHandle())
+		return false;
+
+	UtlHashHandle_t entryHandle = m_primitiveCache.Find(m_primitiveShapes.Element(h));
+	primitivecache_t &entry = m_primitiveCache.Element(entryHandle);
+	if (entry.refCount > 0)
+		entry.refCount--;
+
+	// The cache owns bbox collides
+	if (entry.refCount > 0 || entry.key.type == PRIMITIVE_BBOXCOLLIDE)
+		return true;
+
+	m_primitiveCache.RemoveByHandle(entryHandle);
+	m_primitiveShapes.RemoveByHandle(h);
+	return false;
+}
+
+btCollisionShape *CPhysicsCollision::GetPrimitiveConvex(const primitivekey_t &key) {
+	if (!IsBBoxCacheEnabled())
+		return CreatePrimitiveConvex(key);
+
+	btCollisionShape *pShape = (btCollisionShape *)FindPrimitive(key, true);
+	if (pShape)
+		return pShape;
+
+	pShape = CreatePrimitiveConvex(key);
+	if (!pShape) return NULL;
+
+	btCollisionShape *pInterned = (btCollisionShape *)InternPrimitive(key, pShape, 1);
+	if (pInterned != pShape)
+		delete pShape;
+
+	return pInterned;
+}
+
+// Swaps an interned convex for a private copy (before we change it)
+btCollisionShape *CPhysicsCollision::UnsharePrimitive(btCollisionShape *pShape) {
+	if (m_pMainContext) return m_pMainContext->UnsharePrimitive(pShape);
+
+	primitivekey_t key;
+	{
+		AUTO_LOCK(m_primitiveCacheMutex);
+
+		UtlHashHandle_t h = m_primitiveShapes.Find((uintp)pShape);
+		if (h == m_primitiveShapes.InvalidHandle())
+			return pShape;
 
-		pOutput->solids[i] = pShape;
+		key = m_primitiveCache.Element(m_primitiveCache.Find(m_primitiveShapes.Element(h))).key;
 	}
+
+	btCollisionShape *pCopy = CreatePrimitiveConvex(key);
+	pCopy->setUserPointer(pShape->getUserPointer());
+	pCopy->setUserData(pShape->getUserData());
+
+	// We were the last user, so nobody else has the interned one anymore
+	if (!ReleasePrimitive(pShape))
+		delete pShape;
+
+	return pCopy;
+}
+
+// Takes an interned shape out of the cache if the caller is its only user, so it's private to them from now on.
+// Returns false if somebody else is using it too.
+bool CPhysicsCollision::DetachPrimitive(const void *pShape) {
+	if (m_pMainContext) return m_pMainContext->DetachPrimitive(pShape);
+
+	AUTO_LOCK(m_primitiveCacheMutex);
+
+	UtlHashHandle_t h = m_primitiveShapes.Find((uintp)pShape);
+	if (h == m_primitiveShapes.InvalidHandle())
+		return true;
+
+	UtlHashHandle_t entryHandle = m_primitiveCache.Find(m_primitiveShapes.Element(h));
+	if (m_primitiveCache.Element(entryHandle).refCount > 1)
+		return false;
+
+	m_primitiveCache.RemoveByHandle(entryHandle);
+	m_primitiveShapes.RemoveByHandle(h);
+	return true;
 }
 
 void CPhysicsCollision::VCollideUnload(vcollide_t *pVCollide) {
 	for (int i = 0; i < pVCollide->solidCount; i++) {
-		DestroyCollide(pVCollide->solids[i]);
+		ReleaseSolid(pVCollide->solids[i]);
 	}
 
 	delete [] pVCollide->solids;
@@ -1583,8 +2788,11 @@ void CPhysicsCollision::DestroyQueryModel(ICollisionQuery *pQuery) {
 	delete pQuery;
 }
 
+// Thread contexts get their own trace scratch objects, everything else is shared with the main context.
 IPhysicsCollision *CPhysicsCollision::ThreadContextCreate() {
-	return new CPhysicsCollision;
+	CPhysicsCollision *pContext = new CPhysicsCollision;
+	pContext->m_pMainContext = m_pMainContext ? m_pMainContext : this;
+	return pContext;
 }
 
 void CPhysicsCollision::ThreadContextDestroy(IPhysicsCollision *pThreadContext) {
@@ -4,21 +4,66 @@
 	#pragma once
 #endif
 
+#include <utlhashtable.h>
+#include <tier0/threadtools.h>
+
+class btCollisionObject;
+class btBoxShape;
+
 // NOTE: There can only be up to 16 unique collision groups (data type of short)!
 enum ECollisionGroups {
 	COLGROUP_NONE	= 0,
 	COLGROUP_WORLD	= 1<<1,
 };
 
-// Because the old vphysics had to do this.
-struct bboxcache_t {
+// Primitive shapes with the same dimensions are interned and shared (because the old vphysics had to do this for bboxes)
+enum EPrimitiveType {
+	PRIMITIVE_BBOXCOLLIDE = 0,	// BBoxToCollide
+	PRIMITIVE_BOX,				// BBoxToConvex
+	PRIMITIVE_CYLINDER,			// CylinderToConvex
+	PRIMITIVE_CONE,				// ConeToConvex
+	PRIMITIVE_SPHERE,			// SphereToConvex
+};
+
+struct primitivekey_t {
+	int		type;
+	float	params[6];	// Arguments the shape was created with (mins/maxs, radius/height...), unused ones are 0
+};
+
+struct primitivecache_t {
+	primitivekey_t	key;
+	void *			pShape;		// CPhysCollide for PRIMITIVE_BBOXCOLLIDE, btCollisionShape otherwise
+	int				refCount;	// Users that haven't freed it yet. Convexes are freed by the last user, bbox collides by ClearBBoxCache
+};
+
+// A converted VCollide solid, shared by every load of a solid with the same contents.
+// Changing a shared one (mass center, scale, adding or removing convexes) is refused, see DetachSolid.
+struct solidcache_t {
 	CPhysCollide *	pCollide;
-	Vector			mins, maxs;
+	uint64			hash;		// Full hash of the solid (the table is keyed by the low 32 bits)
+	int				size;		// Size of the solid data
+	int				refCount;	// Number of loaded vcollides using this
+};
+
+// One convex of a collide, triangulated for clipping against a fluid surface (collision shape space)
+struct buoyancyhull_t {
+	btAlignedObjectArray<btVector3>	verts;
+	btAlignedObjectArray<int>		tris;		// 3 verts per triangle, wound counter-clockwise seen from outside
+	btVector3						centroid;
+	btScalar						radius;		// Bounding sphere around the centroid
+	btScalar						volume;
+};
+
+struct buoyancydata_t {
+	btAlignedObjectArray<buoyancyhull_t>	hulls;
+	btVector3								centroid;	// Of the whole collide
+	btScalar								volume;
 };
 
 class CPhysCollide {
 	public:
 		CPhysCollide(btCollisionShape *pShape);
+		~CPhysCollide();
 
 		const btCollisionShape *GetCollisionShape() const {
 			return m_pShape;
@@ -92,8 +137,42 @@ class CPhysCollide {
 			return m_pShape->isConvex();
 		}
 
+		// Solids loaded through VCollideLoad are owned by the solid cache
+		bool IsCachedSolid() const {
+			return m_bCachedSolid;
+		}
+
+		void SetCachedSolid(bool cached, unsigned int key = 0) {
+			m_bCachedSolid = cached;
+			m_solidCacheKey = key;
+		}
+
+		unsigned int GetSolidCacheKey() const {
+			return m_solidCacheKey;
+		}
+
+		// Built the first time it's asked for, safe to call from multiple threads.
+		// Returns NULL if this isn't a compound.
+		const buoyancydata_t *GetBuoyancyData();
+		void InvalidateBuoyancyData(); // Call when the children change
+
+		// Never reused, so a serial tells a collide apart from a newer one that got the same address
+		unsigned int GetSerial() const {
+			return m_serial;
+		}
+
+		// Returns pCollide if it's still alive and is the collide the serial was taken from, NULL otherwise.
+		// pCollide is never dereferenced, so any stale pointer can be passed in.
+		static CPhysCollide *FindLive(const CPhysCollide *pCollide, unsigned int serial);
+
 	private:
 		btCollisionShape *m_pShape;
+		bool m_bCachedSolid;
+		unsigned int m_solidCacheKey;
+		unsigned int m_serial;
+
+		buoyancydata_t * volatile m_pBuoyancyData;
+		CThreadFastMutex m_buoyancyMutex;
 
 		btVector3 m_rotInertia;
 		btVector3 m_massCenter;
@@ -196,8 +275,36 @@ class CPhysicsCollision : public IPhysicsCollision32 {
 		unsigned int			ReadStat(int statID);
 
 	private:
-		CUtlVector<bboxcache_t> m_bboxCache;
+		CPhysCollide *			FindOrConvertSolid(const char *pSolid, int size, bool swap, int solidIndex);
+		void					ReleaseSolid(CPhysCollide *pCollide);
+		bool					DetachSolid(CPhysCollide *pCollide);
+
+		void *					FindPrimitive(const primitivekey_t &key, bool addRef);
+		void *					InternPrimitive(const primitivekey_t &key, void *pShape, int refCount);
+		bool					ReleasePrimitive(const void *pShape);
+		btCollisionShape *		GetPrimitiveConvex(const primitivekey_t &key);
+		btCollisionShape *		UnsharePrimitive(btCollisionShape *pShape);
+		bool					DetachPrimitive(const void *pShape);
+
+		void					TraceBox(const Ray_t &ray, unsigned int contentsMask, IConvexInfo *pConvexInfo, const CPhysCollide *pCollide, const Vector &collideOrigin, const QAngle &collideAngles, trace_t *ptr, btCollisionObject *pObject, btBoxShape *pBox);
+
+		// Set on contexts made by ThreadContextCreate, caches are shared with (and forwarded to) the main context
+		CPhysicsCollision *		m_pMainContext;
+
+		// Scratch objects reused by every trace in a thread context, so tracing doesn't touch the heap.
+		// Only thread contexts have them, the main interface is used by many threads at once.
+		btCollisionObject *		m_pTraceObject;
+		btBoxShape *			m_pTraceBox;
+
+		// Interned primitives by key hash, and the key hash of every interned shape (so frees can find them quickly)
+		CUtlHashtable<unsigned int, primitivecache_t>	m_primitiveCache;
+		CUtlHashtable<uintp, unsigned int>				m_primitiveShapes;
+		CThreadFastMutex		m_primitiveCacheMutex;
 		bool					m_enableBBoxCache;
+
+		// Converted VCollide solids by content hash. Models can be loaded from other threads, so this has a lock.
+		CUtlHashtable<unsigned int, solidcache_t>	m_solidCache;
+		CThreadFastMutex		m_solidCacheMutex;
 };
 
 extern CPhysicsCollision g_PhysicsCollision;
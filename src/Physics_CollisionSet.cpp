@@ -1,6 +1,8 @@
 #include "StdAfx.h"
 
 #include "Physics_CollisionSet.h"
+#include "Physics.h"
+#include "Physics_Object.h"
 
 // memdbgon must be the last include file in a .cpp file!!!
 #include "tier0/memdbgon.h"
@@ -10,57 +12,113 @@
 ******************************/
 
 // Is this class sort of like CPhysicsObjectPairHash?
-// ShouldCollide is called by game code from the collision event handler in CPhysicsEnvironment
-
-// TODO: Needs a better design, right now it's hardcoded to support a max of 32 entries (sizeof int).
+// Objects put in a set with IPhysicsObject32::SetCollisionSet are filtered by the set in the broadphase,
+// without asking the game's collision solver. Otherwise ShouldCollide is called by game code from its solver.
+// The game shares a set between every instance of a model (ragdolls), so the set only decides pairs with the same
+// game data (the same entity). Pairs from different instances are still up to the game.
 
 // All objects default with no collisions between other objects.
 // The game has to explicitly enable collisions between two objects (IVP behavior)
 
+// Keeps the matrix (MAX_COLLISIONSET_ENTRIES^2 bits, 128 MB) and its word count well within an int
+#define MAX_COLLISIONSET_ENTRIES 32768
+
 CPhysicsCollisionSet::CPhysicsCollisionSet(int iMaxEntries) {
-	Assert(iMaxEntries <= 32);
+	if (iMaxEntries > MAX_COLLISIONSET_ENTRIES) {
+		Warning("CreateCollisionSet: %d entries is too many, clamping to %d\n", iMaxEntries, MAX_COLLISIONSET_ENTRIES);
+		iMaxEntries = MAX_COLLISIONSET_ENTRIES;
+	}
 
-	m_iMaxEntries = iMaxEntries;
+	m_iMaxEntries = MAX(iMaxEntries, 0);
+	m_iRowWords = (m_iMaxEntries + 31) / 32;
 
-	m_collArray = new int[iMaxEntries];
-	for (int i = 0; i < iMaxEntries; i++) {
-		m_collArray[i] = 0;
+	m_bits.SetCount(m_iMaxEntries * m_iRowWords);
+	for (int i = 0; i < m_bits.Count(); i++) {
+		m_bits[i] = 0;
 	}
 }
 
 CPhysicsCollisionSet::~CPhysicsCollisionSet() {
-	delete [] m_collArray;
+	// Members back to being filtered by the game (ClearCollisionSet removes them from our list)
+	while (m_members.Count() > 0) {
+		m_members.Tail()->ClearCollisionSet();
+	}
+}
+
+void CPhysicsCollisionSet::AddMember(CPhysicsObject *pObject) {
+	m_members.AddToTail(pObject);
+}
+
+void CPhysicsCollisionSet::RemoveMember(CPhysicsObject *pObject) {
+	m_members.FindAndFastRemove(pObject);
+}
+
+// Objects in the set cache their filter decisions in the collision solver, the members at the changed indices
+// need new serials. Existing pairs get rechecked, and newly allowed ones get found again by the broadphase.
+void CPhysicsCollisionSet::RecheckMembers(int index0, int index1, bool enabled) {
+	for (int i = 0; i < m_members.Count(); i++) {
+		CPhysicsObject *pObject = m_members[i];
+
+		int index = pObject->GetCollisionSetIndex();
+		if (index != index0 && index != index1) continue;
+
+		pObject->RecheckCollisionFilter();
+
+		// Refreshing one side is enough to find the pairs
+		if (enabled && index == index0)
+			pObject->RefreshBroadphasePairs();
+	}
+}
+
+void CPhysicsCollisionSet::SetBit(int index0, int index1, bool set) {
+	unsigned int &word = m_bits[index0 * m_iRowWords + (index1 >> 5)];
+	if (set)
+		word |= 1u << (index1 & 31);
+	else
+		word &= ~(1u << (index1 & 31));
 }
 
 void CPhysicsCollisionSet::EnableCollisions(int index0, int index1) {
-	Assert((index0 < m_iMaxEntries && index0 >= 0) && (index1 < m_iMaxEntries && index1 >= 0));
-	if ((index0 >= m_iMaxEntries || index0 < 0) || (index1 >= m_iMaxEntries || index1 < 0)) {
+	// Sets aren't tied to an environment, and the broadphase of any of them may be reading this one
+	g_Physics.WaitForSimulations();
+	Assert(IsValidIndex(index0) && IsValidIndex(index1));
+	if (!IsValidIndex(index0) || !IsValidIndex(index1)) {
 		return;
 	}
 
+	if (ShouldCollideFast(index0, index1)) return;
+
 	// Totally stolen from valve!
-	m_collArray[index0] |= 1 << index1;
-	m_collArray[index1] |= 1 << index0;
+	SetBit(index0, index1, true);
+	SetBit(index1, index0, true);
+
+	RecheckMembers(index0, index1, true);
 }
 
 void CPhysicsCollisionSet::DisableCollisions(int index0, int index1) {
-	Assert((index0 < m_iMaxEntries && index0 >= 0) && (index1 < m_iMaxEntries && index1 >= 0));
-	if ((index0 >= m_iMaxEntries || index0 < 0) || (index1 >= m_iMaxEntries || index1 < 0)) {
+	g_Physics.WaitForSimulations();
+	Assert(IsValidIndex(index0) && IsValidIndex(index1));
+	if (!IsValidIndex(index0) || !IsValidIndex(index1)) {
 		return;
 	}
 
-	m_collArray[index0] &= ~(1 << index1);
-	m_collArray[index1] &= ~(1 << index0);
+	if (!ShouldCollideFast(index0, index1)) return;
+
+	SetBit(index0, index1, false);
+	SetBit(index1, index0, false);
+
+	RecheckMembers(index0, index1, false);
 }
 
 bool CPhysicsCollisionSet::ShouldCollide(int index0, int index1) {
-	Assert((index0 < m_iMaxEntries && index0 >= 0) && (index1 < m_iMaxEntries && index1 >= 0));
-	if ((index0 >= m_iMaxEntries || index0 < 0) || (index1 >= m_iMaxEntries || index1 < 0)) {
+	g_Physics.WaitForSimulations();
+	Assert(IsValidIndex(index0) && IsValidIndex(index1));
+	if (!IsValidIndex(index0) || !IsValidIndex(index1)) {
 		return true;
 	}
 
-	return	(((1 << index1) & m_collArray[index0]) != 0) ||
-			(((1 << index0) & m_collArray[index1]) != 0);
+	// The matrix is symmetric, so one bit is enough
+	return ShouldCollideFast(index0, index1);
 }
 
 /*********************
@@ -4,6 +4,8 @@
 	#pragma once
 #endif
 
+class CPhysicsObject;
+
 class CPhysicsCollisionSet : public IPhysicsCollisionSet {
 	public:
 						CPhysicsCollisionSet(int iMaxEntries);
@@ -14,9 +16,26 @@ class CPhysicsCollisionSet : public IPhysicsCollisionSet {
 
 		bool			ShouldCollide(int index0, int index1);
 
+		// For the broadphase filter. Indices must be valid!
+		bool			ShouldCollideFast(int index0, int index1) const {
+			return (m_bits[index0 * m_iRowWords + (index1 >> 5)] & (1u << (index1 & 31))) != 0;
+		}
+
+		int				GetMaxEntries() const { return m_iMaxEntries; }
+
+		// Objects assigned to the set with SetCollisionSet
+		void			AddMember(CPhysicsObject *pObject);
+		void			RemoveMember(CPhysicsObject *pObject);
+
 	private:
+		bool			IsValidIndex(int index) const { return index >= 0 && index < m_iMaxEntries; }
+		void			SetBit(int index0, int index1, bool set);
+		void			RecheckMembers(int index0, int index1, bool enabled);
+
 		int				m_iMaxEntries;
-		int *			m_collArray;
+		int				m_iRowWords; // Words per row of the matrix
+		CUtlVector<unsigned int>	m_bits; // Symmetric bit matrix, m_iMaxEntries rows
+		CUtlVector<CPhysicsObject *>	m_members;
 };
 
 CPhysicsCollisionSet *CreateCollisionSet(int maxElements);
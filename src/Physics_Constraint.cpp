@@ -525,14 +525,17 @@ CPhysicsConstraint::~CPhysicsConstraint() {
 }
 
 void CPhysicsConstraint::Activate() {
+	m_pEnv->WaitForSimulation();
 	m_pConstraint->setEnabled(true);
 }
 
 void CPhysicsConstraint::Deactivate() {
+	m_pEnv->WaitForSimulation();
 	m_pConstraint->setEnabled(false);
 }
 
 void CPhysicsConstraint::SetLinearMotor(float speed, float maxLinearImpulse) {
+	m_pEnv->WaitForSimulation();
 	switch (m_type) {
 		case CONSTRAINT_SLIDING: {
 			btSliderConstraint *pSlider = (btSliderConstraint *)m_pConstraint;
@@ -550,6 +553,7 @@ void CPhysicsConstraint::SetLinearMotor(float speed, float maxLinearImpulse) {
 }
 
 void CPhysicsConstraint::SetAngularMotor(float rotSpeed, float maxAngularImpulse) {
+	m_pEnv->WaitForSimulation();
 	switch (m_type) {
 		case CONSTRAINT_HINGE: {
 			btHingeConstraint *pHinge = (btHingeConstraint *)m_pConstraint;
@@ -566,6 +570,7 @@ void CPhysicsConstraint::SetAngularMotor(float rotSpeed, float maxAngularImpulse
 
 // Unused.
 void CPhysicsConstraint::UpdateRagdollTransforms(const matrix3x4_t &constraintToReference, const matrix3x4_t &constraintToAttached) {
+	m_pEnv->WaitForSimulation();
 	if (m_type != CONSTRAINT_RAGDOLL) return;
 	NOT_IMPLEMENTED
 }
@@ -631,6 +636,93 @@ btTypedConstraint *CPhysicsConstraint::GetConstraint() {
 	return m_pConstraint;
 }
 
+// UNEXPOSED
+void CPhysicsConstraint::SetCreationParams(const void *pParams, int size) {
+	m_creationParams.CopyArray((const unsigned char *)pParams, size);
+}
+
+// UNEXPOSED
+void CPhysicsConstraint::GetSaveData(constraintsave_t &data) const {
+	memset(&data, 0, sizeof(data));
+
+	data.pReferenceObject	= (IPhysicsObject *)m_pReferenceObject;
+	data.pAttachedObject	= (IPhysicsObject *)m_pAttachedObject;
+	data.pGroup				= (IPhysicsConstraintGroup *)m_pGroup;
+	data.type				= m_type;
+	data.paramsSize			= m_creationParams.Count();
+	data.enabled			= m_pConstraint->isEnabled();
+
+	data.frames[0].setIdentity();
+	data.frames[1].setIdentity();
+
+	switch (m_type) {
+		case CONSTRAINT_RAGDOLL: {
+			btGeneric6DofConstraint *pConstraint = (btGeneric6DofConstraint *)m_pConstraint;
+			data.frames[0] = pConstraint->getFrameOffsetA();
+			data.frames[1] = pConstraint->getFrameOffsetB();
+			break;
+		}
+		case CONSTRAINT_HINGE: {
+			btHingeConstraint *pHinge = (btHingeConstraint *)m_pConstraint;
+			data.frames[0] = pHinge->getAFrame();
+			data.frames[1] = pHinge->getBFrame();
+			break;
+		}
+		case CONSTRAINT_FIXED: {
+			btFixedConstraint *pWeld = (btFixedConstraint *)m_pConstraint;
+			data.frames[0] = pWeld->getFrameOffsetA();
+			data.frames[1] = pWeld->getFrameOffsetB();
+			break;
+		}
+		case CONSTRAINT_SLIDING: {
+			btSliderConstraint *pSlider = (btSliderConstraint *)m_pConstraint;
+			data.frames[0] = pSlider->getFrameOffsetA();
+			data.frames[1] = pSlider->getFrameOffsetB();
+			break;
+		}
+		case CONSTRAINT_BALLSOCKET:
+		case CONSTRAINT_LENGTH:
+		case CONSTRAINT_SPRING: {
+			btPoint2PointConstraint *pPoint = (btPoint2PointConstraint *)m_pConstraint;
+			data.frames[0].setOrigin(pPoint->getPivotInA());
+			data.frames[1].setOrigin(pPoint->getPivotInB());
+			break;
+		}
+		default:
+			break;
+	}
+}
+
+// UNEXPOSED
+void CPhysicsConstraint::ApplySaveData(const constraintsave_t &data) {
+	switch (m_type) {
+		case CONSTRAINT_RAGDOLL:
+			((btGeneric6DofConstraint *)m_pConstraint)->setFrames(data.frames[0], data.frames[1]);
+			break;
+		case CONSTRAINT_HINGE:
+			((btHingeConstraint *)m_pConstraint)->setFrames(data.frames[0], data.frames[1]);
+			break;
+		case CONSTRAINT_FIXED:
+			((btFixedConstraint *)m_pConstraint)->setFrames(data.frames[0], data.frames[1]);
+			break;
+		case CONSTRAINT_SLIDING:
+			((btSliderConstraint *)m_pConstraint)->setFrames(data.frames[0], data.frames[1]);
+			break;
+		case CONSTRAINT_BALLSOCKET:
+		case CONSTRAINT_LENGTH:
+		case CONSTRAINT_SPRING: {
+			btPoint2PointConstraint *pPoint = (btPoint2PointConstraint *)m_pConstraint;
+			pPoint->setPivotA(data.frames[0].getOrigin());
+			pPoint->setPivotB(data.frames[1].getOrigin());
+			break;
+		}
+		default:
+			break;
+	}
+
+	m_pConstraint->setEnabled(data.enabled);
+}
+
 /*********************************
 * CLASS CPhysicsConstraintGroup
 *********************************/
@@ -645,6 +737,7 @@ CPhysicsConstraintGroup::~CPhysicsConstraintGroup() {
 }
 
 void CPhysicsConstraintGroup::Activate() {
+	m_pEnvironment->WaitForSimulation();
 	for (int i = 0; i < m_constraints.Count(); i++) {
 		m_constraints[i]->Activate();
 	}
@@ -671,6 +764,7 @@ void CPhysicsConstraintGroup::SetErrorParams(const constraint_groupparams_t &par
 }
 
 void CPhysicsConstraintGroup::SolvePenetration(IPhysicsObject *pObj0, IPhysicsObject *pObj1) {
+	m_pEnvironment->WaitForSimulation();
 	NOT_IMPLEMENTED
 }
 
@@ -698,20 +792,27 @@ CPhysicsSpring::~CPhysicsSpring() {
 }
 
 void CPhysicsSpring::GetEndpoints(Vector *worldPositionStart, Vector *worldPositionEnd) {
+	m_pEnv->WaitForSimulation();
 	if (!worldPositionStart && !worldPositionEnd) return;
 	NOT_IMPLEMENTED
 }
 
 void CPhysicsSpring::SetSpringConstant(float flSpringContant) {
+	m_pEnv->WaitForSimulation();
 	((btSpringConstraint *)m_pConstraint)->setConstant(flSpringContant);
+	((springparams_t *)GetCreationParams())->constant = flSpringContant;
 }
 
 void CPhysicsSpring::SetSpringDamping(float flSpringDamping) {
+	m_pEnv->WaitForSimulation();
 	((btSpringConstraint *)m_pConstraint)->setDamping(flSpringDamping);
+	((springparams_t *)GetCreationParams())->damping = flSpringDamping;
 }
 
 void CPhysicsSpring::SetSpringLength(float flSpringLength) {
+	m_pEnv->WaitForSimulation();
 	((btSpringConstraint *)m_pConstraint)->setLength(ConvertDistanceToBull(flSpringLength));
+	((springparams_t *)GetCreationParams())->naturalLength = flSpringLength;
 }
 
 IPhysicsObject *CPhysicsSpring::GetStartObject() {
@@ -748,7 +849,9 @@ CPhysicsSpring *CreateSpringConstraint(CPhysicsEnvironment *pEnv, IPhysicsObject
 	btSpringConstraint *pConstraint = new btSpringConstraint(*((CPhysicsObject *)pReferenceObject)->GetObject(), *((CPhysicsObject *)pAttachedObject)->GetObject(), bullRefPos, bullAttPos,
 																length, spring->constant, spring->onlyStretch, spring->damping);
 
-	return new CPhysicsSpring(pEnv, (CPhysicsObject *)pReferenceObject, (CPhysicsObject *)pAttachedObject, pConstraint, CONSTRAINT_SPRING);
+	CPhysicsSpring *pSpring = new CPhysicsSpring(pEnv, (CPhysicsObject *)pReferenceObject, (CPhysicsObject *)pAttachedObject, pConstraint, CONSTRAINT_SPRING);
+	pSpring->SetCreationParams(spring, sizeof(*spring));
+	return pSpring;
 }
 
 static void SetupAxis(int axis, btGeneric6DofConstraint *pConstraint, const constraint_axislimit_t &axisData, bool clockwise) {
@@ -809,7 +912,9 @@ CPhysicsConstraint *CreateRagdollConstraint(CPhysicsEnvironment *pEnv, IPhysicsO
 		pConstraint->setAngularOnly(true);
 	}
 	
-	return new CPhysicsConstraint(pEnv, pGroup, pObjRef, pObjAtt, pConstraint, CONSTRAINT_RAGDOLL);
+	CPhysicsConstraint *pRet = new CPhysicsConstraint(pEnv, pGroup, pObjRef, pObjAtt, pConstraint, CONSTRAINT_RAGDOLL);
+	pRet->SetCreationParams(&ragdoll, sizeof(ragdoll));
+	return pRet;
 }
 
 CPhysicsConstraint *CreateHingeConstraint(CPhysicsEnvironment *pEnv, IPhysicsObject *pReferenceObject, IPhysicsObject *pAttachedObject, IPhysicsConstraintGroup *pGroup, const constraint_hingeparams_t &hinge) {
@@ -851,7 +956,9 @@ CPhysicsConstraint *CreateHingeConstraint(CPhysicsEnvironment *pEnv, IPhysicsObj
 	if (hinge.hingeAxis.minRotation != hinge.hingeAxis.maxRotation)
 		pHinge->setLimit(ConvertAngleToBull(hinge.hingeAxis.minRotation), ConvertAngleToBull(hinge.hingeAxis.maxRotation));
 
-	return new CPhysicsConstraint(pEnv, pGroup, pObjRef, pObjAtt, pHinge, CONSTRAINT_HINGE);
+	CPhysicsConstraint *pRet = new CPhysicsConstraint(pEnv, pGroup, pObjRef, pObjAtt, pHinge, CONSTRAINT_HINGE);
+	pRet->SetCreationParams(&hinge, sizeof(hinge));
+	return pRet;
 }
 
 CPhysicsConstraint *CreateFixedConstraint(CPhysicsEnvironment *pEnv, IPhysicsObject *pReferenceObject, IPhysicsObject *pAttachedObject, IPhysicsConstraintGroup *pGroup, const constraint_fixedparams_t &fixed) {
@@ -861,7 +968,9 @@ CPhysicsConstraint *CreateFixedConstraint(CPhysicsEnvironment *pEnv, IPhysicsObj
 																pObjRef->GetObject()->getWorldTransform().inverse() * pObjAtt->GetObject()->getWorldTransform(),
 																btTransform::getIdentity());
 
-	return new CPhysicsConstraint(pEnv, pGroup, pObjRef, pObjAtt, pWeld, CONSTRAINT_FIXED);
+	CPhysicsConstraint *pRet = new CPhysicsConstraint(pEnv, pGroup, pObjRef, pObjAtt, pWeld, CONSTRAINT_FIXED);
+	pRet->SetCreationParams(&fixed, sizeof(fixed));
+	return pRet;
 }
 
 CPhysicsConstraint *CreateSlidingConstraint(CPhysicsEnvironment *pEnv, IPhysicsObject *pReferenceObject, IPhysicsObject *pAttachedObject, IPhysicsConstraintGroup *pGroup, const constraint_slidingparams_t &sliding) {
@@ -909,7 +1018,9 @@ CPhysicsConstraint *CreateSlidingConstraint(CPhysicsEnvironment *pEnv, IPhysicsO
 	pSlider->setLowerAngLimit(0);
 	pSlider->setUpperAngLimit(0);
 
-	return new CPhysicsConstraint(pEnv, pGroup, pObjRef, pObjAtt, pSlider, CONSTRAINT_SLIDING);
+	CPhysicsConstraint *pRet = new CPhysicsConstraint(pEnv, pGroup, pObjRef, pObjAtt, pSlider, CONSTRAINT_SLIDING);
+	pRet->SetCreationParams(&sliding, sizeof(sliding));
+	return pRet;
 }
 
 CPhysicsConstraint *CreateBallsocketConstraint(CPhysicsEnvironment *pEnv, IPhysicsObject *pReferenceObject, IPhysicsObject *pAttachedObject, IPhysicsConstraintGroup *pGroup, const constraint_ballsocketparams_t &ballsocket) {
@@ -924,7 +1035,9 @@ CPhysicsConstraint *CreateBallsocketConstraint(CPhysicsEnvironment *pEnv, IPhysi
 	obj2Pos -= ((btMassCenterMotionState *)pObjAtt->GetObject()->getMotionState())->m_centerOfMassOffset.getOrigin();
 
 	btPoint2PointConstraint *pBallsock = new btPoint2PointConstraint(*pObjRef->GetObject(), *pObjAtt->GetObject(), obj1Pos, obj2Pos);
-	return new CPhysicsConstraint(pEnv, pGroup, pObjRef, pObjAtt, pBallsock, CONSTRAINT_BALLSOCKET);
+	CPhysicsConstraint *pRet = new CPhysicsConstraint(pEnv, pGroup, pObjRef, pObjAtt, pBallsock, CONSTRAINT_BALLSOCKET);
+	pRet->SetCreationParams(&ballsocket, sizeof(ballsocket));
+	return pRet;
 }
 
 // NOT COMPLETE
@@ -946,7 +1059,9 @@ CPhysicsConstraint *CreateLengthConstraint(CPhysicsEnvironment *pEnv, IPhysicsOb
 	obj2Pos -= ((btMassCenterMotionState *)pObjAtt->GetObject()->getMotionState())->m_centerOfMassOffset.getOrigin();
 
 	btPoint2PointConstraint *pLength = new btLengthConstraint(*pObjRef->GetObject(), *pObjAtt->GetObject(), obj1Pos, obj2Pos, ConvertDistanceToBull(length.minLength), ConvertDistanceToBull(length.totalLength));
-	return new CPhysicsConstraint(pEnv, pGroup, pObjRef, pObjAtt, pLength, CONSTRAINT_LENGTH);
+	CPhysicsConstraint *pRet = new CPhysicsConstraint(pEnv, pGroup, pObjRef, pObjAtt, pLength, CONSTRAINT_LENGTH);
+	pRet->SetCreationParams(&length, sizeof(length));
+	return pRet;
 }
 
 CPhysicsConstraint *CreateGearConstraint(CPhysicsEnvironment *pEnv, IPhysicsObject *pReferenceObject, IPhysicsObject *pAttachedObject, IPhysicsConstraintGroup *pGroup, const constraint_gearparams_t &gear) {
@@ -959,7 +1074,9 @@ CPhysicsConstraint *CreateGearConstraint(CPhysicsEnvironment *pEnv, IPhysicsObje
 	}
 
 	btGearConstraint *pConstraint = new btGearConstraint(*pObjRef->GetObject(), *pObjAtt->GetObject(), axes[0], axes[1], gear.ratio);
-	return new CPhysicsConstraint(pEnv, pGroup, pObjRef, pObjAtt, pConstraint, CONSTRAINT_GEAR);
+	CPhysicsConstraint *pRet = new CPhysicsConstraint(pEnv, pGroup, pObjRef, pObjAtt, pConstraint, CONSTRAINT_GEAR);
+	pRet->SetCreationParams(&gear, sizeof(gear));
+	return pRet;
 }
 
 CPhysicsConstraintGroup *CreateConstraintGroup(CPhysicsEnvironment *pEnv, const constraint_groupparams_t &params) {
@@ -976,4 +1093,76 @@ CPhysicsConstraint *CreateUserConstraint(CPhysicsEnvironment *pEnv, IPhysicsObje
 	CPhysicsConstraint *pConstraint = new CPhysicsConstraint(pEnv, pGroup, (CPhysicsObject *)pReferenceObject, (CPhysicsObject *)pAttachedObject, constraint, CONSTRAINT_USER);
 	pConstraint->SetNotifyBroken(false); // Until an entity is hooked up or whatever
 	return pConstraint;
-}
\ No newline at end of file
+}
+
+template <typename T>
+static bool ReadCreationParams(const constraintsave_t &data, const void *pParams, T &params) {
+	if (data.paramsSize != sizeof(T)) return false;
+
+	memcpy(&params, pParams, sizeof(T));
+	return true;
+}
+
+CPhysicsConstraint *CreateConstraintFromSave(CPhysicsEnvironment *pEnv, IPhysicsObject *pReferenceObject, IPhysicsObject *pAttachedObject, IPhysicsConstraintGroup *pGroup, const constraintsave_t &data, const void *pParams) {
+	if (!pReferenceObject || !pAttachedObject) return NULL;
+
+	CPhysicsConstraint *pConstraint = NULL;
+	switch (data.type) {
+		case CONSTRAINT_SPRING: {
+			springparams_t spring;
+			if (ReadCreationParams(data, pParams, spring))
+				pConstraint = CreateSpringConstraint(pEnv, pReferenceObject, pAttachedObject, &spring);
+			break;
+		}
+		case CONSTRAINT_RAGDOLL: {
+			constraint_ragdollparams_t ragdoll;
+			if (ReadCreationParams(data, pParams, ragdoll))
+				pConstraint = CreateRagdollConstraint(pEnv, pReferenceObject, pAttachedObject, pGroup, ragdoll);
+			break;
+		}
+		case CONSTRAINT_HINGE: {
+			constraint_hingeparams_t hinge;
+			if (ReadCreationParams(data, pParams, hinge))
+				pConstraint = CreateHingeConstraint(pEnv, pReferenceObject, pAttachedObject, pGroup, hinge);
+			break;
+		}
+		case CONSTRAINT_FIXED: {
+			constraint_fixedparams_t fixed;
+			if (ReadCreationParams(data, pParams, fixed))
+				pConstraint = CreateFixedConstraint(pEnv, pReferenceObject, pAttachedObject, pGroup, fixed);
+			break;
+		}
+		case CONSTRAINT_SLIDING: {
+			constraint_slidingparams_t sliding;
+			if (ReadCreationParams(data, pParams, sliding))
+				pConstraint = CreateSlidingConstraint(pEnv, pReferenceObject, pAttachedObject, pGroup, sliding);
+			break;
+		}
+		case CONSTRAINT_BALLSOCKET: {
+			constraint_ballsocketparams_t ballsocket;
+			if (ReadCreationParams(data, pParams, ballsocket))
+				pConstraint = CreateBallsocketConstraint(pEnv, pReferenceObject, pAttachedObject, pGroup, ballsocket);
+			break;
+		}
+		case CONSTRAINT_LENGTH: {
+			constraint_lengthparams_t length;
+			if (ReadCreationParams(data, pParams, length))
+				pConstraint = CreateLengthConstraint(pEnv, pReferenceObject, pAttachedObject, pGroup, length);
+			break;
+		}
+		case CONSTRAINT_GEAR: {
+			constraint_gearparams_t gear;
+			if (ReadCreationParams(data, pParams, gear))
+				pConstraint = CreateGearConstraint(pEnv, pReferenceObject, pAttachedObject, pGroup, gear);
+			break;
+		}
+		default:
+			// User constraints belong to the game, and pulleys don't exist
+			return NULL;
+	}
+
+	if (pConstraint)
+		pConstraint->ApplySaveData(data);
+
+	return pConstraint;
+}
@@ -27,6 +27,18 @@ enum EConstraintType {
 	CONSTRAINT_USER
 };
 
+// Constraint state in save games, followed by paramsSize bytes of the params the constraint was created with.
+// The frames are saved too since the creation params are in world space, and the objects have moved since.
+struct constraintsave_t {
+	btTransform				frames[2];			// Reference and attached object frames (just the origin for point to point constraints)
+	void *					pReferenceObject;	// Pointers from when the game was saved
+	void *					pAttachedObject;
+	void *					pGroup;
+	int						type;				// EConstraintType
+	int						paramsSize;
+	bool					enabled;
+};
+
 class CPhysicsConstraint : public IPhysicsConstraint, public IObjectEventListener {
 	public:
 		CPhysicsConstraint(CPhysicsEnvironment *pEnv, IPhysicsConstraintGroup *pGroup, CPhysicsObject *pObject1, CPhysicsObject *pObject2, btTypedConstraint *pConstraint, EConstraintType type);
@@ -60,6 +72,13 @@ class CPhysicsConstraint : public IPhysicsConstraint, public IObjectEventListene
 
 		void					SetNotifyBroken(bool notify) {m_bNotifyBroken = notify;}
 
+		// Copy of the params we were created with, for save games
+		void					SetCreationParams(const void *pParams, int size);
+		void *					GetCreationParams() { return m_creationParams.Base(); }
+
+		void					GetSaveData(constraintsave_t &data) const;
+		void					ApplySaveData(const constraintsave_t &data);
+
 	protected:
 		CPhysicsObject *		m_pReferenceObject;
 		CPhysicsObject *		m_pAttachedObject;
@@ -71,6 +90,7 @@ class CPhysicsConstraint : public IPhysicsConstraint, public IObjectEventListene
 		bool					m_bNotifyBroken; // Should we notify the game that the constraint was broken?
 
 		btTypedConstraint *		m_pConstraint;
+		CUtlVector<unsigned char>	m_creationParams;
 };
 
 class CPhysicsSpring : public IPhysicsSpring, public CPhysicsConstraint {
@@ -130,4 +150,7 @@ CPhysicsConstraint *CreateUserConstraint(CPhysicsEnvironment *pEnv, IPhysicsObje
 
 CPhysicsConstraintGroup *CreateConstraintGroup(CPhysicsEnvironment *pEnv, const constraint_groupparams_t &params);
 
+// Returns NULL for constraints that can't be saved (user and pulley constraints)
+CPhysicsConstraint *CreateConstraintFromSave(CPhysicsEnvironment *pEnv, IPhysicsObject *pReferenceObject, IPhysicsObject *pAttachedObject, IPhysicsConstraintGroup *pGroup, const constraintsave_t &data, const void *pParams);
+
 #endif // PHYSICS_CONSTRAINT_H
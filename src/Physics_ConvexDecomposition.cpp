@@ -0,0 +1,423 @@
+#include "StdAfx.h"
+
+#include "LinearMath/btConvexHull.h"
+#include "BulletMultiThreaded/btThreadPool.h"
+
+#include "Physics_ConvexDecomposition.h"
+
+// memdbgon must be the last include file in a .cpp file!!!
+#include "tier0/memdbgon.h"
+
+/****************************
+* Convex decomposition
+****************************/
+
+// Top-down decomposition: The whole soup starts out as a single part, and we keep cutting the most concave part
+// in two with an axis aligned plane until every part is close enough to its convex hull (or we're out of hulls).
+// The concavity of a part is the furthest any point of its surface is from its convex hull, measured along the
+// surface normal (same as HACD).
+
+#define MAX_CONCAVITY_SAMPLES	2048
+#define NUM_SPLIT_CANDIDATES	12		// 3 axes, 4 cuts per axis
+#define SPLIT_EPSILON			0.0001f
+#define FLAT_HULL_THICKNESS		0.005f	// Flat parts get extruded this far (meters) so they have some volume
+
+struct decomppart_t {
+	btAlignedObjectArray<btVector3>	verts; // 3 per triangle
+	float							concavity;
+	btScalar						deepest[3]; // Most concave point, candidate cuts go through here
+	bool							splittable;
+};
+
+// Returns the furthest distance between the triangles and their convex hull
+static float ComputeConcavity(const btAlignedObjectArray<btVector3> &verts, btScalar *pDeepest) {
+	if (verts.size() == 0) return 0;
+
+	btVector3 mins(verts[0]), maxs(verts[0]);
+	for (int i = 1; i < verts.size(); i++) {
+		mins.setMin(verts[i]);
+		maxs.setMax(verts[i]);
+	}
+
+	// Flat parts can't be concave (and HullLibrary turns axis aligned ones into boxes)
+	btVector3 extents = maxs - mins;
+	if (extents.x() < SIMD_EPSILON || extents.y() < SIMD_EPSILON || extents.z() < SIMD_EPSILON)
+		return 0;
+
+	HullLibrary lib;
+	HullResult res;
+	HullDesc desc(QF_TRIANGLES, verts.size(), &verts[0]);
+	if (lib.CreateConvexHull(desc, res) != QE_OK)
+		return 0;
+
+	btVector3 center(0, 0, 0);
+	for (unsigned int i = 0; i < res.mNumOutputVertices; i++) {
+		center += res.m_OutputVertices[i];
+	}
+	center /= (btScalar)res.mNumOutputVertices;
+
+	// Hull planes (xyz = outward normal, w = distance)
+	btAlignedObjectArray<btVector4> planes;
+	planes.reserve(res.mNumIndices / 3);
+	for (unsigned int i = 0; i < res.mNumIndices / 3; i++) {
+		const btVector3 &a = res.m_OutputVertices[res.m_Indices[i * 3 + 0]];
+		const btVector3 &b = res.m_OutputVertices[res.m_Indices[i * 3 + 1]];
+		const btVector3 &c = res.m_OutputVertices[res.m_Indices[i * 3 + 2]];
+
+		btVector3 normal = (b - a).cross(c - a);
+		if (normal.length2() < SIMD_EPSILON * SIMD_EPSILON) continue;
+
+		normal.normalize();
+		btScalar dist = normal.dot(a);
+		if (normal.dot(center) > dist) {
+			normal = -normal;
+			dist = -dist;
+		}
+
+		planes.push_back(btVector4(normal.x(), normal.y(), normal.z(), dist));
+	}
+
+	lib.ReleaseResult(res);
+
+	// Sample the triangle corners and centers. Big parts only get every n'th triangle sampled.
+	int numTris = verts.size() / 3;
+	int step = max(1, numTris * 4 / MAX_CONCAVITY_SAMPLES);
+	btScalar concavity = 0;
+
+	for (int i = 0; i < numTris; i += step) {
+		const btVector3 *v = &verts[i * 3];
+
+		btVector3 normal = (v[1] - v[0]).cross(v[2] - v[0]);
+		if (normal.fuzzyZero()) continue;
+		normal.normalize();
+
+		btVector3 samples[4] = {v[0], v[1], v[2], (v[0] + v[1] + v[2]) / 3};
+
+		for (int j = 0; j < 4; j++) {
+			// How far the surface is from the hull along its normal. We don't know which way the soup
+			// is wound, so take the closer of the two directions.
+			btScalar front = BT_LARGE_FLOAT, back = BT_LARGE_FLOAT;
+			for (int k = 0; k < planes.size(); k++) {
+				const btVector4 &plane = planes[k];
+				btVector3 planeNormal(plane.x(), plane.y(), plane.z());
+
+				btScalar dist = btMax(plane.w() - planeNormal.dot(samples[j]), btScalar(0));
+				btScalar dot = planeNormal.dot(normal);
+				if (dot > SIMD_EPSILON)
+					front = btMin(front, dist / dot);
+				else if (dot < -SIMD_EPSILON)
+					back = btMin(back, dist / -dot);
+			}
+
+			btScalar depth = btMin(front, back);
+			if (depth > concavity && depth != BT_LARGE_FLOAT) {
+				concavity = depth;
+
+				if (pDeepest) {
+					pDeepest[0] = samples[j].x();
+					pDeepest[1] = samples[j].y();
+					pDeepest[2] = samples[j].z();
+				}
+			}
+		}
+	}
+
+	return concavity;
+}
+
+// Fan triangulates a (convex) polygon onto the end of out
+static void AddPolygon(const btVector3 *pPoly, int numVerts, btAlignedObjectArray<btVector3> &out) {
+	for (int i = 2; i < numVerts; i++) {
+		out.push_back(pPoly[0]);
+		out.push_back(pPoly[i - 1]);
+		out.push_back(pPoly[i]);
+	}
+}
+
+// Cuts a triangle with the plane x[axis] = pos, the pieces are appended to left and right
+static void SplitTriangle(const btVector3 *v, int axis, btScalar pos, btAlignedObjectArray<btVector3> &left, btAlignedObjectArray<btVector3> &right) {
+	btScalar d[3] = {v[0][axis] - pos, v[1][axis] - pos, v[2][axis] - pos};
+
+	// Triangles lying on the plane go to the side behind them (where the solid is, if the soup is wound outwards)
+	if (btFabs(d[0]) <= SPLIT_EPSILON && btFabs(d[1]) <= SPLIT_EPSILON && btFabs(d[2]) <= SPLIT_EPSILON) {
+		btVector3 normal = (v[1] - v[0]).cross(v[2] - v[0]);
+		btAlignedObjectArray<btVector3> &side = normal[axis] > 0 ? left : right;
+		side.push_back(v[0]);
+		side.push_back(v[1]);
+		side.push_back(v[2]);
+		return;
+	}
+
+	// Triangles touching the plane go to the side they're on
+	if (d[0] <= SPLIT_EPSILON && d[1] <= SPLIT_EPSILON && d[2] <= SPLIT_EPSILON) {
+		left.push_back(v[0]);
+		left.push_back(v[1]);
+		left.push_back(v[2]);
+		return;
+	}
+
+	if (d[0] >= -SPLIT_EPSILON && d[1] >= -SPLIT_EPSILON && d[2] >= -SPLIT_EPSILON) {
+		right.push_back(v[0]);
+		right.push_back(v[1]);
+		right.push_back(v[2]);
+		return;
+	}
+
+	// A triangle cut in two has at most 4 verts on either side
+	btVector3 leftPoly[4], rightPoly[4];
+	int numLeft = 0, numRight = 0;
+
+	for (int i = 0; i < 3; i++) {
+		int next = (i + 1) % 3;
+
+		if (d[i] <= 0) leftPoly[numLeft++] = v[i];
+		if (d[i] >= 0) rightPoly[numRight++] = v[i];
+
+		if ((d[i] < 0 && d[next] > 0) || (d[i] > 0 && d[next] < 0)) {
+			btVector3 point = v[i].lerp(v[next], d[i] / (d[i] - d[next]));
+			leftPoly[numLeft++] = point;
+			rightPoly[numRight++] = point;
+		}
+	}
+
+	AddPolygon(leftPoly, numLeft, left);
+	AddPolygon(rightPoly, numRight, right);
+}
+
+static void RunDecompTasks(btThreadPool *pPool, btIThreadTask **ppTasks, int numTasks) {
+	if (!pPool) {
+		for (int i = 0; i < numTasks; i++) {
+			ppTasks[i]->run();
+		}
+
+		return;
+	}
+
+	for (int i = 0; i < numTasks; i++) {
+		pPool->addTask(ppTasks[i]);
+	}
+
+	pPool->runTasks();
+	pPool->clearTasks();
+}
+
+// Cuts a part in two along a plane and measures how concave both halves are
+class CDecompSplitTask : public btIThreadTask {
+	public:
+		void Init(const decomppart_t *pPart, int axis, btScalar pos) {
+			m_pPart = pPart;
+			m_axis = axis;
+			m_pos = pos;
+			m_bValid = false;
+
+			m_left.resize(0);
+			m_right.resize(0);
+		}
+
+		void run() {
+			const btAlignedObjectArray<btVector3> &verts = m_pPart->verts;
+			for (int i = 0; i < verts.size(); i += 3) {
+				SplitTriangle(&verts[i], m_axis, m_pos, m_left, m_right);
+			}
+
+			if (m_left.size() == 0 || m_right.size() == 0)
+				return;
+
+			m_leftConcavity = ComputeConcavity(m_left, m_leftDeepest);
+			m_rightConcavity = ComputeConcavity(m_right, m_rightDeepest);
+			m_bValid = true;
+		}
+
+		float GetCost() const {
+			return m_leftConcavity + m_rightConcavity;
+		}
+
+		const decomppart_t *	m_pPart;
+		int						m_axis;
+		btScalar				m_pos;
+
+		bool					m_bValid;
+		btAlignedObjectArray<btVector3>	m_left;
+		btAlignedObjectArray<btVector3>	m_right;
+		float					m_leftConcavity;
+		float					m_rightConcavity;
+		btScalar				m_leftDeepest[3];
+		btScalar				m_rightDeepest[3];
+};
+
+// Builds the final (vertex limited) hull of a part
+class CDecompHullTask : public btIThreadTask {
+	public:
+		CDecompHullTask() {
+			m_pPart = NULL;
+			m_maxVerts = 0;
+		}
+
+		void run() {
+			const btAlignedObjectArray<btVector3> &verts = m_pPart->verts;
+
+			btAlignedObjectArray<btVector3> points;
+			points.reserve(verts.size() * 2);
+
+			// Average normal, used to extrude flat parts. Triangles facing the other way (double sided soups) are flipped.
+			btVector3 normal(0, 0, 0);
+			for (int i = 0; i < verts.size(); i += 3) {
+				points.push_back(verts[i + 0]);
+				points.push_back(verts[i + 1]);
+				points.push_back(verts[i + 2]);
+
+				btVector3 triNormal = (verts[i + 1] - verts[i]).cross(verts[i + 2] - verts[i]);
+				if (normal.dot(triNormal) < 0)
+					normal -= triNormal;
+				else
+					normal += triNormal;
+			}
+
+			if (!normal.fuzzyZero()) {
+				normal.normalize();
+
+				btScalar minDist = BT_LARGE_FLOAT, maxDist = -BT_LARGE_FLOAT;
+				for (int i = 0; i < points.size(); i++) {
+					btScalar dist = normal.dot(points[i]);
+					minDist = btMin(minDist, dist);
+					maxDist = btMax(maxDist, dist);
+				}
+
+				if (maxDist - minDist < FLAT_HULL_THICKNESS) {
+					int numPoints = points.size();
+					for (int i = 0; i < numPoints; i++) {
+						points.push_back(points[i] - normal * FLAT_HULL_THICKNESS);
+					}
+				}
+			}
+
+			HullLibrary lib;
+			HullResult res;
+			HullDesc desc(QF_TRIANGLES, points.size(), &points[0]);
+			desc.mMaxVertices = m_maxVerts;
+			if (lib.CreateConvexHull(desc, res) != QE_OK)
+				return;
+
+			m_hullVerts.copyFromArray(res.m_OutputVertices);
+			lib.ReleaseResult(res);
+		}
+
+		const decomppart_t *	m_pPart;
+		int						m_maxVerts;
+
+		btAlignedObjectArray<btVector3>	m_hullVerts;
+};
+
+void DecomposeConvex(const btVector3 *pTriVerts, int numTris, const convexdecompparams_t &params, btThreadPool *pPool, btAlignedObjectArray<btVector3> &hullVerts, CUtlVector<int> &hullVertCounts) {
+	hullVerts.clear();
+	hullVertCounts.RemoveAll();
+	if (!pTriVerts || numTris <= 0) return;
+
+	int maxHulls = max(params.maxHulls, 1);
+	int maxVerts = max(params.maxVerticesPerHull, 4);
+
+	btVector3 mins(pTriVerts[0]), maxs(pTriVerts[0]);
+	for (int i = 1; i < numTris * 3; i++) {
+		mins.setMin(pTriVerts[i]);
+		maxs.setMax(pTriVerts[i]);
+	}
+
+	btScalar threshold = params.concavity * (maxs - mins).length();
+
+	CUtlVector<decomppart_t *> parts;
+
+	decomppart_t *pRoot = new decomppart_t;
+	pRoot->verts.copyFromArray(pTriVerts, numTris * 3);
+	pRoot->splittable = maxHulls > 1;
+	pRoot->concavity = pRoot->splittable ? ComputeConcavity(pRoot->verts, pRoot->deepest) : 0;
+	parts.AddToTail(pRoot);
+
+	CDecompSplitTask splitTasks[NUM_SPLIT_CANDIDATES];
+	btIThreadTask *pSplitTasks[NUM_SPLIT_CANDIDATES];
+	for (int i = 0; i < NUM_SPLIT_CANDIDATES; i++) {
+		pSplitTasks[i] = &splitTasks[i];
+	}
+
+	while (parts.Count() < maxHulls) {
+		// Find the worst part
+		decomppart_t *pPart = NULL;
+		for (int i = 0; i < parts.Count(); i++) {
+			if (parts[i]->splittable && parts[i]->concavity > threshold && (!pPart || parts[i]->concavity > pPart->concavity))
+				pPart = parts[i];
+		}
+
+		if (!pPart)
+			break; // Everything's convex enough
+
+		btVector3 partMins(pPart->verts[0]), partMaxs(pPart->verts[0]);
+		for (int i = 1; i < pPart->verts.size(); i++) {
+			partMins.setMin(pPart->verts[i]);
+			partMaxs.setMax(pPart->verts[i]);
+		}
+
+		// Per axis, try a cut through the most concave point and cuts at 1/4, 1/2 and 3/4 of the way through
+		for (int i = 0; i < NUM_SPLIT_CANDIDATES; i++) {
+			int axis = i / 4;
+			int cut = i % 4;
+
+			btScalar pos;
+			if (cut == 0)
+				pos = pPart->deepest[axis];
+			else
+				pos = partMins[axis] + (partMaxs[axis] - partMins[axis]) * cut / 4;
+
+			splitTasks[i].Init(pPart, axis, pos);
+		}
+
+		RunDecompTasks(pPool, pSplitTasks, NUM_SPLIT_CANDIDATES);
+
+		CDecompSplitTask *pBest = NULL;
+		for (int i = 0; i < NUM_SPLIT_CANDIDATES; i++) {
+			if (splitTasks[i].m_bValid && (!pBest || splitTasks[i].GetCost() < pBest->GetCost()))
+				pBest = &splitTasks[i];
+		}
+
+		if (!pBest) {
+			// Nowhere left to cut this one
+			pPart->splittable = false;
+			continue;
+		}
+
+		decomppart_t *pRight = new decomppart_t;
+		pRight->verts.copyFromArray(pBest->m_right);
+		pRight->concavity = pBest->m_rightConcavity;
+		memcpy(pRight->deepest, pBest->m_rightDeepest, sizeof(pRight->deepest));
+		pRight->splittable = true;
+		parts.AddToTail(pRight);
+
+		pPart->verts.copyFromArray(pBest->m_left);
+		pPart->concavity = pBest->m_leftConcavity;
+		memcpy(pPart->deepest, pBest->m_leftDeepest, sizeof(pPart->deepest));
+	}
+
+	// Now build the hulls
+	CDecompHullTask *pHullTasks = new CDecompHullTask[parts.Count()];
+	btIThreadTask **ppHullTasks = new btIThreadTask *[parts.Count()];
+	for (int i = 0; i < parts.Count(); i++) {
+		pHullTasks[i].m_pPart = parts[i];
+		pHullTasks[i].m_maxVerts = maxVerts;
+		ppHullTasks[i] = &pHullTasks[i];
+	}
+
+	RunDecompTasks(pPool, ppHullTasks, parts.Count());
+
+	for (int i = 0; i < parts.Count(); i++) {
+		const btAlignedObjectArray<btVector3> &verts = pHullTasks[i].m_hullVerts;
+		if (verts.size() == 0) continue;
+
+		for (int j = 0; j < verts.size(); j++) {
+			hullVerts.push_back(verts[j]);
+		}
+
+		hullVertCounts.AddToTail(verts.size());
+	}
+
+	delete [] ppHullTasks;
+	delete [] pHullTasks;
+	parts.PurgeAndDeleteElements();
+}
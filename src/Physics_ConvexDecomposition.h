@@ -0,0 +1,20 @@
+#ifndef PHYSICS_CONVEXDECOMPOSITION_H
+#define PHYSICS_CONVEXDECOMPOSITION_H
+#if defined(_MSC_VER) || (defined(__GNUC__) && __GNUC__ > 3)
+	#pragma once
+#endif
+
+class btThreadPool;
+
+struct convexdecompparams_t {
+	int		maxHulls;			// Stop splitting once we have this many hulls
+	int		maxVerticesPerHull;	// Vertex budget for every output hull
+	float	concavity;			// Parts shallower than this (fraction of the bbox diagonal) are considered convex
+};
+
+// Splits a triangle soup (3 bullet space vertices per triangle) into a set of convex point clouds.
+// The hulls are appended to hullVerts back to back, hullVertCounts receives the amount of vertices in each one.
+// Split candidates and the final hulls are evaluated on pPool if one is given.
+void DecomposeConvex(const btVector3 *pTriVerts, int numTris, const convexdecompparams_t &params, btThreadPool *pPool, btAlignedObjectArray<btVector3> &hullVerts, CUtlVector<int> &hullVertCounts);
+
+#endif // PHYSICS_CONVEXDECOMPOSITION_H
@@ -25,58 +25,178 @@ float CPhysicsDragController::GetAirDensity() {
 }
 
 void CPhysicsDragController::RemovePhysicsObject(CPhysicsObject *obj) {
-	m_ents.FindAndRemove(obj);
+	if (!IsControlling(obj)) return;
+
+	// Swap the last object into our slot
+	int index = obj->GetDragIndex();
+	m_ents.FastRemove(index);
+	m_bodies.FastRemove(index);
+	m_active.FastRemove(index);
+	for (int i = 0; i < 3; i++) {
+		m_dragBasis[i].FastRemove(index);
+		m_angDragBasis[i].FastRemove(index);
+	}
+
+	if (index < m_ents.Count())
+		m_ents[index]->SetDragIndex(index);
+
+	obj->SetDragIndex(-1);
 }
 
 void CPhysicsDragController::AddPhysicsObject(CPhysicsObject *obj) {
-	if (!IsControlling(obj)) {
-		m_ents.AddToTail(obj);
+	if (IsControlling(obj)) return;
+
+	int index = m_ents.AddToTail(obj);
+	m_bodies.AddToTail(obj->GetObject());
+	m_active.AddToTail();
+	for (int i = 0; i < 3; i++) {
+		m_dragBasis[i].AddToTail();
+		m_angDragBasis[i].AddToTail();
 	}
+
+	obj->SetDragIndex(index);
+	ActivationStateChanged(obj, obj->GetObject()->getActivationState());
+	UpdatePhysicsObject(obj);
 }
 
-bool CPhysicsDragController::IsControlling(const CPhysicsObject *obj) const {
-	return m_ents.Find((CPhysicsObject *)obj) != -1;
+// The coefficients are folded into the basis so a tick only reads the packed lists
+void CPhysicsDragController::UpdatePhysicsObject(CPhysicsObject *obj) {
+	if (!IsControlling(obj)) return;
+
+	int index = obj->GetDragIndex();
+	btVector3 drag = obj->GetDragBasis().absolute() * obj->GetDragCoefficient();
+	btVector3 angDrag = obj->GetAngularDragBasis().absolute() * obj->GetAngularDragCoefficient();
+	for (int i = 0; i < 3; i++) {
+		m_dragBasis[i][index] = drag[i];
+		m_angDragBasis[i][index] = angDrag[i];
+	}
 }
 
-void CPhysicsDragController::Tick(btScalar dt) {
-	for (int i = 0; i < m_ents.Count(); i++) {
-		CPhysicsObject *pObject = (CPhysicsObject *)m_ents[i];
-		btRigidBody *body = pObject->GetObject();
-		if (body->getActivationState() == ISLAND_SLEEPING || body->getActivationState() == DISABLE_SIMULATION)
-			continue;
+// Called by the object tracker as soon as bullet changes the state
+void CPhysicsDragController::ActivationStateChanged(CPhysicsObject *obj, int newState) {
+	if (!IsControlling(obj)) return;
 
-		//------------------
-		// LINEAR DRAG
-		//------------------
-		if (!btFuzzyZero(body->getLinearVelocity().length2())) {
-			btVector3 vel(0, 0, 0);
+	m_active[obj->GetDragIndex()] = newState != ISLAND_SLEEPING && newState != DISABLE_SIMULATION;
+}
 
-			float dragForce = -1 * pObject->GetDragInDirection(body->getLinearVelocity().normalized()) * m_airDensity * dt;
-			if (dragForce < -1.0f)
-				dragForce = -1.0f;
+bool CPhysicsDragController::IsControlling(const CPhysicsObject *obj) const {
+	int index = obj->GetDragIndex();
+	return index >= 0 && index < m_ents.Count() && m_ents[index] == obj;
+}
 
-			// If the drag force actually drags
-			if (dragForce < 0)
-				vel = body->getLinearVelocity() * dragForce;
+void CPhysicsDragController::Tick(btScalar dt) {
+	Tick(dt, 0, m_ents.Count());
+}
 
-			body->setLinearVelocity(body->getLinearVelocity() + vel);
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+	#define DRAG_USE_SSE
+	#include <xmmintrin.h>
+#endif
+
+// Active objects are gathered this many slots at a time
+#define DRAG_BLOCK_SIZE 64
+
+// 4 objects worth of one kind of drag, laid out for SIMD
+struct dragbatch_t {
+	float x[4], y[4], z[4];		// Velocity in the space of the drag basis
+	float bx[4], by[4], bz[4];	// Drag basis (premultiplied by the coefficient)
+	float factor[4];			// Out: what to scale the velocity by
+};
+
+// Same as the old per object code: drag = -coefficient * dot(|dir|, |basis|) * density * dt, clamped to [-1, 0].
+// Objects that aren't moving (and unused lanes) get a factor of 1.
+static void ComputeDragFactors(dragbatch_t &batch, float scale) {
+#ifdef DRAG_USE_SSE
+	__m128 x = _mm_loadu_ps(batch.x);
+	__m128 y = _mm_loadu_ps(batch.y);
+	__m128 z = _mm_loadu_ps(batch.z);
+
+	__m128 len2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)), _mm_mul_ps(z, z));
+	__m128 moving = _mm_cmpge_ps(len2, _mm_set1_ps(SIMD_EPSILON));
+	__m128 invLen = _mm_div_ps(_mm_set1_ps(1.0f), _mm_sqrt_ps(_mm_max_ps(len2, _mm_set1_ps(SIMD_EPSILON))));
+
+	__m128 signMask = _mm_set1_ps(-0.0f);
+	__m128 dot = _mm_mul_ps(_mm_andnot_ps(signMask, x), _mm_loadu_ps(batch.bx));
+	dot = _mm_add_ps(dot, _mm_mul_ps(_mm_andnot_ps(signMask, y), _mm_loadu_ps(batch.by)));
+	dot = _mm_add_ps(dot, _mm_mul_ps(_mm_andnot_ps(signMask, z), _mm_loadu_ps(batch.bz)));
+
+	__m128 drag = _mm_mul_ps(_mm_mul_ps(dot, invLen), _mm_set1_ps(-scale));
+	drag = _mm_min_ps(_mm_max_ps(drag, _mm_set1_ps(-1.0f)), _mm_setzero_ps());
+
+	_mm_storeu_ps(batch.factor, _mm_add_ps(_mm_set1_ps(1.0f), _mm_and_ps(moving, drag)));
+#else
+	for (int i = 0; i < 4; i++) {
+		float len2 = batch.x[i] * batch.x[i] + batch.y[i] * batch.y[i] + batch.z[i] * batch.z[i];
+		if (len2 < SIMD_EPSILON) {
+			batch.factor[i] = 1.0f;
+			continue;
 		}
 
-		//------------------
-		// ANGULAR DRAG
-		//------------------
-		if (!btFuzzyZero(body->getAngularVelocity().length2())) {
-			btVector3 ang(0, 0, 0);
+		float dot = fabsf(batch.x[i]) * batch.bx[i] + fabsf(batch.y[i]) * batch.by[i] + fabsf(batch.z[i]) * batch.bz[i];
+		float drag = -dot / sqrtf(len2) * scale;
+		batch.factor[i] = 1.0f + clamp(drag, -1.0f, 0.0f);
+	}
+#endif
+}
 
-			float angDragForce = -1 * pObject->GetAngularDragInDirection(body->getAngularVelocity().normalized()) * m_airDensity * dt;
-			if (angDragForce < -1.0f)
-				angDragForce = -1.0f;
+// Every object only touches its own body, so chunks can tick in parallel
+void CPhysicsDragController::Tick(btScalar dt, int first, int last) {
+	float scale = m_airDensity * dt;
 
-			// If the drag force actually drags
-			if (angDragForce < 0)
-				ang = body->getAngularVelocity() * angDragForce;
+	for (int blockStart = first; blockStart < last; blockStart += DRAG_BLOCK_SIZE) {
+		int blockEnd = MIN(blockStart + DRAG_BLOCK_SIZE, last);
 
-			body->setAngularVelocity(body->getAngularVelocity() + ang);
+		// Compact the awake objects into a list, no branches
+		int active[DRAG_BLOCK_SIZE];
+		int numActive = 0;
+		for (int i = blockStart; i < blockEnd; i++) {
+			active[numActive] = i;
+			numActive += m_active[i];
+		}
+
+		for (int base = 0; base < numActive; base += 4) {
+			int lanes = MIN(numActive - base, 4);
+			dragbatch_t linear, angular;
+
+			for (int lane = 0; lane < 4; lane++) {
+				if (lane >= lanes) {
+					linear.x[lane] = linear.y[lane] = linear.z[lane] = 0;
+					angular.x[lane] = angular.y[lane] = angular.z[lane] = 0;
+					linear.bx[lane] = linear.by[lane] = linear.bz[lane] = 0;
+					angular.bx[lane] = angular.by[lane] = angular.bz[lane] = 0;
+					continue;
+				}
+
+				int index = active[base + lane];
+				const btRigidBody *body = m_bodies[index];
+
+				// Linear drag basis is in object space: transpose multiply (BtMatrix_vimult)
+				const btMatrix3x3 &mat = body->getCenterOfMassTransform().getBasis();
+				const btVector3 &vel = body->getLinearVelocity();
+				linear.x[lane] = mat[0][0] * vel.x() + mat[1][0] * vel.y() + mat[2][0] * vel.z();
+				linear.y[lane] = mat[0][1] * vel.x() + mat[1][1] * vel.y() + mat[2][1] * vel.z();
+				linear.z[lane] = mat[0][2] * vel.x() + mat[1][2] * vel.y() + mat[2][2] * vel.z();
+				linear.bx[lane] = m_dragBasis[0][index];
+				linear.by[lane] = m_dragBasis[1][index];
+				linear.bz[lane] = m_dragBasis[2][index];
+
+				const btVector3 &angVel = body->getAngularVelocity();
+				angular.x[lane] = angVel.x();
+				angular.y[lane] = angVel.y();
+				angular.z[lane] = angVel.z();
+				angular.bx[lane] = m_angDragBasis[0][index];
+				angular.by[lane] = m_angDragBasis[1][index];
+				angular.bz[lane] = m_angDragBasis[2][index];
+			}
+
+			ComputeDragFactors(linear, scale);
+			ComputeDragFactors(angular, scale);
+
+			for (int lane = 0; lane < lanes; lane++) {
+				btRigidBody *body = m_bodies[active[base + lane]];
+				body->setLinearVelocity(body->getLinearVelocity() * linear.factor[lane]);
+				body->setAngularVelocity(body->getAngularVelocity() * angular.factor[lane]);
+			}
 		}
 	}
-}
\ No newline at end of file
+}
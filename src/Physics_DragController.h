@@ -14,12 +14,21 @@ class CPhysicsDragController {
 
 		void						AddPhysicsObject(CPhysicsObject *pObject);
 		void						RemovePhysicsObject(CPhysicsObject *pObject);
+		void						UpdatePhysicsObject(CPhysicsObject *pObject); // Drag coefficients or basis changed
+		void						ActivationStateChanged(CPhysicsObject *pObject, int newState);
 		void						Tick(btScalar dt);
+		void						Tick(btScalar dt, int first, int last); // Objects [first, last), for ticking in chunks
+		int							GetObjectCount() const { return m_ents.Count(); }
 		bool						IsControlling(const CPhysicsObject *pObject) const;
 	private:
 		float						m_airDensity;
 
+		// Packed per object state, slot i of every list belongs to m_ents[i]
 		CUtlVector<CPhysicsObject *>m_ents;
+		CUtlVector<btRigidBody *>	m_bodies;
+		CUtlVector<unsigned char>	m_active;			// 0 if sleeping or simulation disabled
+		CUtlVector<float>			m_dragBasis[3];		// |drag basis| * drag coefficient
+		CUtlVector<float>			m_angDragBasis[3];	// |angular drag basis| * angular drag coefficient
 };
 
-#endif // PHYSICS_DRAGCONTROLLER_H
\ No newline at end of file
+#endif // PHYSICS_DRAGCONTROLLER_H
@@ -1,6 +1,7 @@
 #include "StdAfx.h"
 
 #include <cmodel.h>
+#include <isaverestore.h>
 
 #include "Physics_Environment.h"
 #include "Physics.h"
@@ -14,6 +15,8 @@
 #include "Physics_Collision.h"
 #include "Physics_VehicleController.h"
 #include "Physics_SoftBody.h"
+#include "Physics_CollisionSet.h"
+#include "Physics_Profiler.h"
 #include "miscmath.h"
 #include "convert.h"
 
@@ -24,7 +27,7 @@
 // Multithreading stuff
 
 #define USE_PARALLEL_DISPATCHER
-//#define USE_PARALLEL_SOLVER // NOT COMPLETE
+#define USE_PARALLEL_SOLVER
 
 #if defined(USE_PARALLEL_DISPATCHER) || defined(USE_PARALLEL_SOLVER)
 	#define MULTITHREADED
@@ -38,6 +41,10 @@
 	#include "BulletMultiThreaded/btParallelConstraintSolver.h"
 #endif
 
+#ifdef MULTITHREADED
+	#include "BulletMultiThreaded/btThreading.h"
+#endif
+
 #include "BulletSoftBody/btSoftRigidDynamicsWorld.h"
 #include "BulletSoftBody/btSoftBodyRigidBodyCollisionConfiguration.h"
 
@@ -87,6 +94,99 @@ class CDeleteQueue {
 		CUtlVector<IDeleteQueueItem *> m_list;
 };
 
+/*******************************
+* CLASS CCollisionSolver
+*******************************/
+
+// The broadphase reports the same overlapping pairs every tick, and asking the game is a virtual call.
+// So each pair is judged once and the answer is cached (by filter serial) until one of the objects changes.
+
+#define FILTERCACHE_MIN_SLOTS	256
+#define FILTERCACHE_MAX_SLOTS	(1 << 16)	// Once it's this big, start over instead of growing
+
+CCollisionSolver::CCollisionSolver(CPhysicsEnvironment *pEnv) {
+	m_pEnv = pEnv;
+	m_pSolver = NULL;
+	m_numFilters = 0;
+
+	ClearFilterCache();
+}
+
+void CCollisionSolver::SetHandler(IPhysicsCollisionSolver *pSolver) {
+	m_pSolver = pSolver;
+	ClearFilterCache();
+}
+
+unsigned int CCollisionSolver::NewFilterSerial() {
+	static CInterlockedUInt s_serial;
+
+	unsigned int serial = ++s_serial;
+	if (serial == 0) // 0 marks empty slots
+		serial = ++s_serial;
+
+	return serial;
+}
+
+static unsigned int HashFilter(unsigned int serial0, unsigned int serial1) {
+	return (serial0 * 0x9E3779B9) ^ (serial1 * 0x85EBCA6B);
+}
+
+bool CCollisionSolver::FindFilter(unsigned int serial0, unsigned int serial1, bool &collides) const {
+	int mask = m_filterCache.Count() - 1;
+	for (int slot = HashFilter(serial0, serial1) & mask; m_filterCache[slot].serial[0] != 0; slot = (slot + 1) & mask) {
+		const filtercache_t &filter = m_filterCache[slot];
+		if (filter.serial[0] == serial0 && filter.serial[1] == serial1) {
+			collides = filter.collides;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+void CCollisionSolver::InsertFilter(unsigned int serial0, unsigned int serial1, bool collides) const {
+	if ((m_numFilters + 1) * 2 > m_filterCache.Count()) {
+		if (m_filterCache.Count() >= FILTERCACHE_MAX_SLOTS) {
+			// Most of these are stale (old serials) anyways
+			ClearFilterCache();
+		} else {
+			CUtlVector<filtercache_t> oldCache;
+			oldCache.Swap(m_filterCache);
+
+			m_filterCache.SetCount(oldCache.Count() * 2);
+			for (int i = 0; i < m_filterCache.Count(); i++)
+				m_filterCache[i].serial[0] = 0;
+
+			m_numFilters = 0;
+			for (int i = 0; i < oldCache.Count(); i++) {
+				if (oldCache[i].serial[0] != 0)
+					InsertFilter(oldCache[i].serial[0], oldCache[i].serial[1], oldCache[i].collides);
+			}
+		}
+	}
+
+	int mask = m_filterCache.Count() - 1;
+	int slot = HashFilter(serial0, serial1) & mask;
+	while (m_filterCache[slot].serial[0] != 0)
+		slot = (slot + 1) & mask;
+
+	filtercache_t &filter = m_filterCache[slot];
+	filter.serial[0] = serial0;
+	filter.serial[1] = serial1;
+	filter.collides = collides;
+	m_numFilters++;
+}
+
+void CCollisionSolver::ClearFilterCache() const {
+	AUTO_LOCK(m_filterMutex);
+
+	m_filterCache.SetCount(FILTERCACHE_MIN_SLOTS);
+	for (int i = 0; i < m_filterCache.Count(); i++)
+		m_filterCache[i].serial[0] = 0;
+
+	m_numFilters = 0;
+}
+
 bool CCollisionSolver::needBroadphaseCollision(btBroadphaseProxy *proxy0, btBroadphaseProxy *proxy1) const {
 	btRigidBody *body0 = btRigidBody::upcast((btCollisionObject *)proxy0->m_clientObject);
 	btRigidBody *body1 = btRigidBody::upcast((btCollisionObject *)proxy1->m_clientObject);
@@ -108,22 +208,140 @@ bool CCollisionSolver::needBroadphaseCollision(btBroadphaseProxy *proxy0, btBroa
 		return false;
 	}
 
+	// Filter groups only change when the body is re-added, so there's never a pair to remove for these
+	if (!(proxy0->m_collisionFilterGroup & proxy1->m_collisionFilterMask) || !(proxy1->m_collisionFilterGroup & proxy0->m_collisionFilterMask))
+		return false;
+
 	CPhysicsObject *pObject0 = (CPhysicsObject *)body0->getUserPointer();
 	CPhysicsObject *pObject1 = (CPhysicsObject *)body1->getUserPointer();
+	if (!pObject0 || !pObject1)
+		return ComputeNeedsCollision(pObject0, pObject1, NULL);
+
+	unsigned int serial0 = pObject0->GetFilterSerial();
+	unsigned int serial1 = pObject1->GetFilterSerial();
+	if (serial0 > serial1)
+		V_swap(serial0, serial1);
+
+	bool collides;
+	{
+		AUTO_LOCK(m_filterMutex);
+		if (FindFilter(serial0, serial1, collides))
+			return collides;
+	}
+
+	bool deferred = false;
+	collides = ComputeNeedsCollision(pObject0, pObject1, &deferred);
+	if (deferred) {
+		// Leave the pair out until the game has been asked (a pair that's already in the cache stays)
+		DeferPair(pObject0, pObject1);
+		return false;
+	}
+
+	AUTO_LOCK(m_filterMutex);
 
-	bool collides = NeedsCollision(pObject0, pObject1);
-	collides = collides && (proxy0->m_collisionFilterGroup & proxy1->m_collisionFilterMask);
-	collides = collides && (proxy1->m_collisionFilterGroup & proxy0->m_collisionFilterMask);
+	// Somebody else may have judged it while we were asking
+	bool cached;
+	if (!FindFilter(serial0, serial1, cached))
+		InsertFilter(serial0, serial1, collides);
 
 	if (!collides) {
-		// Clean this pair from the cache
-		m_pEnv->GetBulletEnvironment()->getBroadphase()->getOverlappingPairCache()->removeOverlappingPair(proxy0, proxy1, m_pEnv->GetBulletEnvironment()->getDispatcher());
+		// The pair may still be in the pair cache from before the filter changed. We're being called from
+		// inside the broadphase here, so the pair is removed when it's done (see CPhysicsBroadphase)
+		filterpair_t pair = {proxy0, proxy1, {serial0, serial1}};
+		m_rejectedPairs.AddToTail(pair);
 	}
-			
+
 	return collides;
 }
 
 bool CCollisionSolver::NeedsCollision(CPhysicsObject *pObject0, CPhysicsObject *pObject1) const {
+	if (!pObject0 || !pObject1)
+		return ComputeNeedsCollision(pObject0, pObject1, NULL);
+
+	unsigned int serial0 = pObject0->GetFilterSerial();
+	unsigned int serial1 = pObject1->GetFilterSerial();
+	if (serial0 > serial1)
+		V_swap(serial0, serial1);
+
+	bool collides;
+	{
+		AUTO_LOCK(m_filterMutex);
+		if (FindFilter(serial0, serial1, collides))
+			return collides;
+	}
+
+	bool deferred = false;
+	collides = ComputeNeedsCollision(pObject0, pObject1, &deferred);
+	if (deferred) {
+		DeferPair(pObject0, pObject1);
+		return collides;
+	}
+
+	AUTO_LOCK(m_filterMutex);
+
+	bool cached;
+	if (!FindFilter(serial0, serial1, cached))
+		InsertFilter(serial0, serial1, collides);
+
+	return collides;
+}
+
+void CCollisionSolver::FlushRejectedPairs(btOverlappingPairCache *pCache, btDispatcher *pDispatcher) {
+	AUTO_LOCK(m_filterMutex);
+
+	for (int i = 0; i < m_rejectedPairs.Count(); i++) {
+		const filterpair_t &pair = m_rejectedPairs[i];
+		CPhysicsObject *pObject0 = (CPhysicsObject *)((btCollisionObject *)pair.pProxy0->m_clientObject)->getUserPointer();
+		CPhysicsObject *pObject1 = (CPhysicsObject *)((btCollisionObject *)pair.pProxy1->m_clientObject)->getUserPointer();
+
+		// One of them changed its filter since, so the rejection may be out of date. Only remove the pair
+		// if the current serials are known to be rejected too (otherwise the next check decides).
+		unsigned int serial0 = pObject0->GetFilterSerial();
+		unsigned int serial1 = pObject1->GetFilterSerial();
+		if (serial0 > serial1)
+			V_swap(serial0, serial1);
+
+		if (serial0 != pair.serial[0] || serial1 != pair.serial[1]) {
+			bool collides;
+			if (!FindFilter(serial0, serial1, collides) || collides)
+				continue;
+		}
+
+		pCache->removeOverlappingPair(pair.pProxy0, pair.pProxy1, pDispatcher);
+	}
+
+	m_rejectedPairs.RemoveAll();
+}
+
+void CCollisionSolver::DeferPair(CPhysicsObject *pObject0, CPhysicsObject *pObject1) const {
+	AUTO_LOCK(m_deferredMutex);
+
+	deferredfilter_t pair = {pObject0, pObject1};
+	m_deferredPairs.AddToTail(pair);
+}
+
+void CCollisionSolver::FlushDeferredPairs(btOverlappingPairCache *pCache) {
+	for (int i = 0; i < m_deferredPairs.Count(); i++) {
+		CPhysicsObject *pObject0 = m_deferredPairs[i].pObject0;
+		CPhysicsObject *pObject1 = m_deferredPairs[i].pObject1;
+		if ((pObject0->GetCallbackFlags() | pObject1->GetCallbackFlags()) & CALLBACK_MARKED_FOR_DELETE)
+			continue;
+
+		// Caches the answer, so pairs that came up more than once only ask the game once
+		if (!NeedsCollision(pObject0, pObject1))
+			continue;
+
+		// The broadphase won't report the pair again until one of them moves, so add it ourselves
+		btBroadphaseProxy *pProxy0 = pObject0->GetObject()->getBroadphaseHandle();
+		btBroadphaseProxy *pProxy1 = pObject1->GetObject()->getBroadphaseHandle();
+		if (pProxy0 && pProxy1 && TestAabbAgainstAabb2(pProxy0->m_aabbMin, pProxy0->m_aabbMax, pProxy1->m_aabbMin, pProxy1->m_aabbMax))
+			pCache->addOverlappingPair(pProxy0, pProxy1);
+	}
+
+	m_deferredPairs.RemoveAll();
+}
+
+bool CCollisionSolver::ComputeNeedsCollision(CPhysicsObject *pObject0, CPhysicsObject *pObject1, bool *pDeferred) const {
 	if (pObject0 && pObject1) {
 		if (!pObject0->IsCollisionEnabled() || !pObject1->IsCollisionEnabled())
 			return false;
@@ -144,8 +362,21 @@ bool CCollisionSolver::NeedsCollision(CPhysicsObject *pObject0, CPhysicsObject *
 		if ((pObject0->GetCallbackFlags() & CALLBACK_ENABLING_COLLISION) || (pObject1->GetCallbackFlags() & CALLBACK_MARKED_FOR_DELETE)) return false;
 		if ((pObject1->GetCallbackFlags() & CALLBACK_ENABLING_COLLISION) || (pObject0->GetCallbackFlags() & CALLBACK_MARKED_FOR_DELETE)) return false;
 
-		if (m_pSolver && !m_pSolver->ShouldCollide(pObject0, pObject1, pObject0->GetGameData(), pObject1->GetGameData())) 
-			return false;
+		// Objects of the same instance in the same collision set are filtered by the set, without asking the game
+		CPhysicsCollisionSet *pSet = pObject0->GetPhysicsCollisionSet();
+		if (pSet && pSet == pObject1->GetPhysicsCollisionSet() && pObject0->GetGameData() == pObject1->GetGameData())
+			return pSet->ShouldCollideFast(pObject0->GetCollisionSetIndex(), pObject1->GetCollisionSetIndex());
+
+		if (m_pSolver) {
+			// The game can't be called from the simulation thread, it's asked once the step is done
+			if (pDeferred && m_pEnv->IsAsyncStepRunning()) {
+				*pDeferred = true;
+				return true;
+			}
+
+			if (!m_pSolver->ShouldCollide(pObject0, pObject1, pObject0->GetGameData(), pObject1->GetGameData()))
+				return false;
+		}
 	} else {
 		// One of the objects has no phys object...
 		if (pObject0 && !pObject0->IsCollisionEnabled())
@@ -158,6 +389,65 @@ bool CCollisionSolver::NeedsCollision(CPhysicsObject *pObject0, CPhysicsObject *
 	return true;
 }
 
+/*******************************
+* CLASS CPhysicsBroadphase
+*******************************/
+
+// Removes the pairs the collision solver rejected once the broadphase is done with the pair cache
+// (before the narrowphase sees them), and before a proxy they reference goes away.
+class CPhysicsBroadphase : public btDbvtBroadphase {
+	public:
+		CPhysicsBroadphase() {
+			m_pCollisionSolver = NULL;
+		}
+
+		void SetCollisionSolver(CCollisionSolver *pSolver) {
+			m_pCollisionSolver = pSolver;
+		}
+
+		void calculateOverlappingPairs(btDispatcher *dispatcher) {
+			btDbvtBroadphase::calculateOverlappingPairs(dispatcher);
+
+			if (m_pCollisionSolver)
+				m_pCollisionSolver->FlushRejectedPairs(m_paircache, dispatcher);
+		}
+
+		void destroyProxy(btBroadphaseProxy *proxy, btDispatcher *dispatcher) {
+			if (m_pCollisionSolver)
+				m_pCollisionSolver->FlushRejectedPairs(m_paircache, dispatcher);
+
+			btDbvtBroadphase::destroyProxy(proxy, dispatcher);
+		}
+
+	private:
+		CCollisionSolver *m_pCollisionSolver;
+};
+
+/*******************************
+* CLASS CPairStatsCallback
+*******************************/
+
+// Counts the pairs that really get added to/removed from the pair cache for physics_stats_t
+class CPairStatsCallback : public btGhostPairCallback {
+	public:
+		CPairStatsCallback(physics_stats_t *pStats) {
+			m_pStats = pStats;
+		}
+
+		btBroadphasePair *addOverlappingPair(btBroadphaseProxy *proxy0, btBroadphaseProxy *proxy1) {
+			m_pStats->collisionPairsCreated++;
+			return btGhostPairCallback::addOverlappingPair(proxy0, proxy1);
+		}
+
+		void *removeOverlappingPair(btBroadphaseProxy *proxy0, btBroadphaseProxy *proxy1, btDispatcher *dispatcher) {
+			m_pStats->collisionPairsDestroyed++;
+			return btGhostPairCallback::removeOverlappingPair(proxy0, proxy1, dispatcher);
+		}
+
+	private:
+		physics_stats_t *m_pStats;
+};
+
 void SerializeWorld_f(const CCommand &args) {
 	if (args.ArgC() != 3) {
 		Msg("Usage: vphysics_serialize <index> <name>\n");
@@ -188,11 +478,28 @@ void SerializeWorld_f(const CCommand &args) {
 
 static ConCommand cmd_serializeworld("vphysics_serialize", SerializeWorld_f, "Serialize environment by index (usually 0=server, 1=client)\n\tDumps the file out to the exe directory.");
 
+void PrintStats_f(const CCommand &args) {
+	for (int i = 0; i < g_Physics.GetActiveEnvironmentCount(); i++) {
+		if (args.ArgC() > 1 && atoi(args.Arg(1)) != i)
+			continue;
+
+		CPhysicsEnvironment *pEnv = (CPhysicsEnvironment *)g_Physics.GetActiveEnvironmentByIndex(i);
+		if (!pEnv) continue;
+
+		Msg("Environment %d:\n", i);
+		pEnv->PrintStats();
+	}
+}
+
+static ConCommand cmd_printstats("vphysics_printstats", PrintStats_f, "Print simulation stats and step timings (min/avg/max over the last few hundred steps)\n\tUsage: vphysics_printstats [environment index]");
+
 /*******************************
 * CLASS CObjectTracker
 *******************************/
 
-class CObjectTracker {
+// Bullet tells us when an object's activation state changes, and we queue it up until the next tick.
+// That way a tick only costs as much as the number of objects that actually woke up or fell asleep.
+class CObjectTracker : public btActivationStateCallback {
 	public:
 		CObjectTracker(CPhysicsEnvironment *pEnv, IPhysicsObjectEvent *pObjectEvents) {
 			m_pEnv = pEnv;
@@ -216,68 +523,169 @@ class CObjectTracker {
 			m_pObjEvents = pEvents;
 		}
 
+		void ObjectAdded(CPhysicsObject *pObject) {
+			pObject->GetObject()->setActivationStateCallback(this);
+
+			// Check it on the next tick so the game hears about its initial state
+			MarkDirty(pObject);
+		}
+
 		void ObjectRemoved(CPhysicsObject *pObject) {
-			m_activeObjects.FindAndRemove(pObject);
+			if (pObject->GetObject()->getActivationStateCallback() == this)
+				pObject->GetObject()->setActivationStateCallback(NULL);
+
+			RemoveActiveObject(pObject);
+
+			// Leave a hole in the dirty lists, they're thrown away on the next tick/step anyways
+			int index = pObject->GetDirtyActivationIndex();
+			if (index != -1) {
+				Assert(m_dirtyObjects[index] == pObject);
+				m_dirtyObjects[index] = NULL;
+				pObject->SetDirtyActivationIndex(-1);
+			}
+
+			index = pObject->GetDirtySnapshotIndex();
+			if (index != -1) {
+				Assert(m_dirtySnapshots[index] == pObject);
+				m_dirtySnapshots[index] = NULL;
+				pObject->SetDirtySnapshotIndex(-1);
+			}
+		}
+
+		// Asynchronous steps: Awake objects get a new snapshot every step. Sleeping ones keep theirs
+		// unless they fell asleep since the last one, or the game changed them.
+		void MarkSnapshotDirty(CPhysicsObject *pObject) {
+			AUTO_LOCK(m_dirtyMutex);
+
+			if (pObject->GetDirtySnapshotIndex() != -1) return;
+
+			pObject->SetDirtySnapshotIndex(m_dirtySnapshots.AddToTail(pObject));
+		}
+
+		void UpdateSnapshots() {
+			for (int i = 0; i < m_activeObjects.Count(); i++) {
+				((CPhysicsObject *)m_activeObjects[i])->UpdateSnapshot();
+			}
+
+			// Woken or put to sleep since the last tick
+			for (int i = 0; i < m_dirtyObjects.Count(); i++) {
+				if (m_dirtyObjects[i])
+					m_dirtyObjects[i]->UpdateSnapshot();
+			}
+
+			for (int i = 0; i < m_dirtySnapshots.Count(); i++) {
+				CPhysicsObject *pObj = m_dirtySnapshots[i];
+				if (!pObj) continue;
+
+				pObj->SetDirtySnapshotIndex(-1);
+				pObj->UpdateSnapshot();
+			}
+
+			m_dirtySnapshots.RemoveAll();
+		}
+
+		// btActivationStateCallback
+		void activationStateChanged(const btCollisionObject *pObject, int oldState, int newState) {
+			CPhysicsObject *pObj = (CPhysicsObject *)pObject->getUserPointer();
+			if (!pObj) return; // Internal object that the game doesn't need to know about
+
+			// Drag needs to know right away, it runs before our next tick
+			m_pEnv->GetDragController()->ActivationStateChanged(pObj, newState);
+			MarkDirty(pObj);
 		}
 
 		void Tick() {
-			btDiscreteDynamicsWorld *pBulletEnv = m_pEnv->GetBulletEnvironment();
-			btCollisionObjectArray &colObjArray = pBulletEnv->getCollisionObjectArray();
-			for (int i = 0; i < colObjArray.size(); i++) {
-				CPhysicsObject *pObj = (CPhysicsObject *)colObjArray[i]->getUserPointer();
-				if (!pObj) continue; // Internal object that the game doesn't need to know about
+			for (int i = 0; i < m_dirtyObjects.Count(); i++) {
+				CPhysicsObject *pObj = m_dirtyObjects[i];
+				if (!pObj) continue; // Removed since it was queued
 
 				Assert(*(char *)pObj != 0xDD); // Make sure the object isn't deleted (only works in debug builds)
- 
+				pObj->SetDirtyActivationIndex(-1);
+
+				// It may be leaving the active list, which is all UpdateSnapshots looks at otherwise
+				MarkSnapshotDirty(pObj);
+
 				// Don't add objects marked for delete
 				if (pObj->GetCallbackFlags() & CALLBACK_MARKED_FOR_DELETE) {
 					continue;
 				}
 
-				if (colObjArray[i]->getActivationState() != pObj->GetLastActivationState()) {
-					int newState = colObjArray[i]->getActivationState();
-
-					// Not a state we want to track.
-					if (newState == WANTS_DEACTIVATION)
-						continue;
+				int newState = pObj->GetObject()->getActivationState();
+				if (newState == pObj->GetLastActivationState())
+					continue; // Changed back before we got to it
 
-					if (m_pObjEvents) {
-						switch (newState) {
-							// FIXME: Objects may call objectwake twice if they go from disable_deactivation -> active_tag
-							case DISABLE_DEACTIVATION:
-							case ACTIVE_TAG:
-								m_pObjEvents->ObjectWake(pObj);
-								break;
-							case ISLAND_SLEEPING: // Don't call ObjectSleep on DISABLE_SIMULATION on purpose.
-								m_pObjEvents->ObjectSleep(pObj);
-								break;
-						}
-					}
+				// Not a state we want to track.
+				if (newState == WANTS_DEACTIVATION)
+					continue;
 
+				if (m_pObjEvents) {
 					switch (newState) {
+						// FIXME: Objects may call objectwake twice if they go from disable_deactivation -> active_tag
 						case DISABLE_DEACTIVATION:
 						case ACTIVE_TAG:
-							// Don't add the object twice!
-							if (m_activeObjects.Find(pObj) == -1)
-								m_activeObjects.AddToTail(pObj);
-
+							m_pObjEvents->ObjectWake(pObj);
 							break;
-						case DISABLE_SIMULATION:
-						case ISLAND_SLEEPING:
-							m_activeObjects.FindAndRemove(pObj);
+						case ISLAND_SLEEPING: // Don't call ObjectSleep on DISABLE_SIMULATION on purpose.
+							m_pObjEvents->ObjectSleep(pObj);
 							break;
 					}
+				}
 
-					pObj->SetLastActivationState(newState);
+				switch (newState) {
+					case DISABLE_DEACTIVATION:
+					case ACTIVE_TAG:
+						AddActiveObject(pObj);
+						break;
+					case DISABLE_SIMULATION:
+					case ISLAND_SLEEPING:
+						RemoveActiveObject(pObj);
+						break;
 				}
+
+				pObj->SetLastActivationState(newState);
 			}
+
+			m_dirtyObjects.RemoveAll();
 		}
 
 	private:
+		// Controllers can wake objects while they tick in parallel
+		void MarkDirty(CPhysicsObject *pObject) {
+			AUTO_LOCK(m_dirtyMutex);
+
+			// Only queue it once, we read the current state when we drain the list
+			if (pObject->GetDirtyActivationIndex() != -1) return;
+
+			pObject->SetDirtyActivationIndex(m_dirtyObjects.AddToTail(pObject));
+		}
+
+		void AddActiveObject(CPhysicsObject *pObject) {
+			// Don't add the object twice!
+			if (pObject->GetActiveIndex() != -1) return;
+
+			pObject->SetActiveIndex(m_activeObjects.AddToTail(pObject));
+		}
+
+		void RemoveActiveObject(CPhysicsObject *pObject) {
+			int index = pObject->GetActiveIndex();
+			if (index == -1) return;
+
+			// Swap the last object into our slot
+			Assert(m_activeObjects[index] == pObject);
+			m_activeObjects.FastRemove(index);
+			if (index < m_activeObjects.Count())
+				((CPhysicsObject *)m_activeObjects[index])->SetActiveIndex(index);
+
+			pObject->SetActiveIndex(-1);
+		}
+
 		CPhysicsEnvironment *m_pEnv;
 		IPhysicsObjectEvent *m_pObjEvents;
 
 		CUtlVector<IPhysicsObject *> m_activeObjects;
+		CUtlVector<CPhysicsObject *> m_dirtyObjects;
+		CUtlVector<CPhysicsObject *> m_dirtySnapshots;
+		CThreadFastMutex m_dirtyMutex;
 };
 
 /*******************************
@@ -292,6 +700,12 @@ class CPhysicsCollisionData : public IPhysicsCollisionData {
 			ConvertPosToHL(manPoint->m_lateralFrictionDir1, m_contactSpeed);	// FIXME: Need the correct variable from the manifold point
 		}
 
+		CPhysicsCollisionData(const Vector &surfaceNormal, const Vector &contactPoint, const Vector &contactSpeed) {
+			m_surfaceNormal = surfaceNormal;
+			m_contactPoint = contactPoint;
+			m_contactSpeed = contactSpeed;
+		}
+
 		// normal points toward second object (object index 1)
 		void GetSurfaceNormal(Vector &out) {
 			out = m_surfaceNormal;
@@ -317,182 +731,305 @@ class CPhysicsCollisionData : public IPhysicsCollisionData {
 * CLASS CCollisionEventListener
 *********************************/
 
+// Contacts used to be reported to the game from inside the solver loop, once per contact point and solver iteration.
+// Now the solver only remembers the velocities objects had before it touched them, and after the step
+// we walk the contact manifolds and send one Pre/PostCollision pair per colliding object pair.
+
+struct collisionrecord_t {
+	CPhysicsObject *		pObjects[2];
+	btPersistentManifold *	pManifold;	// Not valid anymore once we start calling the game
+	int						order;		// Position in the manifold list, breaks ties when sorting
+	float					impulse;	// Strongest impulse applied on the pair this step
+	float					deltaTime;
+	bool					isCollision;
+	bool					isShadowCollision;
+	Vector					surfaceNormal;
+	Vector					contactPoint;
+	Vector					contactSpeed;
+
+	// Velocities from before the solver touched the objects (bullet units), copied out since the next step overwrites them
+	bool					hasPreVelocity[2];
+	Vector					preVelocity[2];
+	Vector					preAngVelocity[2];
+};
+
+static bool IsSamePair(const collisionrecord_t &left, const collisionrecord_t &right) {
+	return (left.pObjects[0] == right.pObjects[0] && left.pObjects[1] == right.pObjects[1])
+		|| (left.pObjects[0] == right.pObjects[1] && left.pObjects[1] == right.pObjects[0]);
+}
+
+// Sorted by environment index instead of by pointer, so the game hears about the pairs in the same order every run
+static int CompareCollisionRecords(const collisionrecord_t *pLeft, const collisionrecord_t *pRight) {
+	int left0 = pLeft->pObjects[0]->GetEnvironmentIndex(), left1 = pLeft->pObjects[1]->GetEnvironmentIndex();
+	int right0 = pRight->pObjects[0]->GetEnvironmentIndex(), right1 = pRight->pObjects[1]->GetEnvironmentIndex();
+
+	int leftMin = min(left0, left1), rightMin = min(right0, right1);
+	if (leftMin != rightMin)
+		return leftMin < rightMin ? -1 : 1;
+
+	int leftMax = max(left0, left1), rightMax = max(right0, right1);
+	if (leftMax != rightMax)
+		return leftMax < rightMax ? -1 : 1;
+
+	return pLeft->order - pRight->order;
+}
+
+#define COLLISION_FIRST_DELTA_TIME 10.f // What we report when the pair hasn't collided before
+
+// Manifolds stamp the step they last reported on in m_userTimestamp, which is a float.
+// Keep the step in the range a float holds exactly and compare it modulo that range.
+#define COLLISION_STEP_MASK 0xFFFFFF
+
 class CCollisionEventListener : public btSolveCallback {
 	public:
 		CCollisionEventListener(CPhysicsEnvironment *pEnv) {
 			m_pEnv = pEnv;
 			m_pCallback = NULL;
+			m_iStep = 1;
 		}
 
-		// TODO: Optimize this, heavily!
+		// Called from the solver threads. Rows solved at the same time never share a dynamic body,
+		// and we only write to dynamic ones, so there's nothing to lock here.
 		virtual void preSolveContact(btSolverBody *body0, btSolverBody *body1, btManifoldPoint *cp) {
-			CPhysicsObject *pObj0 = (CPhysicsObject *)body0->m_originalColObj->getUserPointer();
-			CPhysicsObject *pObj1 = (CPhysicsObject *)body1->m_originalColObj->getUserPointer();
-			if (pObj0->GetCallbackFlags() & CALLBACK_MARKED_FOR_DELETE || pObj1->GetCallbackFlags() & CALLBACK_MARKED_FOR_DELETE)
-				return;
+			RecordPreCollisionVelocity(body0);
+			RecordPreCollisionVelocity(body1);
+		}
 
-			unsigned int flags0 = pObj0->GetCallbackFlags();
-			unsigned int flags1 = pObj1->GetCallbackFlags();
+		virtual bool isThreadSafe() const {
+			return true;
+		}
 
-			// Clear it
-			memset(&m_tmpEvent, 0, sizeof(m_tmpEvent));
-			m_tmpEvent.collisionSpeed = 0.f; // Invalid pre-collision
-			m_tmpEvent.deltaCollisionTime = 10.f; // FIXME: Find a way to track the real delta time
-			m_tmpEvent.isCollision = (flags0 & flags1 & CALLBACK_GLOBAL_COLLISION); // False when either one of the objects don't have CALLBACK_GLOBAL_COLLISION
-			m_tmpEvent.isShadowCollision = (flags0 ^ flags1) & CALLBACK_SHADOW_COLLISION; // True when only one of the objects is a shadow (if both are shadow, it's handled by the game)
+		void SetCollisionEventCallback(IPhysicsCollisionEvent *pCallback) {
+			m_pCallback = pCallback;
+		}
 
-			m_tmpEvent.pObjects[0] = pObj0;
-			m_tmpEvent.pObjects[1] = pObj1;	
-			m_tmpEvent.surfaceProps[0] = pObj0->GetMaterialIndex();
-			m_tmpEvent.surfaceProps[1] = pObj1->GetMaterialIndex();
+		// Call after each simulation step, while still in simulation (so objects the game deletes get queued)
+		// Returns the amount of events the game got
+		int DeliverEvents(btDispatcher *pDispatcher, float timeStep) {
+			GatherEvents(pDispatcher, timeStep);
+			return DispatchEvents();
+		}
 
-			if ((pObj0->IsStatic() && !(flags1 & CALLBACK_GLOBAL_COLLIDE_STATIC)) || (pObj1->IsStatic() && !(flags0 & CALLBACK_GLOBAL_COLLIDE_STATIC))) {
-				m_tmpEvent.isCollision = false;
+		// Asynchronous steps gather the events of every tick on the simulation thread,
+		// and the game gets them all on its own thread once the step is done.
+		void GatherEvents(btDispatcher *pDispatcher, float timeStep) {
+			if (m_pCallback) {
+				GatherRecords(pDispatcher);
+				CoalesceRecords(timeStep);
 			}
 
-			if (!m_tmpEvent.isCollision && !m_tmpEvent.isShadowCollision) return;
-
-			CPhysicsCollisionData data(cp);
-			m_tmpEvent.pInternalData = &data;
-
-			// Give the game its stupid velocities
-			if (body0->m_originalBody) {
-				m_tmpVelocities[0] = body0->m_originalBody->getLinearVelocity();
-				m_tmpAngVelocities[0] = body0->m_originalBody->getAngularVelocity();
+			m_records.RemoveAll();
+			m_iStep++;
+		}
 
-				body0->m_originalBody->setLinearVelocity(m_tmpVelocities[0] + body0->internalGetDeltaLinearVelocity());
-				body0->m_originalBody->setAngularVelocity(m_tmpAngVelocities[0] + body0->internalGetDeltaAngularVelocity());
+		int DispatchEvents() {
+			int numEvents = 0;
+			if (m_pCallback) {
+				for (int i = 0; i < m_events.Count(); i++) {
+					if (DispatchEvent(m_events[i]))
+						numEvents++;
+				}
 			}
-			if (body1->m_originalBody) {
-				m_tmpVelocities[1] = body1->m_originalBody->getLinearVelocity();
-				m_tmpAngVelocities[1] = body1->m_originalBody->getAngularVelocity();
 
-				body1->m_originalBody->setLinearVelocity(m_tmpVelocities[1] + body1->internalGetDeltaLinearVelocity());
-				body1->m_originalBody->setAngularVelocity(m_tmpAngVelocities[1] + body1->internalGetDeltaAngularVelocity());
-			}
+			m_events.RemoveAll();
+			return numEvents;
+		}
 
-			if (m_pCallback)
-				m_pCallback->PreCollision(&m_tmpEvent);
+		void DiscardEvents() {
+			m_events.RemoveAll();
+		}
 
-			// Restore the velocities
-			// UNDONE: No need, postSolveContact will do this.
-			/*
-			if (body0->m_originalBody) {
-				body0->m_originalBody->setLinearVelocity(m_tmpVelocities[0]);
-				body0->m_originalBody->setAngularVelocity(m_tmpAngVelocities[0]);
-			}
-			if (body1->m_originalBody) {
-				body1->m_originalBody->setLinearVelocity(m_tmpVelocities[1]);
-				body1->m_originalBody->setAngularVelocity(m_tmpAngVelocities[1]);
+	private:
+		void RecordPreCollisionVelocity(btSolverBody *body) {
+			btRigidBody *pBody = body->m_originalBody;
+			if (!pBody || pBody->getInvMass() == 0)
+				return;
+
+			CPhysicsObject *pObject = (CPhysicsObject *)pBody->getUserPointer();
+			if (pObject && pObject->GetPreCollisionStep() != m_iStep) {
+				// The solver doesn't write the velocities back to the body until it's done
+				pObject->SetPreCollisionVelocity(pBody->getLinearVelocity(), pBody->getAngularVelocity(), m_iStep);
 			}
-			*/
 		}
 
-		// TODO: Optimize this, heavily!
-		virtual void postSolveContact(btSolverBody *body0, btSolverBody *body1, btManifoldPoint *cp) {
-			btRigidBody *rb0 = btRigidBody::upcast(body0->m_originalColObj);
-			btRigidBody *rb1 = btRigidBody::upcast(body1->m_originalColObj);
+		void GatherRecords(btDispatcher *pDispatcher) {
+			int numManifolds = pDispatcher->getNumManifolds();
+			for (int i = 0; i < numManifolds; i++) {
+				btPersistentManifold *pManifold = pDispatcher->getManifoldByIndexInternal(i);
+				if (pManifold->getNumContacts() <= 0)
+					continue;
 
-			// FIXME: Problem with bullet code, only one solver body created for static objects!
-			// There could be more than one static object created by us!
-			CPhysicsObject *pObj0 = (CPhysicsObject *)body0->m_originalColObj->getUserPointer();
-			CPhysicsObject *pObj1 = (CPhysicsObject *)body1->m_originalColObj->getUserPointer();
-			if (pObj0->GetCallbackFlags() & CALLBACK_MARKED_FOR_DELETE || pObj1->GetCallbackFlags() & CALLBACK_MARKED_FOR_DELETE)
-				return;
+				const btRigidBody *body0 = btRigidBody::upcast(pManifold->getBody0());
+				const btRigidBody *body1 = btRigidBody::upcast(pManifold->getBody1());
+				if (!body0 || !body1)
+					continue;
 
-			//unsigned int flags0 = pObj0->GetCallbackFlags();
-			//unsigned int flags1 = pObj1->GetCallbackFlags();
+				// The solver skips sleeping islands
+				if (!body0->isActive() && !body1->isActive())
+					continue;
 
-			btScalar combinedInvMass = rb0->getInvMass() + rb1->getInvMass();
-			m_tmpEvent.collisionSpeed = BULL2HL(cp->m_appliedImpulse * combinedInvMass); // Speed of body 1 rel to body 2 on axis of constraint normal
+				CPhysicsObject *pObj0 = (CPhysicsObject *)body0->getUserPointer();
+				CPhysicsObject *pObj1 = (CPhysicsObject *)body1->getUserPointer();
+				if (!pObj0 || !pObj1)
+					continue;
 
-			// FIXME: Find a way to track the real delta time
-			// IVP tracks this delta time between object pairs
-			m_tmpEvent.deltaCollisionTime = 10.f;
-			/*
-			m_tmpEvent.isCollision = (flags0 & flags1 & CALLBACK_GLOBAL_COLLISION); // False when either one of the objects don't have CALLBACK_GLOBAL_COLLISION
-			m_tmpEvent.isShadowCollision = (flags0 ^ flags1) & CALLBACK_SHADOW_COLLISION; // True when only one of the objects is a shadow
+				unsigned int flags0 = pObj0->GetCallbackFlags();
+				unsigned int flags1 = pObj1->GetCallbackFlags();
+				if ((flags0 | flags1) & CALLBACK_MARKED_FOR_DELETE)
+					continue;
 
-			m_tmpEvent.pObjects[0] = pObj0;
-			m_tmpEvent.pObjects[1] = pObj1;	
-			m_tmpEvent.surfaceProps[0] = pObj0 ? pObj0->GetMaterialIndex() : 0;
-			m_tmpEvent.surfaceProps[1] = pObj1 ? pObj1->GetMaterialIndex() : 0;
-			*/
+				bool isCollision = (flags0 & flags1 & CALLBACK_GLOBAL_COLLISION) != 0; // False when either one of the objects don't have CALLBACK_GLOBAL_COLLISION
+				bool isShadowCollision = ((flags0 ^ flags1) & CALLBACK_SHADOW_COLLISION) != 0; // True when only one of the objects is a shadow (if both are shadow, it's handled by the game)
 
-			if (!m_tmpEvent.isCollision && !m_tmpEvent.isShadowCollision) return;
+				if ((pObj0->IsStatic() && !(flags1 & CALLBACK_GLOBAL_COLLIDE_STATIC)) || (pObj1->IsStatic() && !(flags0 & CALLBACK_GLOBAL_COLLIDE_STATIC))) {
+					isCollision = false;
+				}
 
-			CPhysicsCollisionData data(cp);
-			m_tmpEvent.pInternalData = &data;
+				if (!isCollision && !isShadowCollision)
+					continue;
 
-			// Give the game its stupid velocities
-			if (body0->m_originalBody) {
-				body0->m_originalBody->setLinearVelocity(m_tmpVelocities[0] + body0->internalGetDeltaLinearVelocity());
-				body0->m_originalBody->setAngularVelocity(m_tmpAngVelocities[0] + body0->internalGetDeltaAngularVelocity());
-			}
-			if (body1->m_originalBody) {
-				body1->m_originalBody->setLinearVelocity(m_tmpVelocities[1] + body1->internalGetDeltaLinearVelocity());
-				body1->m_originalBody->setAngularVelocity(m_tmpAngVelocities[1] + body1->internalGetDeltaAngularVelocity());
-			}
+				// Find the point the solver pushed on the hardest (it only solves points within the processing threshold)
+				int best = -1;
+				for (int j = 0; j < pManifold->getNumContacts(); j++) {
+					const btManifoldPoint &cp = pManifold->getContactPoint(j);
+					if (cp.getDistance() > pManifold->getContactProcessingThreshold())
+						continue;
+
+					if (best == -1 || cp.m_appliedImpulse > pManifold->getContactPoint(best).m_appliedImpulse)
+						best = j;
+				}
 
-			if (m_pCallback)
-				m_pCallback->PostCollision(&m_tmpEvent);
+				if (best == -1)
+					continue;
 
-			// Restore the velocities
-			if (body0->m_originalBody) {
-				body0->m_originalBody->setLinearVelocity(m_tmpVelocities[0]);
-				body0->m_originalBody->setAngularVelocity(m_tmpAngVelocities[0]);
+				btManifoldPoint &cp = pManifold->getContactPoint(best);
+
+				int order = m_records.AddToTail();
+				collisionrecord_t &record = m_records[order];
+				record.pObjects[0] = pObj0;
+				record.pObjects[1] = pObj1;
+				record.pManifold = pManifold;
+				record.order = order;
+				record.impulse = cp.m_appliedImpulse;
+				record.deltaTime = COLLISION_FIRST_DELTA_TIME;
+				record.isCollision = isCollision;
+				record.isShadowCollision = isShadowCollision;
+
+				ConvertDirectionToHL(cp.m_normalWorldOnB, record.surfaceNormal);
+				ConvertPosToHL(cp.getPositionWorldOnA(), record.contactPoint);
+				ConvertPosToHL(cp.m_lateralFrictionDir1, record.contactSpeed);	// FIXME: Need the correct variable from the manifold point
 			}
-			if (body1->m_originalBody) {
-				body1->m_originalBody->setLinearVelocity(m_tmpVelocities[1]);
-				body1->m_originalBody->setAngularVelocity(m_tmpAngVelocities[1]);
+		}
+
+		// Some pairs have more than one manifold (compounds), the game only gets to hear about the strongest one
+		void CoalesceRecords(float timeStep) {
+			m_records.Sort(CompareCollisionRecords);
+			int step = m_iStep & COLLISION_STEP_MASK;
+
+			for (int first = 0; first < m_records.Count();) {
+				int last = first + 1;
+				while (last < m_records.Count() && IsSamePair(m_records[first], m_records[last]))
+					last++;
+
+				int best = first;
+				int lastEventStep = -1;
+				for (int i = first; i < last; i++) {
+					btPersistentManifold *pManifold = m_records[i].pManifold;
+					if (pManifold->m_userTimestamp >= 0) {
+						int manifoldStep = (int)pManifold->m_userTimestamp;
+						if (lastEventStep == -1 || ((step - manifoldStep) & COLLISION_STEP_MASK) < ((step - lastEventStep) & COLLISION_STEP_MASK))
+							lastEventStep = manifoldStep;
+					}
+					pManifold->m_userTimestamp = (btScalar)step;
+
+					if (m_records[i].impulse > m_records[best].impulse)
+						best = i;
+				}
+
+				collisionrecord_t &event = m_events[m_events.AddToTail(m_records[best])];
+				event.pManifold = NULL;
+				if (lastEventStep >= 0)
+					event.deltaTime = min(((step - lastEventStep) & COLLISION_STEP_MASK) * timeStep, COLLISION_FIRST_DELTA_TIME);
+
+				for (int j = 0; j < 2; j++) {
+					CPhysicsObject *pObject = event.pObjects[j];
+					event.hasPreVelocity[j] = pObject->GetPreCollisionStep() == m_iStep;
+					if (!event.hasPreVelocity[j])
+						continue;
+
+					const btVector3 &vel = pObject->GetPreCollisionVelocity();
+					const btVector3 &angVel = pObject->GetPreCollisionAngularVelocity();
+					event.preVelocity[j].Init(vel.x(), vel.y(), vel.z());
+					event.preAngVelocity[j].Init(angVel.x(), angVel.y(), angVel.z());
+				}
+
+				first = last;
 			}
 		}
 
-		void friction(btSolverBody *body0, btSolverBody *body1, btSolverConstraint *constraint) {
-			/*
-			btRigidBody *rb0 = btRigidBody::upcast(body0->m_originalColObj);
-			btRigidBody *rb1 = btRigidBody::upcast(body1->m_originalColObj);
+		bool DispatchEvent(const collisionrecord_t &record) {
+			CPhysicsObject *pObj0 = record.pObjects[0];
+			CPhysicsObject *pObj1 = record.pObjects[1];
 
-			// FIXME: Problem with bullet code, only one solver body created for static objects!
-			// There could be more than one static object created by us!
-			CPhysicsObject *pObj0 = (CPhysicsObject *)body0->m_originalColObj->getUserPointer();
-			CPhysicsObject *pObj1 = (CPhysicsObject *)body1->m_originalColObj->getUserPointer();
+			// The game may have killed one of them in an earlier event
+			if ((pObj0->GetCallbackFlags() | pObj1->GetCallbackFlags()) & CALLBACK_MARKED_FOR_DELETE)
+				return false;
 
-			unsigned int flags0 = pObj0->GetCallbackFlags();
-			unsigned int flags1 = pObj1->GetCallbackFlags();
+			vcollisionevent_t event;
+			memset(&event, 0, sizeof(event));
+			event.pObjects[0] = pObj0;
+			event.pObjects[1] = pObj1;
+			event.surfaceProps[0] = pObj0->GetMaterialIndex();
+			event.surfaceProps[1] = pObj1->GetMaterialIndex();
+			event.isCollision = record.isCollision;
+			event.isShadowCollision = record.isShadowCollision;
+			event.deltaCollisionTime = record.deltaTime;
+
+			CPhysicsCollisionData data(record.surfaceNormal, record.contactPoint, record.contactSpeed);
+			event.pInternalData = &data;
+
+			// Give the game its stupid velocities: the ones from before the collision in PreCollision
+			btRigidBody *pBodies[2] = {pObj0->GetObject(), pObj1->GetObject()};
+			btVector3 vel[2], angVel[2];
+			bool swapped[2] = {false, false};
+			for (int i = 0; i < 2; i++) {
+				if (!record.hasPreVelocity[i])
+					continue;
 
-			// Don't do the callback if it's disabled on either object
-			if (!(flags0 & flags1 & CALLBACK_GLOBAL_FRICTION)) return;
+				const Vector &preVel = record.preVelocity[i];
+				const Vector &preAngVel = record.preAngVelocity[i];
 
-			// If the solver uses 2 friction directions
-			btSolverConstraint *constraint2 = NULL;
-			if (m_pEnv->GetBulletEnvironment()->getSolverInfo().m_solverMode & SOLVER_USE_2_FRICTION_DIRECTIONS) {
-				constraint2 = constraint + 1; // Always stored after the first one
+				vel[i] = pBodies[i]->getLinearVelocity();
+				angVel[i] = pBodies[i]->getAngularVelocity();
+				pBodies[i]->setLinearVelocity(btVector3(preVel.x, preVel.y, preVel.z));
+				pBodies[i]->setAngularVelocity(btVector3(preAngVel.x, preAngVel.y, preAngVel.z));
+				swapped[i] = true;
 			}
 
-			// Calculate the energy consumed
-			float totalImpulse = constraint->m_appliedImpulse + (constraint2 ? constraint2->m_appliedImpulse : 0);
-			totalImpulse *= rb0->getInvMass(); // Get just the velocity
-			totalImpulse *= totalImpulse; // Square it
-			totalImpulse *= SAFE_DIVIDE(.5, rb0->getInvMass()); // Add back the mass (1/2*mv^2)
+			event.collisionSpeed = 0.f; // Invalid pre-collision
+			m_pCallback->PreCollision(&event);
 
-			if (m_pCallback)
-				m_pCallback->Friction(pObj0)
-			*/
-		}
+			for (int i = 0; i < 2; i++) {
+				if (!swapped[i])
+					continue;
 
-		void SetCollisionEventCallback(IPhysicsCollisionEvent *pCallback) {
-			m_pCallback = pCallback;
+				pBodies[i]->setLinearVelocity(vel[i]);
+				pBodies[i]->setAngularVelocity(angVel[i]);
+			}
+
+			btScalar combinedInvMass = pBodies[0]->getInvMass() + pBodies[1]->getInvMass();
+			event.collisionSpeed = BULL2HL(record.impulse * combinedInvMass); // Speed of body 1 rel to body 2 on axis of constraint normal
+			m_pCallback->PostCollision(&event);
+			return true;
 		}
 
-	private:
 		CPhysicsEnvironment *m_pEnv;
 		IPhysicsCollisionEvent *m_pCallback;
 
-		// Temp. variables saved between Pre/PostCollision
-		btVector3 m_tmpVelocities[2];
-		btVector3 m_tmpAngVelocities[2];
-		vcollisionevent_t m_tmpEvent;
+		int m_iStep; // Objects remember which step their pre-collision velocity is from, manifolds which step they last reported on
+
+		CUtlVector<collisionrecord_t> m_records;
+		CUtlVector<collisionrecord_t> m_events;
 };
 
 /*******************************
@@ -503,7 +1040,7 @@ class CCollisionEventListener : public btSolveCallback {
 // Change the hardcoded min and max if you change the min and max here!
 #ifdef MULTITHREADED
 static void vphysics_numthreads_Change(IConVar *var, const char *pOldValue, float flOldValue);
-static ConVar vphysics_numthreads("vphysics_numthreads", "4", FCVAR_ARCHIVE, "Amount of threads to use in simulation (don't set this too high).", true, 1, true, 8, vphysics_numthreads_Change);
+ConVar vphysics_numthreads("vphysics_numthreads", "4", FCVAR_ARCHIVE, "Amount of threads to use in simulation (don't set this too high).", true, 1, true, 8, vphysics_numthreads_Change);
 
 static void vphysics_numthreads_Change(IConVar *var, const char *pOldValue, float flOldValue) {
 	int newVal = vphysics_numthreads.GetInt();
@@ -540,6 +1077,21 @@ CPhysicsEnvironment::CPhysicsEnvironment() {
 	m_simPSICurrent = 0;
 	m_simPSI = 0;
 
+	m_bAsyncSimulation		= false;
+	m_bAsyncStepRunning		= false;
+	m_bAsyncEventsPending	= false;
+	m_bAsyncThreadExit		= false;
+	m_asyncDeltaTime		= 0.f;
+	m_numAsyncTicks			= 0;
+	m_asyncOwnerThread		= 0;
+	m_pAsyncThread			= NULL;
+	m_pAsyncStartEvent		= NULL;
+	m_pAsyncDoneEvent		= NULL;
+
+	m_bRestoring			= false;
+	m_bSavedDeferredCollide	= false;
+	m_sharedPoolBusy		= 0;
+
 #ifdef MULTITHREADED
 	// Maximum number of parallel tasks (number of threads in the thread support)
 	// Good to set it to the same amount of CPU cores on the system.
@@ -569,13 +1121,16 @@ CPhysicsEnvironment::CPhysicsEnvironment() {
 	m_pBulletSolver = new btSequentialImpulseConstraintSolver;
 #endif
 
-	m_pBulletBroadphase = new btDbvtBroadphase;
+	CPhysicsBroadphase *pBroadphase = new CPhysicsBroadphase;
+	m_pBulletBroadphase = pBroadphase;
 
 	// Note: The soft body solver (last default-arg in the constructor) is used for OpenCL stuff (as per the Soft Body Demo)
 	m_pBulletEnvironment = new btSoftRigidDynamicsWorld(m_pBulletDispatcher, m_pBulletBroadphase, m_pBulletSolver, m_pBulletConfiguration);
 
-	m_pBulletGhostCallback = new btGhostPairCallback;
+	memset(&m_stats, 0, sizeof(m_stats));
+	m_pBulletGhostCallback = new CPairStatsCallback(&m_stats);
 	m_pCollisionSolver = new CCollisionSolver(this);
+	pBroadphase->SetCollisionSolver(m_pCollisionSolver);
 	m_pBulletEnvironment->getPairCache()->setOverlapFilterCallback(m_pCollisionSolver);
 	m_pBulletBroadphase->getOverlappingPairCache()->setInternalGhostPairCallback(m_pBulletGhostCallback);
 
@@ -583,8 +1138,9 @@ CPhysicsEnvironment::CPhysicsEnvironment() {
 	m_pPhysicsDragController = new CPhysicsDragController;
 	m_pObjectTracker = new CObjectTracker(this, NULL);
 
+	m_pProfiler = new CPhysicsProfiler;
+
 	m_perfparams.Defaults();
-	memset(&m_stats, 0, sizeof(m_stats));
 
 	// Soft body stuff
 	m_softBodyWorldInfo.m_broadphase = m_pBulletBroadphase;
@@ -618,6 +1174,22 @@ CPhysicsEnvironment::CPhysicsEnvironment() {
 }
 
 CPhysicsEnvironment::~CPhysicsEnvironment() {
+	// The last step's events point at objects we're about to delete
+	WaitForSimulation();
+	DiscardAsyncEvents();
+
+#ifdef MULTITHREADED
+	if (m_pAsyncThread) {
+		m_bAsyncThreadExit = true;
+		m_pAsyncStartEvent->trigger();
+		m_pAsyncThread->waitForExit();
+
+		btDeleteThread(m_pAsyncThread);
+		btDeleteEvent(m_pAsyncStartEvent);
+		btDeleteEvent(m_pAsyncDoneEvent);
+	}
+#endif
+
 #if DEBUG_DRAW
 	delete m_debugdraw;
 #endif
@@ -653,10 +1225,15 @@ CPhysicsEnvironment::~CPhysicsEnvironment() {
 	delete m_pCollisionListener;
 	delete m_pCollisionSolver;
 	delete m_pObjectTracker;
+	delete m_pProfiler;
+
+	m_dragTickTasks.PurgeAndDeleteElements();
+	m_controllerTickTasks.PurgeAndDeleteElements();
 }
 
 void CPhysicsEnvironment::ChangeThreadCount(int newThreadCount) {
 #ifdef MULTITHREADED
+	WaitForSimulation();
 	m_pSharedThreadPool->resizeThreads(newThreadCount);
 #endif
 }
@@ -690,6 +1267,7 @@ btIDebugDraw *CPhysicsEnvironment::GetDebugDrawer() {
 }
 
 void CPhysicsEnvironment::SetGravity(const Vector &gravityVector) {
+	WaitForSimulation();
 	btVector3 temp;
 	ConvertPosToBull(gravityVector, temp);
 
@@ -705,6 +1283,7 @@ void CPhysicsEnvironment::GetGravity(Vector *pGravityVector) const {
 }
 
 void CPhysicsEnvironment::SetAirDensity(float density) {
+	WaitForSimulation();
 	m_pPhysicsDragController->SetAirDensity(density);
 
 	// Density is kg/in^3 from HL
@@ -715,33 +1294,94 @@ float CPhysicsEnvironment::GetAirDensity() const {
 	return m_pPhysicsDragController->GetAirDensity();
 }
 
-IPhysicsObject *CPhysicsEnvironment::CreatePolyObject(const CPhysCollide *pCollisionModel, int materialIndex, const Vector &position, const QAngle &angles, objectparams_t *pParams) {
-	IPhysicsObject *pObject = CreatePhysicsObject(this, pCollisionModel, materialIndex, position, angles, pParams, false);
-	m_objects.AddToTail(pObject);
-	return pObject;
+// Objects, soft bodies and controllers remember their slot in our lists. Removing one swaps the last
+// element into its slot, so nothing ever has to search the lists (and they stay contiguous for GetObjectList)
+void CPhysicsEnvironment::AddObjectToList(IPhysicsObject *pObject) {
+	if (!pObject) return;
+
+	((CPhysicsObject *)pObject)->SetEnvironmentIndex(m_objects.AddToTail(pObject));
+	m_pObjectTracker->ObjectAdded((CPhysicsObject *)pObject);
 }
 
-IPhysicsObject *CPhysicsEnvironment::CreatePolyObjectStatic(const CPhysCollide *pCollisionModel, int materialIndex, const Vector &position, const QAngle &angles, objectparams_t *pParams) {
-	IPhysicsObject *pObject = CreatePhysicsObject(this, pCollisionModel, materialIndex, position, angles, pParams, true);
-	m_objects.AddToTail(pObject);
-	return pObject;
+void CPhysicsEnvironment::RemoveObjectFromList(IPhysicsObject *pObject) {
+	CPhysicsObject *pPhys = (CPhysicsObject *)pObject;
+	m_pObjectTracker->ObjectRemoved(pPhys);
+
+	int index = pPhys->GetEnvironmentIndex();
+	if (index < 0 || index >= m_objects.Count() || m_objects[index] != pObject) return;
+
+	m_objects.FastRemove(index);
+	if (index < m_objects.Count())
+		((CPhysicsObject *)m_objects[index])->SetEnvironmentIndex(index);
+
+	pPhys->SetEnvironmentIndex(-1);
 }
 
-// Deprecated. Create a sphere model using collision interface.
+void CPhysicsEnvironment::AddSoftBodyToList(IPhysicsSoftBody *pSoftBody) {
+	((CPhysicsSoftBody *)pSoftBody)->SetEnvironmentIndex(m_softBodies.AddToTail(pSoftBody));
+}
+
+void CPhysicsEnvironment::RemoveSoftBodyFromList(IPhysicsSoftBody *pSoftBody) {
+	CPhysicsSoftBody *pPhys = (CPhysicsSoftBody *)pSoftBody;
+	int index = pPhys->GetEnvironmentIndex();
+	if (index < 0 || index >= m_softBodies.Count() || m_softBodies[index] != pSoftBody) return;
+
+	m_softBodies.FastRemove(index);
+	if (index < m_softBodies.Count())
+		((CPhysicsSoftBody *)m_softBodies[index])->SetEnvironmentIndex(index);
+
+	pPhys->SetEnvironmentIndex(-1);
+}
+
+template <class T>
+static void AddControllerToList(CUtlVector<T *> &list, T *pController) {
+	pController->SetControllerIndex(list.AddToTail(pController));
+}
+
+template <class T>
+static void RemoveControllerFromList(CUtlVector<T *> &list, T *pController) {
+	int index = pController->GetControllerIndex();
+	if (index < 0 || index >= list.Count() || list[index] != pController) return;
+
+	list.FastRemove(index);
+	if (index < list.Count())
+		list[index]->SetControllerIndex(index);
+
+	pController->SetControllerIndex(-1);
+}
+
+IPhysicsObject *CPhysicsEnvironment::CreatePolyObject(const CPhysCollide *pCollisionModel, int materialIndex, const Vector &position, const QAngle &angles, objectparams_t *pParams) {
+	WaitForSimulation();
+	IPhysicsObject *pObject = CreatePhysicsObject(this, pCollisionModel, materialIndex, position, angles, pParams, false);
+	AddObjectToList(pObject);
+	return pObject;
+}
+
+IPhysicsObject *CPhysicsEnvironment::CreatePolyObjectStatic(const CPhysCollide *pCollisionModel, int materialIndex, const Vector &position, const QAngle &angles, objectparams_t *pParams) {
+	WaitForSimulation();
+	IPhysicsObject *pObject = CreatePhysicsObject(this, pCollisionModel, materialIndex, position, angles, pParams, true);
+	AddObjectToList(pObject);
+	return pObject;
+}
+
+// Deprecated. Create a sphere model using collision interface.
 IPhysicsObject *CPhysicsEnvironment::CreateSphereObject(float radius, int materialIndex, const Vector &position, const QAngle &angles, objectparams_t *pParams, bool isStatic) {
+	WaitForSimulation();
 	IPhysicsObject *pObject = CreatePhysicsSphere(this, radius, materialIndex, position, angles, pParams, isStatic);
-	m_objects.AddToTail(pObject);
+	AddObjectToList(pObject);
 	return pObject;
 }
 
 void CPhysicsEnvironment::DestroyObject(IPhysicsObject *pObject) {
 	if (!pObject) return;
-	Assert(m_deadObjects.Find(pObject) == -1);	// If you hit this assert, the object is already on the list!
 
-	m_objects.FindAndRemove(pObject);
-	m_pObjectTracker->ObjectRemoved((CPhysicsObject *)pObject);
+	WaitForSimulation();
+	Assert(!(pObject->GetCallbackFlags() & CALLBACK_MARKED_FOR_DELETE));	// If you hit this assert, the object is already on the dead list!
 
-	if (m_inSimulation || m_bUseDeleteQueue) {
+	RemoveObjectFromList(pObject);
+
+	// In asynchronous mode the last step's events may still point at it, so it's always queued
+	if (m_inSimulation || m_bUseDeleteQueue || m_bAsyncSimulation) {
 		// We're still in the simulation, so deleting an object would be disastrous here. Queue it!
 		((CPhysicsObject *)pObject)->AddCallbackFlags(CALLBACK_MARKED_FOR_DELETE);
 		m_deadObjects.AddToTail(pObject);
@@ -751,33 +1391,37 @@ void CPhysicsEnvironment::DestroyObject(IPhysicsObject *pObject) {
 }
 
 IPhysicsSoftBody *CPhysicsEnvironment::CreateSoftBody() {
+	WaitForSimulation();
 	CPhysicsSoftBody *pSoftBody = ::CreateSoftBody(this);
 	if (pSoftBody)
-		m_softBodies.AddToTail(pSoftBody);
+		AddSoftBodyToList(pSoftBody);
 
 	return pSoftBody;
 }
 
 IPhysicsSoftBody *CPhysicsEnvironment::CreateSoftBodyFromVertices(const Vector *vertices, int numVertices, const softbodyparams_t *pParams) {
+	WaitForSimulation();
 	CPhysicsSoftBody *pSoftBody = ::CreateSoftBodyFromVertices(this, vertices, numVertices, pParams);
 	if (pSoftBody)
-		m_softBodies.AddToTail(pSoftBody);
+		AddSoftBodyToList(pSoftBody);
 
 	return pSoftBody;
 }
 
 IPhysicsSoftBody *CPhysicsEnvironment::CreateSoftBodyRope(const Vector &pos, const Vector &end, int resolution, const softbodyparams_t *pParams) {
+	WaitForSimulation();
 	CPhysicsSoftBody *pSoftBody = ::CreateSoftBodyRope(this, pos, end, resolution, pParams);
 	if (pSoftBody)
-		m_softBodies.AddToTail(pSoftBody);
+		AddSoftBodyToList(pSoftBody);
 
 	return pSoftBody;
 }
 
 IPhysicsSoftBody *CPhysicsEnvironment::CreateSoftBodyPatch(const Vector *corners, int resx, int resy, const softbodyparams_t *pParams) {
+	WaitForSimulation();
 	CPhysicsSoftBody *pSoftBody = ::CreateSoftBodyPatch(this, corners, resx, resy, pParams);
 	if (pSoftBody)
-		m_softBodies.AddToTail(pSoftBody);
+		AddSoftBodyToList(pSoftBody);
 
 	return pSoftBody;
 }
@@ -785,7 +1429,9 @@ IPhysicsSoftBody *CPhysicsEnvironment::CreateSoftBodyPatch(const Vector *corners
 void CPhysicsEnvironment::DestroySoftBody(IPhysicsSoftBody *pSoftBody) {
 	if (!pSoftBody) return;
 
-	m_softBodies.FindAndRemove(pSoftBody);
+	WaitForSimulation();
+
+	RemoveSoftBodyFromList(pSoftBody);
 	
 	if (m_inSimulation || m_bUseDeleteQueue) {
 		m_pDeleteQueue->QueueForDelete(pSoftBody);
@@ -795,25 +1441,36 @@ void CPhysicsEnvironment::DestroySoftBody(IPhysicsSoftBody *pSoftBody) {
 }
 
 IPhysicsFluidController *CPhysicsEnvironment::CreateFluidController(IPhysicsObject *pFluidObject, fluidparams_t *pParams) {
+	WaitForSimulation();
 	CPhysicsFluidController *pFluid = ::CreateFluidController(this, (CPhysicsObject *)pFluidObject, pParams);
 	if (pFluid)
-		m_fluids.AddToTail(pFluid);
+		AddControllerToList(m_fluids, pFluid);
 
 	return pFluid;
 }
 
 void CPhysicsEnvironment::DestroyFluidController(IPhysicsFluidController *pController) {
-	m_fluids.FindAndRemove((CPhysicsFluidController *)pController);
+	WaitForSimulation();
+	RemoveControllerFromList(m_fluids, (CPhysicsFluidController *)pController);
+
+	for (int i = 0; i < m_deferredFluidTouches.Count(); i++) {
+		if (m_deferredFluidTouches[i].pController == pController)
+			m_deferredFluidTouches[i].pController = NULL;
+	}
+
 	delete pController;
 }
 
 IPhysicsSpring *CPhysicsEnvironment::CreateSpring(IPhysicsObject *pObjectStart, IPhysicsObject *pObjectEnd, springparams_t *pParams) {
+	WaitForSimulation();
 	return ::CreateSpringConstraint(this, pObjectStart, pObjectEnd, pParams);
 }
 
 void CPhysicsEnvironment::DestroySpring(IPhysicsSpring *pSpring) {
 	if (!pSpring) return;
 
+	WaitForSimulation();
+
 	CPhysicsConstraint *pConstraint = (CPhysicsConstraint *)pSpring;
 
 	if (m_deleteQuick) {
@@ -835,44 +1492,55 @@ void CPhysicsEnvironment::DestroySpring(IPhysicsSpring *pSpring) {
 }
 
 IPhysicsConstraint *CPhysicsEnvironment::CreateRagdollConstraint(IPhysicsObject *pReferenceObject, IPhysicsObject *pAttachedObject, IPhysicsConstraintGroup *pGroup, const constraint_ragdollparams_t &ragdoll) {
+	WaitForSimulation();
 	return ::CreateRagdollConstraint(this, pReferenceObject, pAttachedObject, pGroup, ragdoll);
 }
 
 IPhysicsConstraint *CPhysicsEnvironment::CreateHingeConstraint(IPhysicsObject *pReferenceObject, IPhysicsObject *pAttachedObject, IPhysicsConstraintGroup *pGroup, const constraint_hingeparams_t &hinge) {
+	WaitForSimulation();
 	return ::CreateHingeConstraint(this, pReferenceObject, pAttachedObject, pGroup, hinge);
 }
 
 IPhysicsConstraint *CPhysicsEnvironment::CreateFixedConstraint(IPhysicsObject *pReferenceObject, IPhysicsObject *pAttachedObject, IPhysicsConstraintGroup *pGroup, const constraint_fixedparams_t &fixed) {
+	WaitForSimulation();
 	return ::CreateFixedConstraint(this, pReferenceObject, pAttachedObject, pGroup, fixed);
 }
 
 IPhysicsConstraint *CPhysicsEnvironment::CreateSlidingConstraint(IPhysicsObject *pReferenceObject, IPhysicsObject *pAttachedObject, IPhysicsConstraintGroup *pGroup, const constraint_slidingparams_t &sliding) {
+	WaitForSimulation();
 	return ::CreateSlidingConstraint(this, pReferenceObject, pAttachedObject, pGroup, sliding);
 }
 
 IPhysicsConstraint *CPhysicsEnvironment::CreateBallsocketConstraint(IPhysicsObject *pReferenceObject, IPhysicsObject *pAttachedObject, IPhysicsConstraintGroup *pGroup, const constraint_ballsocketparams_t &ballsocket) {
+	WaitForSimulation();
 	return ::CreateBallsocketConstraint(this, pReferenceObject, pAttachedObject, pGroup, ballsocket);
 }
 
 IPhysicsConstraint *CPhysicsEnvironment::CreatePulleyConstraint(IPhysicsObject *pReferenceObject, IPhysicsObject *pAttachedObject, IPhysicsConstraintGroup *pGroup, const constraint_pulleyparams_t &pulley) {
+	WaitForSimulation();
 	return ::CreatePulleyConstraint(this, pReferenceObject, pAttachedObject, pGroup, pulley);
 }
 
 IPhysicsConstraint *CPhysicsEnvironment::CreateLengthConstraint(IPhysicsObject *pReferenceObject, IPhysicsObject *pAttachedObject, IPhysicsConstraintGroup *pGroup, const constraint_lengthparams_t &length) {
+	WaitForSimulation();
 	return ::CreateLengthConstraint(this, pReferenceObject, pAttachedObject, pGroup, length);
 }
 
 IPhysicsConstraint *CPhysicsEnvironment::CreateGearConstraint(IPhysicsObject *pReferenceObject, IPhysicsObject *pAttachedObject, IPhysicsConstraintGroup *pGroup, const constraint_gearparams_t &gear) {
+	WaitForSimulation();
 	return ::CreateGearConstraint(this, pReferenceObject, pAttachedObject, pGroup, gear);
 }
 
 IPhysicsConstraint *CPhysicsEnvironment::CreateUserConstraint(IPhysicsObject *pReferenceObject, IPhysicsObject *pAttachedObject, IPhysicsConstraintGroup *pGroup, IPhysicsUserConstraint *pConstraint) {
+	WaitForSimulation();
 	return ::CreateUserConstraint(this, pReferenceObject, pAttachedObject, pGroup, pConstraint);
 }
 
 void CPhysicsEnvironment::DestroyConstraint(IPhysicsConstraint *pConstraint) {
 	if (!pConstraint) return;
 
+	WaitForSimulation();
+
 	if (m_deleteQuick) {
 		IPhysicsObject *pObj0 = pConstraint->GetReferenceObject();
 		if (pObj0 && !pObj0->IsStatic())
@@ -892,17 +1560,20 @@ void CPhysicsEnvironment::DestroyConstraint(IPhysicsConstraint *pConstraint) {
 }
 
 IPhysicsConstraintGroup *CPhysicsEnvironment::CreateConstraintGroup(const constraint_groupparams_t &groupParams) {
+	WaitForSimulation();
 	return ::CreateConstraintGroup(this, groupParams);
 }
 
 void CPhysicsEnvironment::DestroyConstraintGroup(IPhysicsConstraintGroup *pGroup) {
+	WaitForSimulation();
 	delete pGroup;
 }
 
 IPhysicsShadowController *CPhysicsEnvironment::CreateShadowController(IPhysicsObject *pObject, bool allowTranslation, bool allowRotation) {
+	WaitForSimulation();
 	CShadowController *pController = ::CreateShadowController(pObject, allowTranslation, allowRotation);
 	if (pController)
-		m_controllers.AddToTail(pController);
+		AddControllerToList<IController>(m_controllers, pController);
 
 	return pController;
 }
@@ -910,14 +1581,17 @@ IPhysicsShadowController *CPhysicsEnvironment::CreateShadowController(IPhysicsOb
 void CPhysicsEnvironment::DestroyShadowController(IPhysicsShadowController *pController) {
 	if (!pController) return;
 
-	m_controllers.FindAndRemove((CShadowController *)pController);
+	WaitForSimulation();
+
+	RemoveControllerFromList<IController>(m_controllers, (CShadowController *)pController);
 	delete pController;
 }
 
 IPhysicsPlayerController *CPhysicsEnvironment::CreatePlayerController(IPhysicsObject *pObject) {
+	WaitForSimulation();
 	CPlayerController *pController = ::CreatePlayerController(this, pObject);
 	if (pController)
-		m_controllers.AddToTail(pController);
+		AddControllerToList<IController>(m_controllers, pController);
 
 	return pController;
 }
@@ -925,14 +1599,17 @@ IPhysicsPlayerController *CPhysicsEnvironment::CreatePlayerController(IPhysicsOb
 void CPhysicsEnvironment::DestroyPlayerController(IPhysicsPlayerController *pController) {
 	if (!pController) return;
 
-	m_controllers.FindAndRemove((CPlayerController *)pController);
+	WaitForSimulation();
+
+	RemoveControllerFromList<IController>(m_controllers, (CPlayerController *)pController);
 	delete pController;
 }
 
 IPhysicsMotionController *CPhysicsEnvironment::CreateMotionController(IMotionEvent *pHandler) {
+	WaitForSimulation();
 	CPhysicsMotionController *pController = (CPhysicsMotionController *)::CreateMotionController(this, pHandler);
 	if (pController)
-		m_controllers.AddToTail(pController);
+		AddControllerToList<IController>(m_controllers, pController);
 
 	return pController;
 }
@@ -940,26 +1617,40 @@ IPhysicsMotionController *CPhysicsEnvironment::CreateMotionController(IMotionEve
 void CPhysicsEnvironment::DestroyMotionController(IPhysicsMotionController *pController) {
 	if (!pController) return;
 
-	m_controllers.FindAndRemove((CPhysicsMotionController *)pController);
+	WaitForSimulation();
+
+	RemoveControllerFromList<IController>(m_controllers, (CPhysicsMotionController *)pController);
 	delete pController;
 }
 
 IPhysicsVehicleController *CPhysicsEnvironment::CreateVehicleController(IPhysicsObject *pVehicleBodyObject, const vehicleparams_t &params, unsigned int nVehicleType, IPhysicsGameTrace *pGameTrace) {
+	WaitForSimulation();
 	return ::CreateVehicleController(this, (CPhysicsObject *)pVehicleBodyObject, params, nVehicleType, pGameTrace);
 }
 
 void CPhysicsEnvironment::DestroyVehicleController(IPhysicsVehicleController *pController) {
+	WaitForSimulation();
 	delete pController;
 }
 
 void CPhysicsEnvironment::SetCollisionSolver(IPhysicsCollisionSolver *pSolver) {
+	WaitForSimulation();
 	m_pCollisionSolver->SetHandler(pSolver);
 }
 
 static ConVar cvar_substeps("vphysics_substeps", "4", FCVAR_REPLICATED, "Sets the amount of simulation substeps (higher number means higher precision)", true, 1, false, 0);
+
+#define SIMULATE_MAX_TICKS 4 // Most fixed timesteps a single Simulate call runs
+
 void CPhysicsEnvironment::Simulate(float deltaTime) {
 	Assert(m_pBulletEnvironment);
 
+	// Asynchronous mode: Finish the step the last call launched and give the game its callbacks
+	if (m_bAsyncStepRunning || m_bAsyncEventsPending) {
+		WaitForSimulation();
+		DeliverAsyncEvents();
+	}
+
 	// Input deltaTime is how many seconds have elapsed since the previous frame
 	// phys_timescale can scale this parameter however...
 	// Can cause physics to slow down on the client environment when the game's window is not in focus
@@ -979,18 +1670,24 @@ void CPhysicsEnvironment::Simulate(float deltaTime) {
 	
 	// Simulate no less than 1 ms
 	if (deltaTime > 0.0001) {
+		m_subStepTime = m_timestep;
+
+		if (m_bAsyncSimulation) {
+			// The last step is done, so draw it and collect the SDF now. Both are left alone while the next one runs.
+#if DEBUG_DRAW
+			m_debugdraw->DrawWorld();
+#endif
+			m_softBodyWorldInfo.m_sparsesdf.GarbageCollect();
+
+			LaunchAsyncStep(deltaTime);
+			return;
+		}
+
 		// Now mark us as being in simulation. This is used for callbacks from bullet mid-simulation
 		// so we don't end up doing stupid things like deleting objects still in use
 		m_inSimulation = true;
 
-		m_subStepTime = m_timestep;
-		
-		// Okay, how this fixed timestep shit works:
-		// The game sends in deltaTime which is the amount of time that has passed since the last frame
-		// Bullet will add the deltaTime to its internal counter
-		// When this internal counter exceeds m_timestep (param 3 to the below), the simulation will run for fixedTimeStep seconds
-		// If the internal counter does not exceed fixedTimeStep, bullet will just interpolate objects so the game can render them nice and happy
-		m_pBulletEnvironment->stepSimulation(deltaTime, 4, m_timestep, m_simPSICurrent);
+		StepSimulation(deltaTime);
 
 		// No longer in simulation!
 		m_inSimulation = false;
@@ -1004,6 +1701,197 @@ void CPhysicsEnvironment::Simulate(float deltaTime) {
 	m_softBodyWorldInfo.m_sparsesdf.GarbageCollect();
 }
 
+// UNEXPOSED
+void CPhysicsEnvironment::StepSimulation(float deltaTime) {
+	m_pProfiler->BeginStep();
+
+	// Okay, how this fixed timestep shit works:
+	// The game sends in deltaTime which is the amount of time that has passed since the last frame
+	// Bullet will add the deltaTime to its internal counter
+	// When this internal counter exceeds m_timestep (param 3 to the below), the simulation will run for fixedTimeStep seconds
+	// If the internal counter does not exceed fixedTimeStep, bullet will just interpolate objects so the game can render them nice and happy
+	m_pBulletEnvironment->stepSimulation(deltaTime, SIMULATE_MAX_TICKS, m_timestep, m_simPSICurrent);
+
+	m_pProfiler->EndStep();
+}
+
+// Asynchronous simulation overview:
+// Simulate snapshots the objects and hands the step to our simulation thread (which also drives the thread pool).
+// While it runs, the game thread reads the snapshots, and any call that changes (or reads more of) the environment waits for it.
+// Everything that would call into the game during the step is held back and delivered by the next Simulate.
+void CPhysicsEnvironment::SetAsyncSimulation(bool enable) {
+#ifdef MULTITHREADED
+	if (enable == m_bAsyncSimulation) return;
+
+	if (!enable) {
+		// Back to how a synchronous Simulate leaves things
+		WaitForSimulation();
+		DeliverAsyncEvents();
+	} else if (!m_pAsyncThread) {
+		m_pAsyncStartEvent = btCreateEvent(false);
+		m_pAsyncDoneEvent = btCreateEvent(true);
+
+		m_pAsyncThread = btCreateThread();
+		m_pAsyncThread->setThreadFunc(AsyncThreadFunc);
+		m_pAsyncThread->setThreadName("vphysics simulation");
+		m_pAsyncThread->run(this);
+	}
+
+	m_bAsyncSimulation = enable;
+#endif
+}
+
+bool CPhysicsEnvironment::IsAsyncSimulation() const {
+	return m_bAsyncSimulation;
+}
+
+void CPhysicsEnvironment::WaitForSimulation() {
+#ifdef MULTITHREADED
+	// Only the thread that launched the step waits. The simulation thread and the thread pool call
+	// the same functions while the step runs (controllers waking objects and such).
+	if (!m_bAsyncStepRunning || ThreadGetCurrentId() != m_asyncOwnerThread)
+		return;
+
+	m_pAsyncDoneEvent->wait();
+	m_bAsyncStepRunning = false;
+#endif
+}
+
+// UNEXPOSED
+// The pool isn't reentrant, and the step uses it. Other threads, calls made during the step (from a trace filter or
+// any other callback) and nested calls don't get it, and should do their work on the calling thread instead.
+btThreadPool *CPhysicsEnvironment::AcquireSharedThreadPool() {
+#ifdef MULTITHREADED
+	if (!ThreadInMainThread() || m_inSimulation || m_bAsyncStepRunning)
+		return NULL;
+
+	if (!ThreadInterlockedAssignIf(&m_sharedPoolBusy, 1, 0))
+		return NULL;
+
+	return m_pSharedThreadPool;
+#else
+	return NULL;
+#endif
+}
+
+// UNEXPOSED
+void CPhysicsEnvironment::ReleaseSharedThreadPool() {
+	Assert(m_sharedPoolBusy);
+	m_sharedPoolBusy = 0;
+}
+
+// UNEXPOSED
+// For changes the game makes to an object that don't wake it
+void CPhysicsEnvironment::MarkSnapshotDirty(CPhysicsObject *pObject) {
+	m_pObjectTracker->MarkSnapshotDirty(pObject);
+}
+
+// UNEXPOSED
+bool CPhysicsEnvironment::ShouldReadSnapshot() const {
+	return m_bAsyncStepRunning && ThreadGetCurrentId() == m_asyncOwnerThread;
+}
+
+// UNEXPOSED
+void CPhysicsEnvironment::AsyncThreadFunc(void *pArg) {
+#ifdef MULTITHREADED
+	CPhysicsEnvironment *pEnv = (CPhysicsEnvironment *)pArg;
+
+	while (true) {
+		pEnv->m_pAsyncStartEvent->wait();
+		if (pEnv->m_bAsyncThreadExit)
+			break;
+
+		pEnv->StepSimulation(pEnv->m_asyncDeltaTime);
+		pEnv->m_pAsyncDoneEvent->trigger();
+	}
+#endif
+}
+
+// UNEXPOSED
+void CPhysicsEnvironment::LaunchAsyncStep(float deltaTime) {
+#ifdef MULTITHREADED
+	// Same math stepSimulation uses to decide how many fixed timesteps to run
+	btScalar localTime = m_pBulletEnvironment->getLocalTime() + deltaTime;
+	int numTicks = localTime >= m_timestep ? MIN((int)(localTime / m_timestep), SIMULATE_MAX_TICKS) : 0;
+
+	if (numTicks > 0) {
+		m_inSimulation = true;
+
+		// One tick per substep at the substep time, with the PSI scale BulletTick would give them
+		btScalar subStepTime = m_timestep / m_simPSI;
+		int simPSICurrent = m_simPSICurrent;
+		for (int i = 0; i < numTicks * m_simPSI; i++) {
+			float invPSIScale = 0;
+			if (simPSICurrent) {
+				invPSIScale = 1.0f / (float)simPSICurrent;
+				simPSICurrent--;
+			}
+
+			TickGameThreadControllers(subStepTime, invPSIScale);
+		}
+
+		m_inSimulation = false;
+	}
+
+	// What the game thread reads until the step is done
+	m_pObjectTracker->UpdateSnapshots();
+
+	m_asyncDeltaTime = deltaTime;
+	m_asyncOwnerThread = ThreadGetCurrentId();
+	m_numAsyncTicks = 0;
+	m_bAsyncEventsPending = true;
+	m_bAsyncStepRunning = true;
+
+	m_pAsyncDoneEvent->reset();
+	m_pAsyncStartEvent->trigger();
+#endif
+}
+
+// UNEXPOSED
+// The callbacks of the last asynchronous step, in the order a synchronous tick makes them
+void CPhysicsEnvironment::DeliverAsyncEvents() {
+	if (!m_bAsyncEventsPending) return;
+
+	m_inSimulation = true;
+
+	m_pCollisionSolver->FlushDeferredPairs(m_pBulletBroadphase->getOverlappingPairCache());
+	m_stats.impactCounter += m_pCollisionListener->DispatchEvents();
+
+	// DestroyFluidController clears the controller out of touches we haven't gotten to yet
+	for (int i = 0; i < m_deferredFluidTouches.Count(); i++) {
+		fluidtouch_t touch = m_deferredFluidTouches[i];
+		if (!touch.pController) continue;
+
+		if (touch.start)
+			HandleFluidStartTouch(touch.pController, touch.pObject);
+		else
+			HandleFluidEndTouch(touch.pController, touch.pObject);
+	}
+
+	m_deferredFluidTouches.RemoveAll();
+
+	m_inSimulation = false;
+	m_bAsyncEventsPending = false;
+
+	// Update object sleep states
+	m_pObjectTracker->Tick();
+
+	if (!m_bUseDeleteQueue) {
+		CleanupDeleteList();
+	}
+
+	// Once per step instead of once per tick
+	if (m_pCollisionEvent && m_numAsyncTicks > 0)
+		m_pCollisionEvent->PostSimulationFrame();
+}
+
+// UNEXPOSED
+void CPhysicsEnvironment::DiscardAsyncEvents() {
+	m_pCollisionListener->DiscardEvents();
+	m_deferredFluidTouches.RemoveAll();
+	m_bAsyncEventsPending = false;
+}
+
 bool CPhysicsEnvironment::IsInSimulation() const {
 	return m_inSimulation;
 }
@@ -1013,6 +1901,7 @@ float CPhysicsEnvironment::GetSimulationTimestep() const {
 }
 
 void CPhysicsEnvironment::SetSimulationTimestep(float timestep) {
+	WaitForSimulation();
 	m_timestep = timestep;
 }
 
@@ -1031,21 +1920,25 @@ float CPhysicsEnvironment::GetNextFrameTime() const {
 }
 
 void CPhysicsEnvironment::SetCollisionEventHandler(IPhysicsCollisionEvent *pCollisionEvents) {
+	WaitForSimulation();
 	m_pCollisionListener->SetCollisionEventCallback(pCollisionEvents);
 	m_pCollisionEvent = pCollisionEvents;
 }
 
 void CPhysicsEnvironment::SetObjectEventHandler(IPhysicsObjectEvent *pObjectEvents) {
+	WaitForSimulation();
 	m_pObjectEvent = pObjectEvents;
 
 	m_pObjectTracker->SetObjectEventHandler(pObjectEvents);
 }
 
 void CPhysicsEnvironment::SetConstraintEventHandler(IPhysicsConstraintEvent *pConstraintEvents) {
+	WaitForSimulation();
 	m_pConstraintEvent = pConstraintEvents;
 }
 
 void CPhysicsEnvironment::SetQuickDelete(bool bQuick) {
+	WaitForSimulation();
 	m_deleteQuick = bQuick;
 }
 
@@ -1070,25 +1963,34 @@ const IPhysicsObject **CPhysicsEnvironment::GetObjectList(int *pOutputObjectCoun
 }
 
 bool CPhysicsEnvironment::TransferObject(IPhysicsObject *pObject, IPhysicsEnvironment *pDestinationEnvironment) {
+	WaitForSimulation();
 	if (!pObject || !pDestinationEnvironment) return false;
 
 	if (pDestinationEnvironment == this) {
 		((CPhysicsObject *)pObject)->TransferToEnvironment(this);
-		m_objects.AddToTail(pObject);
+		AddObjectToList(pObject);
 		if (pObject->IsFluid())
-			m_fluids.AddToTail(((CPhysicsObject *)pObject)->GetFluidController());
+			AddControllerToList(m_fluids, ((CPhysicsObject *)pObject)->GetFluidController());
 
 		return true;
 	} else {
-		m_objects.FindAndRemove(pObject);
+		RemoveObjectFromList(pObject);
+		((CPhysicsObject *)pObject)->SetLastActivationState(-1); // Let the new environment's tracker pick it up
+
 		if (pObject->IsFluid())
-			m_fluids.FindAndRemove(((CPhysicsObject *)pObject)->GetFluidController());
+			RemoveControllerFromList(m_fluids, ((CPhysicsObject *)pObject)->GetFluidController());
 
 		return pDestinationEnvironment->TransferObject(pObject, pDestinationEnvironment);
 	}
 }
 
 void CPhysicsEnvironment::CleanupDeleteList() {
+	WaitForSimulation();
+
+	// The last asynchronous step's events may point at these, they're deleted once the events are delivered
+	if (m_bAsyncEventsPending)
+		return;
+
 	for (int i = 0; i < m_deadObjects.Count(); i++) {
 		delete m_deadObjects.Element(i);
 	}
@@ -1098,25 +2000,401 @@ void CPhysicsEnvironment::CleanupDeleteList() {
 }
 
 void CPhysicsEnvironment::EnableDeleteQueue(bool enable) {
+	WaitForSimulation();
 	m_bUseDeleteQueue = enable;
 }
 
+// Save games: every saved thing is one flat record (the *save_t structs next to each class) written in a single pass,
+// the game stores it as one block of data. Pointers in the records are from when the game was saved,
+// Restore maps them to whatever was restored in their place (objects are always restored before anything using them).
+#define PHYSSAVE_VERSION	1
+
+struct physsaveheader_t {
+	unsigned short	version;
+	unsigned short	type;		// PhysInterfaceId_t
+	void *			pObject;	// Pointer from when the game was saved
+};
+
+template <typename T>
+static inline void PutRecordData(CUtlBuffer &buf, const T &data) {
+	buf.Put(&data, sizeof(T));
+}
+
+template <typename T>
+static inline bool GetRecordData(CUtlBuffer &buf, T &data) {
+	buf.Get(&data, sizeof(T));
+	return buf.IsValid();
+}
+
 bool CPhysicsEnvironment::Save(const physsaveparams_t &params) {
-	NOT_IMPLEMENTED
-	return false;
+	if (!params.pSave || !params.pObject) return false;
+
+	WaitForSimulation();
+
+	m_saveBuffer.Clear();
+	if (!WriteSaveRecord(m_saveBuffer, params.type, params.pObject))
+		return false;
+
+	int size = m_saveBuffer.TellPut();
+	params.pSave->WriteInt(&size);
+	params.pSave->WriteData((const char *)m_saveBuffer.Base(), size);
+	return true;
 }
 
 void CPhysicsEnvironment::PreRestore(const physprerestoreparams_t &params) {
-	NOT_IMPLEMENTED
+	WaitForSimulation();
+
+	m_restoredPointers.RemoveAll();
+	for (int i = 0; i < params.recreatedObjectCount; i++) {
+		m_restoredPointers.Insert((uintp)params.recreatedObjectList[i].pOldObject, params.recreatedObjectList[i].pNewObject);
+	}
+
+	// Restored objects go in the broadphase without looking for pairs, PostRestore finds them all at once
+	if (!m_bRestoring) {
+		btDbvtBroadphase *pBroadphase = (btDbvtBroadphase *)m_pBulletBroadphase;
+		m_bSavedDeferredCollide = pBroadphase->m_deferedcollide;
+		pBroadphase->m_deferedcollide = true;
+		m_bRestoring = true;
+	}
 }
 
 bool CPhysicsEnvironment::Restore(const physrestoreparams_t &params) {
-	NOT_IMPLEMENTED
-	return false;
+	if (!params.pRestore || !params.ppObject) return false;
+
+	WaitForSimulation();
+	*params.ppObject = NULL;
+
+	int size = 0;
+	params.pRestore->ReadInt(&size);
+	if (size <= 0) return false;
+
+	m_saveBuffer.Clear();
+	m_saveBuffer.EnsureCapacity(size);
+	params.pRestore->ReadData((char *)m_saveBuffer.Base(), size, size);
+	m_saveBuffer.SeekPut(CUtlBuffer::SEEK_HEAD, size);
+
+	*params.ppObject = ReadSaveRecord(m_saveBuffer, params);
+	return *params.ppObject != NULL;
 }
 
 void CPhysicsEnvironment::PostRestore() {
-	NOT_IMPLEMENTED
+	WaitForSimulation();
+
+	if (m_bRestoring) {
+		btDbvtBroadphase *pBroadphase = (btDbvtBroadphase *)m_pBulletBroadphase;
+		pBroadphase->rebuild(m_pBulletDispatcher);
+		pBroadphase->m_deferedcollide = m_bSavedDeferredCollide;
+		m_bRestoring = false;
+	}
+
+	m_restoredPointers.Purge();
+	m_saveBuffer.Purge();
+}
+
+// UNEXPOSED
+bool CPhysicsEnvironment::WriteSaveRecord(CUtlBuffer &buf, PhysInterfaceId_t type, void *pObject) {
+	if (!pObject) return false;
+
+	physsaveheader_t header;
+	memset(&header, 0, sizeof(header));
+	header.version = PHYSSAVE_VERSION;
+	header.type = type;
+	header.pObject = pObject;
+
+	switch (type) {
+		case PIID_IPHYSICSOBJECT: {
+			CPhysicsObject *pPhys = (CPhysicsObject *)(IPhysicsObject *)pObject;
+
+			objectsave_t data;
+			pPhys->GetSaveData(data);
+
+			PutRecordData(buf, header);
+			PutRecordData(buf, data);
+
+			if (data.flags & OBJECTSAVE_SHADOW) {
+				shadowsave_t shadow;
+				((CShadowController *)pPhys->GetShadowController())->GetSaveData(shadow);
+				PutRecordData(buf, shadow);
+			}
+
+			return true;
+		}
+		case PIID_IPHYSICSFLUIDCONTROLLER: {
+			fluidsave_t data;
+			((CPhysicsFluidController *)(IPhysicsFluidController *)pObject)->GetSaveData(data);
+
+			PutRecordData(buf, header);
+			PutRecordData(buf, data);
+			return true;
+		}
+		case PIID_IPHYSICSSPRING:
+		case PIID_IPHYSICSCONSTRAINT: {
+			CPhysicsConstraint *pConstraint;
+			if (type == PIID_IPHYSICSSPRING)
+				pConstraint = (CPhysicsSpring *)(IPhysicsSpring *)pObject;
+			else
+				pConstraint = (CPhysicsConstraint *)(IPhysicsConstraint *)pObject;
+
+			constraintsave_t data;
+			pConstraint->GetSaveData(data);
+
+			// The game owns user constraints and saves them itself
+			if (data.type == CONSTRAINT_USER || data.type == CONSTRAINT_PULLEY || data.type == CONSTRAINT_UNKNOWN)
+				return false;
+
+			PutRecordData(buf, header);
+			PutRecordData(buf, data);
+			buf.Put(pConstraint->GetCreationParams(), data.paramsSize);
+			return true;
+		}
+		case PIID_IPHYSICSCONSTRAINTGROUP: {
+			constraint_groupparams_t data;
+			((CPhysicsConstraintGroup *)(IPhysicsConstraintGroup *)pObject)->GetErrorParams(&data);
+
+			PutRecordData(buf, header);
+			PutRecordData(buf, data);
+			return true;
+		}
+		case PIID_IPHYSICSSHADOWCONTROLLER: {
+			// The shadow's state is saved with its object
+			CPhysicsObject *pPhys = ((CShadowController *)(IPhysicsShadowController *)pObject)->GetObject();
+			if (!pPhys) return false;
+
+			PutRecordData(buf, header);
+			PutRecordData(buf, (void *)(IPhysicsObject *)pPhys);
+			return true;
+		}
+		case PIID_IPHYSICSPLAYERCONTROLLER: {
+			playersave_t data;
+			((CPlayerController *)(IPhysicsPlayerController *)pObject)->GetSaveData(data);
+			if (!data.pObject) return false;
+
+			PutRecordData(buf, header);
+			PutRecordData(buf, data);
+			return true;
+		}
+		case PIID_IPHYSICSMOTIONCONTROLLER: {
+			// The game hands us the event handler on restore, all that's left are the objects
+			CPhysicsMotionController *pController = (CPhysicsMotionController *)(IPhysicsMotionController *)pObject;
+			int count = pController->CountObjects();
+
+			CUtlVector<IPhysicsObject *> objects;
+			objects.SetCount(count);
+			pController->GetObjects(objects.Base());
+
+			PutRecordData(buf, header);
+			PutRecordData(buf, count);
+			buf.Put(objects.Base(), count * sizeof(IPhysicsObject *));
+			return true;
+		}
+		case PIID_IPHYSICSVEHICLECONTROLLER: {
+			vehiclesave_t data;
+			((CPhysicsVehicleController *)(IPhysicsVehicleController *)pObject)->GetSaveData(data);
+
+			PutRecordData(buf, header);
+			PutRecordData(buf, data);
+			return true;
+		}
+		default:
+			return false;
+	}
+}
+
+// UNEXPOSED
+void *CPhysicsEnvironment::ReadSaveRecord(CUtlBuffer &buf, const physrestoreparams_t &params) {
+	physsaveheader_t header;
+	if (!GetRecordData(buf, header)) {
+		Warning("Restore: Save record is truncated!\n");
+		return NULL;
+	}
+
+	if (header.version != PHYSSAVE_VERSION) {
+		Warning("Restore: Save record version mismatch! (expected %d, got %d)\n", PHYSSAVE_VERSION, header.version);
+		return NULL;
+	}
+
+	if (header.type != params.type) {
+		Warning("Restore: Save record type mismatch! (expected %d, got %d)\n", params.type, header.type);
+		return NULL;
+	}
+
+	void *pRestored = NULL;
+
+	switch (header.type) {
+		case PIID_IPHYSICSOBJECT: {
+			objectsave_t data;
+			shadowsave_t shadow;
+			if (!GetRecordData(buf, data)) break;
+			if ((data.flags & OBJECTSAVE_SHADOW) && !GetRecordData(buf, shadow)) break;
+
+			CPhysicsObject *pPhys = CreateObjectFromSave(data, (data.flags & OBJECTSAVE_SHADOW) ? &shadow : NULL, params.pCollisionModel, params.pGameData, params.pName);
+			pRestored = (IPhysicsObject *)pPhys;
+			break;
+		}
+		case PIID_IPHYSICSFLUIDCONTROLLER: {
+			fluidsave_t data;
+			if (!GetRecordData(buf, data)) break;
+
+			IPhysicsObject *pFluidObject = (IPhysicsObject *)GetRestoredPointer(data.pFluidObject);
+			if (!pFluidObject) break;
+
+			data.params.pGameData = params.pGameData;
+			pRestored = CreateFluidController(pFluidObject, &data.params);
+			break;
+		}
+		case PIID_IPHYSICSSPRING:
+		case PIID_IPHYSICSCONSTRAINT: {
+			constraintsave_t data;
+			if (!GetRecordData(buf, data)) break;
+			if (data.paramsSize < 0 || data.paramsSize > buf.GetBytesRemaining()) break;
+
+			const void *pParams = buf.PeekGet(data.paramsSize, 0);
+			buf.SeekGet(CUtlBuffer::SEEK_CURRENT, data.paramsSize);
+
+			IPhysicsObject *pReferenceObject = (IPhysicsObject *)GetRestoredPointer(data.pReferenceObject);
+			IPhysicsObject *pAttachedObject = (IPhysicsObject *)GetRestoredPointer(data.pAttachedObject);
+			IPhysicsConstraintGroup *pGroup = (IPhysicsConstraintGroup *)GetRestoredPointer(data.pGroup);
+
+			CPhysicsConstraint *pConstraint = ::CreateConstraintFromSave(this, pReferenceObject, pAttachedObject, pGroup, data, pParams);
+			if (!pConstraint) break;
+
+			pConstraint->SetGameData(params.pGameData);
+			if (header.type == PIID_IPHYSICSSPRING)
+				pRestored = (IPhysicsSpring *)(CPhysicsSpring *)pConstraint;
+			else
+				pRestored = (IPhysicsConstraint *)pConstraint;
+
+			break;
+		}
+		case PIID_IPHYSICSCONSTRAINTGROUP: {
+			constraint_groupparams_t data;
+			if (!GetRecordData(buf, data)) break;
+
+			pRestored = (IPhysicsConstraintGroup *)::CreateConstraintGroup(this, data);
+			break;
+		}
+		case PIID_IPHYSICSSHADOWCONTROLLER: {
+			void *pOldObject;
+			if (!GetRecordData(buf, pOldObject)) break;
+
+			CPhysicsObject *pPhys = (CPhysicsObject *)(IPhysicsObject *)GetRestoredPointer(pOldObject);
+			if (!pPhys) break;
+
+			// The object's record normally brought its shadow back already
+			if (!pPhys->GetShadowController())
+				pPhys->SetShadow(0, 0, true, true);
+
+			pRestored = pPhys->GetShadowController();
+			break;
+		}
+		case PIID_IPHYSICSPLAYERCONTROLLER: {
+			playersave_t data;
+			if (!GetRecordData(buf, data)) break;
+
+			IPhysicsObject *pPhys = (IPhysicsObject *)GetRestoredPointer(data.pObject);
+			if (!pPhys) break;
+
+			CPlayerController *pController = (CPlayerController *)CreatePlayerController(pPhys);
+			pController->ApplySaveData(data, (CPhysicsObject *)(IPhysicsObject *)GetRestoredPointer(data.pGround));
+			pRestored = (IPhysicsPlayerController *)pController;
+			break;
+		}
+		case PIID_IPHYSICSMOTIONCONTROLLER: {
+			int count;
+			if (!GetRecordData(buf, count)) break;
+			if (count < 0 || count * (int)sizeof(void *) > buf.GetBytesRemaining()) break;
+
+			IPhysicsMotionController *pController = CreateMotionController((IMotionEvent *)params.pGameData);
+			for (int i = 0; i < count; i++) {
+				void *pOldObject;
+				GetRecordData(buf, pOldObject);
+
+				IPhysicsObject *pPhys = (IPhysicsObject *)GetRestoredPointer(pOldObject);
+				if (pPhys)
+					pController->AttachObject(pPhys, false);
+			}
+
+			pRestored = pController;
+			break;
+		}
+		case PIID_IPHYSICSVEHICLECONTROLLER: {
+			vehiclesave_t data;
+			if (!GetRecordData(buf, data)) break;
+
+			IPhysicsObject *pBody = (IPhysicsObject *)GetRestoredPointer(data.pBody);
+			if (!pBody) break;
+
+			CPhysicsVehicleController *pController = (CPhysicsVehicleController *)CreateVehicleController(pBody, data.params, data.vehicleType, params.pGameTrace);
+			pController->ApplySaveData(data);
+			pRestored = (IPhysicsVehicleController *)pController;
+			break;
+		}
+		default:
+			break;
+	}
+
+	if (!pRestored) {
+		Warning("Restore: Failed to restore a save record of type %d!\n", header.type);
+		return NULL;
+	}
+
+	m_restoredPointers.Insert((uintp)header.pObject, pRestored);
+	return pRestored;
+}
+
+// UNEXPOSED
+CPhysicsObject *CPhysicsEnvironment::CreateObjectFromSave(const objectsave_t &data, const shadowsave_t *pShadow, const CPhysCollide *pCollide, void *pGameData, const char *pName) {
+	bool isStatic = (data.flags & OBJECTSAVE_STATIC) != 0;
+
+	objectparams_t params;
+	memset(&params, 0, sizeof(params));
+	params.mass				= data.mass;
+	params.inertia			= 1.0f;
+	params.pName			= pName;
+	params.pGameData		= pGameData;
+	params.volume			= data.volume / CUBIC_METERS_PER_CUBIC_INCH;
+	params.dragCoefficient	= data.dragCoefficient;
+	params.enableCollisions	= (data.flags & OBJECTSAVE_COLLISIONS) != 0;
+
+	// Created where it was saved, so static objects land in the right spot in the broadphase
+	Vector position;
+	QAngle angles;
+	ConvertPosToHL(data.transform.getOrigin(), position);
+	ConvertRotationToHL(data.transform.getBasis(), angles);
+
+	IPhysicsObject *pObject;
+	if (data.flags & OBJECTSAVE_SPHERE)
+		pObject = CreateSphereObject(data.sphereRadius, data.materialIndex, position, angles, &params, isStatic);
+	else if (pCollide && isStatic)
+		pObject = CreatePolyObjectStatic(pCollide, data.materialIndex, position, angles, &params);
+	else if (pCollide)
+		pObject = CreatePolyObject(pCollide, data.materialIndex, position, angles, &params);
+	else
+		return NULL;
+
+	if (!pObject) return NULL;
+
+	CPhysicsObject *pPhys = (CPhysicsObject *)pObject;
+
+	// The shadow goes first, attaching it changes what the object saved
+	if (pShadow) {
+		pPhys->SetShadow(0, 0, pShadow->allowTranslation, pShadow->allowRotation);
+		((CShadowController *)pPhys->GetShadowController())->ApplySaveData(*pShadow);
+	}
+
+	pPhys->ApplySaveData(data);
+	return pPhys;
+}
+
+// Returns NULL if nothing was restored in its place
+void *CPhysicsEnvironment::GetRestoredPointer(void *pOldPointer) const {
+	if (!pOldPointer) return NULL;
+
+	UtlHashHandle_t h = m_restoredPointers.Find((uintp)pOldPointer);
+	if (h == m_restoredPointers.InvalidHandle())
+		return NULL;
+
+	return m_restoredPointers.Element(h);
 }
 
 bool CPhysicsEnvironment::IsCollisionModelUsed(CPhysCollide *pCollide) const {
@@ -1134,20 +2412,241 @@ bool CPhysicsEnvironment::IsCollisionModelUsed(CPhysCollide *pCollide) const {
 	return false;
 }
 
+// Shared by the ray and convex trace callbacks
+static bool ShouldTraceHitProxy(IPhysicsTraceFilter *pFilter, unsigned int mask, const btBroadphaseProxy *proxy0, short int filterGroup, short int filterMask) {
+	btCollisionObject *pColObj = (btCollisionObject *)proxy0->m_clientObject;
+	CPhysicsObject *pObj = (CPhysicsObject *)pColObj->getUserPointer();
+	if (pFilter && pObj && !pFilter->ShouldHitObject(pObj, mask)) {
+		return false;
+	}
+
+	bool collides = (proxy0->m_collisionFilterGroup & filterMask) != 0;
+	collides = collides && (filterGroup & proxy0->m_collisionFilterMask);
+
+	return collides;
+}
+
+class CTraceFilterRayResultCallback : public btCollisionWorld::ClosestRayResultCallback {
+	public:
+		CTraceFilterRayResultCallback(): btCollisionWorld::ClosestRayResultCallback(btVector3(0, 0, 0), btVector3(0, 0, 0)) {
+			m_pTraceFilter = NULL;
+			m_mask = 0;
+		}
+
+		void Init(IPhysicsTraceFilter *pFilter, unsigned int mask, const btVector3 &rayFromWorld, const btVector3 &rayToWorld) {
+			m_rayFromWorld = rayFromWorld;
+			m_rayToWorld = rayToWorld;
+			m_closestHitFraction = 1;
+			m_collisionObject = NULL;
+			m_pTraceFilter = pFilter;
+			m_mask = mask;
+		}
+
+		virtual bool needsCollision(btBroadphaseProxy *proxy0) const {
+			return ShouldTraceHitProxy(m_pTraceFilter, m_mask, proxy0, m_collisionFilterGroup, m_collisionFilterMask);
+		}
+
+	private:
+		IPhysicsTraceFilter *m_pTraceFilter;
+		unsigned int m_mask;
+};
+
+// Max rays traced through the broadphase trees together (rayTestPacket supports up to 32)
+#define RAY_PACKET_SIZE 16
+
+// Ray packet leaf callback, narrowphase tests a leaf against a single ray and shrinks that ray to the closest hit
+class CRayPacketCollider : public btDbvt::ICollide {
+	public:
+		CRayPacketCollider(btDbvt::sRayPacketEntry *pEntries, CTraceFilterRayResultCallback *pCallbacks, const btScalar *pLengths) {
+			m_pEntries = pEntries;
+			m_pCallbacks = pCallbacks;
+			m_pLengths = pLengths;
+		}
+
+		void ProcessRay(const btDbvtNode *leaf, int ray) {
+			CTraceFilterRayResultCallback &cb = m_pCallbacks[ray];
+			if (cb.m_closestHitFraction == 0) return;
+
+			btBroadphaseProxy *pProxy = (btBroadphaseProxy *)leaf->data;
+			if (!cb.needsCollision(pProxy)) return;
+
+			btCollisionObject *pObject = (btCollisionObject *)pProxy->m_clientObject;
+
+			btTransform rayFromTrans, rayToTrans;
+			rayFromTrans.setIdentity();
+			rayFromTrans.setOrigin(cb.m_rayFromWorld);
+			rayToTrans.setIdentity();
+			rayToTrans.setOrigin(cb.m_rayToWorld);
+
+			btSoftRigidDynamicsWorld::rayTestSingle(rayFromTrans, rayToTrans, pObject, pObject->getCollisionShape(), pObject->getWorldTransform(), cb);
+			m_pEntries[ray].lambda_max = m_pLengths[ray] * cb.m_closestHitFraction;
+		}
+
+	private:
+		btDbvt::sRayPacketEntry *m_pEntries;
+		CTraceFilterRayResultCallback *m_pCallbacks;
+		const btScalar *m_pLengths;
+};
+
+// Traces up to RAY_PACKET_SIZE rays. Box traces (!m_IsRay) aren't supported and are left untouched, like TraceRay.
+// Thread safe as long as the stack isn't shared (and the trace filters are thread safe)
+static void TraceRayPacket(btDbvtBroadphase *pBroadphase, const physraytrace_t *pRays, int numRays, trace_t *pTraces, btAlignedObjectArray<btDbvt::sStkNP> &stack) {
+	Assert(numRays <= RAY_PACKET_SIZE);
+
+	CTraceFilterRayResultCallback callbacks[RAY_PACKET_SIZE];
+	btDbvt::sRayPacketEntry entries[RAY_PACKET_SIZE];
+	btScalar lengths[RAY_PACKET_SIZE];
+	int rayIndices[RAY_PACKET_SIZE];
+	int numEntries = 0;
+
+	for (int i = 0; i < numRays; i++) {
+		const Ray_t *pRay = pRays[i].pRay;
+		if (!pRay || !pRay->m_IsRay) continue;
+
+		btVector3 vecStart, vecEnd;
+		ConvertPosToBull(pRay->m_Start + pRay->m_StartOffset, vecStart);
+		ConvertPosToBull(pRay->m_Start + pRay->m_StartOffset + pRay->m_Delta, vecEnd);
+
+		// Zero length rays can't hit anything (and would normalize to NaN)
+		if ((vecEnd - vecStart).length2() < SIMD_EPSILON * SIMD_EPSILON) {
+			trace_t *pTrace = &pTraces[i];
+			pTrace->startpos = pRay->m_Start + pRay->m_StartOffset;
+			pTrace->endpos = pTrace->startpos;
+			pTrace->fraction = 1;
+			pTrace->allsolid = false;
+			pTrace->startsolid = false;
+			pTrace->plane.normal.Init();
+			pTrace->plane.dist = 0;
+			continue;
+		}
+
+		btDbvt::sRayPacketEntry &entry = entries[numEntries];
+		btVector3 rayDir = (vecEnd - vecStart).normalized();
+		entry.rayFrom = vecStart;
+		entry.rayDirectionInverse[0] = rayDir[0] == btScalar(0.0) ? btScalar(BT_LARGE_FLOAT) : btScalar(1.0) / rayDir[0];
+		entry.rayDirectionInverse[1] = rayDir[1] == btScalar(0.0) ? btScalar(BT_LARGE_FLOAT) : btScalar(1.0) / rayDir[1];
+		entry.rayDirectionInverse[2] = rayDir[2] == btScalar(0.0) ? btScalar(BT_LARGE_FLOAT) : btScalar(1.0) / rayDir[2];
+		entry.signs[0] = entry.rayDirectionInverse[0] < 0.0;
+		entry.signs[1] = entry.rayDirectionInverse[1] < 0.0;
+		entry.signs[2] = entry.rayDirectionInverse[2] < 0.0;
+		entry.lambda_max = rayDir.dot(vecEnd - vecStart);
+
+		lengths[numEntries] = entry.lambda_max;
+		callbacks[numEntries].Init(pRays[i].pTraceFilter, pRays[i].fMask, vecStart, vecEnd);
+		rayIndices[numEntries] = i;
+		numEntries++;
+	}
+
+	if (numEntries == 0) return;
+
+	// Dynamic and static sets, lambda_max carries over so the second tree gets culled by hits in the first
+	CRayPacketCollider collider(entries, callbacks, lengths);
+	btVector3 zero(0, 0, 0);
+	btDbvt::rayTestPacket(pBroadphase->m_sets[0].m_root, entries, numEntries, zero, zero, stack, collider);
+	btDbvt::rayTestPacket(pBroadphase->m_sets[1].m_root, entries, numEntries, zero, zero, stack, collider);
+
+	for (int i = 0; i < numEntries; i++) {
+		const Ray_t *pRay = pRays[rayIndices[i]].pRay;
+		const CTraceFilterRayResultCallback &cb = callbacks[i];
+		trace_t *pTrace = &pTraces[rayIndices[i]];
+
+		pTrace->startpos = pRay->m_Start + pRay->m_StartOffset;
+		pTrace->endpos = pTrace->startpos + pRay->m_Delta * cb.m_closestHitFraction;
+		pTrace->fraction = cb.m_closestHitFraction;
+		pTrace->allsolid = false;
+		pTrace->startsolid = false;
+
+		if (cb.hasHit()) {
+			ConvertDirectionToHL(cb.m_hitNormalWorld, pTrace->plane.normal);
+			pTrace->plane.dist = DotProduct(pTrace->endpos, pTrace->plane.normal);
+		} else {
+			pTrace->plane.normal.Init();
+			pTrace->plane.dist = 0;
+		}
+	}
+}
+
+class CTraceRaysTask : public btIThreadTask {
+	public:
+		CTraceRaysTask() {
+			m_pBroadphase = NULL;
+			m_pRays = NULL;
+			m_pTraces = NULL;
+			m_numRays = 0;
+		}
+
+		void run() {
+			for (int i = 0; i < m_numRays; i += RAY_PACKET_SIZE) {
+				TraceRayPacket(m_pBroadphase, m_pRays + i, MIN(RAY_PACKET_SIZE, m_numRays - i), m_pTraces + i, m_stack);
+			}
+		}
+
+		btDbvtBroadphase *m_pBroadphase;
+		const physraytrace_t *m_pRays;
+		trace_t *m_pTraces;
+		int m_numRays;
+
+		btAlignedObjectArray<btDbvt::sStkNP> m_stack;
+};
+
 void CPhysicsEnvironment::TraceRay(const Ray_t &ray, unsigned int fMask, IPhysicsTraceFilter *pTraceFilter, trace_t *pTrace) {
 	if (!ray.m_IsRay || !pTrace) return;
 
-	btVector3 vecStart, vecEnd;
-	ConvertPosToBull(ray.m_Start + ray.m_StartOffset, vecStart);
-	ConvertPosToBull(ray.m_Start + ray.m_StartOffset + ray.m_Delta, vecEnd);
+	physraytrace_t params;
+	params.pRay = &ray;
+	params.fMask = fMask;
+	params.pTraceFilter = pTraceFilter;
+	TraceRays(&params, 1, pTrace);
+}
 
-	// TODO: Override this class to use the mask and trace filter.
-	btCollisionWorld::ClosestRayResultCallback cb(vecStart, vecEnd);
-	m_pBulletEnvironment->rayTest(vecStart, vecEnd, cb);
+// Upper bound on the tasks a single TraceRays call splits its rays into
+#define MAX_TRACE_RAYS_TASKS 16
 
-	pTrace->fraction = cb.m_closestHitFraction;
-	ConvertPosToHL(cb.m_hitPointWorld, pTrace->endpos);
-	ConvertDirectionToHL(cb.m_hitNormalWorld, pTrace->plane.normal);
+void CPhysicsEnvironment::TraceRays(const physraytrace_t *pRays, int numRays, trace_t *pTraces) {
+	if (!pRays || !pTraces || numRays <= 0) return;
+
+	WaitForSimulation();
+
+	btDbvtBroadphase *pBroadphase = (btDbvtBroadphase *)m_pBulletBroadphase;
+
+	// Split the rays into one chunk of packets per thread (the calling thread works too)
+	int numPackets = (numRays + RAY_PACKET_SIZE - 1) / RAY_PACKET_SIZE;
+	int numTasks = 1;
+	btThreadPool *pPool = numPackets > 1 ? AcquireSharedThreadPool() : NULL;
+	if (pPool)
+		numTasks = MIN(MIN(numPackets, pPool->getNumThreads() + 1), MAX_TRACE_RAYS_TASKS);
+
+	// Every call gets its own tasks (and traversal stacks)
+	CTraceRaysTask tasks[MAX_TRACE_RAYS_TASKS];
+
+	int packetsPerTask = (numPackets + numTasks - 1) / numTasks;
+	for (int i = 0; i < numTasks; i++) {
+		int first = MIN(i * packetsPerTask * RAY_PACKET_SIZE, numRays);
+		int last = MIN((i + 1) * packetsPerTask * RAY_PACKET_SIZE, numRays);
+
+		CTraceRaysTask &task = tasks[i];
+		task.m_pBroadphase = pBroadphase;
+		task.m_pRays = pRays + first;
+		task.m_pTraces = pTraces + first;
+		task.m_numRays = last - first;
+	}
+
+	if (numTasks == 1) {
+		tasks[0].run();
+		if (pPool)
+			ReleaseSharedThreadPool();
+		return;
+	}
+
+	for (int i = 0; i < numTasks; i++) {
+		if (tasks[i].m_numRays > 0)
+			pPool->addTask(&tasks[i]);
+	}
+
+	pPool->runTasks();
+	pPool->clearTasks();
+
+	ReleaseSharedThreadPool();
 }
 
 // Is this function ever called?
@@ -1165,16 +2664,7 @@ class CFilteredConvexResultCallback : public btCollisionWorld::ClosestConvexResu
 		}
 
 		virtual bool needsCollision(btBroadphaseProxy *proxy0) const {
-			btCollisionObject *pColObj = (btCollisionObject *)proxy0->m_clientObject;
-			CPhysicsObject *pObj = (CPhysicsObject *)pColObj->getUserPointer();
-			if (pObj && !m_pTraceFilter->ShouldHitObject(pObj, m_mask)) {
-				return false;
-			}
-
-			bool collides = (proxy0->m_collisionFilterGroup & m_collisionFilterMask) != 0;
-			collides = collides && (m_collisionFilterGroup & proxy0->m_collisionFilterMask);
-
-			return collides;
+			return ShouldTraceHitProxy(m_pTraceFilter, m_mask, proxy0, m_collisionFilterGroup, m_collisionFilterMask);
 		}
 
 	private:
@@ -1184,6 +2674,8 @@ class CFilteredConvexResultCallback : public btCollisionWorld::ClosestConvexResu
 
 void CPhysicsEnvironment::SweepConvex(const CPhysConvex *pConvex, const Vector &vecAbsStart, const Vector &vecAbsEnd, const QAngle &vecAngles, unsigned int fMask, IPhysicsTraceFilter *pTraceFilter, trace_t *pTrace) {
 	if (!pConvex || !pTrace) return;
+
+	WaitForSimulation();
 	
 	btVector3 vecStart, vecEnd;
 	ConvertPosToBull(vecAbsStart, vecStart);
@@ -1218,34 +2710,171 @@ void CPhysicsEnvironment::GetPerformanceSettings(physics_performanceparams_t *pO
 void CPhysicsEnvironment::SetPerformanceSettings(const physics_performanceparams_t *pSettings) {
 	if (!pSettings) return;
 
+	WaitForSimulation();
+
 	m_perfparams = *pSettings;
 }
 
 void CPhysicsEnvironment::ReadStats(physics_stats_t *pOutput) {
 	if (!pOutput) return;
 
+	WaitForSimulation();
+
 	*pOutput = m_stats;
+
+	// The rest is a snapshot of the current pairs
+	btOverlappingPairCache *pCache = m_pBulletBroadphase->getOverlappingPairCache();
+	pOutput->collisionPairsTotal = pCache->getNumOverlappingPairs();
+
+	const btBroadphasePair *pPairs = pCache->getOverlappingPairArrayPtr();
+	for (int i = 0; i < pCache->getNumOverlappingPairs(); i++) {
+		const btCollisionObject *pObj0 = (btCollisionObject *)pPairs[i].m_pProxy0->m_clientObject;
+		const btCollisionObject *pObj1 = (btCollisionObject *)pPairs[i].m_pProxy1->m_clientObject;
+
+		if (pObj0->isStaticObject() || pObj1->isStaticObject())
+			pOutput->potentialCollisionsObjectVsWorld++;
+		else
+			pOutput->potentialCollisionsObjectVsObject++;
+	}
+
+	int numManifolds = m_pBulletDispatcher->getNumManifolds();
+	for (int i = 0; i < numManifolds; i++) {
+		if (m_pBulletDispatcher->getManifoldByIndexInternal(i)->getNumContacts() > 0)
+			pOutput->impactCollisionChecks++;
+	}
 }
 
 void CPhysicsEnvironment::ClearStats() {
+	WaitForSimulation();
 	memset(&m_stats, 0, sizeof(m_stats));
+	m_pProfiler->Clear();
+}
+
+int CPhysicsEnvironment::GetStepProfile(physprofile_t *pOutput, int maxStages) const {
+	// The profiler is written to while a step runs
+	const_cast<CPhysicsEnvironment *>(this)->WaitForSimulation();
+	return m_pProfiler->GetProfile(pOutput, maxStages);
+}
+
+// UNEXPOSED
+void CPhysicsEnvironment::PrintStats() {
+	physics_stats_t stats;
+	memset(&stats, 0, sizeof(stats));
+	ReadStats(&stats);
+
+	Msg("\t%d objects, %d active\n", GetObjectCount(), GetActiveObjectCount());
+	Msg("\t%d collision pairs (%d object vs object, %d object vs world), %d created, %d destroyed\n", stats.collisionPairsTotal,
+		stats.potentialCollisionsObjectVsObject, stats.potentialCollisionsObjectVsWorld, stats.collisionPairsCreated, stats.collisionPairsDestroyed);
+	Msg("\t%d touching pairs, %d collision events\n", stats.impactCollisionChecks, stats.impactCounter);
+
+	physprofile_t profile[PHYSPROFILE_COUNT];
+	int numStages = GetStepProfile(profile, PHYSPROFILE_COUNT);
+
+	Msg("\t%-12s %8s %8s %8s %8s (ms)\n", "stage", "last", "min", "avg", "max");
+	for (int i = 0; i < numStages; i++) {
+		Msg("\t%-12s %8.3f %8.3f %8.3f %8.3f\n", profile[i].pName, profile[i].lastMs, profile[i].minMs, profile[i].avgMs, profile[i].maxMs);
+	}
+}
+
+// Per-object blobs for duplicators and moving objects between environments. Same state as a save record, but the
+// collision model is referenced by pointer instead of copied, so a blob is only good while its collide is alive (checked on load).
+#define OBJECTBLOB_VERSION	2
+
+struct objectblobheader_t {
+	unsigned short			version;
+	unsigned short			nameLength;		// Including the terminator, the name follows the header
+	const CPhysCollide *	pCollide;		// Only looked up by address, it may be long gone
+	unsigned int			collideSerial;	// CPhysCollide::GetSerial, so a new collide at the same address isn't taken for it
+	objectsave_t			data;
+};
+
+// Names that don't fit in nameLength are cut short
+static unsigned short GetBlobNameLength(const char *pName) {
+	if (!pName) return 0;
+
+	return (unsigned short)MIN(strlen(pName) + 1, (size_t)0xFFFF);
 }
 
 unsigned int CPhysicsEnvironment::GetObjectSerializeSize(IPhysicsObject *pObject) const {
-	NOT_IMPLEMENTED
-	return 0;
+	if (!pObject) return 0;
+
+	return sizeof(objectblobheader_t) + GetBlobNameLength(pObject->GetName());
 }
 
 void CPhysicsEnvironment::SerializeObjectToBuffer(IPhysicsObject *pObject, unsigned char *pBuffer, unsigned int bufferSize) {
-	NOT_IMPLEMENTED
+	if (!pObject || !pBuffer) return;
+
+	unsigned int size = GetObjectSerializeSize(pObject);
+	if (bufferSize < size) {
+		Warning("SerializeObjectToBuffer: Buffer too small! (need %u, got %u)\n", size, bufferSize);
+		return;
+	}
+
+	WaitForSimulation();
+	CPhysicsObject *pPhys = (CPhysicsObject *)pObject;
+
+	// The buffer may not be aligned for the bullet types, so build the header here and copy it
+	objectblobheader_t header;
+	memset(&header, 0, sizeof(header));
+	header.version = OBJECTBLOB_VERSION;
+	header.nameLength = size - sizeof(objectblobheader_t);
+	header.pCollide = pPhys->GetCollide();
+	header.collideSerial = header.pCollide ? header.pCollide->GetSerial() : 0;
+	pPhys->GetSaveData(header.data);
+
+	// The shadow belongs to the game's entity, it'll attach a new one
+	header.data.flags &= ~OBJECTSAVE_SHADOW;
+
+	memcpy(pBuffer, &header, sizeof(header));
+	if (header.nameLength) {
+		memcpy(pBuffer + sizeof(header), pObject->GetName(), header.nameLength - 1);
+		pBuffer[sizeof(header) + header.nameLength - 1] = '\0';
+	}
 }
 
 IPhysicsObject *CPhysicsEnvironment::UnserializeObjectFromBuffer(void *pGameData, unsigned char *pBuffer, unsigned int bufferSize, bool enableCollisions) {
-	NOT_IMPLEMENTED
-	return NULL;
+	if (!pBuffer || bufferSize < sizeof(objectblobheader_t)) {
+		Warning("UnserializeObjectFromBuffer: Buffer too small!\n");
+		return NULL;
+	}
+
+	objectblobheader_t header;
+	memcpy(&header, pBuffer, sizeof(header));
+
+	if (header.version != OBJECTBLOB_VERSION) {
+		Warning("UnserializeObjectFromBuffer: Version mismatch! (expected %d, got %d)\n", OBJECTBLOB_VERSION, header.version);
+		return NULL;
+	}
+
+	if (sizeof(header) + header.nameLength > bufferSize) {
+		Warning("UnserializeObjectFromBuffer: Buffer is truncated! (need %u, got %u)\n", (unsigned int)(sizeof(header) + header.nameLength), bufferSize);
+		return NULL;
+	}
+
+	const CPhysCollide *pCollide = NULL;
+	if (!(header.data.flags & OBJECTSAVE_SPHERE)) {
+		// The blob doesn't own the collide, the game may have freed it (or loaded another one in its place) since
+		pCollide = CPhysCollide::FindLive(header.pCollide, header.collideSerial);
+		if (!pCollide) {
+			Warning("UnserializeObjectFromBuffer: Object's collision model was destroyed!\n");
+			return NULL;
+		}
+	}
+
+	const char *pName = NULL;
+	if (header.nameLength && pBuffer[sizeof(header) + header.nameLength - 1] == '\0')
+		pName = (const char *)pBuffer + sizeof(header);
+
+	if (enableCollisions)
+		header.data.flags |= OBJECTSAVE_COLLISIONS;
+	else
+		header.data.flags &= ~OBJECTSAVE_COLLISIONS;
+
+	return CreateObjectFromSave(header.data, NULL, pCollide, pGameData, pName);
 }
 
 void CPhysicsEnvironment::EnableConstraintNotify(bool bEnable) {
+	WaitForSimulation();
 	// Notify game about broken constraints?
 	m_bConstraintNotify = bEnable;
 }
@@ -1265,8 +2894,226 @@ float CPhysicsEnvironment::GetInvPSIScale() {
 	return m_invPSIScale;
 }
 
+class CDragTickTask : public btIThreadTask {
+	public:
+		void run() {
+			m_pDragController->Tick(m_dt, m_first, m_last);
+		}
+
+		CPhysicsDragController *m_pDragController;
+		btScalar m_dt;
+		int m_first;
+		int m_last;
+};
+
+class CControllerTickTask : public btIThreadTask {
+	public:
+		void run() {
+			for (int i = 0; i < m_controllers.Count(); i++) {
+				m_controllers[i]->Tick(m_dt);
+			}
+		}
+
+		CUtlVector<IController *> m_controllers;
+		btScalar m_dt;
+};
+
+// Below these it isn't worth waking up the threads
+#define PARALLEL_DRAG_MIN_OBJECTS		256
+#define PARALLEL_TICK_MIN_CONTROLLERS	16
+
+static int FindTickGroup(CUtlVector<controllertick_t> &controllers, int i) {
+	while (controllers[i].parent != i) {
+		controllers[i].parent = controllers[controllers[i].parent].parent;
+		i = controllers[i].parent;
+	}
+
+	return i;
+}
+
+static void JoinTickGroups(CUtlVector<controllertick_t> &controllers, int a, int b) {
+	a = FindTickGroup(controllers, a);
+	b = FindTickGroup(controllers, b);
+	if (a == b) return;
+
+	// Keep the lower index as the root so groups keep the order of the controller list
+	if (b < a)
+		V_swap(a, b);
+
+	controllers[b].parent = a;
+}
+
+// UNEXPOSED
+// Same work (and order per object) as ticking drag, m_controllers and m_fluids one after another,
+// but controllers that share no objects run in parallel on the shared thread pool.
+void CPhysicsEnvironment::TickControllers(btScalar dt) {
+	int numTasks = 1;
+#ifdef MULTITHREADED
+	numTasks = m_pSharedThreadPool->getNumThreads() + 1;
+#endif
+
+	// Drag goes first for every object
+	int numDragObjects = m_pPhysicsDragController->GetObjectCount();
+	if (numTasks > 1 && numDragObjects >= PARALLEL_DRAG_MIN_OBJECTS) {
+#ifdef MULTITHREADED
+		while (m_dragTickTasks.Count() < numTasks) {
+			m_dragTickTasks.AddToTail(new CDragTickTask);
+		}
+
+		int objectsPerTask = (numDragObjects + numTasks - 1) / numTasks;
+		for (int i = 0; i < numTasks; i++) {
+			CDragTickTask *pTask = m_dragTickTasks[i];
+			pTask->m_pDragController = m_pPhysicsDragController;
+			pTask->m_dt = dt;
+			pTask->m_first = MIN(i * objectsPerTask, numDragObjects);
+			pTask->m_last = MIN((i + 1) * objectsPerTask, numDragObjects);
+
+			if (pTask->m_first < pTask->m_last)
+				m_pSharedThreadPool->addTask(pTask);
+		}
+
+		m_pSharedThreadPool->runTasks();
+		m_pSharedThreadPool->clearTasks();
+#endif
+	} else {
+		m_pPhysicsDragController->Tick(dt);
+	}
+
+	// Asynchronous steps leave the controllers that call into the game to the game thread (see LaunchAsyncStep)
+	bool tickGameThread = !m_bAsyncStepRunning;
+
+	int numControllers = m_controllers.Count() + m_fluids.Count();
+	if (numTasks == 1 || numControllers < PARALLEL_TICK_MIN_CONTROLLERS) {
+		for (int i = 0; i < m_controllers.Count(); i++) {
+			if (tickGameThread || m_controllers[i]->IsTickThreadSafe())
+				m_controllers[i]->Tick(dt);
+		}
+
+		for (int i = 0; i < m_fluids.Count(); i++) {
+			if (tickGameThread || m_fluids[i]->IsTickThreadSafe())
+				m_fluids[i]->Tick(dt);
+		}
+
+		return;
+	}
+
+	// Group the controllers by the objects they touch. Objects remember the first controller that touched them this tick.
+	static CInterlockedInt s_tickSerial;
+	int tick = ++s_tickSerial;
+
+	m_tickControllers.SetCount(numControllers);
+	for (int i = 0; i < numControllers; i++) {
+		controllertick_t &info = m_tickControllers[i];
+		info.pController = i < m_controllers.Count() ? m_controllers[i] : m_fluids[i - m_controllers.Count()];
+		info.parent = i;
+		info.size = 0;
+		info.task = -1;
+		info.gameThread = false;
+
+		m_tickObjects.RemoveAll();
+		info.pController->GetTickObjects(m_tickObjects);
+
+		for (int j = 0; j < m_tickObjects.Count(); j++) {
+			CPhysicsObject *pObject = m_tickObjects[j];
+			int other = pObject->GetTickController(tick);
+			if (other == -1)
+				pObject->SetTickController(tick, i);
+			else
+				JoinTickGroups(m_tickControllers, other, i);
+		}
+	}
+
+	for (int i = 0; i < numControllers; i++) {
+		controllertick_t &root = m_tickControllers[FindTickGroup(m_tickControllers, i)];
+		root.size++;
+		if (!m_tickControllers[i].pController->IsTickThreadSafe())
+			root.gameThread = true;
+	}
+
+	while (m_controllerTickTasks.Count() < numTasks) {
+		m_controllerTickTasks.AddToTail(new CControllerTickTask);
+	}
+
+	for (int i = 0; i < numTasks; i++) {
+		m_controllerTickTasks[i]->m_controllers.RemoveAll();
+		m_controllerTickTasks[i]->m_dt = dt;
+	}
+
+	// Whole groups go to the task with the least controllers so far, in list order
+	for (int i = 0; i < numControllers; i++) {
+		IController *pController = m_tickControllers[i].pController;
+		controllertick_t &root = m_tickControllers[FindTickGroup(m_tickControllers, i)];
+
+		if (root.gameThread) {
+			pController->SetTickGroup(-1);
+			continue;
+		}
+
+		if (root.task == -1) {
+			root.task = 0;
+			for (int j = 1; j < numTasks; j++) {
+				if (m_controllerTickTasks[j]->m_controllers.Count() < m_controllerTickTasks[root.task]->m_controllers.Count())
+					root.task = j;
+			}
+		}
+
+		pController->SetTickGroup(root.task);
+		m_controllerTickTasks[root.task]->m_controllers.AddToTail(pController);
+	}
+
+#ifdef MULTITHREADED
+	for (int i = 0; i < numTasks; i++) {
+		if (m_controllerTickTasks[i]->m_controllers.Count() > 0)
+			m_pSharedThreadPool->addTask(m_controllerTickTasks[i]);
+	}
+
+	m_pSharedThreadPool->runTasks();
+	m_pSharedThreadPool->clearTasks();
+#endif
+
+	// Then the groups that call into the game. The lists are walked directly since the game may add or remove controllers.
+	for (int i = 0; i < m_controllers.Count(); i++) {
+		if (m_controllers[i]->GetTickGroup() == -1 && (tickGameThread || m_controllers[i]->IsTickThreadSafe()))
+			m_controllers[i]->Tick(dt);
+	}
+
+	for (int i = 0; i < m_fluids.Count(); i++) {
+		if (m_fluids[i]->GetTickGroup() == -1 && (tickGameThread || m_fluids[i]->IsTickThreadSafe()))
+			m_fluids[i]->Tick(dt);
+	}
+}
+
+// UNEXPOSED
+// Asynchronous mode: The controllers the simulation thread skips get the step's substeps ticked before it's launched
+void CPhysicsEnvironment::TickGameThreadControllers(btScalar dt, float invPSIScale) {
+	m_invPSIScale = invPSIScale;
+
+	for (int i = 0; i < m_controllers.Count(); i++) {
+		if (!m_controllers[i]->IsTickThreadSafe())
+			m_controllers[i]->Tick(dt);
+	}
+
+	for (int i = 0; i < m_fluids.Count(); i++) {
+		if (!m_fluids[i]->IsTickThreadSafe())
+			m_fluids[i]->Tick(dt);
+	}
+}
+
 // UNEXPOSED
 void CPhysicsEnvironment::BulletTick(btScalar dt) {
+	// We're on the simulation thread during an asynchronous step, the game gets its callbacks in DeliverAsyncEvents
+	bool async = m_bAsyncStepRunning;
+
+	{
+		CPhysicsProfileScope profile(m_pProfiler, PHYSPROFILE_CALLBACKS);
+
+		// Still in simulation here, so anything the game deletes in its callbacks gets queued
+		if (async)
+			m_pCollisionListener->GatherEvents(m_pBulletDispatcher, dt);
+		else
+			m_stats.impactCounter += m_pCollisionListener->DeliverEvents(m_pBulletDispatcher, dt);
+	}
+
 	// Dirty hack to spread the controllers throughout the current simulation step
 	if (m_simPSICurrent) {
 		m_invPSIScale = 1.0f / (float)m_simPSICurrent;
@@ -1275,13 +3122,18 @@ void CPhysicsEnvironment::BulletTick(btScalar dt) {
 		m_invPSIScale = 0;
 	}
 
-	m_pPhysicsDragController->Tick(dt);
+	{
+		CPhysicsProfileScope profile(m_pProfiler, PHYSPROFILE_CONTROLLERS);
+		TickControllers(dt);
+	}
 
-	for (int i = 0; i < m_controllers.Count(); i++)
-		m_controllers[i]->Tick(dt);
+	if (async) {
+		m_numAsyncTicks++;
+		m_curSubStep++;
+		return;
+	}
 
-	for (int i = 0; i < m_fluids.Count(); i++)
-		m_fluids[i]->Tick(dt);
+	CPhysicsProfileScope profile(m_pProfiler, PHYSPROFILE_CALLBACKS);
 
 	m_inSimulation = false;
 
@@ -1386,6 +3238,14 @@ void CPhysicsEnvironment::HandleConstraintBroken(CPhysicsConstraint *pConstraint
 void CPhysicsEnvironment::HandleFluidStartTouch(CPhysicsFluidController *pController, CPhysicsObject *pObject) {
 	if (pObject->GetCallbackFlags() & CALLBACK_MARKED_FOR_DELETE) return;
 
+	if (m_bAsyncStepRunning) {
+		AUTO_LOCK(m_deferredMutex);
+
+		fluidtouch_t touch = {pController, pObject, true};
+		m_deferredFluidTouches.AddToTail(touch);
+		return;
+	}
+
 	if (m_pCollisionEvent)
 		m_pCollisionEvent->FluidStartTouch(pObject, pController);
 }
@@ -1394,6 +3254,14 @@ void CPhysicsEnvironment::HandleFluidStartTouch(CPhysicsFluidController *pContro
 void CPhysicsEnvironment::HandleFluidEndTouch(CPhysicsFluidController *pController, CPhysicsObject *pObject) {
 	if (pObject->GetCallbackFlags() & CALLBACK_MARKED_FOR_DELETE) return;
 
+	if (m_bAsyncStepRunning) {
+		AUTO_LOCK(m_deferredMutex);
+
+		fluidtouch_t touch = {pController, pObject, false};
+		m_deferredFluidTouches.AddToTail(touch);
+		return;
+	}
+
 	if (m_pCollisionEvent)
 		m_pCollisionEvent->FluidEndTouch(pObject, pController);
 }
@@ -6,8 +6,14 @@
 
 #include <vphysics/performance.h>
 #include <vphysics/stats.h>
+#include <utlbuffer.h>
+#include <utlhashtable.h>
 
 class btThreadPool;
+class btIThread;
+class btIEvent;
+class CDragTickTask;
+class CControllerTickTask;
 class btCollisionConfiguration;
 class btDispatcher;
 class btBroadphaseInterface;
@@ -29,20 +35,89 @@ class CPhysicsObject;
 class CPhysicsSoftBody;
 
 class CDebugDrawer;
+class CPhysicsProfiler;
+
+struct objectsave_t;
+struct shadowsave_t;
 
 // Temporary; remove later
 class IPhysicsSoftBody;
 
+// A cached NeedsCollision result. Objects are identified by their filter serial, which changes whenever
+// anything NeedsCollision looks at changes (see CPhysicsObject::InvalidateCollisionFilter).
+struct filtercache_t {
+	unsigned int	serial[2];	// Sorted, 0 = empty slot
+	bool			collides;
+};
+
+// A pair rejected during the broadphase, with the (sorted) serials it was rejected under
+struct filterpair_t {
+	btBroadphaseProxy *	pProxy0;
+	btBroadphaseProxy *	pProxy1;
+	unsigned int		serial[2];
+};
+
+// A pair the game couldn't be asked about because it came up during an asynchronous step
+struct deferredfilter_t {
+	CPhysicsObject *	pObject0;
+	CPhysicsObject *	pObject1;
+};
+
+// Fluid touch event from an asynchronous step, delivered with the step's other events
+struct fluidtouch_t {
+	CPhysicsFluidController *	pController;
+	CPhysicsObject *			pObject;
+	bool						start;
+};
+
+// A controller in CPhysicsEnvironment::TickControllers. Controllers that touch the same objects
+// are joined into one group (union-find), a group ticks serially on one thread.
+struct controllertick_t {
+	IController *	pController;
+	int				parent;		// Group root if parent == our index
+	int				size;		// Controllers in the group (roots only)
+	int				task;		// Task the group ticks on (roots only, -1 = game thread)
+	bool			gameThread;	// Something in the group calls into the game (roots only)
+};
+
 class CCollisionSolver : public btOverlapFilterCallback {
 	public:
-		CCollisionSolver(CPhysicsEnvironment *pEnv) {m_pEnv = pEnv; m_pSolver = NULL;}
-		void SetHandler(IPhysicsCollisionSolver *pSolver) {m_pSolver = pSolver;}
+		CCollisionSolver(CPhysicsEnvironment *pEnv);
+		void SetHandler(IPhysicsCollisionSolver *pSolver);
 		virtual bool needBroadphaseCollision(btBroadphaseProxy *proxy0, btBroadphaseProxy *proxy1) const;
 
+		// The game's answer is cached until either object calls RecheckCollisionFilter (or changes its flags)
 		bool NeedsCollision(CPhysicsObject *pObj0, CPhysicsObject *pObj1) const;
+
+		// Removes the pairs rejected during the broadphase from the pair cache
+		void FlushRejectedPairs(btOverlappingPairCache *pCache, btDispatcher *pDispatcher);
+		// Asks the game about the pairs deferred during an asynchronous step, and adds the ones that collide
+		void FlushDeferredPairs(btOverlappingPairCache *pCache);
+		void ClearFilterCache() const;
+
+		static unsigned int NewFilterSerial();
 	private:
+		// pDeferred is set if the game had to be asked during an asynchronous step (the answer is true until it's asked)
+		bool ComputeNeedsCollision(CPhysicsObject *pObj0, CPhysicsObject *pObj1, bool *pDeferred) const;
+		void DeferPair(CPhysicsObject *pObj0, CPhysicsObject *pObj1) const;
+		// Callers hold m_filterMutex
+		bool FindFilter(unsigned int serial0, unsigned int serial1, bool &collides) const;
+		void InsertFilter(unsigned int serial0, unsigned int serial1, bool collides) const;
+
 		IPhysicsCollisionSolver *m_pSolver;
 		CPhysicsEnvironment *m_pEnv;
+
+		// Open addressing (linear probing), power of 2 size, never more than half full
+		// NeedsCollision is also called off the step (vehicle raycasts, RecheckCollisionFilter) and from the dispatcher's threads.
+		// The game is asked without holding it.
+		mutable CUtlVector<filtercache_t> m_filterCache;
+		mutable int m_numFilters;
+		mutable CThreadFastMutex m_filterMutex;
+
+		mutable CUtlVector<filterpair_t> m_rejectedPairs;
+
+		mutable CUtlVector<deferredfilter_t> m_deferredPairs;
+		mutable CThreadFastMutex m_deferredMutex;
 };
 
 class CPhysicsEnvironment : public IPhysicsEnvironment32 {
@@ -116,6 +191,10 @@ public:
 	void									Simulate(float deltaTime);
 	bool									IsInSimulation() const;
 
+	void									SetAsyncSimulation(bool enable);
+	bool									IsAsyncSimulation() const;
+	void									WaitForSimulation();
+
 	float									GetSimulationTimestep() const;
 	void									SetSimulationTimestep(float timestep);
 
@@ -148,6 +227,8 @@ public:
 	bool									IsCollisionModelUsed(CPhysCollide *pCollide) const;
 	
 	void									TraceRay(const Ray_t &ray, unsigned int fMask, IPhysicsTraceFilter *pTraceFilter, trace_t *pTrace);
+	void									TraceRays(const physraytrace_t *pRays, int numRays, trace_t *pTraces);
+	int										GetStepProfile(physprofile_t *pOutput, int maxStages) const;
 	void									SweepCollideable(const CPhysCollide *pCollide, const Vector &vecAbsStart, const Vector &vecAbsEnd, const QAngle &vecAngles, unsigned int fMask, IPhysicsTraceFilter *pTraceFilter, trace_t *pTrace);
 	void									SweepConvex(const CPhysConvex *pConvex, const Vector &vecAbsStart, const Vector &vecAbsEnd, const QAngle &vecAngles, unsigned int fMask, IPhysicsTraceFilter *pTraceFilter, trace_t *pTrace);
 
@@ -163,6 +244,8 @@ public:
 
 	void									EnableConstraintNotify(bool bEnable);
 	void									DebugCheckContacts();
+
+	void									PrintStats();
 public:
 	// Unexposed functions
 	btSoftRigidDynamicsWorld *				GetBulletEnvironment();
@@ -174,6 +257,13 @@ public:
 	int										GetCurSubStep() { return m_curSubStep; }
 
 	void									BulletTick(btScalar timeStep);
+	void									TickControllers(btScalar timeStep);
+
+	// True from the time an asynchronous Simulate launches a step until WaitForSimulation sees it finish
+	bool									IsAsyncStepRunning() const { return m_bAsyncStepRunning; }
+	// Objects hand the game thread their snapshot instead of the state the step is changing
+	bool									ShouldReadSnapshot() const;
+	void									MarkSnapshotDirty(CPhysicsObject *pObject);
 	CPhysicsDragController *				GetDragController();
 	CCollisionSolver *						GetCollisionSolver();
 
@@ -183,6 +273,9 @@ public:
 	btVector3								GetMaxAngularVelocity() const;
 
 	btThreadPool *							GetSharedThreadPool() const { return m_pSharedThreadPool; }
+	// For work outside the step. NULL when the pool is in use, pair a successful call with ReleaseSharedThreadPool.
+	btThreadPool *							AcquireSharedThreadPool();
+	void									ReleaseSharedThreadPool();
 
 	void									DoCollisionEvents(float dt);
 
@@ -194,8 +287,28 @@ public:
 
 	btSoftBodyWorldInfo &					GetSoftBodyWorldInfo() { return m_softBodyWorldInfo; }
 
+	// Save records (see Save). Write appends one record to buf, read reads the record at buf's get position
+	// and returns the restored object (as the interface type the record is for), or NULL on failure.
+	bool									WriteSaveRecord(CUtlBuffer &buf, PhysInterfaceId_t type, void *pObject);
+	void *									ReadSaveRecord(CUtlBuffer &buf, const physrestoreparams_t &params);
+	// pShadow can be NULL, pCollide is ignored for spheres
+	CPhysicsObject *						CreateObjectFromSave(const objectsave_t &data, const shadowsave_t *pShadow, const CPhysCollide *pCollide, void *pGameData, const char *pName);
+
 	// Soft body functions we'll expose at a later time...
 private:
+	void									AddObjectToList(IPhysicsObject *pObject);
+	void									RemoveObjectFromList(IPhysicsObject *pObject);
+	void									AddSoftBodyToList(IPhysicsSoftBody *pSoftBody);
+	void									RemoveSoftBodyFromList(IPhysicsSoftBody *pSoftBody);
+
+	void									StepSimulation(float deltaTime);
+	static void								AsyncThreadFunc(void *pArg);
+	void									LaunchAsyncStep(float deltaTime);
+	void									DeliverAsyncEvents();
+	void									DiscardAsyncEvents();
+	void									TickGameThreadControllers(btScalar timeStep, float invPSIScale);
+	void *									GetRestoredPointer(void *pOldPointer) const;
+
 	bool									m_inSimulation;
 	bool									m_bUseDeleteQueue;
 	bool									m_bConstraintNotify;
@@ -209,6 +322,25 @@ private:
 	float									m_subStepTime;
 
 	btThreadPool *							m_pSharedThreadPool;
+	volatile long							m_sharedPoolBusy; // Set while work outside the step has the shared pool
+	CUtlVector<CDragTickTask *>				m_dragTickTasks;
+	CUtlVector<CControllerTickTask *>		m_controllerTickTasks;
+	CUtlVector<controllertick_t>			m_tickControllers;
+	CUtlVector<CPhysicsObject *>			m_tickObjects;
+
+	// Asynchronous simulation (see Simulate)
+	bool									m_bAsyncSimulation;
+	volatile bool							m_bAsyncStepRunning;
+	bool									m_bAsyncEventsPending;	// The last step's events haven't been delivered yet
+	volatile bool							m_bAsyncThreadExit;
+	float									m_asyncDeltaTime;
+	int										m_numAsyncTicks;		// Ticks the last asynchronous step ran
+	ThreadId_t								m_asyncOwnerThread;		// Thread that launched the step
+	btIThread *								m_pAsyncThread;
+	btIEvent *								m_pAsyncStartEvent;
+	btIEvent *								m_pAsyncDoneEvent;
+	CUtlVector<fluidtouch_t>				m_deferredFluidTouches;
+	CThreadFastMutex						m_deferredMutex;
 	btCollisionConfiguration *				m_pBulletConfiguration;
 	btCollisionDispatcher *					m_pBulletDispatcher;
 	btBroadphaseInterface *					m_pBulletBroadphase;
@@ -229,6 +361,7 @@ private:
 	CDeleteQueue *							m_pDeleteQueue;
 	CObjectTracker *						m_pObjectTracker;
 	CPhysicsDragController *				m_pPhysicsDragController;
+	CPhysicsProfiler *						m_pProfiler;
 	IVPhysicsDebugOverlay *					m_pDebugOverlay;
 
 	IPhysicsCollisionEvent *				m_pCollisionEvent;
@@ -239,6 +372,12 @@ private:
 	physics_stats_t							m_stats;
 
 	CDebugDrawer *							m_debugdraw;
+
+	// Save/restore
+	CUtlBuffer								m_saveBuffer;			// Scratch space for one record
+	CUtlHashtable<uintp, void *>			m_restoredPointers;		// Pointer from the save -> object restored in its place
+	bool									m_bRestoring;			// Between PreRestore and PostRestore
+	bool									m_bSavedDeferredCollide;
 };
 
 #endif // PHYSICS_ENVIRONMENT_H
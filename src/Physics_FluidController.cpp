@@ -83,6 +83,7 @@ CPhysicsFluidController::~CPhysicsFluidController() {
 }
 
 void CPhysicsFluidController::WakeAllSleepingObjects() {
+	m_pEnv->WaitForSimulation();
 	int count = m_pGhostObject->getNumOverlappingObjects();
 	for (int i = 0; i < count; i++) {
 		btRigidBody *body = btRigidBody::upcast(m_pGhostObject->getOverlappingObject(i));
@@ -119,58 +120,122 @@ int	CPhysicsFluidController::GetContents() const {
 	return m_iContents;
 }
 
-static btVector3 calcConvexCenter(btConvexHullShape *pShape, btVector3 &planePos, btVector3 &planeNorm) {
-	// Basic average
-	btVector3 sum(0, 0, 0);
+// Clips a hull against the surface (shape space, points with normal.dot(p) < dist are submerged)
+// and adds the volume and first moment of the part that's under it.
+static void AddSubmergedHull(const buoyancyhull_t &hull, const btVector3 &normal, btScalar dist, btScalar &volume, btVector3 &moment) {
+	btScalar centerDist = normal.dot(hull.centroid) - dist;
+	if (centerDist >= hull.radius)
+		return;
+
+	if (centerDist <= -hull.radius) {
+		volume += hull.volume;
+		moment += hull.volume * hull.centroid;
+		return;
+	}
 
-	if (pShape->getNumPoints() > 0) {
-		for (int i = 0; i < pShape->getNumPoints(); i++) {
-			btVector3 point = pShape->getScaledPoint(i);
-			point -= planePos;
+	// Sum up tetrahedrons between a point on the surface and the clipped triangles.
+	// The cap the surface cuts off has no volume as seen from that point, so we don't have to build it.
+	btVector3 ref = hull.centroid - normal * centerDist;
 
-			// Only add the point if it's submerged
-			if (point.dot(planeNorm) < 0)
-				sum += pShape->getScaledPoint(i);
+	for (int i = 0; i < hull.tris.size(); i += 3) {
+		btVector3 points[3];
+		btScalar dists[3];
+		for (int j = 0; j < 3; j++) {
+			points[j] = hull.verts[hull.tris[i+j]];
+			dists[j] = normal.dot(points[j]) - dist;
 		}
 
-		sum /= pShape->getNumPoints();
-	}
+		// A triangle clipped by a plane has at most 4 verts left
+		btVector3 poly[4];
+		int numPoly = 0;
+		for (int j = 0; j < 3; j++) {
+			int k = (j + 1) % 3;
+			if (dists[j] <= 0)
+				poly[numPoly++] = points[j];
+
+			if ((dists[j] <= 0) != (dists[k] <= 0))
+				poly[numPoly++] = points[j] + (points[k] - points[j]) * (dists[j] / (dists[j] - dists[k]));
+		}
 
-	return sum;
+		for (int j = 1; j < numPoly - 1; j++) {
+			btScalar tetVolume = (poly[0] - ref).dot((poly[j] - ref).cross(poly[j+1] - ref)) / 6;
+			volume += tetVolume;
+			moment += tetVolume * (ref + poly[0] + poly[j] + poly[j+1]) / 4;
+		}
+	}
 }
 
-// Find the object's center of buoyancy
-// This would be the center of all submerged points
-// You can bisect the object by the plane of the water surface to get all points
-// submerged, then calculate the center of all those points
-// planePos: World space plane position
-// planeNorm: World space plane normal
-static btVector3 calculateBuoyantCenter(btRigidBody *pBody, btVector3 &planePos, btVector3 &planeNorm) {
-	btVector3 center(0, 0, 0);
+// Finds the center of buoyancy (world space) of the part of the body below the surface.
+// Returns the fraction of the body's volume that's submerged.
+// surfPos: World space position on the surface
+// surfNorm: World space surface normal
+static btScalar CalculateSubmerged(btRigidBody *pBody, CPhysicsObject *pObject, const btVector3 &surfPos, const btVector3 &surfNorm, btVector3 &center) {
+	btVector3 mins, maxs;
+	pBody->getAabb(mins, maxs);
+
+	// Distance of the AABB's center to the surface, and the AABB's half extent along the normal
+	btVector3 aabbCenter = (mins + maxs) / 2;
+	btScalar aabbDist = surfNorm.dot(aabbCenter - surfPos);
+	btScalar aabbExtent = surfNorm.absolute().dot((maxs - mins) / 2);
+	if (aabbDist >= aabbExtent)
+		return 0; // All above the surface
+
+	const btTransform &trans = pBody->getWorldTransform();
+	btCollisionShape *pShape = pBody->getCollisionShape();
 
-	btVector3 relPlanePos = pBody->getWorldTransform().inverse() * planePos;
-	btVector3 relNorm = quatRotate(pBody->getWorldTransform().getRotation().inverse(), planeNorm);
+	// Spherical cap
+	if (pShape->getShapeType() == SPHERE_SHAPE_PROXYTYPE) {
+		btScalar radius = ((btSphereShape *)pShape)->getRadius();
+		btScalar depth = btClamped(radius - surfNorm.dot(trans.getOrigin() - surfPos), btScalar(0), 2 * radius);
+		if (depth <= 0)
+			return 0;
 
-	btCollisionShape *pShape = pBody->getCollisionShape();
-	if (pShape->getShapeType() == COMPOUND_SHAPE_PROXYTYPE) {
-		btCompoundShape *pCompound = (btCompoundShape *)pShape;
-		for (int i = 0; i < pCompound->getNumChildShapes(); i++) {
-			btCollisionShape *pChild = pCompound->getChildShape(i);
-			if (pChild->getShapeType() == CONVEX_HULL_SHAPE_PROXYTYPE) {
-				center += calcConvexCenter((btConvexHullShape *)pChild, relPlanePos, relNorm);
-			}
-		}
+		center = trans.getOrigin() - surfNorm * (3 * (2 * radius - depth) * (2 * radius - depth) / (4 * (3 * radius - depth)));
+		return depth * depth * (3 * radius - depth) / (4 * radius * radius * radius);
+	}
 
-		if (pCompound->getNumChildShapes() > 0)
-			center /= pCompound->getNumChildShapes();
+	CPhysCollide *pCollide = pObject->GetCollide();
+	const buoyancydata_t *pData = pCollide ? pCollide->GetBuoyancyData() : NULL;
+	if (!pData || pData->volume <= 0) {
+		// Don't know the shape, use the slab of the AABB below the surface
+		btScalar top = btMin(-aabbDist, aabbExtent);
+		center = aabbCenter + surfNorm * ((top - aabbExtent) / 2);
+		return aabbExtent > 0 ? (top + aabbExtent) / (2 * aabbExtent) : 1;
 	}
 
-	return center;
+	if (aabbDist <= -aabbExtent) {
+		center = trans * pData->centroid;
+		return 1;
+	}
+
+	// Surface plane in shape space
+	btVector3 relNorm = trans.getBasis().transpose() * surfNorm;
+	btScalar relDist = relNorm.dot(trans.invXform(surfPos));
+
+	btScalar volume = 0;
+	btVector3 moment(0, 0, 0);
+	for (int i = 0; i < pData->hulls.size(); i++)
+		AddSubmergedHull(pData->hulls[i], relNorm, relDist, volume, moment);
+
+	if (volume <= 0)
+		return 0;
+
+	center = trans * (moment / volume);
+	return btMin(volume / pData->volume, btScalar(1));
 }
 
-// TODO: Refactor this code to be less messy.
 void CPhysicsFluidController::Tick(float dt) {
-	// TODO: Buoyancy calculation
+	// Find the surface plane's world pos (center at the very top)
+	btVector3 surfPos = m_pGhostObject->getWorldTransform().getOrigin();
+	btVector3 surfNorm;
+	ConvertDirectionToBull(m_vSurfacePlane.AsVector3D(), surfNorm);
+
+	btVector3 omins, omaxs;
+	m_pGhostObject->getCollisionShape()->getAabb(m_pGhostObject->getWorldTransform(), omins, omaxs);
+	btScalar height = omaxs.y() - omins.y();
+
+	surfPos += surfNorm * (height / 2);
+
 	int numObjects = m_pGhostObject->getNumOverlappingObjects();
 	for (int i = 0; i < numObjects; i++) {
 		btRigidBody *body = btRigidBody::upcast(m_pGhostObject->getOverlappingObject(i));
@@ -180,24 +245,8 @@ void CPhysicsFluidController::Tick(float dt) {
 		CPhysicsObject *pObject = (CPhysicsObject *)body->getUserPointer();
 		Assert(pObject);
 
-		// Find the surface plane's world pos (center at the very top)
-		btVector3 surfPos = m_pGhostObject->getWorldTransform().getOrigin();
-		btVector3 surfNorm;
-		ConvertDirectionToBull(m_vSurfacePlane.AsVector3D(), surfNorm);
-
-		btScalar fluidLen = ConvertDistanceToBull(m_vSurfacePlane.w);
-
-		btVector3 omins, omaxs;
-		m_pGhostObject->getCollisionShape()->getAabb(m_pGhostObject->getWorldTransform(), omins, omaxs);
-		btScalar height = omaxs.y() - omins.y();
-
-		surfPos += surfNorm * (height / 2);
-
-		btVector3 center = calculateBuoyantCenter(body, surfPos, surfNorm);
-		center = body->getWorldTransform() * center; // Convert back into world space
-
-		btVector3 offset = center - surfPos;
-		btScalar submerged = surfNorm.dot(offset);
+		btVector3 center;
+		btScalar submerged = CalculateSubmerged(body, pObject, surfPos, surfNorm, center);
 
 #ifdef _DEBUG
 		IVPhysicsDebugOverlay *pOverlay = m_pEnv->GetDebugOverlay();
@@ -207,64 +256,44 @@ void CPhysicsFluidController::Tick(float dt) {
 			pOverlay->AddBoxOverlay(pos, Vector(-8), Vector(8), QAngle(0, 0, 0), 255, 0, 0, 255, 0.f);
 			pOverlay->AddLineOverlay(pos, pos + m_vSurfacePlane.AsVector3D() * 32, 255, 0, 0, false, 0.f);
 
-			ConvertPosToHL(center, pos);
-			pOverlay->AddBoxOverlay(pos, Vector(-8), Vector(8), QAngle(0, 0, 0), 0, 0, 255, 255, 0.f);
-
-			if (submerged < 0) {
-				pOverlay->AddTextOverlay(pos, 0.f, "submerged %+04.2f", submerged);
+			if (submerged > 0) {
+				ConvertPosToHL(center, pos);
+				pOverlay->AddBoxOverlay(pos, Vector(-8), Vector(8), QAngle(0, 0, 0), 0, 0, 255, 255, 0.f);
+				pOverlay->AddTextOverlay(pos, 0.f, "submerged %.2f", submerged);
 			}
 		}
 #endif
 
-		if (submerged < 0) {
-			btVector3 mins, maxs;
-			body->getAabb(mins, maxs);
-
-			// Calc the volume coefficient
-			btScalar dist = -submerged;
-			float p = clamp(dist / 1.2, 0.f, 1.f);
-			btScalar vol = p * pObject->GetVolume();
-
-			// TODO: Need a way to calculate this properly
-			// Force should be exactly equal to -gravity when submerged distance is 0
+		if (submerged > 0) {
 			// density units kg/m^3
+			btScalar vol = submerged * pObject->GetVolume();
 			btVector3 force = (m_fDensity * -body->getGravity() * vol) * pObject->GetBuoyancyRatio();
 
 			btVector3 relPos = center - body->getWorldTransform().getOrigin();
 			body->applyForce(force, relPos);
 		}
+	}
+}
 
-		// Old code that actually works better
-		/*
-		btVector3 mins, maxs, omins, omaxs;
-		body->getAabb(mins, maxs);
-		m_pGhostObject->getCollisionShape()->getAabb(m_pGhostObject->getWorldTransform(), omins, omaxs);
-
-		float height = maxs.y() - mins.y(); // If the plane for the surface can be non-upwards I'm going to murder something
-		//float height = abs(ConvertDistanceToBull(m_vSurfacePlane.w));
-		float dist = omaxs.y() - mins.y(); // Distance between top of water and bottom of object (how much of object is in water)
-		float p = clamp(dist / height, 0.0f, 1.0f);
-		float vol = (pObject->GetVolume() * p); // / 64; // Submerged volume
-
-		// TODO: We need to calculate this force at several points on the object (How do we determine what points?).
-		// Maybe have the points determined by the extents of the shape at 4 directions parallel to our surface
-		// Simulate buoyant force per convex or just on the compound?
-
-		// Simulate buoyant force per point submerged
-		// Divide it over all of the points that are submerged
-
-		// IVP calculates this force per triangle
-		btVector3 force = (m_fDensity * -body->getGravity() * vol) * pObject->GetBuoyancyRatio();
-		body->applyCentralForce(force);
-
-		// Damping
-		// FIXME: Damping would be way too much for an object only partially touching our surface (ex. giant fucking bridge with like 1 pixel in the water)
-		body->setLinearVelocity(body->getLinearVelocity() * (1.0f - (0.75f * dt)));
-		body->setAngularVelocity(body->getAngularVelocity() * (1.0f - (0.75f * dt)));
-		*/
+// UNEXPOSED
+void CPhysicsFluidController::GetTickObjects(CUtlVector<CPhysicsObject *> &objects) {
+	int numObjects = m_pGhostObject->getNumOverlappingObjects();
+	for (int i = 0; i < numObjects; i++) {
+		btRigidBody *body = btRigidBody::upcast(m_pGhostObject->getOverlappingObject(i));
+		if (body && body->getUserPointer())
+			objects.AddToTail((CPhysicsObject *)body->getUserPointer());
 	}
 }
 
+// UNEXPOSED
+bool CPhysicsFluidController::IsTickThreadSafe() const {
+#ifdef _DEBUG
+	return false; // Tick draws on the debug overlay
+#else
+	return true;
+#endif
+}
+
 // UNEXPOSED
 void CPhysicsFluidController::ObjectAdded(CPhysicsObject *pObject) {
 	m_pEnv->HandleFluidStartTouch(this, pObject);
@@ -281,6 +310,18 @@ void CPhysicsFluidController::TransferToEnvironment(CPhysicsEnvironment *pDest)
 
 }
 
+// UNEXPOSED
+void CPhysicsFluidController::GetSaveData(fluidsave_t &data) const {
+	memset(&data, 0, sizeof(data));
+
+	data.pFluidObject = (IPhysicsObject *)(CPhysicsObject *)m_pGhostObject->getUserPointer();
+
+	// We don't use damping, torqueFactor or viscosityFactor, so they aren't kept
+	data.params.surfacePlane = m_vSurfacePlane;
+	ConvertPosToHL(m_currentVelocity, data.params.currentVelocity);
+	data.params.contents = m_iContents;
+}
+
 /************************
 * CREATION FUNCTIONS
 ************************/
@@ -10,6 +10,12 @@ class CPhysicsEnvironment;
 class CPhysicsFluidCallback;
 class CPhysicsObject;
 
+// Fluid controller state in save games, the game hands pGameData back on restore
+struct fluidsave_t {
+	void *					pFluidObject;	// Pointer from when the game was saved
+	fluidparams_t			params;
+};
+
 class CPhysicsFluidController : public IPhysicsFluidController, public IController
 {
 	public:
@@ -27,10 +33,14 @@ class CPhysicsFluidController : public IPhysicsFluidController, public IControll
 		// UNEXPOSED FUNCTIONS
 	public:
 		void					Tick(float deltaTime);
+		void					GetTickObjects(CUtlVector<CPhysicsObject *> &objects);
+		bool					IsTickThreadSafe() const;
 		void					ObjectRemoved(CPhysicsObject *pObject);
 		void					ObjectAdded(CPhysicsObject *pObject);
 
 		void					TransferToEnvironment(CPhysicsEnvironment *pDest);
+
+		void					GetSaveData(fluidsave_t &data) const;
 	private:
 		void *					m_pGameData;
 		int						m_iContents;
@@ -14,20 +14,13 @@ CPhysicsFrictionSnapshot::CPhysicsFrictionSnapshot(CPhysicsObject *pObject) {
 	m_iCurContactPoint = 0;
 	m_iCurManifold = 0;
 
-	CPhysicsEnvironment *pEnv = pObject->GetVPhysicsEnvironment();
+	// Every manifold in the body's list involves the body
 	btRigidBody *pBody = pObject->GetObject();
-	int numManifolds = pEnv->GetBulletEnvironment()->getDispatcher()->getNumManifolds();
-	for (int i = 0; i < numManifolds; i++) {
-		btPersistentManifold *pManifold = pEnv->GetBulletEnvironment()->getDispatcher()->getManifoldByIndexInternal(i);
-		const btCollisionObject *pObjA = pManifold->getBody0();
-		const btCollisionObject *pObjB = pManifold->getBody1();
-
+	for (btPersistentManifold *pManifold = pBody->getFirstManifold(); pManifold; pManifold = pManifold->getNextManifoldOnBody(pBody)) {
 		if (pManifold->getNumContacts() <= 0)
 			continue;
 
-		if (pObjA == pBody || pObjB == pBody) {
-			m_manifolds.AddToTail(pManifold);
-		}
+		m_manifolds.AddToTail(pManifold);
 	}
 }
 
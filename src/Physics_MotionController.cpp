@@ -1,6 +1,7 @@
 #include "StdAfx.h"
 
 #include "Physics_MotionController.h"
+#include "Physics_Environment.h"
 #include "Physics_Object.h"
 #include "convert.h"
 
@@ -81,15 +82,21 @@ void CPhysicsMotionController::Tick(float deltaTime) {
 	}
 }
 
+void CPhysicsMotionController::GetTickObjects(CUtlVector<CPhysicsObject *> &objects) {
+	objects.AddVectorToTail(m_objectList);
+}
+
 void CPhysicsMotionController::ObjectDestroyed(CPhysicsObject *pObject) {
 	m_objectList.FindAndRemove(pObject);
 }
 
 void CPhysicsMotionController::SetEventHandler(IMotionEvent *handler) {
+	m_pEnv->WaitForSimulation();
 	m_handler = handler;
 }
 
 void CPhysicsMotionController::AttachObject(IPhysicsObject *pObject, bool checkIfAlreadyAttached) {
+	m_pEnv->WaitForSimulation();
 	Assert(pObject);
 	if (!pObject || pObject->IsStatic()) return;
 
@@ -104,6 +111,7 @@ void CPhysicsMotionController::AttachObject(IPhysicsObject *pObject, bool checkI
 }
 
 void CPhysicsMotionController::DetachObject(IPhysicsObject *pObject) {
+	m_pEnv->WaitForSimulation();
 	CPhysicsObject *pPhys = (CPhysicsObject *)pObject;
 
 	int index = m_objectList.Find(pPhys);
@@ -127,15 +135,18 @@ void CPhysicsMotionController::GetObjects(IPhysicsObject **pObjectList) {
 }
 
 void CPhysicsMotionController::ClearObjects() {
+	m_pEnv->WaitForSimulation();
 	m_objectList.Purge();
 }
 
 void CPhysicsMotionController::WakeObjects() {
+	m_pEnv->WaitForSimulation();
 	for (int i = 0; i < m_objectList.Count(); i++) {
 		m_objectList[i]->GetObject()->setActivationState(ACTIVE_TAG);
 	}
 }
 
 void CPhysicsMotionController::SetPriority(priority_t priority) {
+	m_pEnv->WaitForSimulation();
 	// IVP Controllers had a priority. Since bullet doesn't have controllers, this function is useless.
 }
@@ -28,6 +28,8 @@ class CPhysicsMotionController : public IController, public IPhysicsMotionContro
 		void							SetPriority(priority_t priority);
 	public:
 		void							Tick(float deltaTime);
+		void							GetTickObjects(CUtlVector<CPhysicsObject *> &objects);
+		bool							IsTickThreadSafe() const { return false; } // The game's IMotionEvent does the work
 		void							ObjectDestroyed(CPhysicsObject *pObject);
 
 	private:
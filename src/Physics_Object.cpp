@@ -12,6 +12,7 @@
 #include "Physics_DragController.h"
 #include "Physics_SurfaceProps.h"
 #include "Physics_VehicleController.h"
+#include "Physics_CollisionSet.h"
 #include "convert.h"
 
 // memdbgon must be the last include file in a .cpp file!!!
@@ -57,6 +58,11 @@ CPhysicsObject::CPhysicsObject() {
 	m_pShadow = NULL;
 	m_pFluidController = NULL;
 	m_pVehicleController = NULL;
+	m_pCollisionSet = NULL;
+	m_iCollisionSetIndex = 0;
+	m_iFilterSerial = CCollisionSolver::NewFilterSerial();
+	m_iPreCollisionStep = 0;
+	m_iSnapshotActivationState = 0;
 	m_pEnv = NULL;
 
 	m_contents = 0;
@@ -72,10 +78,19 @@ CPhysicsObject::CPhysicsObject() {
 	m_pName = "UNINITIALIZED";
 
 	m_bRemoving = false;
+
+	m_iEnvIndex = -1;
+	m_iActiveIndex = -1;
+	m_iDragIndex = -1;
+	m_iDirtyActivationIndex = -1;
+	m_iDirtySnapshotIndex = -1;
+	m_iTickStamp = 0;
+	m_iTickController = -1;
 }
 
 CPhysicsObject::~CPhysicsObject() {
 	m_bRemoving = true;
+	ClearCollisionSet();
 
 	if (m_pEnv) {
 		RemoveShadowController();
@@ -111,7 +126,8 @@ bool CPhysicsObject::IsStatic() const {
 }
 
 bool CPhysicsObject::IsAsleep() const {
-	return m_pObject->getActivationState() == ISLAND_SLEEPING || m_pObject->getActivationState() == DISABLE_SIMULATION;
+	int state = ReadSnapshot() ? m_iSnapshotActivationState : m_pObject->getActivationState();
+	return state == ISLAND_SLEEPING || state == DISABLE_SIMULATION;
 }
 
 bool CPhysicsObject::IsFluid() const {
@@ -162,6 +178,7 @@ bool CPhysicsObject::IsMotionEnabled() const {
 }
 
 void CPhysicsObject::EnableCollisions(bool enable) {
+	m_pEnv->WaitForSimulation();
 	if (IsCollisionEnabled() == enable) return;
 
 	if (enable) {
@@ -169,9 +186,12 @@ void CPhysicsObject::EnableCollisions(bool enable) {
 	} else {
 		m_pObject->setCollisionFlags(m_pObject->getCollisionFlags() | btCollisionObject::CF_NO_CONTACT_RESPONSE);
 	}
+
+	InvalidateCollisionFilter();
 }
 
 void CPhysicsObject::EnableGravity(bool enable) {
+	m_pEnv->WaitForSimulation();
 	if (IsGravityEnabled() == enable || IsStatic()) return;
 
 	if (enable) {
@@ -184,6 +204,7 @@ void CPhysicsObject::EnableGravity(bool enable) {
 }
 
 void CPhysicsObject::EnableDrag(bool enable)  {
+	m_pEnv->WaitForSimulation();
 	if (IsStatic() || enable == IsDragEnabled())
 		return;
 
@@ -195,6 +216,7 @@ void CPhysicsObject::EnableDrag(bool enable)  {
 }
 
 void CPhysicsObject::EnableMotion(bool enable) {
+	m_pEnv->WaitForSimulation();
 	if (IsMotionEnabled() == enable || IsStatic()) return;
 
 	if (enable) {
@@ -205,10 +227,18 @@ void CPhysicsObject::EnableMotion(bool enable) {
 
 		m_pObject->setFlags(m_pObject->getFlags() | BT_DISABLE_MOTION);
 	}
+
+	m_pEnv->MarkSnapshotDirty(this);
 }
 
 void CPhysicsObject::SetGameData(void *pGameData) {
 	m_pGameData = pGameData;
+
+	// Collision sets only filter pairs with the same game data
+	if (m_pCollisionSet) {
+		m_pEnv->WaitForSimulation();
+		InvalidateCollisionFilter();
+	}
 }
 
 void *CPhysicsObject::GetGameData() const {
@@ -232,7 +262,11 @@ unsigned short CPhysicsObject::GetGameIndex() const {
 }
 
 void CPhysicsObject::SetCallbackFlags(unsigned short callbackflags) {
+	m_pEnv->WaitForSimulation();
+	if (m_callbacks == callbackflags) return;
+
 	m_callbacks = callbackflags;
+	InvalidateCollisionFilter();
 }
 
 unsigned short CPhysicsObject::GetCallbackFlags() const {
@@ -241,15 +275,16 @@ unsigned short CPhysicsObject::GetCallbackFlags() const {
 
 // UNEXPOSED
 void CPhysicsObject::AddCallbackFlags(unsigned short flags) {
-	m_callbacks |= flags;
+	SetCallbackFlags(m_callbacks | flags);
 }
 
 // UNEXPOSED
 void CPhysicsObject::RemoveCallbackFlags(unsigned short flags) {
-	m_callbacks &= ~(flags);
+	SetCallbackFlags(m_callbacks & ~(flags));
 }
 
 void CPhysicsObject::Wake() {
+	m_pEnv->WaitForSimulation();
 	// Static objects can't wake!
 	if (IsStatic())
 		return;
@@ -259,6 +294,7 @@ void CPhysicsObject::Wake() {
 }
 
 void CPhysicsObject::Sleep() {
+	m_pEnv->WaitForSimulation();
 	// Static objects can't sleep!
 	if (IsStatic())
 		return;
@@ -267,6 +303,9 @@ void CPhysicsObject::Sleep() {
 }
 
 void CPhysicsObject::RecheckCollisionFilter() {
+	m_pEnv->WaitForSimulation();
+	InvalidateCollisionFilter();
+
 	// Remove any collision points that we shouldn't be colliding with now
 	btOverlappingPairCache *pCache = m_pEnv->GetBulletEnvironment()->getBroadphase()->getOverlappingPairCache();
 	btBroadphasePairArray arr = pCache->getOverlappingPairArray();
@@ -296,6 +335,7 @@ void CPhysicsObject::RecheckContactPoints() {
 }
 
 void CPhysicsObject::SetMass(float mass) {
+	m_pEnv->WaitForSimulation();
 	if (IsStatic()) return;
 
 	m_fMass = mass;
@@ -342,6 +382,7 @@ Vector CPhysicsObject::GetInvInertia() const {
 }
 
 void CPhysicsObject::SetInertia(const Vector &inertia) {
+	m_pEnv->WaitForSimulation();
 	btVector3 btvec;
 	ConvertDirectionToBull(inertia, btvec);
 	btvec = btvec.absolute();
@@ -357,6 +398,7 @@ void CPhysicsObject::SetInertia(const Vector &inertia) {
 // FIXME: The API is confusing because we need to add the BT_DISABLE_WORLD_GRAVITY flag to the object
 // by calling EnableGravity(false)
 void CPhysicsObject::SetLocalGravity(const Vector &gravityVector) {
+	m_pEnv->WaitForSimulation();
 	btVector3 tmp;
 	ConvertPosToBull(gravityVector, tmp);
 	m_pObject->setGravity(tmp);
@@ -370,6 +412,7 @@ Vector CPhysicsObject::GetLocalGravity() const {
 
 // TODO: IVP interface took this as damping m/s rad/s rather than bullet's [0..1]
 void CPhysicsObject::SetDamping(const float *speed, const float *rot) {
+	m_pEnv->WaitForSimulation();
 	if (!speed && !rot) return;
 
 	btScalar linSpeed = m_pObject->getLinearDamping();
@@ -390,14 +433,19 @@ void CPhysicsObject::GetDamping(float *speed, float *rot) const {
 }
 
 void CPhysicsObject::SetDragCoefficient(float *pDrag, float *pAngularDrag) {
+	m_pEnv->WaitForSimulation();
 	if (pDrag)
 		m_dragCoefficient = *pDrag;
 
 	if (pAngularDrag)
 		m_angDragCoefficient = *pAngularDrag;
+
+	if (IsDragEnabled())
+		m_pEnv->GetDragController()->UpdatePhysicsObject(this);
 }
 
 void CPhysicsObject::SetBuoyancyRatio(float ratio) {
+	m_pEnv->WaitForSimulation();
 	m_fBuoyancyRatio = ratio;
 }
 
@@ -406,6 +454,7 @@ int CPhysicsObject::GetMaterialIndex() const {
 }
 
 void CPhysicsObject::SetMaterialIndex(int materialIndex) {
+	m_pEnv->WaitForSimulation();
 	surfacedata_t *pSurface = g_SurfaceDatabase.GetSurfaceData(materialIndex);
 
 	if (pSurface) {
@@ -427,10 +476,12 @@ unsigned int CPhysicsObject::GetContents() const {
 }
 
 void CPhysicsObject::SetContents(unsigned int contents) {
+	m_pEnv->WaitForSimulation();
 	m_contents = contents;
 }
 
 void CPhysicsObject::SetSleepThresholds(const float *linVel, const float *angVel) {
+	m_pEnv->WaitForSimulation();
 	if (!linVel && !angVel) return;
 
 	m_pObject->setSleepingThresholds(linVel ? ConvertDistanceToBull(*linVel) : m_pObject->getLinearSleepingThreshold(),
@@ -458,8 +509,10 @@ float CPhysicsObject::GetSphereRadius() const {
 
 float CPhysicsObject::GetEnergy() const {
 	// (1/2) * mass * velocity^2
-	float e = 0.5f * GetMass() * m_pObject->getLinearVelocity().dot(m_pObject->getLinearVelocity());
-	e += 0.5f * GetMass() * m_pObject->getAngularVelocity().dot(m_pObject->getAngularVelocity());
+	btVector3 linVel = GetReadLinearVelocity();
+	btVector3 angVel = GetReadAngularVelocity();
+	float e = 0.5f * GetMass() * linVel.dot(linVel);
+	e += 0.5f * GetMass() * angVel.dot(angVel);
 	return ConvertEnergyToHL(e);
 }
 
@@ -472,6 +525,7 @@ Vector CPhysicsObject::GetMassCenterLocalSpace() const {
 }
 
 void CPhysicsObject::SetPosition(const Vector &worldPosition, const QAngle &angles, bool isTeleport) {
+	m_pEnv->WaitForSimulation();
 	btVector3 bullPos;
 	btMatrix3x3 bullAngles;
 
@@ -488,9 +542,13 @@ void CPhysicsObject::SetPosition(const Vector &worldPosition, const QAngle &angl
 	// Change this if behavior of IVP is different!
 	if (isTeleport)
 		m_pObject->activate();
+
+	// Objects with motion disabled are moved around like this while they sleep
+	m_pEnv->MarkSnapshotDirty(this);
 }
 
 void CPhysicsObject::SetPositionMatrix(const matrix3x4_t &matrix, bool isTeleport) {
+	m_pEnv->WaitForSimulation();
 	btTransform trans;
 	ConvertMatrixToBull(matrix, trans);
 	m_pObject->setWorldTransform(trans * ((btMassCenterMotionState *)m_pObject->getMotionState())->m_centerOfMassOffset);
@@ -500,13 +558,15 @@ void CPhysicsObject::SetPositionMatrix(const matrix3x4_t &matrix, bool isTelepor
 
 	if (isTeleport)
 		m_pObject->activate();
+
+	m_pEnv->MarkSnapshotDirty(this);
 }
 
 void CPhysicsObject::GetPosition(Vector *worldPosition, QAngle *angles) const {
 	if (!worldPosition && !angles) return;
 
 	btTransform transform;
-	((btMassCenterMotionState *)m_pObject->getMotionState())->getGraphicTransform(transform);
+	GetReadGraphicTransform(transform);
 	if (worldPosition) ConvertPosToHL(transform.getOrigin(), *worldPosition);
 	if (angles) ConvertRotationToHL(transform.getBasis(), *angles);
 }
@@ -515,11 +575,12 @@ void CPhysicsObject::GetPositionMatrix(matrix3x4_t *positionMatrix) const {
 	if (!positionMatrix) return;
 
 	btTransform transform;
-	((btMassCenterMotionState *)m_pObject->getMotionState())->getGraphicTransform(transform);
+	GetReadGraphicTransform(transform);
 	ConvertMatrixToHL(transform, *positionMatrix);
 }
 
 void CPhysicsObject::SetVelocity(const Vector *velocity, const AngularImpulse *angularVelocity) {
+	m_pEnv->WaitForSimulation();
 	if (!velocity && !angularVelocity) return;
 
 	if (!IsMoveable() || !IsMotionEnabled()) {
@@ -551,18 +612,22 @@ void CPhysicsObject::GetVelocity(Vector *velocity, AngularImpulse *angularVeloci
 	if (!velocity && !angularVelocity) return;
 
 	if (velocity)
-		ConvertPosToHL(m_pObject->getLinearVelocity(), *velocity);
+		ConvertPosToHL(GetReadLinearVelocity(), *velocity);
 
 	// Angular velocity is supplied in local space.
 	if (angularVelocity) {
-		btVector3 angVel = m_pObject->getAngularVelocity();
-		angVel = m_pObject->getWorldTransform().getBasis().transpose() * angVel;
+		btVector3 angVel = GetReadAngularVelocity();
+		if (ReadSnapshot())
+			angVel = m_snapshotTransform.getBasis().transpose() * angVel;
+		else
+			angVel = m_pObject->getWorldTransform().getBasis().transpose() * angVel;
 
 		ConvertAngularImpulseToHL(angVel, *angularVelocity);
 	}
 }
 
 void CPhysicsObject::AddVelocity(const Vector *velocity, const AngularImpulse *angularVelocity) {
+	m_pEnv->WaitForSimulation();
 	if (!velocity && !angularVelocity) return;
 
 	if (!IsMoveable() || !IsMotionEnabled()) {
@@ -593,10 +658,13 @@ void CPhysicsObject::GetVelocityAtPoint(const Vector &worldPosition, Vector *pVe
 
 	btVector3 vec;
 	ConvertPosToBull(localPos, vec);
-	ConvertPosToHL(m_pObject->getVelocityInLocalPoint(vec), *pVelocity);
+
+	// Same as btRigidBody::getVelocityInLocalPoint
+	ConvertPosToHL(GetReadLinearVelocity() + GetReadAngularVelocity().cross(vec), *pVelocity);
 }
 
 void CPhysicsObject::GetImplicitVelocity(Vector *velocity, AngularImpulse *angularVelocity) const {
+	m_pEnv->WaitForSimulation();
 	if (!velocity && !angularVelocity) return;
 
 	// gets the velocity actually moved by the object in the last simulation update
@@ -642,6 +710,7 @@ void CPhysicsObject::WorldToLocalVector(Vector *localVector, const Vector &world
 }
 
 void CPhysicsObject::ApplyForceCenter(const Vector &forceVector) {
+	m_pEnv->WaitForSimulation();
 	if (!IsMoveable() || !IsMotionEnabled()) {
 		return;
 	}
@@ -680,6 +749,7 @@ void CPhysicsObject::ApplyForceCenter(const Vector &forceVector) {
 }
 
 void CPhysicsObject::ApplyForceOffset(const Vector &forceVector, const Vector &worldPosition) {
+	m_pEnv->WaitForSimulation();
 	if (!IsMoveable() || !IsMotionEnabled()) {
 		return;
 	}
@@ -721,6 +791,7 @@ void CPhysicsObject::ApplyForceOffset(const Vector &forceVector, const Vector &w
 
 // FIXME: Is torque in local or world space?
 void CPhysicsObject::ApplyTorqueCenter(const AngularImpulse &torque) {
+	m_pEnv->WaitForSimulation();
 	if (!IsMoveable() || !IsMotionEnabled()) {
 		return;
 	}
@@ -733,6 +804,7 @@ void CPhysicsObject::ApplyTorqueCenter(const AngularImpulse &torque) {
 
 // Output passed to ApplyForceCenter/ApplyTorqueCenter
 void CPhysicsObject::CalculateForceOffset(const Vector &forceVector, const Vector &worldPosition, Vector *centerForce, AngularImpulse *centerTorque) const {
+	m_pEnv->WaitForSimulation();
 	if (!centerForce && !centerTorque) return;
 
 	btVector3 pos, force;
@@ -754,6 +826,7 @@ void CPhysicsObject::CalculateForceOffset(const Vector &forceVector, const Vecto
 
 // forceVector is an impulse (F*t AKA m*v) in world space
 void CPhysicsObject::CalculateVelocityOffset(const Vector &forceVector, const Vector &worldPosition, Vector *centerVelocity, AngularImpulse *centerAngularVelocity) const {
+	m_pEnv->WaitForSimulation();
 	if (!centerVelocity && !centerAngularVelocity) return;
 
 	btVector3 force, relpos;
@@ -792,11 +865,11 @@ float CPhysicsObject::CalculateAngularDrag(const Vector &objectSpaceRotationAxis
 
 // This function is a silly hack, games should be using the friction snapshot instead.
 bool CPhysicsObject::GetContactPoint(Vector *contactPoint, IPhysicsObject **contactObject) const {
+	m_pEnv->WaitForSimulation();
 	if (!contactPoint && !contactObject) return false;
 
-	int numManifolds = m_pEnv->GetBulletEnvironment()->getDispatcher()->getNumManifolds();
-	for (int i = 0; i < numManifolds; i++) {
-		btPersistentManifold *contactManifold = m_pEnv->GetBulletEnvironment()->getDispatcher()->getManifoldByIndexInternal(i);
+	// Only look at the manifolds that involve us
+	for (btPersistentManifold *contactManifold = m_pObject->getFirstManifold(); contactManifold; contactManifold = contactManifold->getNextManifoldOnBody(m_pObject)) {
 		const btCollisionObject *obA = contactManifold->getBody0();
 		const btCollisionObject *obB = contactManifold->getBody1();
 
@@ -837,6 +910,7 @@ bool CPhysicsObject::GetContactPoint(Vector *contactPoint, IPhysicsObject **cont
 }
 
 void CPhysicsObject::SetShadow(float maxSpeed, float maxAngularSpeed, bool allowPhysicsMovement, bool allowPhysicsRotation) {
+	m_pEnv->WaitForSimulation();
 	if (m_pShadow) {
 		m_pShadow->MaxSpeed(maxSpeed, maxAngularSpeed);
 		m_pShadow->SetAllowsTranslation(allowPhysicsMovement);
@@ -849,10 +923,14 @@ void CPhysicsObject::SetShadow(float maxSpeed, float maxAngularSpeed, bool allow
 
 		m_pShadow = (CShadowController *)m_pEnv->CreateShadowController(this, allowPhysicsMovement, allowPhysicsRotation);
 		m_pShadow->MaxSpeed(maxSpeed, maxAngularSpeed);
+
+		// Shadows don't collide with other shadows
+		InvalidateCollisionFilter();
 	}
 }
 
 void CPhysicsObject::UpdateShadow(const Vector &targetPosition, const QAngle &targetAngles, bool tempDisableGravity, float timeOffset) {
+	m_pEnv->WaitForSimulation();
 	if (m_pShadow) {
 		m_pShadow->Update(targetPosition, targetAngles, timeOffset);
 	}
@@ -863,10 +941,10 @@ int CPhysicsObject::GetShadowPosition(Vector *position, QAngle *angles) const {
 	if (!position && !angles) return m_pEnv->GetNumSubSteps();
 
 	btTransform transform;
-	((btMassCenterMotionState *)m_pObject->getMotionState())->getGraphicTransform(transform);
+	GetReadGraphicTransform(transform);
 
 	float deltaTime = m_pEnv->GetSubStepTime();
-	btTransformUtil::integrateTransform(transform, m_pObject->getLinearVelocity(), m_pObject->getAngularVelocity(), deltaTime, transform);
+	btTransformUtil::integrateTransform(transform, GetReadLinearVelocity(), GetReadAngularVelocity(), deltaTime, transform);
 
 	if (position)
 		ConvertPosToHL(transform.getOrigin(), *position);
@@ -883,6 +961,7 @@ IPhysicsShadowController *CPhysicsObject::GetShadowController() const {
 }
 
 void CPhysicsObject::RemoveShadowController() {
+	m_pEnv->WaitForSimulation();
 	if (m_pShadow)
 		m_pEnv->DestroyShadowController(m_pShadow);
 
@@ -890,9 +969,11 @@ void CPhysicsObject::RemoveShadowController() {
 	AddCallbackFlags(CALLBACK_GLOBAL_FRICTION | CALLBACK_GLOBAL_COLLIDE_STATIC);
 
 	m_pShadow = NULL;
+	InvalidateCollisionFilter();
 }
 
 float CPhysicsObject::ComputeShadowControl(const hlshadowcontrol_params_t &params, float secondsToArrival, float dt) {
+	m_pEnv->WaitForSimulation();
 	return ComputeShadowControllerHL(this, params, secondsToArrival, dt);
 }
 
@@ -901,6 +982,7 @@ IPhysicsVehicleController *CPhysicsObject::GetVehicleController() const {
 }
 
 void CPhysicsObject::UpdateCollide() {
+	m_pEnv->WaitForSimulation();
 	btVector3 inertia;
 
 	btCollisionShape *pShape = m_pObject->getCollisionShape();
@@ -919,6 +1001,7 @@ CPhysCollide *CPhysicsObject::GetCollide() {
 }
 
 void CPhysicsObject::SetCollide(CPhysCollide *pCollide) {
+	m_pEnv->WaitForSimulation();
 	m_pEnv->GetBulletEnvironment()->removeRigidBody(m_pObject);
 
 	btCollisionShape *pShape = pCollide->GetCollisionShape();
@@ -942,11 +1025,70 @@ IPhysicsEnvironment32 *CPhysicsObject::GetEnvironment() const {
 	return m_pEnv;
 }
 
+void CPhysicsObject::SetCollisionSet(IPhysicsCollisionSet *pSet, int index) {
+	m_pEnv->WaitForSimulation();
+	CPhysicsCollisionSet *pColSet = (CPhysicsCollisionSet *)pSet;
+	if (pColSet && (index < 0 || index >= pColSet->GetMaxEntries())) {
+		Assert(0);
+		pColSet = NULL;
+	}
+
+	if (m_pCollisionSet)
+		m_pCollisionSet->RemoveMember(this);
+
+	m_pCollisionSet = pColSet;
+	m_iCollisionSetIndex = pColSet ? index : 0;
+
+	if (m_pCollisionSet)
+		m_pCollisionSet->AddMember(this);
+
+	RecheckCollisionFilter();
+}
+
+// UNEXPOSED
+// For sets that are going away and objects that are going away
+void CPhysicsObject::ClearCollisionSet() {
+	if (!m_pCollisionSet) return;
+
+	m_pCollisionSet->RemoveMember(this);
+	m_pCollisionSet = NULL;
+	m_iCollisionSetIndex = 0;
+
+	if (!m_bRemoving)
+		RecheckCollisionFilter();
+}
+
+// UNEXPOSED
+void CPhysicsObject::InvalidateCollisionFilter() {
+	m_iFilterSerial = CCollisionSolver::NewFilterSerial();
+}
+
+// UNEXPOSED
+void CPhysicsObject::RefreshBroadphasePairs() {
+	btBroadphaseProxy *pProxy = m_pObject->getBroadphaseHandle();
+	if (!pProxy || IsTrigger()) return;
+
+	short group = pProxy->m_collisionFilterGroup;
+	short mask = pProxy->m_collisionFilterMask;
+
+	// Remove/add object to get a new proxy (same as SetCollide)
+	m_pEnv->GetBulletEnvironment()->removeRigidBody(m_pObject);
+	m_pEnv->GetBulletEnvironment()->addRigidBody(m_pObject, group, mask);
+}
+
+IPhysicsCollisionSet *CPhysicsObject::GetCollisionSet(int *pIndex) const {
+	if (pIndex)
+		*pIndex = m_iCollisionSetIndex;
+
+	return m_pCollisionSet;
+}
+
 bool CPhysicsObject::IsTrigger() const {
 	return m_pGhostObject != NULL || m_pFluidController != NULL;
 }
 
 void CPhysicsObject::BecomeTrigger() {
+	m_pEnv->WaitForSimulation();
 	if (IsTrigger())
 		return;
 
@@ -969,6 +1111,7 @@ void CPhysicsObject::BecomeTrigger() {
 }
 
 void CPhysicsObject::RemoveTrigger() {
+	m_pEnv->WaitForSimulation();
 	if (!IsTrigger())
 		return;
 
@@ -976,6 +1119,7 @@ void CPhysicsObject::RemoveTrigger() {
 	EnableGravity(true);
 
 	m_pObject->setWorldTransform(m_pGhostObject->getWorldTransform());
+	m_pEnv->MarkSnapshotDirty(this);
 
 	if (IsStatic())
 		m_pEnv->GetBulletEnvironment()->addRigidBody(m_pObject, COLGROUP_WORLD, ~COLGROUP_WORLD);
@@ -1011,6 +1155,7 @@ void CPhysicsObject::RemoveHinged() {
 }
 
 IPhysicsFrictionSnapshot *CPhysicsObject::CreateFrictionSnapshot() {
+	m_pEnv->WaitForSimulation();
 	return ::CreateFrictionSnapshot(this);
 }
 
@@ -1019,6 +1164,7 @@ void CPhysicsObject::DestroyFrictionSnapshot(IPhysicsFrictionSnapshot *pSnapshot
 }
 
 void CPhysicsObject::OutputDebugInfo() const {
+	m_pEnv->WaitForSimulation();
 	Msg("-----------------\n");
 
 	if (m_pName)
@@ -1134,15 +1280,15 @@ void CPhysicsObject::Init(CPhysicsEnvironment *pEnv, btRigidBody *pObject, int m
 		m_pObject->setCollisionFlags(m_pObject->getCollisionFlags() | btCollisionObject::CF_DISABLE_VISUALIZE_OBJECT);
 	}
 
+	// Set before enabling drag, the drag controller keeps its own copy
+	m_dragCoefficient = drag;
+	m_angDragCoefficient = angDrag;
 	ComputeDragBasis(isStatic);
 
 	if (!isStatic && drag != 0.0f) {
 		EnableDrag(true);
 	}
 
-	m_dragCoefficient = drag;
-	m_angDragCoefficient = angDrag;
-
 	// Compute our continuous collision detection stuff (for fast moving objects, prevents tunneling)
 	// This doesn't work on compound objects! see: btDiscreteDynamicsWorld::integrateTransforms
 	if (!isStatic) {
@@ -1257,10 +1403,142 @@ btVector3 CPhysicsObject::GetBullMassCenterOffset() const {
 }
 
 void CPhysicsObject::TransferToEnvironment(CPhysicsEnvironment *pDest) {
+	// Our drag slot belongs to the old environment's drag controller
+	bool drag = IsDragEnabled();
+	if (drag)
+		m_pEnv->GetDragController()->RemovePhysicsObject(this);
+
 	m_pEnv->GetBulletEnvironment()->removeRigidBody(m_pObject);
 	m_pEnv = pDest;
 
 	m_pEnv->GetBulletEnvironment()->addRigidBody(m_pObject);
+
+	if (drag)
+		m_pEnv->GetDragController()->AddPhysicsObject(this);
+}
+
+// UNEXPOSED
+// Called by the environment right before it launches an asynchronous step
+void CPhysicsObject::UpdateSnapshot() {
+	// Static objects don't move, the getters read them directly
+	if (IsStatic())
+		return;
+
+	((btMassCenterMotionState *)m_pObject->getMotionState())->getGraphicTransform(m_snapshotTransform);
+	m_snapshotLinVel = m_pObject->getLinearVelocity();
+	m_snapshotAngVel = m_pObject->getAngularVelocity();
+	m_iSnapshotActivationState = m_pObject->getActivationState();
+}
+
+// UNEXPOSED
+void CPhysicsObject::GetSaveData(objectsave_t &data) const {
+	memset(&data, 0, sizeof(data));
+
+	((btMassCenterMotionState *)m_pObject->getMotionState())->getGraphicTransform(data.transform);
+	data.linearVelocity			= m_pObject->getLinearVelocity();
+	data.angularVelocity		= m_pObject->getAngularVelocity();
+	data.localGravity			= m_pObject->getGravity();
+	data.invInertia				= m_pObject->getInvInertiaDiagLocal();
+	data.mass					= m_fMass;
+	data.volume					= m_fVolume;
+	data.sphereRadius			= m_bIsSphere ? GetSphereRadius() : 0;
+	data.linearDamping			= m_pObject->getLinearDamping();
+	data.angularDamping			= m_pObject->getAngularDamping();
+	data.dragCoefficient		= m_dragCoefficient;
+	data.angularDragCoefficient	= m_angDragCoefficient;
+	data.buoyancyRatio			= m_fBuoyancyRatio;
+	data.linearSleepThreshold	= m_pObject->getLinearSleepingThreshold();
+	data.angularSleepThreshold	= m_pObject->getAngularSleepingThreshold();
+	data.deactivationTime		= m_pObject->getDeactivationTime();
+	data.activationState		= m_pObject->getActivationState();
+	data.materialIndex			= m_materialIndex;
+	data.contents				= m_contents;
+	data.callbacks				= m_callbacks;
+	data.gameFlags				= m_gameFlags;
+	data.gameIndex				= m_iGameIndex;
+
+	data.flags = 0;
+	if (IsStatic() && !m_pShadow)	data.flags |= OBJECTSAVE_STATIC;	// Shadows without translation are static too
+	if (m_bIsSphere)			data.flags |= OBJECTSAVE_SPHERE;
+	if (IsGravityEnabled())		data.flags |= OBJECTSAVE_GRAVITY;
+	if (IsDragEnabled())		data.flags |= OBJECTSAVE_DRAG;
+	if (IsMotionEnabled())		data.flags |= OBJECTSAVE_MOTION;
+	if (IsCollisionEnabled())	data.flags |= OBJECTSAVE_COLLISIONS;
+	if (m_pGhostObject)			data.flags |= OBJECTSAVE_TRIGGER;
+	if (m_pShadow)				data.flags |= OBJECTSAVE_SHADOW;
+}
+
+// UNEXPOSED
+// Puts us back in the state GetSaveData saved. Whoever created us already picked the collision model
+// and whether we're static or a sphere.
+void CPhysicsObject::ApplySaveData(const objectsave_t &data) {
+	SetMaterialIndex(data.materialIndex);
+	m_contents		= data.contents;
+	m_gameFlags		= data.gameFlags;
+	m_iGameIndex	= data.gameIndex;
+	m_fVolume		= data.volume;
+	EnableCollisions((data.flags & OBJECTSAVE_COLLISIONS) != 0);
+
+	if (!(data.flags & OBJECTSAVE_STATIC)) {
+		m_fMass = data.mass;
+		m_pObject->setMassProps(data.mass, btVector3(0, 0, 0));
+		m_pObject->setInvInertiaDiagLocal(data.invInertia);
+		m_pObject->updateInertiaTensor();
+
+		m_pObject->setDamping(data.linearDamping, data.angularDamping);
+		m_pObject->setSleepingThresholds(data.linearSleepThreshold, data.angularSleepThreshold);
+
+		// The drag controller keeps its own copy of the coefficients
+		m_dragCoefficient = data.dragCoefficient;
+		m_angDragCoefficient = data.angularDragCoefficient;
+		ComputeDragBasis(false);
+		if ((data.flags & OBJECTSAVE_DRAG) && IsDragEnabled())
+			m_pEnv->GetDragController()->UpdatePhysicsObject(this);
+		else
+			EnableDrag((data.flags & OBJECTSAVE_DRAG) != 0);
+
+		EnableGravity((data.flags & OBJECTSAVE_GRAVITY) != 0);
+		m_pObject->setGravity(data.localGravity);
+		EnableMotion((data.flags & OBJECTSAVE_MOTION) != 0);
+
+		m_pObject->setLinearVelocity(data.linearVelocity);
+		m_pObject->setAngularVelocity(data.angularVelocity);
+	}
+
+	m_fBuoyancyRatio = data.buoyancyRatio;
+	SetCallbackFlags(data.callbacks);
+
+	btMassCenterMotionState *pMotionState = (btMassCenterMotionState *)m_pObject->getMotionState();
+	pMotionState->setGraphicTransform(data.transform);
+	m_pObject->setWorldTransform(pMotionState->m_worldTrans);
+	m_pObject->setInterpolationWorldTransform(pMotionState->m_worldTrans);
+
+	m_pObject->forceActivationState(data.activationState);
+	m_pObject->setDeactivationTime(data.deactivationTime);
+	m_pEnv->MarkSnapshotDirty(this);
+
+	if ((data.flags & OBJECTSAVE_TRIGGER) && !IsTrigger())
+		BecomeTrigger();
+}
+
+// The simulation thread is writing to the rigid body, read the snapshot
+bool CPhysicsObject::ReadSnapshot() const {
+	return !IsStatic() && m_pEnv->ShouldReadSnapshot();
+}
+
+btVector3 CPhysicsObject::GetReadLinearVelocity() const {
+	return ReadSnapshot() ? m_snapshotLinVel : m_pObject->getLinearVelocity();
+}
+
+btVector3 CPhysicsObject::GetReadAngularVelocity() const {
+	return ReadSnapshot() ? m_snapshotAngVel : m_pObject->getAngularVelocity();
+}
+
+void CPhysicsObject::GetReadGraphicTransform(btTransform &transform) const {
+	if (ReadSnapshot())
+		transform = m_snapshotTransform;
+	else
+		((btMassCenterMotionState *)m_pObject->getMotionState())->getGraphicTransform(transform);
 }
 
 /************************
@@ -10,6 +10,7 @@ class CShadowController;
 class CPhysicsFluidController;
 class CPhysicsConstraint;
 class IController;
+class CPhysicsCollisionSet;
 
 // Bullet uses this so we can sync the graphics representation of the object.
 struct btMassCenterMotionState : public btMotionState {
@@ -29,6 +30,45 @@ struct btMassCenterMotionState : public btMotionState {
 	void setGraphicTransform(const btTransform &graphTrans) { m_worldTrans = graphTrans * m_centerOfMassOffset; }			// HL -> Bullet
 };
 
+// Object state in save games (see CPhysicsEnvironment::Save), in bullet units.
+// The collision model and the game's pointers aren't in here, the game hands them back on restore.
+enum {
+	OBJECTSAVE_STATIC		= 1 << 0,
+	OBJECTSAVE_SPHERE		= 1 << 1,
+	OBJECTSAVE_GRAVITY		= 1 << 2,
+	OBJECTSAVE_DRAG			= 1 << 3,
+	OBJECTSAVE_MOTION		= 1 << 4,
+	OBJECTSAVE_COLLISIONS	= 1 << 5,
+	OBJECTSAVE_TRIGGER		= 1 << 6,
+	OBJECTSAVE_SHADOW		= 1 << 7,	// Followed by a shadowsave_t
+};
+
+struct objectsave_t {
+	btTransform		transform;			// Graphic transform (what GetPosition returns)
+	btVector3		linearVelocity;
+	btVector3		angularVelocity;	// World space
+	btVector3		localGravity;
+	btVector3		invInertia;
+	float			mass;
+	float			volume;				// Cubic meters
+	float			sphereRadius;		// HL units, spheres only
+	float			linearDamping;
+	float			angularDamping;
+	float			dragCoefficient;
+	float			angularDragCoefficient;
+	float			buoyancyRatio;
+	float			linearSleepThreshold;
+	float			angularSleepThreshold;
+	float			deactivationTime;
+	int				activationState;
+	int				materialIndex;
+	unsigned int	contents;
+	unsigned short	callbacks;
+	unsigned short	gameFlags;
+	unsigned short	gameIndex;
+	unsigned short	flags;				// OBJECTSAVE_*
+};
+
 class CPhysicsObject;
 class IObjectEventListener {
 	public:
@@ -151,6 +191,9 @@ class CPhysicsObject : public IPhysicsObject32 {
 		const char *						GetName() const;
 		IPhysicsEnvironment32 *				GetEnvironment() const;
 
+		void								SetCollisionSet(IPhysicsCollisionSet *pSet, int index);
+		IPhysicsCollisionSet *				GetCollisionSet(int *pIndex = NULL) const;
+
 		bool								IsTrigger() const;
 		void								BecomeTrigger();
 		void								RemoveTrigger();
@@ -185,6 +228,10 @@ class CPhysicsObject : public IPhysicsObject32 {
 		float								GetDragInDirection(const btVector3 &direction) const; // Function is not interfaced anymore
 		float								GetAngularDragInDirection(const btVector3 &direction) const;
 		void								ComputeDragBasis(bool isStatic);
+		const btVector3 &					GetDragBasis() const { return m_dragBasis; }
+		const btVector3 &					GetAngularDragBasis() const { return m_angDragBasis; }
+		float								GetDragCoefficient() const { return m_dragCoefficient; }
+		float								GetAngularDragCoefficient() const { return m_angDragCoefficient; }
 
 		float								GetVolume() const { return m_fVolume; }
 		float								GetBuoyancyRatio() const { return m_fBuoyancyRatio; } // [0..1] value
@@ -197,6 +244,22 @@ class CPhysicsObject : public IPhysicsObject32 {
 		int									GetLastActivationState() { return m_iLastActivationState; }
 		void								SetLastActivationState(int iState) { m_iLastActivationState = iState; }
 
+		// Slots in the environment's lists (-1 if we're not in the list). Lets them remove us without searching.
+		int									GetEnvironmentIndex() const { return m_iEnvIndex; }
+		void								SetEnvironmentIndex(int index) { m_iEnvIndex = index; }
+		int									GetActiveIndex() const { return m_iActiveIndex; }
+		void								SetActiveIndex(int index) { m_iActiveIndex = index; }
+		int									GetDragIndex() const { return m_iDragIndex; }
+		void								SetDragIndex(int index) { m_iDragIndex = index; }
+		int									GetDirtyActivationIndex() const { return m_iDirtyActivationIndex; }
+		void								SetDirtyActivationIndex(int index) { m_iDirtyActivationIndex = index; }
+		int									GetDirtySnapshotIndex() const { return m_iDirtySnapshotIndex; }
+		void								SetDirtySnapshotIndex(int index) { m_iDirtySnapshotIndex = index; }
+
+		// First controller that touched us in the environment's current controller tick (-1 = none yet)
+		int									GetTickController(int tick) const { return m_iTickStamp == tick ? m_iTickController : -1; }
+		void								SetTickController(int tick, int controller) { m_iTickStamp = tick; m_iTickController = controller; }
+
 		CPhysicsFluidController *			GetFluidController() { return m_pFluidController; }
 		void								SetFluidController(CPhysicsFluidController *controller) { m_pFluidController = controller; }
 
@@ -204,9 +267,38 @@ class CPhysicsObject : public IPhysicsObject32 {
 
 		bool								IsBeingRemoved() { return m_bRemoving; }
 
+		CPhysicsCollisionSet *				GetPhysicsCollisionSet() const { return m_pCollisionSet; }
+		int									GetCollisionSetIndex() const { return m_iCollisionSetIndex; }
+
+		// Identifies our collision filter state in the collision solver's cache. Call InvalidateCollisionFilter
+		// when something the filter depends on changes, and the pairs we're in get judged again.
+		unsigned int						GetFilterSerial() const { return m_iFilterSerial; }
+		void								InvalidateCollisionFilter();
+		// The broadphase only looks at new overlaps, this makes it look at the ones it rejected before again
+		void								RefreshBroadphasePairs();
+		void								ClearCollisionSet();
+
+		// Velocity from before the solver ran in the given step (see CCollisionEventListener)
+		int									GetPreCollisionStep() const { return m_iPreCollisionStep; }
+		const btVector3 &					GetPreCollisionVelocity() const { return m_preCollisionVel; }
+		const btVector3 &					GetPreCollisionAngularVelocity() const { return m_preCollisionAngVel; }
+		void								SetPreCollisionVelocity(const btVector3 &vel, const btVector3 &angVel, int step) { m_preCollisionVel = vel; m_preCollisionAngVel = angVel; m_iPreCollisionStep = step; }
+
 		void								TransferToEnvironment(CPhysicsEnvironment *pDest);
 
+		// Copies what the getters read into the snapshot they read instead while an asynchronous step is running
+		void								UpdateSnapshot();
+
+		void								GetSaveData(objectsave_t &data) const;
+		void								ApplySaveData(const objectsave_t &data);
+
 	private:
+		bool								ReadSnapshot() const;
+		btVector3							GetReadLinearVelocity() const;
+		btVector3							GetReadAngularVelocity() const;
+		void								GetReadGraphicTransform(btTransform &transform) const;
+
+
 		CPhysicsEnvironment *				m_pEnv;
 		void *								m_pGameData;
 		btRigidBody *						m_pObject;
@@ -235,11 +327,28 @@ class CPhysicsObject : public IPhysicsObject32 {
 		CShadowController *					m_pShadow;
 		CPhysicsVehicleController *			m_pVehicleController;
 		CPhysicsFluidController *			m_pFluidController;
+		CPhysicsCollisionSet *				m_pCollisionSet;
+		int									m_iCollisionSetIndex;
+		unsigned int						m_iFilterSerial;
+		btVector3							m_preCollisionVel;
+		btVector3							m_preCollisionAngVel;
+		int									m_iPreCollisionStep;
+		btTransform							m_snapshotTransform; // Graphic transform (what GetPosition returns)
+		btVector3							m_snapshotLinVel;
+		btVector3							m_snapshotAngVel; // World space
+		int									m_iSnapshotActivationState;
 		CUtlVector<CPhysicsConstraint *>	m_pConstraintVec;
 		CUtlVector<IController *>			m_pControllers;
 		CUtlVector<IObjectEventListener *>	m_pEventListeners;
 
 		int									m_iLastActivationState;
+		int									m_iEnvIndex;
+		int									m_iActiveIndex;
+		int									m_iDragIndex;
+		int									m_iDirtyActivationIndex;
+		int									m_iDirtySnapshotIndex;
+		int									m_iTickStamp;
+		int									m_iTickController;
 };
 
 CPhysicsObject *CreatePhysicsObject(CPhysicsEnvironment *pEnvironment, const CPhysCollide *pCollisionModel, int materialIndex, const Vector &position, const QAngle &angles, objectparams_t *pParams, bool isStatic);
@@ -8,136 +8,310 @@
 * CLASS CPhysicsObjectPairHash
 ***********************************/
 
+// Game code adds a pair for every no-collide made by tools, so per-object queries walk the object's own
+// pair list (O(number of pairs it's in)) instead of the whole table.
+
+#define PAIRHASH_MIN_SLOTS 64
+
+// Mixes all bits of the pointer (also on 64 bit)
+static unsigned int HashPointer(const void *p) {
+	uint64 x = (uint64)(uintp)p;
+	x ^= x >> 33;
+	x *= 0xff51afd7ed558ccdULL;
+	x ^= x >> 33;
+	return (unsigned int)x;
+}
+
+static unsigned int HashPair(const void *pObject0, const void *pObject1) {
+	return HashPointer(pObject0) ^ (HashPointer(pObject1) * 0x9E3779B9);
+}
+
+// Both tables are kept at most half full
+static void InitSlots(CUtlVector<int> &slots, int count) {
+	slots.SetCount(count);
+	for (int i = 0; i < count; i++)
+		slots[i] = -1;
+}
+
+static void InitSlots(CUtlVector<pairobject_t> &slots, int count) {
+	slots.SetCount(count);
+	for (int i = 0; i < count; i++)
+		slots[i].pObject = NULL;
+}
+
 CPhysicsObjectPairHash::CPhysicsObjectPairHash() {
-	for (int i = 0; i < 256; i++)
-		m_pHashList[i] = NULL;
+	m_numPairs = 0;
+	m_numObjects = 0;
+	m_firstFreePair = -1;
+
+	InitSlots(m_pairSlots, PAIRHASH_MIN_SLOTS);
+	InitSlots(m_objectSlots, PAIRHASH_MIN_SLOTS);
 }
 
 void CPhysicsObjectPairHash::AddObjectPair(void *pObject0, void *pObject1) {
-	int entry = GetEntry(pObject0, pObject1);
+	// NULL marks empty object slots, a pair with it could never be found or removed again
+	if (!pObject0 || !pObject1) {
+		Warning("AddObjectPair: Tried to add a pair with a NULL object!\n");
+		return;
+	}
+
+	if (pObject0 > pObject1)
+		V_swap(pObject0, pObject1);
 
-	// This particular entry may have more than one hash, so find the last one.
-	pair_hash_list *last = NULL;
-	for (pair_hash_list *hash = m_pHashList[entry]; hash; hash = hash->next)
-		last = hash;
+	if (FindPairSlot(pObject0, pObject1) != -1)
+		return;
 
-	// Setup our hash
-	pair_hash_list *hash = new pair_hash_list;
-	hash->object0 = pObject0;
-	hash->object1 = pObject1;
-	//hash->previous = last;
-	hash->next = NULL;
+	int pair;
+	if (m_firstFreePair != -1) {
+		pair = m_firstFreePair;
+		m_firstFreePair = m_pairs[pair].next[0];
+	} else {
+		pair = m_pairs.AddToTail();
+	}
 
-	// Now link ourselves up to the list.
-	if (last)
-		last->next = hash;
-	else
-		m_pHashList[entry] = hash;
+	objectpair_t &p = m_pairs[pair];
+	p.pObject[0] = pObject0;
+	p.pObject[1] = pObject1;
+
+	InsertPairSlot(pair);
+	LinkPair(pair, 0);
+	if (pObject0 != pObject1)
+		LinkPair(pair, 1);
 }
 
 void CPhysicsObjectPairHash::RemoveObjectPair(void *pObject0, void *pObject1) {
-	int entry = GetEntry(pObject0, pObject1);
-
-	pair_hash_list *next = NULL;
-	pair_hash_list *last = NULL;
-
-	for (pair_hash_list *hash = m_pHashList[entry]; hash; hash = next) {
-		if ((hash->object0 == pObject0 || hash->object0 == pObject1) && (hash->object1 == pObject0 || hash->object1 == pObject1)) {
-			if (last)
-				last->next = hash->next;
-			else
-				m_pHashList[entry] = hash->next;
-
-			//if (hash->next)
-			//	hash->next->previous = hash->previous;
-			next = hash->next;	// Fix for access violation
-
-			delete hash;
-		} else {
-			next = hash->next;
-			last = hash;
-		}
-	}
+	if (pObject0 > pObject1)
+		V_swap(pObject0, pObject1);
+
+	int slot = FindPairSlot(pObject0, pObject1);
+	if (slot == -1)
+		return;
+
+	int pair = m_pairSlots[slot];
+	RemovePairSlot(slot);
+	FreePair(pair);
 }
 
 void CPhysicsObjectPairHash::RemoveAllPairsForObject(void *pObject0) {
-	// Loop through all entries
-	for (int i = 0; i < 256; i++) {
-		pair_hash_list *next = NULL;
-		pair_hash_list *last = NULL;
-
-		for (pair_hash_list *hash = m_pHashList[i]; hash; hash = next) {
-			if (hash->object0 == pObject0 || hash->object1 == pObject0) {
-				if (last)
-					last->next = hash->next;
-				else
-					m_pHashList[i] = hash->next;
-
-				//if (hash->next)
-				//	hash->next->previous = hash->previous;
-				next = hash->next;	// Fix for access violation
-
-				delete hash;
-			} else {
-				next = hash->next;
-				last = hash;
-			}
-		}
+	int objSlot = FindObjectSlot(pObject0);
+	if (objSlot == -1)
+		return;
+
+	// FreePair removes the object once its last pair is gone
+	while (objSlot != -1) {
+		int pair = m_objectSlots[objSlot].firstPair;
+		const objectpair_t &p = m_pairs[pair];
+
+		RemovePairSlot(FindPairSlot(p.pObject[0], p.pObject[1]));
+		FreePair(pair);
+
+		objSlot = FindObjectSlot(pObject0);
 	}
 }
 
 bool CPhysicsObjectPairHash::IsObjectPairInHash(void *pObject0, void *pObject1) {
-	int entry = GetEntry(pObject0, pObject1);
-	for (pair_hash_list *hash = m_pHashList[entry]; hash; hash = hash->next) {
-		if ((hash->object0 == pObject0 || hash->object0 == pObject1) && (hash->object1 == pObject0 || hash->object1 == pObject1))
-			return true;
-	}
+	if (pObject0 > pObject1)
+		V_swap(pObject0, pObject1);
 
-	return false;
+	return FindPairSlot(pObject0, pObject1) != -1;
 }
 
 bool CPhysicsObjectPairHash::IsObjectInHash(void *pObject0) {
-	for (int i = 0; i < 256; i++) {
-		for (pair_hash_list *hash = m_pHashList[i]; hash; hash = hash->next) {
-			if (hash->object0 == pObject0 || hash->object1 == pObject0)
-				return true;
+	return FindObjectSlot(pObject0) != -1;
+}
+
+int CPhysicsObjectPairHash::GetPairCountForObject(void *pObject0) {
+	int slot = FindObjectSlot(pObject0);
+	return slot != -1 ? m_objectSlots[slot].numPairs : 0;
+}
+
+int CPhysicsObjectPairHash::GetPairListForObject(void *pObject0, int nMaxCount, void **ppObjectList) {
+	int slot = FindObjectSlot(pObject0);
+	if (slot == -1)
+		return 0;
+
+	int c = 0;
+	for (int pair = m_objectSlots[slot].firstPair; pair != -1 && c < nMaxCount;) {
+		const objectpair_t &p = m_pairs[pair];
+		int side = p.pObject[0] == pObject0 ? 0 : 1;
+
+		// Get the opposite object in the pair
+		ppObjectList[c++] = p.pObject[side ^ 1];
+		pair = p.next[side];
+	}
+
+	return c;
+}
+
+int CPhysicsObjectPairHash::FindPairSlot(void *pObject0, void *pObject1) const {
+	int mask = m_pairSlots.Count() - 1;
+	for (int slot = HashPair(pObject0, pObject1) & mask; m_pairSlots[slot] != -1; slot = (slot + 1) & mask) {
+		const objectpair_t &p = m_pairs[m_pairSlots[slot]];
+		if (p.pObject[0] == pObject0 && p.pObject[1] == pObject1)
+			return slot;
+	}
+
+	return -1;
+}
+
+int CPhysicsObjectPairHash::FindObjectSlot(void *pObject) const {
+	int mask = m_objectSlots.Count() - 1;
+	for (int slot = HashPointer(pObject) & mask; m_objectSlots[slot].pObject; slot = (slot + 1) & mask) {
+		if (m_objectSlots[slot].pObject == pObject)
+			return slot;
+	}
+
+	return -1;
+}
+
+void CPhysicsObjectPairHash::InsertPairSlot(int pair) {
+	if ((m_numPairs + 1) * 2 > m_pairSlots.Count()) {
+		CUtlVector<int> oldSlots;
+		oldSlots.Swap(m_pairSlots);
+		InitSlots(m_pairSlots, oldSlots.Count() * 2);
+
+		m_numPairs = 0;
+		for (int i = 0; i < oldSlots.Count(); i++) {
+			if (oldSlots[i] != -1)
+				InsertPairSlot(oldSlots[i]);
 		}
 	}
 
-	return false;
+	const objectpair_t &p = m_pairs[pair];
+	int mask = m_pairSlots.Count() - 1;
+	int slot = HashPair(p.pObject[0], p.pObject[1]) & mask;
+	while (m_pairSlots[slot] != -1)
+		slot = (slot + 1) & mask;
+
+	m_pairSlots[slot] = pair;
+	m_numPairs++;
 }
 
-int CPhysicsObjectPairHash::GetPairCountForObject(void *pObject0) {
-	int c = 0;
-	for (int i = 0; i < 256; i++) {
-		for (pair_hash_list *hash = m_pHashList[i]; hash; hash = hash->next) {
-			if (hash->object0 == pObject0 || hash->object1 == pObject0)
-				c++;
+// Backward shift deletion, so we don't need tombstones
+void CPhysicsObjectPairHash::RemovePairSlot(int slot) {
+	int mask = m_pairSlots.Count() - 1;
+	m_pairSlots[slot] = -1;
+	m_numPairs--;
+
+	for (int next = (slot + 1) & mask; m_pairSlots[next] != -1; next = (next + 1) & mask) {
+		const objectpair_t &p = m_pairs[m_pairSlots[next]];
+		int home = HashPair(p.pObject[0], p.pObject[1]) & mask;
+
+		// Move it into the hole if the hole is between its home slot and where it is now
+		if (((next - home) & mask) >= ((next - slot) & mask)) {
+			m_pairSlots[slot] = m_pairSlots[next];
+			m_pairSlots[next] = -1;
+			slot = next;
 		}
 	}
+}
 
-	return c;
+int CPhysicsObjectPairHash::InsertObjectSlot(void *pObject) {
+	if ((m_numObjects + 1) * 2 > m_objectSlots.Count()) {
+		CUtlVector<pairobject_t> oldSlots;
+		oldSlots.Swap(m_objectSlots);
+		InitSlots(m_objectSlots, oldSlots.Count() * 2);
+
+		int mask = m_objectSlots.Count() - 1;
+		for (int i = 0; i < oldSlots.Count(); i++) {
+			if (!oldSlots[i].pObject)
+				continue;
+
+			int slot = HashPointer(oldSlots[i].pObject) & mask;
+			while (m_objectSlots[slot].pObject)
+				slot = (slot + 1) & mask;
+
+			m_objectSlots[slot] = oldSlots[i];
+		}
+	}
+
+	int mask = m_objectSlots.Count() - 1;
+	int slot = HashPointer(pObject) & mask;
+	while (m_objectSlots[slot].pObject)
+		slot = (slot + 1) & mask;
+
+	pairobject_t &obj = m_objectSlots[slot];
+	obj.pObject = pObject;
+	obj.firstPair = -1;
+	obj.numPairs = 0;
+	m_numObjects++;
+
+	return slot;
 }
 
-int CPhysicsObjectPairHash::GetPairListForObject(void *pObject0, int nMaxCount, void **ppObjectList) {
-	int c = 0;
-	for (int i = 0; i < 256; i++) {
-		if (c >= nMaxCount)
-			break;
+void CPhysicsObjectPairHash::RemoveObjectSlot(int slot) {
+	int mask = m_objectSlots.Count() - 1;
+	m_objectSlots[slot].pObject = NULL;
+	m_numObjects--;
 
-		for (pair_hash_list *hash = m_pHashList[i]; hash; hash = hash->next) {
-			if (c >= nMaxCount)
-				break;
+	for (int next = (slot + 1) & mask; m_objectSlots[next].pObject; next = (next + 1) & mask) {
+		int home = HashPointer(m_objectSlots[next].pObject) & mask;
 
-			// Get the opposite object in the pair
-			ppObjectList[c++] = hash->object0 == pObject0 ? hash->object1 : hash->object0;
+		if (((next - home) & mask) >= ((next - slot) & mask)) {
+			m_objectSlots[slot] = m_objectSlots[next];
+			m_objectSlots[next].pObject = NULL;
+			slot = next;
 		}
 	}
+}
 
-	return c;
+// Adds the pair to the front of the list of pObject[side]
+void CPhysicsObjectPairHash::LinkPair(int pair, int side) {
+	objectpair_t &p = m_pairs[pair];
+
+	int slot = FindObjectSlot(p.pObject[side]);
+	if (slot == -1)
+		slot = InsertObjectSlot(p.pObject[side]);
+
+	pairobject_t &obj = m_objectSlots[slot];
+	p.prev[side] = -1;
+	p.next[side] = obj.firstPair;
+
+	if (obj.firstPair != -1) {
+		objectpair_t &first = m_pairs[obj.firstPair];
+		first.prev[first.pObject[0] == p.pObject[side] ? 0 : 1] = pair;
+	}
+
+	obj.firstPair = pair;
+	obj.numPairs++;
+}
+
+void CPhysicsObjectPairHash::UnlinkPair(int pair, int side) {
+	objectpair_t &p = m_pairs[pair];
+	void *pObject = p.pObject[side];
+
+	if (p.prev[side] != -1) {
+		objectpair_t &prev = m_pairs[p.prev[side]];
+		prev.next[prev.pObject[0] == pObject ? 0 : 1] = p.next[side];
+	}
+
+	if (p.next[side] != -1) {
+		objectpair_t &next = m_pairs[p.next[side]];
+		next.prev[next.pObject[0] == pObject ? 0 : 1] = p.prev[side];
+	}
+
+	int slot = FindObjectSlot(pObject);
+	Assert(slot != -1);
+	if (slot == -1)
+		return;
+
+	pairobject_t &obj = m_objectSlots[slot];
+	if (obj.firstPair == pair)
+		obj.firstPair = p.next[side];
+
+	if (--obj.numPairs == 0)
+		RemoveObjectSlot(slot);
 }
 
-// Purpose: Generate a number in [0,255] given 2 pointers. Must be the same for the same 2 pointers.
-int CPhysicsObjectPairHash::GetEntry(void *pObject0, void *pObject1) {
-	return (((int)pObject0 ^ (int)pObject1) >> 4) & 0xFF;
-}
\ No newline at end of file
+// Unlinks a pair that was already taken out of the pair table and puts it on the free list
+void CPhysicsObjectPairHash::FreePair(int pair) {
+	objectpair_t &p = m_pairs[pair];
+
+	UnlinkPair(pair, 0);
+	if (p.pObject[0] != p.pObject[1])
+		UnlinkPair(pair, 1);
+
+	p.pObject[0] = p.pObject[1] = NULL;
+	p.next[0] = m_firstFreePair;
+	m_firstFreePair = pair;
+}
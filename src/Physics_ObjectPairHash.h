@@ -6,11 +6,19 @@
 
 #include <vphysics/object_hash.h>
 
-struct pair_hash_list {
-	void *object0;
-	void *object1;
+// A pair, also a node in the adjacency lists of both of its objects.
+// Free pairs are chained through next[0].
+struct objectpair_t {
+	void *	pObject[2];	// Sorted, pObject[0] <= pObject[1]
+	int		next[2];	// Next/previous pair in the list of pObject[i] (-1 = none)
+	int		prev[2];
+};
 
-	pair_hash_list *next;
+// Head of an object's adjacency list
+struct pairobject_t {
+	void *	pObject;	// NULL = empty slot
+	int		firstPair;
+	int		numPairs;
 };
 
 class CPhysicsObjectPairHash : public IPhysicsObjectPairHash {
@@ -26,10 +34,28 @@ class CPhysicsObjectPairHash : public IPhysicsObjectPairHash {
 		int		GetPairCountForObject(void *pObject0);
 		int		GetPairListForObject(void *pObject0, int nMaxCount, void **ppObjectList);
 
-		int		GetEntry(void *pObject0, void *pObject1);
-
 	private:
-		pair_hash_list *m_pHashList[256];
+		int		FindPairSlot(void *pObject0, void *pObject1) const;
+		int		FindObjectSlot(void *pObject) const;
+
+		void	InsertPairSlot(int pair);
+		void	RemovePairSlot(int slot);
+		int		InsertObjectSlot(void *pObject);
+		void	RemoveObjectSlot(int slot);
+
+		void	LinkPair(int pair, int side);
+		void	UnlinkPair(int pair, int side);
+		void	FreePair(int pair);
+
+		// Open addressing (linear probing) tables, sizes are powers of 2
+		CUtlVector<int>				m_pairSlots;	// Indices into m_pairs (-1 = empty)
+		CUtlVector<pairobject_t>	m_objectSlots;
+		int							m_numPairs;
+		int							m_numObjects;
+
+		// Pair storage, reused through the free list so adding pairs doesn't allocate
+		CUtlVector<objectpair_t>	m_pairs;
+		int							m_firstFreePair;
 };
 
 #endif // PHYSICS_OBJECTPAIRHASH_H
@@ -56,6 +56,7 @@ CPlayerController::~CPlayerController() {
 // FIXME: Jumping does not work because as soon as the player leaves the object, the target position delta is exactly
 // zero and his velocity gets completely emptied!
 void CPlayerController::Update(const Vector &position, const Vector &velocity, float secondsToArrival, bool onground, IPhysicsObject *pGround) {
+	m_pEnv->WaitForSimulation();
 	btVector3 bullTargetPosition, bullMaxVelocity;
 
 	ConvertPosToBull(position, bullTargetPosition);
@@ -107,15 +108,15 @@ void CPlayerController::Update(const Vector &position, const Vector &velocity, f
 }
 
 void CPlayerController::SetEventHandler(IPhysicsPlayerControllerEvent *handler) {
+	m_pEnv->WaitForSimulation();
 	m_handler = handler;
 }
 
 bool CPlayerController::IsInContact() {
-	btDispatcher *pDispatcher = m_pEnv->GetBulletEnvironment()->getDispatcher();
+	m_pEnv->WaitForSimulation();
+	btRigidBody *pBody = m_pObject->GetObject();
 
-	int numManifolds = pDispatcher->getNumManifolds();
-	for (int i = 0; i < numManifolds; i++) {
-		btPersistentManifold *contactManifold = pDispatcher->getManifoldByIndexInternal(i);
+	for (btPersistentManifold *contactManifold = pBody->getFirstManifold(); contactManifold; contactManifold = contactManifold->getNextManifoldOnBody(pBody)) {
 		const btCollisionObject *obA = contactManifold->getBody0();
 		const btCollisionObject *obB = contactManifold->getBody1();
 		CPhysicsObject *pPhysUs = NULL;
@@ -143,6 +144,7 @@ bool CPlayerController::IsInContact() {
 
 // Purpose: Calculate the maximum speed we can accelerate.
 void CPlayerController::MaxSpeed(const Vector &hlMaxVelocity) {
+	m_pEnv->WaitForSimulation();
 	btVector3 maxVel;
 	ConvertPosToBull(hlMaxVelocity, maxVel);
 	btVector3 available = maxVel;
@@ -162,6 +164,7 @@ void CPlayerController::MaxSpeed(const Vector &hlMaxVelocity) {
 
 // Called when the game wants to swap hulls (such as from standing to crouching)
 void CPlayerController::SetObject(IPhysicsObject *pObject) {
+	m_pEnv->WaitForSimulation();
 	if (pObject == m_pObject)
 		return;
 
@@ -180,6 +183,7 @@ void CPlayerController::SetObject(IPhysicsObject *pObject) {
 // The one implementation in the 2013 SDK that calls this discards the position we return!
 // Also the angles parameter is unused because our controller cannot rotate
 int CPlayerController::GetShadowPosition(Vector *position, QAngle *angles) {
+	m_pEnv->WaitForSimulation();
 	btRigidBody *pObject = m_pObject->GetObject();
 
 	btTransform transform;
@@ -194,6 +198,7 @@ int CPlayerController::GetShadowPosition(Vector *position, QAngle *angles) {
 }
 
 void CPlayerController::GetShadowVelocity(Vector *velocity) {
+	m_pEnv->WaitForSimulation();
 	if (!velocity) return;
 
 	btRigidBody *body = m_pObject->GetObject();
@@ -208,6 +213,7 @@ void CPlayerController::GetShadowVelocity(Vector *velocity) {
 }
 
 void CPlayerController::StepUp(float height) {
+	m_pEnv->WaitForSimulation();
 	btVector3 step;
 	ConvertPosToBull(Vector(0, 0, height), step);
 
@@ -219,6 +225,7 @@ void CPlayerController::StepUp(float height) {
 }
 
 void CPlayerController::Jump() {
+	m_pEnv->WaitForSimulation();
 	// This function does absolutely nothing!
 	return;
 }
@@ -228,6 +235,7 @@ IPhysicsObject *CPlayerController::GetObject() {
 }
 
 void CPlayerController::GetLastImpulse(Vector *pOut) {
+	m_pEnv->WaitForSimulation();
 	if (!pOut) return;
 
 	ConvertForceImpulseToHL(m_lastImpulse, *pOut);
@@ -236,12 +244,10 @@ void CPlayerController::GetLastImpulse(Vector *pOut) {
 // Purpose: Loop through all of our contact points and see if we're standing on ground anywhere
 // Returns NULL if we're not standing on ground or if we're standing on a static/frozen object (or game physics object)
 CPhysicsObject *CPlayerController::GetGroundObject() {
-	btDispatcher *pDispatcher = m_pEnv->GetBulletEnvironment()->getDispatcher();
+	btRigidBody *pBody = m_pObject->GetObject();
 
-	// Loop through the collision pair manifolds
-	int numManifolds = pDispatcher->getNumManifolds();
-	for (int i = 0; i < numManifolds; i++) {
-		btPersistentManifold *pManifold = pDispatcher->getManifoldByIndexInternal(i);
+	// Loop through the collision pair manifolds that involve us
+	for (btPersistentManifold *pManifold = pBody->getFirstManifold(); pManifold; pManifold = pManifold->getNextManifoldOnBody(pBody)) {
 		if (pManifold->getNumContacts() <= 0)
 			continue;
 
@@ -308,6 +314,16 @@ void CPlayerController::Tick(float deltaTime) {
 	m_ticksSinceUpdate++;
 }
 
+// We also read the velocity of whatever we're standing on
+void CPlayerController::GetTickObjects(CUtlVector<CPhysicsObject *> &objects) {
+	if (!m_pObject) return;
+	objects.AddToTail(m_pObject);
+
+	CPhysicsObject *pGround = GetGroundObject();
+	if (pGround)
+		objects.AddToTail(pGround);
+}
+
 void CPlayerController::CalculateVelocity(float dt) {
 	btRigidBody *body = m_pObject->GetObject();
 
@@ -414,11 +430,66 @@ void CPlayerController::DetachObject() {
 	m_pObject = NULL;
 }
 
+// UNEXPOSED
+void CPlayerController::GetSaveData(playersave_t &data) const {
+	memset(&data, 0, sizeof(data));
+
+	data.pObject			= (IPhysicsObject *)m_pObject;
+	data.pGround			= (IPhysicsObject *)m_pGround;
+	data.groundPos			= m_groundPos;
+	data.saveRot			= m_saveRot;
+	data.maxSpeed			= m_maxSpeed;
+	data.currentSpeed		= m_currentSpeed;
+	data.lastImpulse		= m_lastImpulse;
+	data.inputVelocity		= m_inputVelocity;
+	data.targetPosition		= m_targetPosition;
+	data.maxVelocity		= m_maxVelocity;
+	data.maxDeltaPosition	= m_maxDeltaPosition;
+	data.dampFactor			= m_dampFactor;
+	data.secondsToArrival	= m_secondsToArrival;
+	data.pushMassLimit		= m_pushMassLimit;
+	data.pushSpeedLimit		= m_pushSpeedLimit;
+	data.ticksSinceUpdate	= m_ticksSinceUpdate;
+	data.enable				= m_enable;
+	data.onground			= m_onground;
+}
+
+// UNEXPOSED
+// pGround is the restored ground object (NULL if it wasn't restored)
+void CPlayerController::ApplySaveData(const playersave_t &data, CPhysicsObject *pGround) {
+	m_groundPos			= data.groundPos;
+	m_saveRot			= data.saveRot;
+	m_maxSpeed			= data.maxSpeed;
+	m_currentSpeed		= data.currentSpeed;
+	m_lastImpulse		= data.lastImpulse;
+	m_inputVelocity		= data.inputVelocity;
+	m_targetPosition	= data.targetPosition;
+	m_maxVelocity		= data.maxVelocity;
+	m_maxDeltaPosition	= data.maxDeltaPosition;
+	m_dampFactor		= data.dampFactor;
+	m_secondsToArrival	= data.secondsToArrival;
+	m_pushMassLimit		= data.pushMassLimit;
+	m_pushSpeedLimit	= data.pushSpeedLimit;
+	m_ticksSinceUpdate	= data.ticksSinceUpdate;
+	m_enable			= data.enable;
+	m_onground			= data.onground;
+
+	if (m_pGround)
+		m_pGround->DetachEventListener(this);
+
+	m_pGround = pGround;
+
+	if (m_pGround)
+		m_pGround->AttachEventListener(this);
+}
+
 void CPlayerController::SetPushMassLimit(float maxPushMass) {
+	m_pEnv->WaitForSimulation();
 	m_pushMassLimit = maxPushMass;
 }
 
 void CPlayerController::SetPushSpeedLimit(float maxPushSpeed) {
+	m_pEnv->WaitForSimulation();
 	m_pushSpeedLimit = maxPushSpeed;
 }
 
@@ -431,6 +502,7 @@ float CPlayerController::GetPushSpeedLimit() {
 }
 
 bool CPlayerController::WasFrozen() {
+	m_pEnv->WaitForSimulation();
 	// Appears that if we were frozen, the game will try and update our position to the player's current position.
 	// Probably used for when the controller object is frozen due to performance limits (max collisions per timestep, etc)
 	// TODO: Implement this if we ever implement performance limitations
@@ -15,6 +15,28 @@ class IPhysicsObject;
 
 class CPlayerControllerEventListener;
 
+// Player controller state in save games
+struct playersave_t {
+	void *							pObject;	// Pointers from when the game was saved
+	void *							pGround;
+	btVector3						groundPos;
+	btVector3						saveRot;
+	btVector3						maxSpeed;
+	btVector3						currentSpeed;
+	btVector3						lastImpulse;
+	btVector3						inputVelocity;
+	btVector3						targetPosition;
+	btVector3						maxVelocity;
+	float							maxDeltaPosition;
+	float							dampFactor;
+	float							secondsToArrival;
+	float							pushMassLimit;
+	float							pushSpeedLimit;
+	int								ticksSinceUpdate;
+	bool							enable;
+	bool							onground;
+};
+
 class CPlayerController : public IController, public IPhysicsPlayerController, public IObjectEventListener
 {
 	public:
@@ -46,8 +68,13 @@ class CPlayerController : public IController, public IPhysicsPlayerController, p
 		CPhysicsObject *				GetGroundObject();
 
 		void							Tick(float deltaTime);
+		void							GetTickObjects(CUtlVector<CPhysicsObject *> &objects);
+		bool							IsTickThreadSafe() const { return m_handler == NULL; } // Teleports ask the game first
 		void							ObjectDestroyed(CPhysicsObject *pObject);
 
+		void							GetSaveData(playersave_t &data) const;
+		void							ApplySaveData(const playersave_t &data, CPhysicsObject *pGround);
+
 	private:
 		void							AttachObject();
 		void							DetachObject();
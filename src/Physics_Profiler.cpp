@@ -0,0 +1,207 @@
+#include "StdAfx.h"
+
+#include "Physics_Profiler.h"
+
+// memdbgon must be the last include file in a .cpp file!!!
+#include "tier0/memdbgon.h"
+
+/****************************
+* CLASS CPhysicsProfiler
+****************************/
+
+// Bullet's hooks are global, so they find the profiler through a thread local pointer.
+// Zones entered on other threads (the thread pool) are ignored, their time shows up in the stage that waited on them.
+static CThreadLocalPtr<CPhysicsProfiler> s_pActiveProfiler;
+
+struct profilezone_t {
+	const char *	pName;
+	int				stage;
+};
+
+// Zones that aren't in here count towards whatever stage they're nested in
+static const profilezone_t s_profileZones[] = {
+	{"updateAabbs",							PHYSPROFILE_BROADPHASE},
+	{"calculateOverlappingPairs",			PHYSPROFILE_BROADPHASE},
+	{"performDiscreteCollisionDetection",	PHYSPROFILE_NARROWPHASE},
+	{"dispatchAllCollisionPairs",			PHYSPROFILE_NARROWPHASE},
+	{"createPredictiveContacts",			PHYSPROFILE_NARROWPHASE},
+	{"calculateSimulationIslands",			PHYSPROFILE_ISLANDS},
+	{"islandUnionFindAndQuickSort",			PHYSPROFILE_ISLANDS},
+	{"updateActivationState",				PHYSPROFILE_ISLANDS},
+	{"solveConstraints",					PHYSPROFILE_SOLVER},
+	{"solveSoftConstraints",				PHYSPROFILE_SOLVER},
+	{"predictUnconstraintMotion",			PHYSPROFILE_INTEGRATE},
+	{"predictUnconstraintMotionSoftBody",	PHYSPROFILE_INTEGRATE},
+	{"integrateTransforms",					PHYSPROFILE_INTEGRATE},
+	{"synchronizeMotionStates",				PHYSPROFILE_INTEGRATE},
+	{"updateActions",						PHYSPROFILE_CONTROLLERS},
+};
+
+static const char *s_stageNames[PHYSPROFILE_COUNT] = {
+	"total",
+	"broadphase",
+	"narrowphase",
+	"islands",
+	"solver",
+	"integrate",
+	"controllers",
+	"callbacks",
+	"other",
+};
+
+CPhysicsProfiler::CPhysicsProfiler() {
+	Clear();
+
+	m_stepStart = 0;
+	m_stageStart = 0;
+	m_depth = 0;
+	m_overflow = 0;
+	memset(m_stepTimes, 0, sizeof(m_stepTimes));
+}
+
+const char *CPhysicsProfiler::GetStageName(int stage) {
+	if (stage < 0 || stage >= PHYSPROFILE_COUNT)
+		return "unknown";
+
+	return s_stageNames[stage];
+}
+
+void CPhysicsProfiler::BeginStep() {
+	static bool s_bInstalledHooks = false;
+	if (!s_bInstalledHooks) {
+		btSetCustomProfileZoneFuncs(EnterZone, LeaveZone);
+		s_bInstalledHooks = true;
+	}
+
+	s_pActiveProfiler = this;
+
+	m_stepStart = m_stageStart = Plat_FloatTime();
+	memset(m_stepTimes, 0, sizeof(m_stepTimes));
+	m_depth = 0;
+	m_overflow = 0;
+}
+
+void CPhysicsProfiler::EndStep() {
+	FlushStageTime();
+	m_stepTimes[PHYSPROFILE_TOTAL] = m_stageStart - m_stepStart;
+
+	s_pActiveProfiler = NULL;
+
+	for (int i = 0; i < PHYSPROFILE_COUNT; i++) {
+		m_history[i][m_nextSample] = (float)(m_stepTimes[i] * 1000.0);
+	}
+
+	m_nextSample = (m_nextSample + 1) % PROFILE_HISTORY;
+	m_numSamples = MIN(m_numSamples + 1, PROFILE_HISTORY);
+}
+
+// Adds the time since the last switch to the stage we're leaving
+void CPhysicsProfiler::FlushStageTime() {
+	double now = Plat_FloatTime();
+	int current = m_depth > 0 ? m_stageStack[m_depth - 1] : PHYSPROFILE_OTHER;
+
+	m_stepTimes[current] += now - m_stageStart;
+	m_stageStart = now;
+}
+
+void CPhysicsProfiler::EnterStage(int stage) {
+	if (m_depth >= PROFILE_MAX_DEPTH) {
+		m_overflow++;
+		return;
+	}
+
+	int current = m_depth > 0 ? m_stageStack[m_depth - 1] : PHYSPROFILE_OTHER;
+	if (stage != current)
+		FlushStageTime();
+
+	m_stageStack[m_depth++] = stage;
+}
+
+void CPhysicsProfiler::LeaveStage() {
+	if (m_overflow > 0) {
+		m_overflow--;
+		return;
+	}
+
+	if (m_depth <= 0)
+		return;
+
+	int stage = m_stageStack[m_depth - 1];
+	int parent = m_depth > 1 ? m_stageStack[m_depth - 2] : PHYSPROFILE_OTHER;
+	if (stage != parent)
+		FlushStageTime();
+
+	m_depth--;
+}
+
+int CPhysicsProfiler::GetProfile(physprofile_t *pOutput, int maxStages) const {
+	if (!pOutput) return 0;
+
+	int count = MIN(maxStages, PHYSPROFILE_COUNT);
+	int last = (m_nextSample + PROFILE_HISTORY - 1) % PROFILE_HISTORY;
+
+	for (int i = 0; i < count; i++) {
+		physprofile_t &out = pOutput[i];
+		out.pName = s_stageNames[i];
+		out.lastMs = out.minMs = out.avgMs = out.maxMs = 0;
+
+		if (m_numSamples == 0)
+			continue;
+
+		out.lastMs = m_history[i][last];
+		out.minMs = out.maxMs = out.lastMs;
+
+		float total = 0;
+		for (int j = 0; j < m_numSamples; j++) {
+			float sample = m_history[i][j];
+			out.minMs = MIN(out.minMs, sample);
+			out.maxMs = MAX(out.maxMs, sample);
+			total += sample;
+		}
+
+		out.avgMs = total / m_numSamples;
+	}
+
+	return count;
+}
+
+void CPhysicsProfiler::Clear() {
+	memset(m_history, 0, sizeof(m_history));
+	m_numSamples = 0;
+	m_nextSample = 0;
+}
+
+void CPhysicsProfiler::EnterZone(const char *pName) {
+	CPhysicsProfiler *pProfiler = s_pActiveProfiler;
+	if (!pProfiler) return;
+
+	int stage = pProfiler->FindZoneStage(pName);
+	if (stage == -1)
+		stage = pProfiler->m_depth > 0 ? pProfiler->m_stageStack[pProfiler->m_depth - 1] : PHYSPROFILE_OTHER;
+
+	pProfiler->EnterStage(stage);
+}
+
+// A profiler is only used by one thread at a time, so its cache doesn't need a lock
+int CPhysicsProfiler::FindZoneStage(const char *pName) {
+	UtlHashHandle_t h = m_zoneStages.Find((uintp)pName);
+	if (h != m_zoneStages.InvalidHandle())
+		return m_zoneStages.Element(h);
+
+	int stage = -1;
+	for (int i = 0; i < ARRAYSIZE(s_profileZones); i++) {
+		if (!strcmp(pName, s_profileZones[i].pName)) {
+			stage = s_profileZones[i].stage;
+			break;
+		}
+	}
+
+	m_zoneStages.Insert((uintp)pName, stage);
+	return stage;
+}
+
+void CPhysicsProfiler::LeaveZone() {
+	CPhysicsProfiler *pProfiler = s_pActiveProfiler;
+	if (pProfiler)
+		pProfiler->LeaveStage();
+}
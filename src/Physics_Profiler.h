@@ -0,0 +1,67 @@
+#ifndef PHYSICS_PROFILER_H
+#define PHYSICS_PROFILER_H
+#if defined(_MSC_VER) || (defined(__GNUC__) && __GNUC__ > 3)
+	#pragma once
+#endif
+
+#include <utlhashtable.h>
+
+#define PROFILE_HISTORY		256	// Simulate calls the min/avg/max are taken over
+#define PROFILE_MAX_DEPTH	32
+
+// Times the stages of a simulation step. Bullet's BT_PROFILE zones are mapped onto our stages,
+// and time is only counted towards the innermost stage.
+class CPhysicsProfiler {
+	public:
+							CPhysicsProfiler();
+
+		// Bullet's zones are only picked up on the thread between these two (the one running Simulate)
+		void				BeginStep();
+		void				EndStep();
+
+		void				EnterStage(int stage);
+		void				LeaveStage();
+
+		int					GetProfile(physprofile_t *pOutput, int maxStages) const;
+		void				Clear();
+
+		static const char *	GetStageName(int stage);
+
+	private:
+		static void			EnterZone(const char *pName);
+		static void			LeaveZone();
+		int					FindZoneStage(const char *pName);
+
+		void				FlushStageTime();
+
+		double				m_stepStart;
+		double				m_stageStart;
+		double				m_stepTimes[PHYSPROFILE_COUNT];
+
+		int					m_stageStack[PROFILE_MAX_DEPTH];
+		int					m_depth;
+		int					m_overflow; // Zones entered past PROFILE_MAX_DEPTH
+
+		// Zone names are string literals, so every zone is looked up by name only once (-1 = not a stage)
+		CUtlHashtable<uintp, int>	m_zoneStages;
+
+		float				m_history[PHYSPROFILE_COUNT][PROFILE_HISTORY];
+		int					m_numSamples;
+		int					m_nextSample;
+};
+
+class CPhysicsProfileScope {
+	public:
+		CPhysicsProfileScope(CPhysicsProfiler *pProfiler, int stage) : m_pProfiler(pProfiler) {
+			m_pProfiler->EnterStage(stage);
+		}
+
+		~CPhysicsProfileScope() {
+			m_pProfiler->LeaveStage();
+		}
+
+	private:
+		CPhysicsProfiler *	m_pProfiler;
+};
+
+#endif // PHYSICS_PROFILER_H
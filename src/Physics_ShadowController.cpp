@@ -157,12 +157,18 @@ void CShadowController::Tick(float deltaTime) {
 	m_ticksSinceUpdate++;
 }
 
+void CShadowController::GetTickObjects(CUtlVector<CPhysicsObject *> &objects) {
+	if (m_pObject)
+		objects.AddToTail(m_pObject);
+}
+
 void CShadowController::ObjectDestroyed(CPhysicsObject *pObject) {
 	if (pObject == m_pObject)
 		DetachObject();
 }
 
 void CShadowController::Update(const Vector &position, const QAngle &angles, float timeOffset) {
+	WaitForSimulation();
 	btVector3 targetPosition = m_shadow.targetPosition;
 	btQuaternion targetRotation = m_shadow.targetRotation;
 
@@ -180,6 +186,7 @@ void CShadowController::Update(const Vector &position, const QAngle &angles, flo
 }
 
 void CShadowController::MaxSpeed(float maxSpeed, float maxAngularSpeed) {
+	WaitForSimulation();
 	btRigidBody *body = m_pObject->GetObject();
 
 	//----------------
@@ -226,6 +233,7 @@ void CShadowController::MaxSpeed(float maxSpeed, float maxAngularSpeed) {
 }
 
 void CShadowController::StepUp(float height) {
+	WaitForSimulation();
 	btVector3 step;
 	ConvertPosToBull(Vector(0, 0, height), step);
 
@@ -237,6 +245,7 @@ void CShadowController::StepUp(float height) {
 }
 
 void CShadowController::SetTeleportDistance(float teleportDistance) {
+	WaitForSimulation();
 	m_shadow.teleportDistance = ConvertDistanceToBull(teleportDistance);
 }
 
@@ -256,14 +265,17 @@ bool CShadowController::IsPhysicallyControlled() {
 }
 
 void CShadowController::SetAllowsTranslation(bool enable) {
+	WaitForSimulation();
 	enable ? m_flags |= FLAG_ALLOWPHYSICSMOVEMENT : m_flags &= ~(FLAG_ALLOWPHYSICSMOVEMENT);
 }
 
 void CShadowController::SetAllowsRotation(bool enable) {
+	WaitForSimulation();
 	enable ? m_flags |= FLAG_ALLOWPHYSICSROTATION : m_flags &= ~(FLAG_ALLOWPHYSICSROTATION);
 }
 
 void CShadowController::SetPhysicallyControlled(bool enable) {
+	WaitForSimulation();
 	if (IsPhysicallyControlled() == enable)
 		return;
 
@@ -278,6 +290,9 @@ void CShadowController::SetPhysicallyControlled(bool enable) {
 		btRigidBody *body = m_pObject->GetObject();
 		body->setCollisionFlags(body->getCollisionFlags() & ~(btCollisionObject::CF_KINEMATIC_OBJECT));
 	}
+
+	// Kinematic objects don't collide with static ones
+	m_pObject->InvalidateCollisionFilter();
 }
 
 // NPCs call this
@@ -289,6 +304,7 @@ void CShadowController::GetLastImpulse(Vector *pOut) {
 }
 
 void CShadowController::UseShadowMaterial(bool enable) {
+	WaitForSimulation();
 	enable ? m_flags |= FLAG_USESHADOWMATERIAL : m_flags &= ~(FLAG_USESHADOWMATERIAL);
 }
 
@@ -360,9 +376,50 @@ void CShadowController::DetachObject() {
 }
 
 int CShadowController::GetTicksSinceUpdate() {
+	WaitForSimulation();
 	return m_ticksSinceUpdate;
 }
 
+// UNEXPOSED
+void CShadowController::GetSaveData(shadowsave_t &data) const {
+	memset(&data, 0, sizeof(data));
+
+	data.shadow					= m_shadow;
+	data.currentSpeed			= m_currentSpeed;
+	data.secondsToArrival		= m_secondsToArrival;
+	data.timeOffset				= m_timeOffset;
+	data.savedMass				= m_savedMass;
+	data.savedMaterialIndex		= m_savedMaterialIndex;
+	data.ticksSinceUpdate		= m_ticksSinceUpdate;
+	data.enable					= m_enable;
+	data.allowTranslation		= (m_flags & FLAG_ALLOWPHYSICSMOVEMENT) != 0;
+	data.allowRotation			= (m_flags & FLAG_ALLOWPHYSICSROTATION) != 0;
+	data.physicallyControlled	= (m_flags & FLAG_PHYSICALLYCONTROLLED) != 0;
+	data.useShadowMaterial		= (m_flags & FLAG_USESHADOWMATERIAL) != 0;
+}
+
+// UNEXPOSED
+// We should've been created with the same allowTranslation/allowRotation, the object's own state is restored after us.
+void CShadowController::ApplySaveData(const shadowsave_t &data) {
+	m_shadow				= data.shadow;
+	m_currentSpeed			= data.currentSpeed;
+	m_secondsToArrival		= data.secondsToArrival;
+	m_timeOffset			= data.timeOffset;
+	m_savedMass				= data.savedMass;
+	m_savedMaterialIndex	= data.savedMaterialIndex;
+	m_ticksSinceUpdate		= data.ticksSinceUpdate;
+	m_enable				= data.enable;
+
+	UseShadowMaterial(data.useShadowMaterial);
+	SetPhysicallyControlled(data.physicallyControlled);
+}
+
+// Waits for our environment's asynchronous step (we don't have an environment after our object is destroyed)
+void CShadowController::WaitForSimulation() {
+	if (m_pObject)
+		m_pObject->GetVPhysicsEnvironment()->WaitForSimulation();
+}
+
 /*************************
 * CREATION FUNCTIONS
 *************************/
@@ -22,6 +22,22 @@ struct shadowcontrol_params_t {
 	float			teleportDistance;
 };
 
+// Shadow controller state in save games, follows the objectsave_t of the object it controls
+struct shadowsave_t {
+	shadowcontrol_params_t	shadow;
+	btVector3				currentSpeed;
+	float					secondsToArrival;
+	float					timeOffset;
+	float					savedMass;
+	int						savedMaterialIndex;
+	int						ticksSinceUpdate;
+	bool					enable;
+	bool					allowTranslation;
+	bool					allowRotation;
+	bool					physicallyControlled;
+	bool					useShadowMaterial;
+};
+
 class CShadowController : public IController, public IPhysicsShadowController, public IObjectEventListener
 {
 	public:
@@ -49,15 +65,22 @@ class CShadowController : public IController, public IPhysicsShadowController, p
 
 		// UNEXPOSED FUNCTIONS
 		void					Tick(float deltaTime);
+		void					GetTickObjects(CUtlVector<CPhysicsObject *> &objects);
+		bool					IsTickThreadSafe() const { return true; }
 		void					SetAllowsTranslation(bool enable);
 		void					SetAllowsRotation(bool enable);
 
 		void					ObjectDestroyed(CPhysicsObject *pObject);
 
 		int						GetTicksSinceUpdate();
+
+		CPhysicsObject *		GetObject() const { return m_pObject; }
+		void					GetSaveData(shadowsave_t &data) const;
+		void					ApplySaveData(const shadowsave_t &data);
 	private:
 		void					AttachObject();
 		void					DetachObject();
+		void					WaitForSimulation();
 
 		// NOTE: If you add more than 7 flags, change the m_flags variable type to a short.
 		enum EShadowFlags {
@@ -45,6 +45,7 @@ void ConvertLinkToHL(const btSoftBody::Link *link, softbodylink_t &linkOut) {
 CPhysicsSoftBody::CPhysicsSoftBody() {
 	m_pEnv = NULL;
 	m_pSoftBody = NULL;
+	m_iEnvIndex = -1;
 }
 
 CPhysicsSoftBody::~CPhysicsSoftBody() {
@@ -53,14 +54,17 @@ CPhysicsSoftBody::~CPhysicsSoftBody() {
 }
 
 bool CPhysicsSoftBody::IsAsleep() const {
+	m_pEnv->WaitForSimulation();
 	return m_pSoftBody->getActivationState() == ISLAND_SLEEPING || m_pSoftBody->getActivationState() == DISABLE_SIMULATION;
 }
 
 void CPhysicsSoftBody::SetTotalMass(float fMass, bool bFromFaces) {
+	m_pEnv->WaitForSimulation();
 	m_pSoftBody->setTotalMass(fMass, bFromFaces);
 }
 
 void CPhysicsSoftBody::Anchor(int node, IPhysicsObject *pObj) {
+	m_pEnv->WaitForSimulation();
 	m_pSoftBody->appendAnchor(node, ((CPhysicsObject *)pObj)->GetObject());
 }
 
@@ -77,6 +81,7 @@ int CPhysicsSoftBody::GetLinkCount() const {
 }
 
 softbodynode_t CPhysicsSoftBody::GetNode(int i) const {
+	m_pEnv->WaitForSimulation();
 	Assert(i >= 0 && i < m_pSoftBody->m_nodes.size());
 	btSoftBody::Node &node = m_pSoftBody->m_nodes[i];
 
@@ -86,6 +91,7 @@ softbodynode_t CPhysicsSoftBody::GetNode(int i) const {
 }
 
 softbodylink_t CPhysicsSoftBody::GetLink(int i) const {
+	m_pEnv->WaitForSimulation();
 	Assert(i >= 0 && i < m_pSoftBody->m_links.size());
 	btSoftBody::Link &link = m_pSoftBody->m_links[i];
 
@@ -101,6 +107,7 @@ softbodylink_t CPhysicsSoftBody::GetLink(int i) const {
 }
 
 softbodyface_t CPhysicsSoftBody::GetFace(int i) const {
+	m_pEnv->WaitForSimulation();
 	Assert(i >= 0 && i < m_pSoftBody->m_faces.size());
 	btSoftBody::Face &face = m_pSoftBody->m_faces[i];
 
@@ -116,6 +123,7 @@ softbodyface_t CPhysicsSoftBody::GetFace(int i) const {
 }
 
 void CPhysicsSoftBody::SetNode(int i, softbodynode_t &node) {
+	m_pEnv->WaitForSimulation();
 	Assert(i >= 0 && i < m_pSoftBody->m_nodes.size());
 
 	btSoftBody::Node &bnode = m_pSoftBody->m_nodes[i];
@@ -123,6 +131,7 @@ void CPhysicsSoftBody::SetNode(int i, softbodynode_t &node) {
 }
 
 void CPhysicsSoftBody::AddNode(const Vector &pos, float mass) {
+	m_pEnv->WaitForSimulation();
 	btVector3 btpos;
 	ConvertPosToBull(pos, btpos);
 
@@ -130,10 +139,12 @@ void CPhysicsSoftBody::AddNode(const Vector &pos, float mass) {
 }
 
 void CPhysicsSoftBody::AddLink(int node1, int node2, bool bCheckExist) {
+	m_pEnv->WaitForSimulation();
 	m_pSoftBody->appendLink(node1, node2, NULL, bCheckExist);
 }
 
 void CPhysicsSoftBody::GetAABB(Vector *mins, Vector *maxs) const {
+	m_pEnv->WaitForSimulation();
 	if (!mins && !maxs) return;
 
 	btVector3 btmins, btmaxs;
@@ -150,6 +161,7 @@ void CPhysicsSoftBody::GetAABB(Vector *mins, Vector *maxs) const {
 }
 
 void CPhysicsSoftBody::RemoveNode(int i) {
+	m_pEnv->WaitForSimulation();
 	Assert(i >= 0 && i < m_pSoftBody->m_nodes.size());
 
 	m_pSoftBody->pointersToIndices();
@@ -158,6 +170,7 @@ void CPhysicsSoftBody::RemoveNode(int i) {
 }
 
 void CPhysicsSoftBody::RemoveLink(int i) {
+	m_pEnv->WaitForSimulation();
 	Assert(i >= 0 && i < m_pSoftBody->m_links.size());
 
 	btSoftBody::Link &link = m_pSoftBody->m_links[i];
@@ -170,6 +183,7 @@ void CPhysicsSoftBody::RemoveLink(int i) {
 }
 
 void CPhysicsSoftBody::RemoveFace(int i) {
+	m_pEnv->WaitForSimulation();
 	Assert(i >= 0 && i < m_pSoftBody->m_faces.size());
 
 	btSoftBody::Face &face = m_pSoftBody->m_faces[i];
@@ -180,6 +194,7 @@ void CPhysicsSoftBody::RemoveFace(int i) {
 }
 
 void CPhysicsSoftBody::RayTest(Ray_t &ray, trace_t *pTrace) const {
+	m_pEnv->WaitForSimulation();
 	if (!pTrace) return;
 
 	btVector3 start, end;
@@ -194,6 +209,7 @@ void CPhysicsSoftBody::RayTest(Ray_t &ray, trace_t *pTrace) const {
 }
 
 void CPhysicsSoftBody::BoxTest(Ray_t &ray, trace_t *pTrace) const {
+	m_pEnv->WaitForSimulation();
 	if (!pTrace) return;
 
 	btVector3 start, end;
@@ -204,6 +220,7 @@ void CPhysicsSoftBody::BoxTest(Ray_t &ray, trace_t *pTrace) const {
 }
 
 void CPhysicsSoftBody::Transform(const matrix3x4_t &mat) {
+	m_pEnv->WaitForSimulation();
 	btTransform trans;
 	ConvertMatrixToBull(mat, trans);
 
@@ -211,6 +228,7 @@ void CPhysicsSoftBody::Transform(const matrix3x4_t &mat) {
 }
 
 void CPhysicsSoftBody::Transform(const Vector *vec, const QAngle *ang) {
+	m_pEnv->WaitForSimulation();
 	if (!vec && !ang) return;
 
 	if (vec) {
@@ -229,6 +247,7 @@ void CPhysicsSoftBody::Transform(const Vector *vec, const QAngle *ang) {
 }
 
 void CPhysicsSoftBody::Scale(const Vector &scale) {
+	m_pEnv->WaitForSimulation();
 	// No conversion
 	btVector3 btScale;
 	btScale.setX(scale.x);
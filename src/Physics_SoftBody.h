@@ -58,9 +58,14 @@ class CPhysicsSoftBody : public IPhysicsSoftBody {
 
 		btSoftBody *	GetSoftBody();
 
+		// Slot in the environment's soft body list (-1 if we're not in it)
+		int				GetEnvironmentIndex() const { return m_iEnvIndex; }
+		void			SetEnvironmentIndex(int index) { m_iEnvIndex = index; }
+
 	private:
 		CPhysicsEnvironment *	m_pEnv;
 		btSoftBody *			m_pSoftBody;
+		int						m_iEnvIndex;
 };
 
 CPhysicsSoftBody *CreateSoftBody(CPhysicsEnvironment *pEnv);
@@ -368,6 +368,7 @@ CPhysicsObject *CPhysicsVehicleController::CreateWheel(int wheelIndex, vehicle_a
 
 // Bullet appears to take force in newtons. Correct this if it's wrong.
 void CPhysicsVehicleController::SetWheelForce(int wheelIndex, float force) {
+	m_pEnv->WaitForSimulation();
 	if (wheelIndex >= m_iWheelCount || wheelIndex < 0) {
 		Assert(0);
 		return;
@@ -379,6 +380,7 @@ void CPhysicsVehicleController::SetWheelForce(int wheelIndex, float force) {
 }
 
 void CPhysicsVehicleController::SetWheelBrake(int wheelIndex, float brakeVal) {
+	m_pEnv->WaitForSimulation();
 	if (wheelIndex >= m_iWheelCount || wheelIndex < 0) {
 		Assert(0);
 		return;
@@ -390,6 +392,7 @@ void CPhysicsVehicleController::SetWheelBrake(int wheelIndex, float brakeVal) {
 }
 
 void CPhysicsVehicleController::SetWheelSteering(int wheelIndex, float steerVal) {
+	m_pEnv->WaitForSimulation();
 	if (wheelIndex >= m_iWheelCount || wheelIndex < 0) {
 		Assert(0);
 		return;
@@ -403,6 +406,7 @@ void CPhysicsVehicleController::SetWheelSteering(int wheelIndex, float steerVal)
 }
 
 void CPhysicsVehicleController::Update(float dt, vehicle_controlparams_t &controls) {
+	m_pEnv->WaitForSimulation();
 	if (controls.handbrake) {
 		controls.throttle = 0.0f;
 	}
@@ -498,6 +502,7 @@ void CPhysicsVehicleController::UpdateWheels(vehicle_controlparams_t &controls,
 #endif
 
 float CPhysicsVehicleController::UpdateBooster(float dt) {
+	m_pEnv->WaitForSimulation();
 	NOT_IMPLEMENTED
 	return 0.0f; // Return boost delay.
 }
@@ -614,6 +619,26 @@ CPhysicsObject *CPhysicsVehicleController::GetBody() {
 	return m_pBody;
 }
 
+// UNEXPOSED
+void CPhysicsVehicleController::GetSaveData(vehiclesave_t &data) const {
+	memset(&data, 0, sizeof(data));
+
+	data.pBody			= (IPhysicsObject *)m_pBody;
+	data.params			= m_vehicleParams;
+	data.state			= m_vehicleState;
+	data.vehicleType	= m_iVehicleType;
+	data.engineDisabled	= m_bEngineDisabled;
+	data.occupied		= m_bOccupied;
+}
+
+// UNEXPOSED
+// We should've been created with the same params and vehicle type
+void CPhysicsVehicleController::ApplySaveData(const vehiclesave_t &data) {
+	m_vehicleState		= data.state;
+	m_bEngineDisabled	= data.engineDisabled;
+	m_bOccupied			= data.occupied;
+}
+
 int CPhysicsVehicleController::GetWheelCount() {
 	return m_iWheelCount;
 }
@@ -625,6 +650,7 @@ IPhysicsObject *CPhysicsVehicleController::GetWheel(int index) {
 }
 
 bool CPhysicsVehicleController::GetWheelContactPoint(int index, Vector *pContactPoint, int *pSurfaceProps) {
+	m_pEnv->WaitForSimulation();
 	if ((index >= m_iWheelCount || index < 0) || (!pContactPoint && !pSurfaceProps)) return false;
 
 #ifndef USE_WHEELED_VEHICLE
@@ -648,6 +674,7 @@ bool CPhysicsVehicleController::GetWheelContactPoint(int index, Vector *pContact
 }
 
 void CPhysicsVehicleController::SetSpringLength(int wheelIndex, float length) {
+	m_pEnv->WaitForSimulation();
 	Assert(wheelIndex >= m_iWheelCount || wheelIndex < 0);
 	if (wheelIndex >= m_iWheelCount || wheelIndex < 0) {
 		return;
@@ -662,6 +689,7 @@ void CPhysicsVehicleController::SetSpringLength(int wheelIndex, float length) {
 }
 
 void CPhysicsVehicleController::SetWheelFriction(int wheelIndex, float friction) {
+	m_pEnv->WaitForSimulation();
 	Assert(wheelIndex >= m_iWheelCount || wheelIndex < 0);
 	if (wheelIndex >= m_iWheelCount || wheelIndex < 0) {
 		return;
@@ -673,6 +701,7 @@ void CPhysicsVehicleController::SetWheelFriction(int wheelIndex, float friction)
 }
 
 void CPhysicsVehicleController::SetPosition(const Vector *pos, const QAngle *ang) {
+	m_pEnv->WaitForSimulation();
 	if (!pos && !ang) return;
 
 	const btTransform oldTrans = m_pBody->GetObject()->getWorldTransform();
@@ -729,6 +758,7 @@ void CPhysicsVehicleController::GetCarSystemDebugData(vehicle_debugcarsystem_t &
 
 // Purpose: Reload vehicle params
 void CPhysicsVehicleController::VehicleDataReload() {
+	m_pEnv->WaitForSimulation();
 	// Destroy the wheels first
 	DestroyCarWheels();
 
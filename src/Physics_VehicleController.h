@@ -27,6 +27,16 @@ class IPhysicsVehicleWheelTrace {
 		virtual IPhysicsObject *					CastRay(int wheelIndex, const Vector &start, const Vector &end, trace_t &result) = 0;
 };
 
+// Vehicle controller state in save games, the wheels are rebuilt from the params
+struct vehiclesave_t {
+	void *						pBody;		// Pointer from when the game was saved
+	vehicleparams_t				params;
+	vehicle_operatingparams_t	state;
+	unsigned int				vehicleType;
+	bool						engineDisabled;
+	bool						occupied;
+};
+
 class CPhysicsVehicleController : public IPhysicsVehicleController32 {
 	public:
 		CPhysicsVehicleController(CPhysicsEnvironment *pEnv, CPhysicsObject *pBody, const vehicleparams_t &params, unsigned int nVehicleType, IPhysicsGameTrace *pGameTrace);
@@ -77,6 +87,9 @@ class CPhysicsVehicleController : public IPhysicsVehicleController32 {
 
 		CPhysicsObject *					GetBody();
 
+		void								GetSaveData(vehiclesave_t &data) const;
+		void								ApplySaveData(const vehiclesave_t &data);
+
 		void								UpdateSteering(vehicle_controlparams_t &controls, float dt);
 		void								UpdateEngine(vehicle_controlparams_t &controls, float dt);
 		void								UpdateWheels(vehicle_controlparams_t &controls, float dt);
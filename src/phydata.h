@@ -175,4 +175,50 @@ struct ivpcompactledgenode_t {
 	}
 };
 
+/****************************
+* Our own format
+****************************/
+
+// Written by CPhysicsCollision::CollideWrite and stored right after a collideheader_t (modelType COLLIDE_TYPE_BULLET).
+// Shapes are stored already converted (bullet units/axes), so loading them is just copying arrays out.
+// Every offset is relative to the start of the bulletcollide_t, and every block is 16 byte aligned.
+#define COLLIDE_TYPE_BULLET		0x2
+#define BULLET_COLLIDE_VERSION	1
+#define BULLET_COLLIDE_ENDIAN			0x01020304
+#define BULLET_COLLIDE_ENDIAN_SWAPPED	0x04030201 // What we read if the writer had the other byte order
+
+// 64 bytes
+struct bulletcollide_t {
+	DECLARE_BYTESWAP_DATADESC()
+
+	int		endianTag;		// BULLET_COLLIDE_ENDIAN
+	int		version;		// BULLET_COLLIDE_VERSION
+	int		numConvexes;
+	int		convexOffset;	// bulletconvex_t[numConvexes]
+	float	massCenter[3];
+	float	margin;
+	float	rotInertia[3];
+	float	scale[3];		// Compound scale. Children are stored unscaled.
+	int		reserved[2];
+};
+
+// 112 bytes
+// A child of the compound. Vertices are float[4] (the layout of btVector3), triangles are unsigned short[3].
+struct bulletconvex_t {
+	DECLARE_BYTESWAP_DATADESC()
+
+	float	basis[9];		// Child transform (rows)
+	float	origin[3];
+	float	scale[3];
+	float	margin;
+	float	params[4];		// Constructor arguments for primitive shapes (box/cylinder half extents, sphere/cone radius and height)
+	int		shapeType;		// BroadphaseNativeTypes
+	int		gameData;
+	int		numVertices;
+	int		vertexOffset;
+	int		numTriangles;
+	int		indexOffset;
+	int		reserved[2];
+};
+
 #endif // PHYDATA_H